@@ -3,6 +3,8 @@
 #include <socks5/common/asio.hpp>
 #include <socks5/auth/client/auth_options.hpp>
 #include <socks5/client/defs.hpp>
+#include <socks5/client/compressed_tunnel.hpp>
+#include <socks5/client/tls_context.hpp>
 #include <socks5/common/api_macro.hpp>
 #include <socks5/common/datagram_buffer.hpp>
 #include <socks5/common/address.hpp>
@@ -332,6 +334,90 @@ FirstBindStep(tcp::socket& socket, tcp::endpoint proxy_server_ep,
  */
 SOCKS5_API TcpEndpointOrErrorAwait SecondBindStep(tcp::socket& socket) noexcept;
 
+/**
+ * @brief Start an asynchronous TCP relay connection to the target server via a
+ * socks5 proxy, asking it for a compressed tunnel. The CONNECT command is sent
+ * to the socks5 proxy. After the connection is established, relay data with
+ * the tunnel, which is compressed if the proxy accepted it.
+ *
+ * @param tunnel the tunnel whose socket the asynchronous connection will be
+ * made on.
+ * @param proxy_server_ep socks5 proxy server address.
+ * @param target_server_addr target server address.
+ * @param auth_options authentication parameters for socks5 proxy server.
+ * @param timeout connection timeout in milliseconds.
+ * @return ErrorAwait asio::awaitable with boost::system::error_code.
+ */
+SOCKS5_API ErrorAwait
+AsyncConnect(CompressedTunnel& tunnel, const tcp::endpoint& proxy_server_ep,
+             const common::Address& target_server_addr,
+             const auth::client::AuthOptions& auth_options,
+             size_t timeout) noexcept;
+
+/**
+ * @brief Start an asynchronous TCP relay connection to the target server via a
+ * socks5 proxy, asking it for a compressed tunnel. The CONNECT command is sent
+ * to the socks5 proxy. After the connection is established, relay data with
+ * the tunnel, which is compressed if the proxy accepted it.
+ *
+ * @param tunnel the tunnel whose socket the asynchronous connection will be
+ * made on.
+ * @param proxy_server_ep socks5 proxy server address.
+ * @param target_server_addr target server address.
+ * @param auth_options authentication parameters for socks5 proxy server.
+ * @return ErrorAwait asio::awaitable with boost::system::error_code.
+ */
+SOCKS5_API ErrorAwait
+AsyncConnect(CompressedTunnel& tunnel, const tcp::endpoint& proxy_server_ep,
+             const common::Address& target_server_addr,
+             const auth::client::AuthOptions& auth_options) noexcept;
+
+#ifdef SOCKS5_WITH_TLS
+/**
+ * @brief Start an asynchronous TCP relay connection to the target server via a
+ * socks5 proxy that accepts socks5 over TLS. The CONNECT command is sent to
+ * the socks5 proxy after the TLS handshake. After the connection is
+ * established, relay data with the socket as usual, it's encrypted by the
+ * kernel(kTLS). Available if the library is built with SOCKS5_WITH_TLS.
+ *
+ * @param socket the socket on which the asynchronous connection will
+ * be made.
+ * @param tls TLS settings and session of the connections to the proxy.
+ * @param proxy_server_ep socks5 proxy server address.
+ * @param target_server_addr target server address.
+ * @param auth_options authentication parameters for socks5 proxy server.
+ * @param timeout connection timeout in milliseconds.
+ * @return ErrorAwait asio::awaitable with boost::system::error_code.
+ */
+SOCKS5_API ErrorAwait
+AsyncConnect(tcp::socket& socket, TlsContext& tls,
+             const tcp::endpoint& proxy_server_ep,
+             const common::Address& target_server_addr,
+             const auth::client::AuthOptions& auth_options,
+             size_t timeout) noexcept;
+
+/**
+ * @brief Start an asynchronous TCP relay connection to the target server via a
+ * socks5 proxy that accepts socks5 over TLS. The CONNECT command is sent to
+ * the socks5 proxy after the TLS handshake. After the connection is
+ * established, relay data with the socket as usual, it's encrypted by the
+ * kernel(kTLS).
+ *
+ * @param socket the socket on which the asynchronous connection will
+ * be made.
+ * @param tls TLS settings and session of the connections to the proxy.
+ * @param proxy_server_ep socks5 proxy server address.
+ * @param target_server_addr target server address.
+ * @param auth_options authentication parameters for socks5 proxy server.
+ * @return ErrorAwait asio::awaitable with boost::system::error_code.
+ */
+SOCKS5_API ErrorAwait
+AsyncConnect(tcp::socket& socket, TlsContext& tls,
+             const tcp::endpoint& proxy_server_ep,
+             const common::Address& target_server_addr,
+             const auth::client::AuthOptions& auth_options) noexcept;
+#endif
+
 #endif
 
 }  // namespace socks5::client
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <socks5/common/asio.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <socks5/common/api_macro.hpp>
+#include <cstdint>
+#include <memory>
+
+namespace socks5::client {
+
+/**
+ * @brief Data stream with a target server over a CONNECT relay of a socks5
+ * proxy. If the proxy is built with this library and accepts a compressed
+ * tunnel, the data between the client and the proxy is compressed with LZ4,
+ * the blocks that don't compress are sent as is. Otherwise the data is sent as
+ * is, so the tunnel works with any socks5 proxy. Established with
+ * AsyncConnect(). Worth it on bandwidth-bound links with compressible
+ * traffic.
+ */
+class SOCKS5_API CompressedTunnel final : utils::NonCopyable {
+ public:
+  /**
+   * @param socket the socket connected to the proxy, must outlive the tunnel.
+   */
+  explicit CompressedTunnel(tcp::socket& socket);
+  ~CompressedTunnel();
+
+  tcp::socket& Socket() noexcept;
+
+  /**
+   * @brief Whether the proxy accepted the compressed tunnel.
+   */
+  bool Compressed() const noexcept;
+
+  /**
+   * @brief Start a new stream over the socket. Called by AsyncConnect().
+   *
+   * @param compressed whether the proxy accepted the compressed tunnel.
+   */
+  void Reset(bool compressed) noexcept;
+
+  /**
+   * @brief Bytes passed to Send() and bytes sent for them to the proxy.
+   */
+  uint64_t SentBytes() const noexcept;
+  uint64_t SentWireBytes() const noexcept;
+
+#ifdef __cpp_impl_coroutine
+  /**
+   * @brief Asynchronously send all the data to the target server.
+   *
+   * @param data to send.
+   * @param size of data sent.
+   * @return BytesCountOrErrorAwait asio::awaitable with the count of bytes
+   * sent, or boost::system::error_code if an error occurred.
+   */
+  BytesCountOrErrorAwait Send(const char* data, size_t size) noexcept;
+
+  /**
+   * @brief Asynchronously receive some data from the target server.
+   *
+   * @param data buffer for the received data.
+   * @param size of the buffer.
+   * @return BytesCountOrErrorAwait asio::awaitable with the count of bytes
+   * received, or boost::system::error_code if an error occurred.
+   */
+  BytesCountOrErrorAwait ReadSome(char* data, size_t size) noexcept;
+#endif
+
+ private:
+  class Impl;
+
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace socks5::client
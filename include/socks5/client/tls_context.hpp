@@ -0,0 +1,78 @@
+#pragma once
+
+#ifdef SOCKS5_WITH_TLS
+
+#include <socks5/common/asio.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <socks5/common/api_macro.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace socks5::client {
+
+/**
+ * @brief TLS settings and session of the connections to a socks5 proxy that
+ * accepts socks5 over TLS, see socks5::server::ServerBuilder::EnableTls().
+ * Handshakes resume the session of the last one with its session ticket, so
+ * they skip the full handshake. After the handshake the connection is
+ * encrypted by the kernel(kTLS) and the socket is used as a plain one.
+ * Supported on Linux only. Available if the library is built with
+ * SOCKS5_WITH_TLS. Passed to AsyncConnect(), may be shared by the connections
+ * to one proxy from several threads.
+ */
+class SOCKS5_API TlsContext final : utils::NonCopyable {
+ public:
+  /**
+   * @brief Tag of the constructor that disables the verification of the
+   * certificate of the proxy.
+   */
+  struct NoVerification final {};
+
+  /**
+   * @param ca_file path of the PEM certificates the certificate of the proxy
+   * is verified with. Empty means the default CA certificates of the system.
+   * @param server_name name of the proxy sent in SNI and verified against its
+   * certificate. If it's empty, any certificate issued by a trusted CA is
+   * accepted.
+   * @throws std::runtime_error if the certificates can't be loaded.
+   */
+  explicit TlsContext(const std::string& ca_file = {},
+                      std::string server_name = {});
+
+  /**
+   * @brief Accept any certificate of the proxy. The connection is encrypted,
+   * but an active attacker may impersonate the proxy.
+   *
+   * @param server_name name of the proxy sent in SNI.
+   */
+  TlsContext(NoVerification, std::string server_name = {});
+  ~TlsContext();
+
+  /**
+   * @brief Number of handshakes that resumed a session.
+   */
+  uint64_t ResumedHandshakes() const noexcept;
+
+#ifdef __cpp_impl_coroutine
+  /**
+   * @brief Asynchronously run the TLS handshake on the socket connected to the
+   * proxy and enable kTLS on it. Called by AsyncConnect().
+   *
+   * @param socket the socket connected to the proxy.
+   * @return ErrorAwait asio::awaitable with boost::system::error_code. If kTLS
+   * can't be enabled, socks5::error::Error::kKernelTlsNotAvailable is returned
+   * and the socket must not be used.
+   */
+  ErrorAwait Handshake(tcp::socket& socket) noexcept;
+#endif
+
+ private:
+  class Impl;
+
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace socks5::client
+
+#endif
@@ -42,13 +42,68 @@ class SOCKS5_API Metrics final : utils::NonCopyable {
   size_t GetSentBytesTotal() const noexcept;
 
   /**
-   * @brief Clear all metrics. Thread-safe.
+   * @brief Add the number of target servers opened by the udp relay.
+   * Thread-safe.
+   *
+   * @param num number of opened target servers.
+   */
+  void AddUdpTargetServers(size_t num) noexcept;
+
+  /**
+   * @brief Subtract the number of target servers closed by the udp relay.
+   * Thread-safe.
+   *
+   * @param num number of closed target servers.
+   */
+  void RemoveUdpTargetServers(size_t num) noexcept;
+
+  /**
+   * @brief Add the number of target servers evicted by the udp relay, see
+   * ServerBuilder::SetUdpMaxTargetServers(). Thread-safe.
+   *
+   * @param num number of evicted target servers.
+   */
+  void AddEvictedUdpTargetServers(size_t num) noexcept;
+
+  /**
+   * @brief Add the number of client datagrams dropped by the udp relay while
+   * the domain names of their target servers were being resolved.
+   * Thread-safe.
+   *
+   * @param num number of dropped datagrams.
+   */
+  void AddDroppedUdpDatagrams(size_t num) noexcept;
+
+  /**
+   * @brief Get the number of target servers currently open by the udp relay.
+   * Every target server holds a socket. Thread-safe.
+   */
+  size_t GetUdpTargetServers() const noexcept;
+
+  /**
+   * @brief Get the total number of target servers evicted by the udp relay
+   * since startup. Thread-safe.
+   */
+  size_t GetEvictedUdpTargetServersTotal() const noexcept;
+
+  /**
+   * @brief Get the total number of client datagrams dropped by the udp relay
+   * since startup, see AddDroppedUdpDatagrams(). Thread-safe.
+   */
+  size_t GetDroppedUdpDatagramsTotal() const noexcept;
+
+  /**
+   * @brief Clear all metrics. The number of currently open target servers is
+   * kept. Thread-safe.
    */
   void Clear() noexcept;
 
  private:
   std::atomic_size_t recv_bytes_total{};
   std::atomic_size_t sent_bytes_total{};
+  std::atomic_size_t udp_target_servers{};
+  std::atomic_size_t evicted_udp_target_servers_total{};
+  std::atomic_size_t dropped_udp_datagrams_total{};
 };
 
 using MetricsPtr = std::shared_ptr<Metrics>;
@@ -22,6 +22,9 @@ enum class SOCKS5_API Error {
   kDomainResolutionFailure,
   kCancellationFailure,
   kInvalidAddress,
+  kInvalidTunnelFrame,
+  kTlsHandshakeFailure,
+  kKernelTlsNotAvailable,
 };
 
 SOCKS5_API boost::system::error_code make_error_code(Error err) noexcept;
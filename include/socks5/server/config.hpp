@@ -10,6 +10,7 @@
 namespace socks5::server {
 
 using ListenerAddr = std::pair<std::string, unsigned short>;
+using ResolverAddr = std::pair<std::string, unsigned short>;
 
 /**
  * @brief Socks5 proxy server config. The specified default values are used by
@@ -27,9 +28,56 @@ struct SOCKS5_API Config final {
   bool bind_validate_accepted_conn{false};
   // Timeout in seconds on socket io during udp relay(UDP ASSOCIATE command).
   size_t udp_relay_timeout{15};
+  // Max number of datagrams received or sent with one system call by the udp
+  // relay. 1 disables batching.
+  size_t udp_batch_size{1};
+  // Max size of a datagram relayed with batching. Bigger datagrams are
+  // dropped.
+  size_t udp_batch_datagram_size{2048};
+  // Max number of target servers of a UDP association. When the limit is
+  // reached, the least recently active target server is evicted. 0 means no
+  // limit.
+  size_t udp_max_target_servers{0};
+  // Timeout in seconds after which an idle target server of a UDP association
+  // is evicted. 0 disables idle eviction.
+  size_t udp_target_server_idle_timeout{0};
+  // Send runs of same-sized datagrams as one UDP GSO packet(UDP_SEGMENT).
+  // Used only with batching.
+  bool udp_gso{false};
+  // Enable UDP_GRO on the sockets connected to target servers. Coalesced
+  // packets are split back into datagrams. Used only with batching.
+  bool udp_gro{false};
+  // Connect the sockets of the udp relay to their target servers. The kernel
+  // caches the route and drops datagrams of other senders.
+  bool udp_connect_targets{false};
+  // Serve all the UDP associations through one udp port instead of a socket
+  // per association and per target server. Used only with the default udp
+  // relay handler.
+  bool udp_shared_relay{false};
+  // Port of the shared udp relay. 0 means any free port.
+  unsigned short udp_shared_relay_port{0};
+  // Answer repeated DNS queries relayed to udp_dns_cache_resolvers from a
+  // cache of their answers. Used only with the default udp relay handler and
+  // without the shared udp relay.
+  bool udp_dns_cache{false};
+  // Max number of answers in the DNS cache.
+  size_t udp_dns_cache_size{4096};
+  // IP addresses and ports of the resolvers whose answers are cached.
+  std::vector<ResolverAddr> udp_dns_cache_resolvers;
   // IPv4/IPv6 address and port pair for proxy server listener. IP "0.0.0.0" is
   // not supported.
   ListenerAddr listener_addr{"127.0.0.1", 1080};
+  // Accept socks5 over TLS on the listener. After the TLS handshake the
+  // connection is encrypted by the kernel(kTLS), connections on which kTLS
+  // can't be enabled are closed. Supported on Linux only. The tls fields are
+  // used only if the library is built with SOCKS5_WITH_TLS.
+  bool tls{false};
+  // Path of the PEM certificate chain of the server.
+  std::string tls_cert_chain_file;
+  // Path of the PEM private key of the server.
+  std::string tls_private_key_file;
+  // Lifetime in seconds of the TLS sessions resumed with session tickets.
+  size_t tls_session_timeout{7200};
   // Enable Username/Password authentication.
   bool enable_user_auth{false};
   // Authentication username.
@@ -38,6 +86,33 @@ struct SOCKS5_API Config final {
   std::string auth_password;
   // Enable TCP_NODELAY socket option(Nagle's algorithm).
   bool tcp_nodelay{false};
+  // Accept compressed tunnels asked for by the clients of this library on
+  // CONNECT. Used only with the default tcp relay handler without data
+  // processors.
+  bool tcp_compressed_tunnel{false};
+  // Number of threads on which the synchronous tcp data processors run
+  // instead of the server threads. 0 runs them on the server threads.
+  size_t tcp_offload_threads{0};
+  // Max number of relayed bytes queued to or processed by the offload
+  // threads. Relays wait for room before passing more data to them.
+  size_t tcp_offload_max_inflight_bytes{8388608};
+  // CPUs to which the offload threads are pinned round-robin. Empty disables
+  // pinning. Supported on Linux only.
+  std::vector<int> tcp_offload_cpus;
+  // Interval in milliseconds at which every server thread measures the
+  // scheduling delay of the io_context. 0 disables the measurement.
+  size_t loop_lag_probe_interval{100};
+  // Count the handlers executed by every server thread and the time spent in
+  // them. The threads then run the io_context handler by handler.
+  bool loop_handler_stats{false};
+  // Number of the last events kept by the flight recorder per server thread.
+  // Rounded up to a power of two. 0 disables the flight recorder.
+  size_t flight_recorder_capacity{4096};
+  // Signal that dumps the flight recorder to flight_recorder_dump_path. 0
+  // disables the dump on signal.
+  int flight_recorder_dump_signal{0};
+  // Path of the file to which the flight recorder is dumped on signal.
+  std::string flight_recorder_dump_path{"socks5_flight_recorder.bin"};
 };
 
 using ConfigPtr = std::shared_ptr<Config>;
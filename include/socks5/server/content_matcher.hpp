@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <socks5/server/relay_data_processor_defs.hpp>
+#include <socks5/common/api_macro.hpp>
+
+namespace socks5::server {
+
+/**
+ * @brief What happens to the relayed data when a pattern matches.
+ */
+enum class ContentAction : uint8_t {
+  // The data is blocked: the tcp connection is closed, the datagram is
+  // dropped.
+  kBlock,
+  // The match is only reported to the match callback.
+  kTag,
+  // The match callback decides whether the data is blocked.
+  kCallback,
+};
+
+/**
+ * @brief A byte pattern searched for in the relayed data.
+ */
+struct SOCKS5_API ContentPattern final {
+  // Bytes of the pattern, mustn't be empty.
+  std::string bytes;
+  ContentAction action{ContentAction::kBlock};
+  // Reported in ContentMatch, needn't be unique.
+  uint32_t id{};
+};
+
+/**
+ * @brief A match of a pattern in the relayed data.
+ */
+struct SOCKS5_API ContentMatch final {
+  uint32_t pattern_id{};
+  ContentAction action{ContentAction::kBlock};
+  // Offset of the byte after the match from the start of the tcp stream of
+  // the direction or of the datagram.
+  uint64_t end{};
+  // True if the data is relayed from the client.
+  bool from_client{};
+};
+
+/**
+ * @brief A callback called for every match.
+ *
+ * @param match the match.
+ * @return true if the data must be blocked. The data is blocked on a kBlock
+ * match whatever the result, and isn't on a kTag match.
+ */
+using ContentMatchCb = std::function<bool(const ContentMatch& match)>;
+
+/**
+ * @brief Thrown by the tcp content processors to close the connection when
+ * the data is blocked.
+ */
+class SOCKS5_API ContentBlockedError final : public std::runtime_error {
+ public:
+  explicit ContentBlockedError(uint32_t pattern_id)
+      : std::runtime_error{"Relayed data is blocked by pattern " +
+                           std::to_string(pattern_id)},
+        pattern_id_{pattern_id} {}
+
+  uint32_t PatternId() const noexcept { return pattern_id_; }
+
+ private:
+  uint32_t pattern_id_;
+};
+
+/**
+ * @brief Multi-pattern matcher of the relayed data, built once for a set of
+ * patterns, possibly tens of thousands of them, and shared by all the
+ * relays. The patterns are compiled into an Aho-Corasick automaton, so the
+ * data is scanned once whatever the number of patterns, and the matches
+ * spanning the chunks of a tcp stream are found. While no pattern is
+ * partially matched, the data is skipped to the next byte that starts a
+ * pattern with SIMD instructions if the CPU supports them. Copies share the
+ * compiled patterns.
+ */
+class SOCKS5_API ContentMatcher final {
+ public:
+  /**
+   * @brief Streaming state of a direction of a relay.
+   */
+  struct Stream final {
+    uint32_t state{};
+    uint64_t offset{};
+    bool from_client{};
+  };
+
+  /**
+   * @brief Compile the patterns.
+   *
+   * @param patterns patterns to search for.
+   * @param case_insensitive whether ASCII letters match regardless of case.
+   * @throws std::invalid_argument if a pattern is empty.
+   */
+  explicit ContentMatcher(const std::vector<ContentPattern>& patterns,
+                          bool case_insensitive = false);
+  ~ContentMatcher();
+  ContentMatcher(const ContentMatcher&);
+  ContentMatcher(ContentMatcher&&) noexcept;
+  ContentMatcher& operator=(const ContentMatcher&);
+  ContentMatcher& operator=(ContentMatcher&&) noexcept;
+
+  /**
+   * @brief Scan the next data of the stream. Scanning stops at the first
+   * match that blocks the data.
+   *
+   * @param stream streaming state, updated by the call.
+   * @param data pointer to relayed data.
+   * @param size data size.
+   * @param on_match callback called for every match, may be empty.
+   * @return the match that blocks the data or nullopt.
+   */
+  std::optional<ContentMatch> Scan(Stream& stream, const char* data,
+                                   size_t size,
+                                   const ContentMatchCb& on_match) const;
+
+  size_t PatternsNum() const noexcept;
+
+ private:
+  class Impl;
+
+  std::shared_ptr<const Impl> impl_;
+};
+
+/**
+ * @brief A stage of a RelayPipeline matching a direction of a tcp relay. It
+ * throws ContentBlockedError if the data is blocked, which closes the
+ * connection; the blocked chunk isn't sent.
+ */
+class SOCKS5_API ContentMatchStage final {
+ public:
+  ContentMatchStage(ContentMatcher matcher, bool from_client,
+                    ContentMatchCb on_match = {});
+
+  void operator()(RelayBuffer& buf);
+
+ private:
+  ContentMatcher matcher_;
+  ContentMatcher::Stream stream_;
+  ContentMatchCb on_match_;
+};
+
+/**
+ * @brief Make TCP data processors matching the data relayed in both
+ * directions. The directions are matched as streams, the data is relayed in
+ * place. Pass the result to ServerBuilder::Build().
+ *
+ * @param matcher compiled patterns.
+ * @param on_match callback called for every match, may be empty.
+ * @return TcpRelayDataProcessor
+ */
+SOCKS5_API TcpRelayDataProcessor
+MakeTcpRelayContentProcessor(ContentMatcher matcher,
+                             ContentMatchCb on_match = {});
+
+/**
+ * @brief Make UDP data processors matching the datagrams relayed in both
+ * directions. Every datagram is matched on its own, a blocked datagram is
+ * dropped. Pass the result to ServerBuilder::Build().
+ *
+ * @param matcher compiled patterns.
+ * @param on_match callback called for every match, may be empty.
+ * @return UdpRelayDataProcessor
+ */
+SOCKS5_API UdpRelayDataProcessor
+MakeUdpRelayContentProcessor(ContentMatcher matcher,
+                             ContentMatchCb on_match = {});
+
+}  // namespace socks5::server
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <socks5/common/api_macro.hpp>
+
+namespace socks5::server {
+
+/**
+ * @brief Type of an event of the flight recorder. The meaning of the arguments
+ * of FlightEvent depends on the type.
+ */
+enum class FlightEventType : uint32_t {
+  kNone,
+  // The socks5 handshake started.
+  kHandshakeStart,
+  // The socks5 handshake finished. arg0: 1 on success, 0 on failure.
+  kHandshakeEnd,
+  // Authentication finished. arg0: auth method, arg1: 1 on success.
+  kAuthResult,
+  // Connecting to the target server started.
+  kConnectStart,
+  // Connecting to the target server finished. arg0: error code, 0 on success.
+  kConnectEnd,
+  // Data was read by the tcp relay. arg0: direction, arg1: bytes.
+  kTcpRelayRead,
+  // Data was written by the tcp relay. arg0: direction, arg1: bytes.
+  kTcpRelayWrite,
+  // A datagram was received by the udp relay. arg0: direction, arg1: bytes.
+  kUdpDatagramIn,
+  // A datagram was sent by the udp relay. arg0: direction, arg1: bytes.
+  kUdpDatagramOut,
+  // No data was relayed within the relay timeout. arg1: timeout in seconds.
+  kWatchdogExpired,
+  // The session was killed through Server::KillSessions().
+  kSessionKilled,
+  // The session was closed. arg0: CloseReason, arg1: relayed bytes in both
+  // directions.
+  kSessionClose,
+  // A target server of the udp relay was evicted. arg0: 1 if it was idle, 0 if
+  // the limit of target servers was reached, arg1: target servers left.
+  kUdpTargetEvicted,
+  // The tcp relay data processor detached. arg0: direction, arg1: bytes read
+  // in the direction before that.
+  kTcpRelayDetached,
+};
+
+/**
+ * @brief A compact event of the flight recorder. Direction is 0 for client to
+ * target and 1 for target to client.
+ */
+struct SOCKS5_API FlightEvent final {
+  // Time of the event in nanoseconds of the steady clock.
+  int64_t timestamp_ns{};
+  // Id of the session that produced the event.
+  uint64_t session_id{};
+  FlightEventType type{FlightEventType::kNone};
+  uint32_t arg0{};
+  uint64_t arg1{};
+};
+
+static_assert(sizeof(FlightEvent) == 32);
+
+/**
+ * @brief Binary dump of the flight recorder. The dump starts with
+ * FlightDumpHeader followed by header.threads_num blocks. Every block is a
+ * FlightDumpThread followed by its events_num FlightEvent records in the order
+ * they were recorded. All the fields are in the host byte order.
+ */
+inline constexpr char kFlightDumpMagic[8]{'S', '5', 'F', 'L', 'I', 'G', 'H',
+                                          'T'};
+inline constexpr uint32_t kFlightDumpVersion{1};
+
+struct SOCKS5_API FlightDumpHeader final {
+  char magic[8]{};
+  uint32_t version{};
+  uint32_t threads_num{};
+  // Steady and system clocks at the moment of the dump, in nanoseconds. Used
+  // to convert event timestamps to the wall clock time.
+  int64_t steady_now_ns{};
+  int64_t system_now_ns{};
+};
+
+struct SOCKS5_API FlightDumpThread final {
+  // Index of the thread in the order threads recorded their first event.
+  uint32_t thread_index{};
+  uint32_t events_num{};
+};
+
+}  // namespace socks5::server
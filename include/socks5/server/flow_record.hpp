@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <socks5/common/asio.hpp>
+#include <socks5/common/api_macro.hpp>
+
+namespace socks5::server {
+
+/**
+ * @brief Socks5 command served by a session.
+ */
+enum class SessionCommand : uint8_t {
+  kUnknown,
+  kConnect,
+  kBind,
+  kUdpAssociate,
+};
+
+/**
+ * @brief The reason why a relay session was closed.
+ */
+enum class CloseReason : uint8_t {
+  // The client closed the connection or the client leg failed.
+  kClientClosed,
+  // The target server closed the connection or the target leg failed.
+  kTargetClosed,
+  // No data was relayed within the relay timeout.
+  kTimeout,
+  // The relay failed on the proxy side.
+  kError,
+  // The session was killed through Server::KillSessions().
+  kKilled,
+};
+
+/**
+ * @brief TCP_INFO statistics of a tcp socket sampled when the session was
+ * closed. Available on Linux only.
+ */
+struct SOCKS5_API TcpInfo final {
+  // Smoothed round trip time in microseconds.
+  uint32_t rtt_us{};
+  // Round trip time variance in microseconds.
+  uint32_t rtt_var_us{};
+  // Total number of retransmitted segments.
+  uint32_t total_retrans{};
+  // Number of segments considered lost at the moment of sampling.
+  uint32_t lost{};
+  // Sender congestion window in segments.
+  uint32_t snd_cwnd{};
+};
+
+using TcpInfoOpt = std::optional<TcpInfo>;
+
+/**
+ * @brief Summary of a relay session(CONNECT, BIND or UDP ASSOCIATE) produced
+ * by the socks5 proxy server when the session is closed.
+ */
+struct SOCKS5_API FlowRecord final {
+  // Unique id of the session within the server.
+  uint64_t session_id{};
+  // Command served by the session.
+  SessionCommand command{SessionCommand::kUnknown};
+  // Client endpoint of the socks5 tcp connection.
+  tcp::endpoint client;
+  // Target address from the socks5 request. For UDP ASSOCIATE it is the
+  // address from which the client is going to send datagrams.
+  std::string target;
+  // Authenticated username. Empty if authentication is disabled.
+  std::string user;
+  // Number of bytes read from the client and relayed to the target(s).
+  uint64_t bytes_from_client{};
+  // Number of bytes read from the target(s) and relayed to the client.
+  uint64_t bytes_from_target{};
+  // Time at which the client connection was accepted.
+  std::chrono::system_clock::time_point start;
+  // Time from accepting the client connection to closing the session.
+  std::chrono::microseconds duration{};
+  // The reason why the session was closed.
+  CloseReason close_reason{CloseReason::kError};
+  // TCP_INFO of the client leg.
+  TcpInfoOpt client_tcp_info;
+  // TCP_INFO of the target leg. Empty for UDP ASSOCIATE.
+  TcpInfoOpt target_tcp_info;
+};
+
+/**
+ * @brief A callback that receives flow records of closed sessions. Records are
+ * delivered from a dedicated collector thread, so relay threads never wait for
+ * the callback. Records are produced only by the default tcp/udp relay
+ * handlers and the handlers with data processors; custom handlers receive raw
+ * sockets and are not tracked.
+ *
+ * @param record flow record of the closed session.
+ */
+using FlowRecordCb = std::function<void(const FlowRecord& record)>;
+
+}  // namespace socks5::server
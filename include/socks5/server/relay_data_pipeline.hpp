@@ -0,0 +1,287 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <socks5/server/relay_data_processor_defs.hpp>
+#include <socks5/common/asio.hpp>
+
+namespace socks5::server {
+
+/**
+ * @brief A type of a stage of a RelayPipeline: a movable callable that
+ * processes the relayed data in place. A stage filters the data out by
+ * trimming the buffer to empty, the following stages aren't called then.
+ */
+template <typename T>
+concept RelayPipelineStage =
+    std::move_constructible<T> &&
+    requires(T& stage, RelayBuffer& buf) { stage(buf); };
+
+/**
+ * @brief A stage that maps every relayed byte, see MapBytes(). Adjacent byte
+ * map stages of a RelayPipeline are fused into one, so the data is walked
+ * once whatever their number.
+ */
+template <typename Fn>
+class ByteMap final {
+ public:
+  explicit ByteMap(Fn fn) : fn_{std::move(fn)} {}
+
+  void operator()(RelayBuffer& buf) {
+    auto* data = buf.Data();
+    for (size_t i = 0; i < buf.Size(); ++i) {
+      data[i] = fn_(data[i]);
+    }
+  }
+
+  /**
+   * @brief A byte map applying this map and then the next one.
+   */
+  template <typename NextFn>
+  auto Fuse(ByteMap<NextFn> next) && {
+    auto fused = [fn = std::move(fn_), next_fn = std::move(next.fn_)](
+                     char byte) mutable { return next_fn(fn(byte)); };
+    return ByteMap<decltype(fused)>{std::move(fused)};
+  }
+
+ private:
+  template <typename>
+  friend class ByteMap;
+
+  Fn fn_;
+};
+
+/**
+ * @brief Make a stage that replaces every relayed byte with fn(byte).
+ *
+ * @param fn callable taking and returning char.
+ * @return ByteMap
+ */
+template <typename Fn>
+  requires std::is_invocable_r_v<char, Fn&, char>
+ByteMap<Fn> MapBytes(Fn fn) {
+  return ByteMap<Fn>{std::move(fn)};
+}
+
+/**
+ * @brief Make a stage that observes the relayed data without changing it,
+ * e.g. to account it.
+ *
+ * @param fn callable taking (const char* data, size_t size).
+ */
+template <typename Fn>
+  requires std::is_invocable_v<Fn&, const char*, size_t>
+auto Inspect(Fn fn) {
+  return [fn = std::move(fn)](RelayBuffer& buf) mutable {
+    fn(static_cast<const RelayBuffer&>(buf).Data(), buf.Size());
+  };
+}
+
+template <typename... Stages>
+class RelayPipeline;
+
+namespace detail {
+
+template <typename T>
+struct IsByteMap : std::false_type {};
+
+template <typename Fn>
+struct IsByteMap<ByteMap<Fn>> : std::true_type {};
+
+template <typename... Stages>
+constexpr bool LastIsByteMap() {
+  if constexpr (sizeof...(Stages) == 0) {
+    return false;
+  } else {
+    return IsByteMap<std::tuple_element_t<sizeof...(Stages) - 1,
+                                          std::tuple<Stages...>>>::value;
+  }
+}
+
+// Storage of the copies of the datagrams processed by a pipeline. The room
+// around the data is the same as in the tcp relay buffer by default.
+class PipelineScratch final {
+ public:
+  static constexpr size_t kRoom{256};
+
+  RelayBuffer Load(const char* data, size_t size) {
+    if (storage_.size() < size + 2 * kRoom) {
+      storage_.resize(size + 2 * kRoom);
+    }
+    std::memcpy(storage_.data() + kRoom, data, size);
+    return RelayBuffer{storage_.data(), storage_.data() + storage_.size(),
+                       storage_.data() + kRoom, size};
+  }
+
+ private:
+  std::vector<char> storage_;
+};
+
+}  // namespace detail
+
+/**
+ * @brief Stages that process the relayed data of a direction one after
+ * another in one buffer. The stage types are known statically, so a chunk
+ * of data costs one call of the pipeline whatever the number of stages, and
+ * adjacent MapBytes() stages are fused into one pass over the data. The
+ * stages of a tcp relay work on the relay buffer itself, see
+ * MakeTcpRelayPipelineProcessor(). Build a pipeline with Then():
+ *
+ * RelayPipeline<>{}.Then(MapBytes(to_upper)).Then(Inspect(count))
+ */
+template <typename... Stages>
+class RelayPipeline final {
+ public:
+  static constexpr size_t kStagesNum{sizeof...(Stages)};
+
+  RelayPipeline() = default;
+  explicit RelayPipeline(std::tuple<Stages...> stages)
+      : stages_{std::move(stages)} {}
+
+  /**
+   * @brief A pipeline with the stage appended. The pipeline is consumed.
+   *
+   * @param stage callable processing RelayBuffer& in place.
+   * @return RelayPipeline
+   */
+  template <RelayPipelineStage Stage>
+  auto Then(Stage stage) && {
+    if constexpr (detail::LastIsByteMap<Stages...>() &&
+                  detail::IsByteMap<Stage>::value) {
+      return FuseLast(std::move(stage),
+                      std::make_index_sequence<kStagesNum - 1>{});
+    } else {
+      return RelayPipeline<Stages..., Stage>{std::tuple_cat(
+          std::move(stages_), std::tuple<Stage>{std::move(stage)})};
+    }
+  }
+
+  /**
+   * @brief Process the relayed data.
+   *
+   * @param buf mutable view of the relayed data.
+   */
+  void operator()(RelayBuffer& buf) { Run<0>(buf); }
+
+ private:
+  template <size_t I>
+  void Run(RelayBuffer& buf) {
+    if constexpr (I < kStagesNum) {
+      if (buf.Size() == 0) {
+        return;
+      }
+      std::get<I>(stages_)(buf);
+      Run<I + 1>(buf);
+    }
+  }
+
+  template <typename Stage, size_t... Is>
+  auto FuseLast(Stage stage, std::index_sequence<Is...>) {
+    auto fused = std::move(std::get<kStagesNum - 1>(stages_))
+                     .Fuse(std::move(stage));
+    return RelayPipeline<std::tuple_element_t<Is, std::tuple<Stages...>>...,
+                         decltype(fused)>{
+        std::tuple<std::tuple_element_t<Is, std::tuple<Stages...>>...,
+                   decltype(fused)>{std::move(std::get<Is>(stages_))...,
+                                    std::move(fused)}};
+  }
+
+  std::tuple<Stages...> stages_;
+};
+
+/**
+ * @brief Make TCP data processors running pipelines in place over the relay
+ * buffer. Every creator is called with the "from" and "to" endpoints of the
+ * relay, like TcpRelayDataProcessorCreatorCb, and returns a pipeline or
+ * another copyable callable processing RelayBuffer&. Pass the result to
+ * ServerBuilder::Build().
+ *
+ * @param client_to_server creator of the pipelines of the data relayed from
+ * the client to the server.
+ * @param server_to_client creator of the pipelines of the data relayed from
+ * the server to the client.
+ * @return TcpRelayDataProcessor
+ */
+template <typename ClientToServer, typename ServerToClient>
+  requires std::copy_constructible<std::invoke_result_t<
+               const ClientToServer&, const tcp::endpoint&,
+               const tcp::endpoint&>> &&
+           std::copy_constructible<std::invoke_result_t<
+               const ServerToClient&, const tcp::endpoint&,
+               const tcp::endpoint&>>
+TcpRelayDataProcessor MakeTcpRelayPipelineProcessor(
+    ClientToServer client_to_server, ServerToClient server_to_client) {
+  TcpRelayDataProcessor processor;
+  processor.client_to_server_in_place =
+      [client_to_server = std::move(client_to_server)](
+          const tcp::endpoint& from, const tcp::endpoint& to) {
+        return TcpRelayInPlaceDataProcessorCb{client_to_server(from, to)};
+      };
+  processor.server_to_client_in_place =
+      [server_to_client = std::move(server_to_client)](
+          const tcp::endpoint& from, const tcp::endpoint& to) {
+        return TcpRelayInPlaceDataProcessorCb{server_to_client(from, to)};
+      };
+  return processor;
+}
+
+/**
+ * @brief Make UDP data processors running pipelines over the relayed
+ * datagrams. A datagram is copied once into a buffer reused by the
+ * processor, with room to prepend and append up to 256 bytes, and the
+ * pipeline output is sent unless it's empty.
+ *
+ * @param client_to_server creator of the pipelines of the datagrams relayed
+ * from the client, called like UdpRelayDataFromClientProcessorCreatorCb.
+ * @param server_to_client creator of the pipelines of the datagrams relayed
+ * from the server, called like UdpRelayDataProcessorCreatorCb.
+ * @return UdpRelayDataProcessor
+ */
+template <typename ClientToServer, typename ServerToClient>
+  requires std::copy_constructible<std::invoke_result_t<
+               const ClientToServer&, const udp::endpoint&>> &&
+           std::copy_constructible<std::invoke_result_t<
+               const ServerToClient&, const udp::endpoint&,
+               const udp::endpoint&>>
+UdpRelayDataProcessor MakeUdpRelayPipelineProcessor(
+    ClientToServer client_to_server, ServerToClient server_to_client) {
+  UdpRelayDataProcessor processor;
+  processor.client_to_server =
+      [client_to_server = std::move(client_to_server)](
+          const udp::endpoint& expected_client_ep)
+      -> UdpRelayDataFromClientProcessorCb {
+    return [pipeline = client_to_server(expected_client_ep),
+            scratch = detail::PipelineScratch{}](
+               const char* data, size_t size, const udp::endpoint&,
+               const RelayDataSender& send) mutable {
+      auto buf = scratch.Load(data, size);
+      pipeline(buf);
+      if (buf.Size() > 0) {
+        send(buf.Data(), buf.Size());
+      }
+    };
+  };
+  processor.server_to_client =
+      [server_to_client = std::move(server_to_client)](
+          const udp::endpoint& client,
+          const udp::endpoint& server) -> UdpRelayDataProcessorCb {
+    return [pipeline = server_to_client(client, server),
+            scratch = detail::PipelineScratch{}](
+               const char* data, size_t size,
+               const RelayDataSender& send) mutable {
+      auto buf = scratch.Load(data, size);
+      pipeline(buf);
+      if (buf.Size() > 0) {
+        send(buf.Data(), buf.Size());
+      }
+    };
+  };
+  return processor;
+}
+
+}  // namespace socks5::server
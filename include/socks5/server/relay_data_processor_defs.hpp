@@ -1,6 +1,13 @@
 #pragma once
 
+#include <concepts>
 #include <functional>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <socks5/server/config.hpp>
 #include <socks5/common/asio.hpp>
 #include <socks5/common/api_macro.hpp>
@@ -40,6 +47,257 @@ using TcpRelayDataProcessorCb = std::function<void(
 using TcpRelayDataProcessorCreatorCb = std::function<TcpRelayDataProcessorCb(
     const tcp::endpoint& from, const tcp::endpoint& to)>;
 
+/**
+ * @brief Collects the data emitted by an inline data processor. Send() isn't
+ * type-erased, so it's inlined into the processor. The relay sends the
+ * collected data after the processor returns.
+ */
+class SOCKS5_API RelayDataSink final {
+ public:
+  /**
+   * @brief Emit data that will be asynchronously sent to the network. The
+   * data must stay valid until the processor is called again.
+   *
+   * @param data pointer to data to send.
+   * @param size data size.
+   */
+  void Send(const char* data, size_t size) { data_.emplace_back(data, size); }
+
+  /**
+   * @brief Stop processing the relayed data of the direction, e.g. once the
+   * processor has seen the beginning of the stream it cares about. The data
+   * emitted by this call of the processor is sent, then the processor is
+   * destroyed and the rest of the data is relayed as is, with the throughput
+   * of a relay without data processors. The udp relay ignores it.
+   */
+  void Detach() noexcept { detached_ = true; }
+  bool Detached() const noexcept { return detached_; }
+
+  const std::vector<RelayData>& Data() const noexcept { return data_; }
+  void Clear() noexcept { data_.clear(); }
+
+ private:
+  std::vector<RelayData> data_;
+  bool detached_{false};
+};
+
+/**
+ * @brief A type of an inline TCP data processor: a movable callable invoked
+ * with the relayed data, its size and a RelayDataSink.
+ */
+template <typename T>
+concept InlineTcpRelayDataProcessor =
+    std::move_constructible<T> &&
+    requires(T& processor, const char* data, size_t size, RelayDataSink& sink) {
+      processor(data, size, sink);
+    };
+
+/**
+ * @brief A TCP data processor of a concrete type. The relay calls it through
+ * a plain function pointer instantiated for the type, so the processor body
+ * and its RelayDataSink::Send() calls are compiled into one function, unlike
+ * TcpRelayDataProcessorCb that goes through two std::function calls.
+ */
+class SOCKS5_API TcpRelayInlineDataProcessorCb final {
+ public:
+  TcpRelayInlineDataProcessorCb() noexcept = default;
+
+  template <InlineTcpRelayDataProcessor Processor>
+  explicit TcpRelayInlineDataProcessorCb(Processor processor)
+      : processor_{new Processor(std::move(processor)),
+                   [](void* processor) {
+                     delete static_cast<Processor*>(processor);
+                   }},
+        process_{[](void* processor, const char* data, size_t size,
+                    RelayDataSink& sink) {
+          (*static_cast<Processor*>(processor))(data, size, sink);
+        }} {}
+
+  /**
+   * @brief Process the relayed data.
+   *
+   * @param data pointer to relayed data.
+   * @param size data size.
+   * @param sink collects the data to send to the network.
+   */
+  void operator()(const char* data, size_t size, RelayDataSink& sink) const {
+    process_(processor_.get(), data, size, sink);
+  }
+
+  explicit operator bool() const noexcept { return process_ != nullptr; }
+
+ private:
+  using Deleter = void (*)(void*);
+  using Process = void (*)(void*, const char*, size_t, RelayDataSink&);
+
+  std::unique_ptr<void, Deleter> processor_{nullptr, nullptr};
+  Process process_{};
+};
+
+/**
+ * @brief A callback that returns an inline object that will handle the
+ * relayed data. See TcpRelayDataProcessorCreatorCb.
+ *
+ * @param from data sender endpoint to the socks5 proxy.
+ * @param to data receiver endpoint from the socks5 proxy.
+ * @return TcpRelayInlineDataProcessorCb
+ */
+using TcpRelayInlineDataProcessorCreatorCb =
+    std::function<TcpRelayInlineDataProcessorCb(const tcp::endpoint& from,
+                                                const tcp::endpoint& to)>;
+
+/**
+ * @brief A mutable view of the data in the relay buffer. The buffer has
+ * headroom before the data and tailroom after it, so an in-place data
+ * processor may rewrite, trim, prepend or append bytes without copying the
+ * data. The relay sends the view as it is after the processor returns.
+ */
+class SOCKS5_API RelayBuffer final {
+ public:
+  RelayBuffer(char* begin, char* end, char* data, size_t size) noexcept
+      : begin_{begin}, end_{end}, data_{data}, size_{size} {}
+
+  char* Data() noexcept { return data_; }
+  const char* Data() const noexcept { return data_; }
+  size_t Size() const noexcept { return size_; }
+
+  /**
+   * @brief Free bytes before the data.
+   */
+  size_t Headroom() const noexcept {
+    return static_cast<size_t>(data_ - begin_);
+  }
+
+  /**
+   * @brief Free bytes after the data.
+   */
+  size_t Tailroom() const noexcept {
+    return static_cast<size_t>(end_ - data_ - size_);
+  }
+
+  /**
+   * @brief Extend the data to the front by len bytes of headroom.
+   *
+   * @param len number of bytes to prepend.
+   * @return char* pointer to the prepended bytes, it's the new Data().
+   * @throws std::length_error if there isn't enough headroom.
+   */
+  char* Prepend(size_t len) {
+    if (len > Headroom()) {
+      throw std::length_error{"Not enough relay buffer headroom"};
+    }
+    data_ -= len;
+    size_ += len;
+    return data_;
+  }
+
+  /**
+   * @brief Extend the data to the back by len bytes of tailroom.
+   *
+   * @param len number of bytes to append.
+   * @return char* pointer to the appended bytes.
+   * @throws std::length_error if there isn't enough tailroom.
+   */
+  char* Append(size_t len) {
+    if (len > Tailroom()) {
+      throw std::length_error{"Not enough relay buffer tailroom"};
+    }
+    size_ += len;
+    return data_ + size_ - len;
+  }
+
+  /**
+   * @brief Remove len bytes from the front of the data, they become
+   * headroom.
+   *
+   * @throws std::out_of_range if len is greater than Size().
+   */
+  void TrimFront(size_t len) {
+    if (len > size_) {
+      throw std::out_of_range{"Relay buffer trim is out of range"};
+    }
+    data_ += len;
+    size_ -= len;
+  }
+
+  /**
+   * @brief Remove len bytes from the back of the data, they become tailroom.
+   *
+   * @throws std::out_of_range if len is greater than Size().
+   */
+  void TrimBack(size_t len) {
+    if (len > size_) {
+      throw std::out_of_range{"Relay buffer trim is out of range"};
+    }
+    size_ -= len;
+  }
+
+  /**
+   * @brief Stop processing the relayed data of the direction. The buffer is
+   * sent as it is after this call of the processor, then the rest of the data
+   * is relayed as is. See RelayDataSink::Detach().
+   */
+  void Detach() noexcept { detached_ = true; }
+  bool Detached() const noexcept { return detached_; }
+
+ private:
+  char* begin_;
+  char* end_;
+  char* data_;
+  size_t size_;
+  bool detached_{false};
+};
+
+/**
+ * @brief A callback that processes TCP data relayed through the socks5 proxy
+ * server in place. Nothing is sent if the buffer is trimmed to empty.
+ *
+ * @param buf mutable view of the relayed data.
+ */
+using TcpRelayInPlaceDataProcessorCb = std::function<void(RelayBuffer& buf)>;
+
+/**
+ * @brief A callback that returns an object that will handle the relayed data
+ * in place. See TcpRelayDataProcessorCreatorCb.
+ *
+ * @param from data sender endpoint to the socks5 proxy.
+ * @param to data receiver endpoint from the socks5 proxy.
+ * @return TcpRelayInPlaceDataProcessorCb
+ */
+using TcpRelayInPlaceDataProcessorCreatorCb =
+    std::function<TcpRelayInPlaceDataProcessorCb(const tcp::endpoint& from,
+                                                 const tcp::endpoint& to)>;
+
+/**
+ * @brief A callback that processes TCP data relayed through the socks5 proxy
+ * server asynchronously. It may suspend, e.g. to consult an external store,
+ * without blocking the other sessions of the thread. The relay doesn't read
+ * the next data of the direction until the returned awaitable completes, so
+ * the data is processed in order and a slow processor slows down the sender.
+ * The data stays valid until then. The time spent in the processor counts
+ * towards the tcp relay timeout.
+ *
+ * @param data pointer to relayed data.
+ * @param size data size.
+ * @param sink collects the data to send to the network after the awaitable
+ * completes.
+ * @return VoidAwait
+ */
+using TcpRelayAsyncDataProcessorCb = std::function<VoidAwait(
+    const char* data, size_t size, RelayDataSink& sink)>;
+
+/**
+ * @brief A callback that returns an object that will handle the relayed data
+ * asynchronously. See TcpRelayDataProcessorCreatorCb.
+ *
+ * @param from data sender endpoint to the socks5 proxy.
+ * @param to data receiver endpoint from the socks5 proxy.
+ * @return TcpRelayAsyncDataProcessorCb
+ */
+using TcpRelayAsyncDataProcessorCreatorCb =
+    std::function<TcpRelayAsyncDataProcessorCb(const tcp::endpoint& from,
+                                               const tcp::endpoint& to)>;
+
 /**
  * @brief A callback that processes UDP data relayed through the socks5
  * proxy server.
@@ -94,6 +352,147 @@ using UdpRelayDataProcessorCb = std::function<void(
 using UdpRelayDataProcessorCreatorCb = std::function<UdpRelayDataProcessorCb(
     const udp::endpoint& client, const udp::endpoint& server)>;
 
+/**
+ * @brief A callback that processes UDP data relayed from the client through
+ * the socks5 proxy server asynchronously. The relay doesn't receive the next
+ * datagram from the client until the returned awaitable completes. See
+ * TcpRelayAsyncDataProcessorCb.
+ *
+ * @param data pointer to relayed data.
+ * @param size data size.
+ * @param server target server endpoint to which the data will be sent.
+ * @param sink collects the data to send to the network after the awaitable
+ * completes.
+ * @return VoidAwait
+ */
+using UdpRelayAsyncDataFromClientProcessorCb = std::function<VoidAwait(
+    const char* data, size_t size, const udp::endpoint& server,
+    RelayDataSink& sink)>;
+
+/**
+ * @brief A callback that returns an object that will handle the data being
+ * relayed from the client to the server asynchronously. See
+ * UdpRelayDataFromClientProcessorCreatorCb.
+ *
+ * @param expected_client_ep the client endpoint from which datagrams are
+ * expected.
+ * @return UdpRelayAsyncDataFromClientProcessorCb
+ */
+using UdpRelayAsyncDataFromClientProcessorCreatorCb =
+    std::function<UdpRelayAsyncDataFromClientProcessorCb(
+        const udp::endpoint& expected_client_ep)>;
+
+/**
+ * @brief A callback that processes UDP data relayed from the server through
+ * the socks5 proxy server asynchronously. The relay doesn't receive the next
+ * datagram from the server until the returned awaitable completes. See
+ * TcpRelayAsyncDataProcessorCb.
+ *
+ * @param data pointer to relayed data.
+ * @param size data size.
+ * @param sink collects the data to send to the network after the awaitable
+ * completes.
+ * @return VoidAwait
+ */
+using UdpRelayAsyncDataProcessorCb = std::function<VoidAwait(
+    const char* data, size_t size, RelayDataSink& sink)>;
+
+/**
+ * @brief A callback that returns an object that will handle the data being
+ * relayed from the server to the client asynchronously.
+ *
+ * @param client client endpoint.
+ * @param server server endpoint.
+ * @return UdpRelayAsyncDataProcessorCb
+ */
+using UdpRelayAsyncDataProcessorCreatorCb =
+    std::function<UdpRelayAsyncDataProcessorCb(const udp::endpoint& client,
+                                               const udp::endpoint& server)>;
+
+/**
+ * @brief A datagram of a batch relayed through the socks5 proxy server.
+ */
+struct SOCKS5_API UdpRelayDatagram final {
+  // Pointer to relayed data.
+  const char* data;
+  // Data size.
+  size_t size;
+  // Target server endpoint to which the datagram is sent or from which it's
+  // received.
+  const udp::endpoint* server;
+};
+
+/**
+ * @brief Datagrams emitted by a batch data processor. The relay clears it
+ * before every batch and sends the datagrams after the processor returns, so
+ * the emitted data must stay valid until the processor is called again.
+ */
+class SOCKS5_API UdpRelayBatchSender final {
+ public:
+  struct Datagram final {
+    // Index of the input datagram whose destination the datagram is sent to.
+    size_t index;
+    const char* data;
+    size_t size;
+  };
+
+  /**
+   * @brief Emit a datagram to the destination of an input datagram.
+   *
+   * @param index index of the input datagram in the batch.
+   * @param data pointer to data to send.
+   * @param size data size.
+   */
+  void Send(size_t index, const char* data, size_t size) {
+    datagrams_.push_back({index, data, size});
+  }
+
+  const std::vector<Datagram>& Datagrams() const noexcept {
+    return datagrams_;
+  }
+  void Clear() noexcept { datagrams_.clear(); }
+
+ private:
+  std::vector<Datagram> datagrams_;
+};
+
+/**
+ * @brief A callback that processes a batch of UDP datagrams relayed through
+ * the socks5 proxy server. The batch holds the datagrams received with one
+ * system call, up to Config::udp_batch_size.
+ *
+ * @param datagrams relayed datagrams.
+ * @param send datagrams to send to the network.
+ */
+using UdpRelayBatchDataProcessorCb =
+    std::function<void(std::span<const UdpRelayDatagram> datagrams,
+                       UdpRelayBatchSender& send)>;
+
+/**
+ * @brief A callback that returns an object that will handle the batches of
+ * datagrams being relayed from the client to the servers. See
+ * UdpRelayDataFromClientProcessorCreatorCb.
+ *
+ * @param expected_client_ep the client endpoint from which datagrams are
+ * expected.
+ * @return UdpRelayBatchDataProcessorCb
+ */
+using UdpRelayBatchDataFromClientProcessorCreatorCb =
+    std::function<UdpRelayBatchDataProcessorCb(
+        const udp::endpoint& expected_client_ep)>;
+
+/**
+ * @brief A callback that returns an object that will handle the batches of
+ * datagrams being relayed from the server to the client.
+ *
+ * @param client client endpoint.
+ * @param server server endpoint.
+ * @return UdpRelayBatchDataProcessorCb
+ */
+using UdpRelayBatchDataProcessorCreatorCb =
+    std::function<UdpRelayBatchDataProcessorCb(const udp::endpoint& client,
+                                               const udp::endpoint& server)>;
+
 /**
  * @brief A callbacks that create objects that handle all TCP data relayed
  * through the socks5 proxy.
@@ -105,6 +504,20 @@ struct SOCKS5_API TcpRelayDataProcessor final {
   // A callback that returns an object that will handle the data being relayed
   // from the server to the client.
   TcpRelayDataProcessorCreatorCb server_to_client;
+  // Inline alternatives of the callbacks above, see
+  // MakeTcpRelayDataProcessor(). If set, they are used instead of the
+  // type-erased ones for the same direction.
+  TcpRelayInlineDataProcessorCreatorCb client_to_server_inline;
+  TcpRelayInlineDataProcessorCreatorCb server_to_client_inline;
+  // In-place alternatives of the callbacks above. If set, they are used
+  // instead of the others for the same direction.
+  TcpRelayInPlaceDataProcessorCreatorCb client_to_server_in_place;
+  TcpRelayInPlaceDataProcessorCreatorCb server_to_client_in_place;
+  // Asynchronous alternatives of the callbacks above. If set, they are used
+  // instead of the std::function ones for the same direction, but not
+  // instead of the inline or in-place ones.
+  TcpRelayAsyncDataProcessorCreatorCb client_to_server_async;
+  TcpRelayAsyncDataProcessorCreatorCb server_to_client_async;
 };
 
 /**
@@ -114,8 +527,54 @@ struct SOCKS5_API TcpRelayDataProcessor final {
 struct SOCKS5_API UdpRelayDataProcessor final {
   UdpRelayDataFromClientProcessorCreatorCb client_to_server;
   UdpRelayDataProcessorCreatorCb server_to_client;
+  // Batch alternatives of the callbacks above. If set, they are used instead
+  // of the per-datagram ones for the same direction.
+  UdpRelayBatchDataFromClientProcessorCreatorCb client_to_server_batch;
+  UdpRelayBatchDataProcessorCreatorCb server_to_client_batch;
+  // Asynchronous alternatives of the callbacks above. If set, they are used
+  // instead of the per-datagram ones for the same direction, but not instead
+  // of the batch ones.
+  UdpRelayAsyncDataFromClientProcessorCreatorCb client_to_server_async;
+  UdpRelayAsyncDataProcessorCreatorCb server_to_client_async;
 };
 
+/**
+ * @brief Make TCP data processors that are dispatched statically. Every
+ * creator is called with the "from" and "to" endpoints of the relay, like
+ * TcpRelayDataProcessorCreatorCb, and returns a processor of a concrete type
+ * satisfying InlineTcpRelayDataProcessor, e.g. a lambda taking
+ * (const char* data, size_t size, RelayDataSink& sink). Pass the result to
+ * ServerBuilder::Build().
+ *
+ * @param client_to_server creator of the processors of the data relayed from
+ * the client to the server.
+ * @param server_to_client creator of the processors of the data relayed from
+ * the server to the client.
+ * @return TcpRelayDataProcessor
+ */
+template <typename ClientToServer, typename ServerToClient>
+  requires InlineTcpRelayDataProcessor<std::invoke_result_t<
+               const ClientToServer&, const tcp::endpoint&,
+               const tcp::endpoint&>> &&
+           InlineTcpRelayDataProcessor<std::invoke_result_t<
+               const ServerToClient&, const tcp::endpoint&,
+               const tcp::endpoint&>>
+TcpRelayDataProcessor MakeTcpRelayDataProcessor(
+    ClientToServer client_to_server, ServerToClient server_to_client) {
+  TcpRelayDataProcessor processor;
+  processor.client_to_server_inline =
+      [client_to_server = std::move(client_to_server)](
+          const tcp::endpoint& from, const tcp::endpoint& to) {
+        return TcpRelayInlineDataProcessorCb{client_to_server(from, to)};
+      };
+  processor.server_to_client_inline =
+      [server_to_client = std::move(server_to_client)](
+          const tcp::endpoint& from, const tcp::endpoint& to) {
+        return TcpRelayInlineDataProcessorCb{server_to_client(from, to)};
+      };
+  return processor;
+}
+
 using TcpRelayDataProcessorPtr = std::shared_ptr<TcpRelayDataProcessor>;
 using UdpRelayDataProcessorPtr = std::shared_ptr<UdpRelayDataProcessor>;
 
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <socks5/server/relay_data_processor_defs.hpp>
+#include <socks5/common/asio.hpp>
+#include <socks5/common/api_macro.hpp>
+
+namespace socks5::utils {
+
+class ByteSetFinder;
+
+}  // namespace socks5::utils
+
+namespace socks5::server {
+
+/**
+ * @brief Gives a kernel transforming data in place, with
+ * Process(char* data, size_t size), the call shapes of the data processors:
+ * TcpRelayInPlaceDataProcessorCb, TcpRelayDataProcessorCb,
+ * UdpRelayDataProcessorCb and UdpRelayDataFromClientProcessorCb. The in-place
+ * shape doesn't copy the data, the others copy it once into a buffer reused
+ * by the kernel. A kernel with Reset() restarts on every datagram, since
+ * datagrams may be lost or reordered.
+ */
+template <typename Kernel>
+class TransformKernel {
+ public:
+  void operator()(RelayBuffer& buf) { Self().Process(buf.Data(), buf.Size()); }
+
+  void operator()(const char* data, size_t size, const RelayDataSender& send) {
+    scratch_.assign(data, data + size);
+    Self().Process(scratch_.data(), scratch_.size());
+    send(scratch_.data(), scratch_.size());
+  }
+
+  void operator()(const char* data, size_t size, const udp::endpoint&,
+                  const RelayDataSender& send) {
+    if constexpr (requires(Kernel& kernel) { kernel.Reset(); }) {
+      Self().Reset();
+    }
+    (*this)(data, size, send);
+  }
+
+ private:
+  Kernel& Self() noexcept { return static_cast<Kernel&>(*this); }
+
+  std::vector<char> scratch_;
+};
+
+/**
+ * @brief Gives a kernel observing data, with
+ * Update(const char* data, size_t size), the call shapes of the data
+ * processors, see TransformKernel. The data is relayed as is.
+ */
+template <typename Kernel>
+class ObserveKernel {
+ public:
+  void operator()(RelayBuffer& buf) {
+    Self().Update(static_cast<const RelayBuffer&>(buf).Data(), buf.Size());
+  }
+
+  void operator()(const char* data, size_t size, const RelayDataSender& send) {
+    Self().Update(data, size);
+    send(data, size);
+  }
+
+  void operator()(const char* data, size_t size, const udp::endpoint&,
+                  const RelayDataSender& send) {
+    (*this)(data, size, send);
+  }
+
+ private:
+  Kernel& Self() noexcept { return static_cast<Kernel&>(*this); }
+};
+
+/**
+ * @brief XORs the data with a repeating key, e.g. to obfuscate a stream. The
+ * position in the key carries over the calls, so the chunks of a tcp stream
+ * are XORed as one sequence. The same kernel with the same key restores the
+ * data.
+ */
+class SOCKS5_API XorStream final : public TransformKernel<XorStream> {
+ public:
+  /**
+   * @throws std::invalid_argument if the key is empty.
+   */
+  explicit XorStream(std::string_view key);
+
+  void Process(char* data, size_t size) noexcept;
+  void Reset() noexcept { pos_ = 0; }
+
+ private:
+  // The key repeated, so a vector register worth of key can be loaded at any
+  // position.
+  std::vector<uint8_t> key_;
+  size_t key_size_;
+  size_t pos_{0};
+};
+
+/**
+ * @brief Replaces every byte with its entry of a translation table, e.g. to
+ * map a character set or to substitute bytes.
+ */
+class SOCKS5_API ByteTranslator final
+    : public TransformKernel<ByteTranslator> {
+ public:
+  using Table = std::array<uint8_t, 256>;
+
+  explicit ByteTranslator(const Table& table) noexcept;
+
+  void Process(char* data, size_t size) const noexcept;
+
+ private:
+  alignas(32) Table table_;
+};
+
+/**
+ * @brief A callback called for every delimiter found by DelimiterScanner.
+ *
+ * @param offset offset of the delimiter from the start of the stream.
+ */
+using DelimiterCb = std::function<void(uint64_t offset)>;
+
+/**
+ * @brief Finds the delimiters of records, e.g. the line ends of a text
+ * protocol, in a stream. Copies share the compiled set of delimiters.
+ */
+class SOCKS5_API DelimiterScanner final
+    : public ObserveKernel<DelimiterScanner> {
+ public:
+  /**
+   * @param delimiters bytes any of which is a delimiter.
+   * @param on_delimiter callback called for every delimiter, may be empty.
+   */
+  explicit DelimiterScanner(std::string_view delimiters,
+                            DelimiterCb on_delimiter = {});
+
+  /**
+   * @brief Find the first delimiter in a range, without advancing the
+   * stream.
+   *
+   * @return pointer to the delimiter or end if there is none.
+   */
+  const char* Find(const char* begin, const char* end) const noexcept;
+
+  void Update(const char* data, size_t size);
+
+  // Number of bytes of the stream scanned so far.
+  uint64_t Offset() const noexcept { return offset_; }
+  // Number of delimiters found so far.
+  uint64_t Count() const noexcept { return count_; }
+
+ private:
+  std::shared_ptr<const utils::ByteSetFinder> finder_;
+  DelimiterCb on_delimiter_;
+  uint64_t offset_{0};
+  uint64_t count_{0};
+};
+
+/**
+ * @brief Streaming CRC-32C(Castagnoli) of the data. Computed with the SSE4.2
+ * or ARMv8 CRC instructions where available.
+ */
+class SOCKS5_API Crc32c final : public ObserveKernel<Crc32c> {
+ public:
+  void Update(const char* data, size_t size) noexcept;
+  uint32_t Value() const noexcept { return ~crc_; }
+  void Reset() noexcept { crc_ = 0xffffffff; }
+
+ private:
+  uint32_t crc_{0xffffffff};
+};
+
+/**
+ * @brief Streaming 64-bit xxHash(XXH64) of the data.
+ */
+class SOCKS5_API XxHash64 final : public ObserveKernel<XxHash64> {
+ public:
+  explicit XxHash64(uint64_t seed = 0) noexcept;
+
+  void Update(const char* data, size_t size) noexcept;
+  uint64_t Value() const noexcept;
+  void Reset() noexcept;
+
+ private:
+  uint64_t seed_;
+  std::array<uint64_t, 4> acc_;
+  uint64_t total_size_{0};
+  std::array<uint8_t, 32> tail_{};
+  size_t tail_size_{0};
+};
+
+}  // namespace socks5::server
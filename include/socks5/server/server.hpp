@@ -7,13 +7,20 @@
 #include <socks5/common/metrics.hpp>
 #include <socks5/utils/fast_pimpl.hpp>
 #include <socks5/server/relay_data_processor_defs.hpp>
+#include <socks5/server/relay_data_pipeline.hpp>
+#include <socks5/server/thread_stats.hpp>
+#include <socks5/server/session_info.hpp>
+#include <ostream>
 #include <socks5/common/api_macro.hpp>
 
 namespace socks5::server {
 
+class ServerContext;
+
 namespace detail {
 
 using ListenerRunner = std::function<void()>;
+using ServerContextPtr = std::shared_ptr<ServerContext>;
 
 }  // namespace detail
 
@@ -32,7 +39,8 @@ class SOCKS5_API Server final : utils::NonCopyable {
          ConfigPtr config_ptr, common::MetricsPtr metrics,
          auth::server::UserAuthCbPtr user_auth_cb,
          TcpRelayDataProcessorPtr tcp_data_processor,
-         UdpRelayDataProcessorPtr udp_data_processor);
+         UdpRelayDataProcessorPtr udp_data_processor,
+         detail::ServerContextPtr context);
 
   /**
    * @brief Calls Wait() and destroys the server.
@@ -68,6 +76,56 @@ class SOCKS5_API Server final : utils::NonCopyable {
    */
   size_t GetSentBytesTotal() const noexcept;
 
+  /**
+   * @brief Get the total number of flow records dropped because the flow
+   * record callback couldn't keep up with closed sessions. Thread-safe.
+   */
+  size_t GetDroppedFlowRecordsTotal() const noexcept;
+
+  /**
+   * @brief Get scheduler statistics of every server thread: executed handlers,
+   * busy and idle time, scheduling delay of the io_context and live sessions.
+   * Thread-safe.
+   *
+   * @return ThreadStatsVec one element per server thread.
+   * @throws std::exception
+   */
+  ThreadStatsVec GetThreadStats() const;
+
+  /**
+   * @brief Get a snapshot of the live sessions of the server: sessions in the
+   * handshake stage, tcp relays and udp associations. Thread-safe.
+   *
+   * @return SessionInfoVec one element per live session.
+   * @throws std::exception
+   */
+  SessionInfoVec GetSessions() const;
+
+  /**
+   * @brief Kills the live sessions selected by the predicate. The client
+   * connection of every selected session is shut down, so the session closes
+   * with CloseReason::kKilled. The function does not block, the sessions are
+   * killed asynchronously on the server threads. Sessions served by custom
+   * relay handlers can't be killed. Thread-safe.
+   *
+   * @param pred called once per live session without holding any lock.
+   * @return size_t the number of sessions requested to kill.
+   * @throws std::exception
+   */
+  size_t KillSessions(const SessionPredicate& pred);
+
+  /**
+   * @brief Write the last events recorded by the flight recorder of every
+   * server thread. The binary format is described in
+   * socks5/server/flight_event.hpp, the socks5_flight_decoder tool converts it
+   * to text. Writes an empty dump if the flight recorder is disabled.
+   * Thread-safe.
+   *
+   * @param out binary output stream.
+   * @throws std::exception
+   */
+  void DumpFlightRecorder(std::ostream& out) const;
+
   /**
    * @brief Requests to stop the socks5 proxy server. This function does not
    * block, but instead simply signals proxy server to stop. The behavior is
@@ -2,6 +2,7 @@
 
 #include <socks5/common/address.hpp>
 #include <socks5/server/server.hpp>
+#include <socks5/server/flow_record.hpp>
 #include <socks5/utils/fast_pimpl.hpp>
 #include <socks5/auth/server/user_auth_fwd.hpp>
 #include <socks5/common/api_macro.hpp>
@@ -10,6 +11,7 @@
 #include <functional>
 #include <utility>
 #include <variant>
+#include <vector>
 
 namespace socks5::server {
 
@@ -180,6 +182,90 @@ class SOCKS5_API ServerBuilder final : utils::NonCopyable {
    */
   ServerBuilder& SetUdpRelayTimeout(size_t timeout) noexcept;
 
+  /**
+   * @brief Set max number of datagrams received or sent with one system call
+   * by the udp relay(recvmmsg/sendmmsg on Linux). 1 disables batching. Default
+   * is 1.
+   *
+   * @param size number of datagrams.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& SetUdpBatchSize(size_t size) noexcept;
+
+  /**
+   * @brief Set max size of a datagram relayed with batching. Bigger datagrams
+   * are dropped. Default is 2048.
+   *
+   * @param size datagram size in bytes.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& SetUdpBatchDatagramSize(size_t size) noexcept;
+
+  /**
+   * @brief Set max number of target servers of a UDP association. Every target
+   * server holds a socket, when the limit is reached the least recently active
+   * one is closed. 0 means no limit. Default is 0.
+   *
+   * @param max number of target servers.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& SetUdpMaxTargetServers(size_t max) noexcept;
+
+  /**
+   * @brief Set a timeout in seconds after which the socket of an idle target
+   * server of a UDP association is closed. 0 disables idle eviction. Default
+   * is 0.
+   *
+   * @param timeout timeout in seconds.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& SetUdpTargetServerIdleTimeout(size_t timeout) noexcept;
+
+  /**
+   * @brief Set an interval in milliseconds at which the scheduling delay of
+   * the server threads is measured, see Server::GetThreadStats(). 0 disables
+   * the measurement. Default is 100.
+   *
+   * @param interval interval in milliseconds.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& SetLoopLagProbeInterval(size_t interval) noexcept;
+
+  /**
+   * @brief Count the handlers executed by every server thread and its busy and
+   * idle time, see Server::GetThreadStats(). The threads then run the
+   * io_context handler by handler, which adds two clock reads and a scheduler
+   * round trip per handler. Disabled by default.
+   *
+   * @param enable_loop_handler_stats enable or disable the handler statistics.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& EnableLoopHandlerStats(
+      bool enable_loop_handler_stats) noexcept;
+
+  /**
+   * @brief Set the number of the last session events(handshake, relays,
+   * watchdog, close) kept by the flight recorder per server thread, see
+   * Server::DumpFlightRecorder(). 0 disables the flight recorder. Default is
+   * 4096.
+   *
+   * @param capacity number of events, rounded up to a power of two.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& SetFlightRecorderCapacity(size_t capacity) noexcept;
+
+  /**
+   * @brief Dump the flight recorder to the file each time the process receives
+   * the signal. The signal is handled on a dedicated thread, so the dump works
+   * even if the server threads are stalled. Disabled by default.
+   *
+   * @param signal_number signal number, e.g. SIGUSR1.
+   * @param path path of the dump file. The file is overwritten by every dump.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& SetFlightRecorderDumpSignal(int signal_number,
+                                             std::string path) noexcept;
+
   /**
    * @brief Set a callback that will be called for authentication when the
    * client will establishes a connection if authentication has been enabled.
@@ -190,6 +276,19 @@ class SOCKS5_API ServerBuilder final : utils::NonCopyable {
    */
   ServerBuilder& SetUserAuthCb(auth::server::UserAuthCb user_auth_cb);
 
+  /**
+   * @brief Set a callback that receives a flow record(client, target, user,
+   * bytes per direction, duration, close reason, TCP_INFO of both legs) for
+   * every closed relay session. The callback is called on a separate collector
+   * thread. Records that don't fit into the internal queues are dropped, see
+   * Server::GetDroppedFlowRecordsTotal(). Disabled by default.
+   *
+   * @param flow_record_cb callback for flow records.
+   * @return ServerBuilder&
+   * @throws std::exception
+   */
+  ServerBuilder& SetFlowRecordCb(FlowRecordCb flow_record_cb);
+
   /**
    * @brief Set the authentication username that will be used in the default
    * authentication callback if authentication has been enabled.
@@ -210,6 +309,28 @@ class SOCKS5_API ServerBuilder final : utils::NonCopyable {
    */
   ServerBuilder& SetAuthPassword(std::string auth_password) noexcept;
 
+#ifdef SOCKS5_WITH_TLS
+  /**
+   * @brief Accept socks5 over TLS on the listener, see
+   * socks5::client::TlsContext. TLS 1.2 sessions are resumed with session
+   * tickets. After the TLS handshake the connection is encrypted by the
+   * kernel(kTLS), so the relay costs the same as without TLS. Connections on
+   * which kTLS can't be enabled, e.g. without the tls kernel module, are
+   * closed. Supported on Linux only. Available if the library is built with
+   * SOCKS5_WITH_TLS. Disabled by default.
+   *
+   * @param enable_tls enable or disable TLS.
+   * @param cert_chain_file path of the PEM certificate chain of the server.
+   * @param private_key_file path of the PEM private key of the server.
+   * @param session_timeout lifetime in seconds of the resumed sessions.
+   * Default is 7200.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& EnableTls(bool enable_tls, std::string cert_chain_file,
+                           std::string private_key_file,
+                           size_t session_timeout = 7200) noexcept;
+#endif
+
   /**
    * @brief Enable authentication. Disabled by default.
    *
@@ -227,6 +348,104 @@ class SOCKS5_API ServerBuilder final : utils::NonCopyable {
    */
   ServerBuilder& EnableTcpNodelay(bool enable_tcp_nodelay) noexcept;
 
+  /**
+   * @brief Accept compressed tunnels asked for by the clients of this library,
+   * see socks5::client::CompressedTunnel. The data of a CONNECT relay between
+   * the client and the server is compressed with LZ4, the blocks that don't
+   * compress are sent as is. Used only with the default tcp relay handler
+   * without data processors, otherwise the tunnel is declined. Disabled by
+   * default.
+   *
+   * @param enable_compressed_tunnel enable or disable compressed tunnels.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& EnableCompressedTunnel(bool enable_compressed_tunnel) noexcept;
+
+  /**
+   * @brief Enable UDP generic segmentation offload(UDP_SEGMENT) in the udp
+   * relay. Runs of same-sized datagrams to the same address are sent as one
+   * packet and split by the kernel or the NIC. Used only with batching, see
+   * SetUdpBatchSize(). Disabled by default.
+   *
+   * @param enable_udp_gso enable or disable UDP GSO.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& EnableUdpGso(bool enable_udp_gso) noexcept;
+
+  /**
+   * @brief Enable UDP generic receive offload(UDP_GRO) on the udp relay sockets
+   * connected to target servers. Used only with batching, see
+   * SetUdpBatchSize(). Disabled by default.
+   *
+   * @param enable_udp_gro enable or disable UDP GRO.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& EnableUdpGro(bool enable_udp_gro) noexcept;
+
+  /**
+   * @brief Connect the udp relay sockets to their target servers. Datagrams
+   * are sent and received without passing the target address, and the kernel
+   * drops datagrams from other senders. Not used by the shared udp relay.
+   * Disabled by default.
+   *
+   * @param enable_udp_connect_targets enable or disable connected sockets.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& EnableUdpConnectedTargets(
+      bool enable_udp_connect_targets) noexcept;
+
+  /**
+   * @brief Serve all the UDP associations through one udp port on the listener
+   * address. Client datagrams are dispatched to associations by the client
+   * address, and target servers are reached through a shared pool of sockets.
+   * A socket relays a target server endpoint for one association at a time,
+   * so each server thread needs as many sockets as the associations that talk
+   * to the same target at the same time, e.g. to a DNS resolver. Otherwise
+   * the number of open sockets doesn't grow with the number of associations.
+   * Used only with the default udp relay handler. Disabled by default.
+   *
+   * @param enable_udp_shared_relay enable or disable the shared udp relay.
+   * @param port udp port of the relay, 0 means any free port.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& EnableUdpSharedRelay(bool enable_udp_shared_relay,
+                                      unsigned short port = 0) noexcept;
+
+  /**
+   * @brief Answer repeated DNS queries relayed by UDP ASSOCIATE to the
+   * specified resolvers from a cache. Answers are kept for the min TTL of
+   * their records and served with the transaction id of the query. Misses
+   * are relayed to the resolver as usual. Used only with the default udp relay
+   * handler and without the shared udp relay. Disabled by default.
+   *
+   * @param enable_udp_dns_cache enable or disable the DNS cache.
+   * @param resolvers IP addresses and ports of the cached resolvers.
+   * @param size max number of cached answers. Default is 4096.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& EnableUdpDnsCache(bool enable_udp_dns_cache,
+                                   std::vector<ResolverAddr> resolvers,
+                                   size_t size = 4096) noexcept;
+
+  /**
+   * @brief Run the synchronous tcp data processors on a dedicated pool of
+   * threads instead of the server threads, so heavy processors don't delay
+   * the io of other sessions. The data of a connection is still processed
+   * and sent in order. Asynchronous processors always run on the server
+   * threads. Disabled by default.
+   *
+   * @param threads_num number of offload threads. 0 disables offloading.
+   * @param max_inflight_bytes max number of relayed bytes queued to or
+   * processed by the offload threads. Relays wait for room before reading
+   * more data. Default is 8 MiB.
+   * @param cpus CPUs to which the offload threads are pinned round-robin.
+   * Empty disables pinning. Supported on Linux only.
+   * @return ServerBuilder&
+   */
+  ServerBuilder& SetTcpOffloadThreads(size_t threads_num,
+                                      size_t max_inflight_bytes = 8388608,
+                                      std::vector<int> cpus = {}) noexcept;
+
   /**
    * @brief Set whether to validate incoming connections when using BIND.
    * Disabled by default.
@@ -261,6 +480,15 @@ class SOCKS5_API ServerBuilder final : utils::NonCopyable {
    * complex to implement. A data processor is simpler to implement and allows
    * you to focus on processing and sending data.
    *
+   * A data processor that needs to wait for something, e.g. an external
+   * policy store, should be asynchronous(the *_async fields of
+   * TcpRelayDataProcessor/UdpRelayDataProcessor), so it doesn't block the
+   * other sessions served by the same thread.
+   *
+   * Several transformations of the relayed data are chained with a
+   * RelayPipeline(include/server/relay_data_pipeline.hpp) passed via
+   * MakeTcpRelayPipelineProcessor()/MakeUdpRelayPipelineProcessor().
+   *
    * @tparam T
    * CoroTcpRelayHandlerCb/TcpRelayHandlerCb/TcpRelayDataProcessor/nullptr
    * (from include/server/handler_defs.hpp or
@@ -296,7 +524,7 @@ class SOCKS5_API ServerBuilder final : utils::NonCopyable {
   Server Dispatch(auto&& lhs, auto&& rhs);
 
   struct Impl;
-  constexpr static size_t kSize{308};
+  constexpr static size_t kSize{396};
   constexpr static size_t kAlignment{8};
   utils::FastPimpl<Impl, kSize, kAlignment> impl_;
 };
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <socks5/common/asio.hpp>
+#include <socks5/server/flow_record.hpp>
+#include <socks5/common/api_macro.hpp>
+
+namespace socks5::server {
+
+/**
+ * @brief Stage of a live session.
+ */
+enum class SessionState : uint8_t {
+  // Authentication and the socks5 request are being processed.
+  kHandshake,
+  // Data is relayed between the client and the target server(CONNECT, BIND).
+  kTcpRelay,
+  // Datagrams are relayed for the client(UDP ASSOCIATE).
+  kUdpRelay,
+};
+
+/**
+ * @brief State of a live session of the socks5 proxy server at the moment of
+ * the snapshot.
+ */
+struct SOCKS5_API SessionInfo final {
+  // Unique id of the session within the server.
+  uint64_t session_id{};
+  // Command served by the session. kUnknown until the request is received.
+  SessionCommand command{SessionCommand::kUnknown};
+  // Current stage of the session.
+  SessionState state{SessionState::kHandshake};
+  // Client endpoint of the socks5 tcp connection.
+  tcp::endpoint client;
+  // Target address from the socks5 request. Empty until the request is
+  // received.
+  std::string target;
+  // Authenticated username. Empty if authentication is disabled or hasn't
+  // completed yet.
+  std::string user;
+  // Number of bytes read from the client and relayed to the target(s) so far.
+  uint64_t bytes_from_client{};
+  // Number of bytes read from the target(s) and relayed to the client so far.
+  uint64_t bytes_from_target{};
+  // Time at which the client connection was accepted.
+  std::chrono::system_clock::time_point start;
+  // Time since the client connection was accepted.
+  std::chrono::microseconds age{};
+  // False if the session is served by a custom relay handler. Such a handler
+  // owns the sockets, so the server can't kill the session.
+  bool killable{true};
+};
+
+using SessionInfoVec = std::vector<SessionInfo>;
+
+/**
+ * @brief A predicate that selects sessions to kill.
+ *
+ * @param info state of a live session.
+ * @return true if the session must be killed.
+ */
+using SessionPredicate = std::function<bool(const SessionInfo& info)>;
+
+}  // namespace socks5::server
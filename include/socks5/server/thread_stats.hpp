@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <socks5/common/api_macro.hpp>
+
+namespace socks5::server {
+
+/**
+ * @brief Scheduler statistics of one socks5 proxy server thread. All the
+ * counters are cumulative since the server was started, so rates and averages
+ * are computed from the difference of two snapshots.
+ */
+struct SOCKS5_API ThreadStats final {
+  // Number of handlers executed by the thread. This and the busy and idle time
+  // are counted only if enabled with ServerBuilder::EnableLoopHandlerStats().
+  uint64_t handlers_total{};
+  // Wall time the thread spent executing handlers, including the time a
+  // handler blocked the thread. The handler that ends a wait for handlers is
+  // counted as idle time.
+  std::chrono::microseconds busy_time{};
+  // Time the thread spent waiting for handlers.
+  std::chrono::microseconds idle_time{};
+  // Number of lag probes executed by the thread. A lag probe is a handler
+  // posted to the io_context at a regular interval. Its scheduling delay is
+  // the time from posting to execution.
+  uint64_t lag_samples_total{};
+  // Sum of the scheduling delays of the lag probes executed by the thread.
+  std::chrono::microseconds lag_total{};
+  // Scheduling delay of the last lag probe executed by the thread.
+  std::chrono::microseconds last_lag{};
+  // Maximum scheduling delay of the lag probes executed by the thread.
+  std::chrono::microseconds max_lag{};
+  // Number of live sessions started on the thread.
+  uint64_t live_sessions{};
+};
+
+using ThreadStatsVec = std::vector<ThreadStats>;
+
+}  // namespace socks5::server
@@ -18,6 +18,19 @@ enum SOCKS5_API Level : int {
   off,
 };
 
+/**
+ * @brief What to do with a message if the asynchronous logging queue of the
+ * current thread is full.
+ */
+enum class SOCKS5_API OverflowPolicy {
+  // Drop the message. Dropped messages are counted.
+  kDrop,
+  // Wait until the background thread frees space in the queue.
+  kBlock,
+};
+
+inline constexpr size_t kDefaultAsyncLogQueueCapacity{8192};
+
 using LogLevelAtomic = std::atomic<Level>;
 using LoggerBasePtr = std::shared_ptr<class LoggerBase>;
 using LoggerCb =
@@ -81,6 +94,33 @@ SOCKS5_API void SetLevel(Level lvl) noexcept;
  */
 SOCKS5_API void EnableLogging(bool enable);
 
+/**
+ * @brief Enable asynchronous logging. Every logging thread gets its own
+ * lock-free queue. Messages are captured into the queue without formatting and
+ * formatted and passed to the logger by a background thread. Disabling
+ * asynchronous logging writes the remaining messages. Disabled by default.
+ *
+ * Log calls below the SOCKS5_MIN_LOG_LEVEL CMake option are removed from the
+ * library at compile time regardless of this setting.
+ *
+ * @param enable enable/disable asynchronous logging.
+ * @param policy what to do if the queue of a logging thread is full.
+ * @param queue_capacity capacity of the per-thread queue in messages. Applied
+ * to the threads that haven't logged yet.
+ * @throws std::exception
+ */
+SOCKS5_API void EnableAsyncLogging(
+    bool enable, OverflowPolicy policy = OverflowPolicy::kDrop,
+    size_t queue_capacity = kDefaultAsyncLogQueueCapacity);
+
+/**
+ * @brief Get the number of messages dropped by the asynchronous logging
+ * because of full queues.
+ *
+ * @return size_t
+ */
+SOCKS5_API size_t GetDroppedLogMessagesTotal() noexcept;
+
 /**
  * @brief Check if logging is enabled.
  *
@@ -49,15 +49,18 @@ UserAuthRequestOptAwait UserAuth::ReadUserAuthRequest() noexcept {
   co_return parsers::ParseUserAuthRequest(buf);
 }
 
+std::string_view UserAuth::Username() const noexcept { return username_; }
+
 BoolAwait UserAuth::Run() noexcept {
   try {
     const auto user_auth_req = co_await ReadUserAuthRequest();
     if (!user_auth_req) {
       co_return false;
     }
-    if (!user_auth_cb_(std::string_view{reinterpret_cast<const char*>(
-                                            user_auth_req->uname.data()),
-                                        user_auth_req->ulen},
+    const std::string_view username{
+        reinterpret_cast<const char*>(user_auth_req->uname.data()),
+        user_auth_req->ulen};
+    if (!user_auth_cb_(username,
                        std::string_view{reinterpret_cast<const char*>(
                                             user_auth_req->passwd.data()),
                                         user_auth_req->plen},
@@ -72,6 +75,7 @@ BoolAwait UserAuth::Run() noexcept {
       SOCKS5_LOG(debug, net::MakeErrorMsg(*err, client_));
       co_return false;
     }
+    username_ = username;
     co_return true;
   } catch (const std::exception& ex) {
     SOCKS5_LOG(error, "UserAuth exception: {}", ex.what());
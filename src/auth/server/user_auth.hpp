@@ -22,6 +22,8 @@ class UserAuth final : utils::NonCopyable {
            const Config& config) noexcept;
 
   BoolAwait Run() noexcept;
+  // Username sent by the client. Empty until Run() succeeds.
+  std::string_view Username() const noexcept;
 
  private:
   UserAuthRequestOptAwait ReadUserAuthRequest() noexcept;
@@ -29,6 +31,7 @@ class UserAuth final : utils::NonCopyable {
   net::TcpConnection& client_;
   const UserAuthCb& user_auth_cb_;
   const Config& config_;
+  std::string username_;
 };
 
 }  // namespace socks5::auth::server
\ No newline at end of file
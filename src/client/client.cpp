@@ -141,4 +141,40 @@ TcpEndpointOrErrorAwait SecondBindStep(tcp::socket& socket) noexcept {
   co_return co_await RunSecondBindStep(socket);
 }
 
+ErrorAwait AsyncConnect(CompressedTunnel& tunnel,
+                        const tcp::endpoint& proxy_server_ep,
+                        const common::Address& target_server_addr,
+                        const auth::client::AuthOptions& auth_options,
+                        size_t timeout) noexcept {
+  co_return co_await RunConnect(tunnel, proxy_server_ep, target_server_addr,
+                                auth_options, timeout);
+}
+
+ErrorAwait AsyncConnect(
+    CompressedTunnel& tunnel, const tcp::endpoint& proxy_server_ep,
+    const common::Address& target_server_addr,
+    const auth::client::AuthOptions& auth_options) noexcept {
+  co_return co_await RunConnect(tunnel, proxy_server_ep, target_server_addr,
+                                auth_options);
+}
+
+#ifdef SOCKS5_WITH_TLS
+ErrorAwait AsyncConnect(tcp::socket& socket, TlsContext& tls,
+                        const tcp::endpoint& proxy_server_ep,
+                        const common::Address& target_server_addr,
+                        const auth::client::AuthOptions& auth_options,
+                        size_t timeout) noexcept {
+  co_return co_await RunConnect(socket, tls, proxy_server_ep,
+                                target_server_addr, auth_options, timeout);
+}
+
+ErrorAwait AsyncConnect(
+    tcp::socket& socket, TlsContext& tls, const tcp::endpoint& proxy_server_ep,
+    const common::Address& target_server_addr,
+    const auth::client::AuthOptions& auth_options) noexcept {
+  co_return co_await RunConnect(socket, tls, proxy_server_ep,
+                                target_server_addr, auth_options);
+}
+#endif
+
 }  // namespace socks5::client
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include <socks5/client/compressed_tunnel.hpp>
+#include <socks5/error/error.hpp>
+#include <common/tunnel_codec.hpp>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+namespace socks5::client {
+
+namespace {
+
+constexpr size_t kReadBufSize{16384};
+
+}  // namespace
+
+class CompressedTunnel::Impl final {
+ public:
+  explicit Impl(tcp::socket& socket) noexcept : socket{socket} {}
+
+  tcp::socket& socket;
+  bool compressed{false};
+  common::TunnelEncoder encoder;
+  common::TunnelDecoder decoder;
+  std::vector<char> frames;
+  // Data decoded and not read yet starts at decoded_pos.
+  std::vector<char> decoded;
+  size_t decoded_pos{0};
+  uint64_t sent_bytes{0};
+  uint64_t sent_wire_bytes{0};
+  std::array<char, kReadBufSize> read_buf;
+};
+
+CompressedTunnel::CompressedTunnel(tcp::socket& socket)
+    : impl_{std::make_unique<Impl>(socket)} {}
+
+CompressedTunnel::~CompressedTunnel() = default;
+
+tcp::socket& CompressedTunnel::Socket() noexcept { return impl_->socket; }
+
+bool CompressedTunnel::Compressed() const noexcept {
+  return impl_->compressed;
+}
+
+void CompressedTunnel::Reset(bool compressed) noexcept {
+  impl_->compressed = compressed;
+  impl_->encoder = common::TunnelEncoder{};
+  impl_->decoder = common::TunnelDecoder{};
+  impl_->frames.clear();
+  impl_->decoded.clear();
+  impl_->decoded_pos = 0;
+  impl_->sent_bytes = 0;
+  impl_->sent_wire_bytes = 0;
+}
+
+uint64_t CompressedTunnel::SentBytes() const noexcept {
+  return impl_->sent_bytes;
+}
+
+uint64_t CompressedTunnel::SentWireBytes() const noexcept {
+  return impl_->sent_wire_bytes;
+}
+
+BytesCountOrErrorAwait CompressedTunnel::Send(const char* data,
+                                              size_t size) noexcept {
+  try {
+    auto* wire_data = data;
+    auto wire_size = size;
+    if (impl_->compressed) {
+      impl_->frames.clear();
+      impl_->encoder.Encode(data, size, impl_->frames);
+      wire_data = impl_->frames.data();
+      wire_size = impl_->frames.size();
+    }
+    const auto [err, sent_bytes] = co_await asio::async_write(
+        impl_->socket, asio::buffer(wire_data, wire_size),
+        use_nothrow_awaitable);
+    impl_->sent_wire_bytes += sent_bytes;
+    if (err) {
+      co_return std::make_pair(err, 0);
+    }
+    impl_->sent_bytes += size;
+    co_return std::make_pair(error::Error::kSucceeded, size);
+  } catch (...) {
+    co_return std::make_pair(error::Error::kGeneralFailure, 0);
+  }
+}
+
+BytesCountOrErrorAwait CompressedTunnel::ReadSome(char* data,
+                                                  size_t size) noexcept {
+  try {
+    if (!impl_->compressed) {
+      const auto [err, recv_bytes] = co_await impl_->socket.async_read_some(
+          asio::buffer(data, size), use_nothrow_awaitable);
+      co_return std::make_pair(err, recv_bytes);
+    }
+    // A frame may arrive in several reads.
+    while (size > 0 && impl_->decoded_pos == impl_->decoded.size()) {
+      impl_->decoded.clear();
+      impl_->decoded_pos = 0;
+      const auto [err, recv_bytes] = co_await impl_->socket.async_read_some(
+          asio::buffer(impl_->read_buf), use_nothrow_awaitable);
+      if (err) {
+        co_return std::make_pair(err, 0);
+      }
+      if (!impl_->decoder.Decode(impl_->read_buf.data(), recv_bytes,
+                                 impl_->decoded)) {
+        co_return std::make_pair(error::Error::kInvalidTunnelFrame, 0);
+      }
+    }
+    const auto read_bytes =
+        std::min(size, impl_->decoded.size() - impl_->decoded_pos);
+    std::memcpy(data, impl_->decoded.data() + impl_->decoded_pos, read_bytes);
+    impl_->decoded_pos += read_bytes;
+    co_return std::make_pair(error::Error::kSucceeded, read_bytes);
+  } catch (...) {
+    co_return std::make_pair(error::Error::kGeneralFailure, 0);
+  }
+}
+
+}  // namespace socks5::client
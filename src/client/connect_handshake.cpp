@@ -9,9 +9,11 @@ namespace socks5::client {
 
 ConnectHandshake::ConnectHandshake(
     tcp::socket& socket, const common::Address& target_server_addr,
-    const auth::client::AuthOptions& auth_options) noexcept
+    const auth::client::AuthOptions& auth_options,
+    bool compressed_tunnel) noexcept
     : Handshake{socket, auth_options},
-      target_server_addr_{target_server_addr} {}
+      target_server_addr_{target_server_addr},
+      compressed_tunnel_{compressed_tunnel} {}
 
 ErrorAwait ConnectHandshake::ProcessRequest() noexcept {
   const auto request = common::MakeRequest(
@@ -24,13 +26,16 @@ ErrorAwait ConnectHandshake::ProcessRequest() noexcept {
   if (err) {
     co_return err;
   }
+  compressed_tunnel_accepted_ =
+      compressed_tunnel_selected_ &&
+      reply->rep == proto::ReplyRep::kReplyRepSuccess;
   co_return error::MakeError(reply->rep);
 }
 
 // Authentication and connection establishment with a socks5 proxy
 // server for tcp relay.
 ErrorAwait ConnectHandshake::Run() noexcept {
-  if (const auto err = co_await Auth()) {
+  if (const auto err = co_await Auth(compressed_tunnel_)) {
     co_return err;
   }
   if (const auto err = co_await ProcessRequest()) {
@@ -10,15 +10,22 @@ namespace socks5::client {
 
 class ConnectHandshake final : public Handshake, utils::NonCopyable {
  public:
+  // A compressed tunnel is asked for if compressed_tunnel is set.
   ConnectHandshake(tcp::socket& socket,
                    const common::Address& target_server_addr,
-                   const auth::client::AuthOptions& auth_options) noexcept;
+                   const auth::client::AuthOptions& auth_options,
+                   bool compressed_tunnel = false) noexcept;
   ErrorAwait Run() noexcept;
 
+  // Whether the server accepted the compressed tunnel.
+  bool CompressedTunnel() const noexcept { return compressed_tunnel_accepted_; }
+
  private:
   ErrorAwait ProcessRequest() noexcept;
 
   const common::Address& target_server_addr_;
+  const bool compressed_tunnel_;
+  bool compressed_tunnel_accepted_{false};
 };
 
 }  // namespace socks5::client
\ No newline at end of file
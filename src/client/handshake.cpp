@@ -47,19 +47,29 @@ ReplyOrErrorAwait Handshake::ReadReply() noexcept {
   co_return std::make_pair(error::Error::kSucceeded, parsers::ParseReply(buf));
 }
 
-ErrorAwait Handshake::Auth() noexcept {
+ErrorAwait Handshake::Auth(bool compressed_tunnel) noexcept {
   if (const auto err = co_await net::Send(
-          socket_,
-          serializers::Serialize(common::MakeClientGreeting(auth_options_)))) {
+          socket_, serializers::Serialize(common::MakeClientGreeting(
+                       auth_options_, compressed_tunnel)))) {
     co_return err;
   }
   const auto [err, server_choice] = co_await ReadServerChoice();
   if (err) {
     co_return err;
   }
-  if (server_choice->method == proto::AuthMethod::kAuthMethodNone) {
+  auto method = server_choice->method;
+  if (compressed_tunnel) {
+    if (method == proto::AuthMethod::kAuthMethodNoneCompressedTunnel) {
+      method = proto::AuthMethod::kAuthMethodNone;
+      compressed_tunnel_selected_ = true;
+    } else if (method == proto::AuthMethod::kAuthMethodUserCompressedTunnel) {
+      method = proto::AuthMethod::kAuthMethodUser;
+      compressed_tunnel_selected_ = true;
+    }
+  }
+  if (method == proto::AuthMethod::kAuthMethodNone) {
     co_return error::Error::kSucceeded;
-  } else if (server_choice->method == proto::AuthMethod::kAuthMethodUser) {
+  } else if (method == proto::AuthMethod::kAuthMethodUser) {
     const auto options = auth_options_.UserAuth();
     if (!options) {
       co_return error::Error::kGeneralFailure;
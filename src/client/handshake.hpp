@@ -22,7 +22,9 @@ class Handshake {
             const auth::client::AuthOptions& auth_options) noexcept;
 
   ReplyOrErrorAwait ReadReply() noexcept;
-  ErrorAwait Auth() noexcept;
+  // The compressed tunnel variants of the auth methods are offered if
+  // compressed_tunnel is set.
+  ErrorAwait Auth(bool compressed_tunnel = false) noexcept;
   ServerChoiceOrErrorAwait ReadServerChoice() noexcept;
 
   template <typename Buffer>
@@ -71,6 +73,8 @@ class Handshake {
  protected:
   tcp::socket& socket_;
   const auth::client::AuthOptions& auth_options_;
+  // Whether the server chose a compressed tunnel variant of an auth method.
+  bool compressed_tunnel_selected_{false};
 };
 
 }  // namespace socks5::client
\ No newline at end of file
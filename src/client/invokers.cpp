@@ -18,12 +18,21 @@
 
 namespace socks5::client {
 
+#ifndef SOCKS5_WITH_TLS
+// Declared for the parameter of RunConnectImpl, which is always null then.
+class TlsContext;
+#endif
+
 namespace {
 
-ErrorAwait RunConnectImpl(
-    tcp::socket& socket, const tcp::endpoint& proxy_server_ep,
-    const common::Address& target_server_addr,
-    const auth::client::AuthOptions& auth_options) noexcept {
+// A compressed tunnel is asked for if the tunnel isn't null. The connection
+// to the proxy is wrapped in TLS if tls isn't null.
+ErrorAwait RunConnectImpl(tcp::socket& socket,
+                          const tcp::endpoint& proxy_server_ep,
+                          const common::Address& target_server_addr,
+                          const auth::client::AuthOptions& auth_options,
+                          CompressedTunnel* tunnel = nullptr,
+                          TlsContext* tls = nullptr) noexcept {
   if (target_server_addr.IsEmpty()) {
     co_return error::Error::kInvalidAddress;
   }
@@ -32,10 +41,21 @@ ErrorAwait RunConnectImpl(
   if (err) {
     co_return err;
   }
-  ConnectHandshake handshake{socket, target_server_addr, auth_options};
+#ifdef SOCKS5_WITH_TLS
+  if (tls) {
+    if (const auto err = co_await tls->Handshake(socket)) {
+      co_return err;
+    }
+  }
+#endif
+  ConnectHandshake handshake{socket, target_server_addr, auth_options,
+                             tunnel != nullptr};
   if (const auto err = co_await handshake.Run()) {
     co_return err;
   }
+  if (tunnel) {
+    tunnel->Reset(handshake.CompressedTunnel());
+  }
   co_return error::Error::kSucceeded;
 }
 
@@ -43,11 +63,12 @@ ErrorAwait RunConnectImpl(tcp::socket& socket,
                           const tcp::endpoint& proxy_server_ep,
                           const common::Address& target_server_addr,
                           const auth::client::AuthOptions& auth_options,
-                          size_t timeout) noexcept {
+                          size_t timeout, CompressedTunnel* tunnel = nullptr,
+                          TlsContext* tls = nullptr) noexcept {
   try {
     const auto res =
         co_await (RunConnectImpl(socket, proxy_server_ep, target_server_addr,
-                                 auth_options) ||
+                                 auth_options, tunnel, tls) ||
                   utils::Timeout(timeout));
     if (res.index() == 1) {
       co_return error::Error::kTimeoutExpired;
@@ -292,6 +313,45 @@ ErrorAwait RunConnect(tcp::socket& socket, const tcp::endpoint& proxy_server_ep,
                                     auth_options);
 }
 
+ErrorAwait RunConnect(CompressedTunnel& tunnel,
+                      const tcp::endpoint& proxy_server_ep,
+                      const common::Address& target_server_addr,
+                      const auth::client::AuthOptions& auth_options,
+                      size_t timeout) noexcept {
+  co_return co_await RunConnectImpl(tunnel.Socket(), proxy_server_ep,
+                                    target_server_addr, auth_options, timeout,
+                                    &tunnel);
+}
+
+ErrorAwait RunConnect(CompressedTunnel& tunnel,
+                      const tcp::endpoint& proxy_server_ep,
+                      const common::Address& target_server_addr,
+                      const auth::client::AuthOptions& auth_options) noexcept {
+  co_return co_await RunConnectImpl(tunnel.Socket(), proxy_server_ep,
+                                    target_server_addr, auth_options, &tunnel);
+}
+
+#ifdef SOCKS5_WITH_TLS
+ErrorAwait RunConnect(tcp::socket& socket, TlsContext& tls,
+                      const tcp::endpoint& proxy_server_ep,
+                      const common::Address& target_server_addr,
+                      const auth::client::AuthOptions& auth_options,
+                      size_t timeout) noexcept {
+  co_return co_await RunConnectImpl(socket, proxy_server_ep,
+                                    target_server_addr, auth_options, timeout,
+                                    nullptr, &tls);
+}
+
+ErrorAwait RunConnect(tcp::socket& socket, TlsContext& tls,
+                      const tcp::endpoint& proxy_server_ep,
+                      const common::Address& target_server_addr,
+                      const auth::client::AuthOptions& auth_options) noexcept {
+  co_return co_await RunConnectImpl(socket, proxy_server_ep,
+                                    target_server_addr, auth_options, nullptr,
+                                    &tls);
+}
+#endif
+
 UdpAssociateResultOrErrorAwait RunUdpAssociate(
     tcp::socket& socket, const tcp::endpoint& proxy_server_ep,
     const auth::client::AuthOptions& auth_options) noexcept {
@@ -3,6 +3,8 @@
 #include <socks5/common/asio.hpp>
 #include <socks5/auth/client/auth_options.hpp>
 #include <socks5/client/defs.hpp>
+#include <socks5/client/compressed_tunnel.hpp>
+#include <socks5/client/tls_context.hpp>
 #include <client/udp_associate_handshake.hpp>
 #include <socks5/common/address.hpp>
 #include <socks5/common/datagram_buffer.hpp>
@@ -74,4 +76,26 @@ BytesCountOrErrorAwait RunReceiveFrom(udp::socket& socket,
                                       udp::endpoint& proxy_sender_ep,
                                       common::Address& sender_addr,
                                       common::DatagramBuffer& buf) noexcept;
+
+ErrorAwait RunConnect(CompressedTunnel& tunnel,
+                      const tcp::endpoint& proxy_server_ep,
+                      const common::Address& target_server_addr,
+                      const auth::client::AuthOptions& auth_options,
+                      size_t timeout) noexcept;
+ErrorAwait RunConnect(CompressedTunnel& tunnel,
+                      const tcp::endpoint& proxy_server_ep,
+                      const common::Address& target_server_addr,
+                      const auth::client::AuthOptions& auth_options) noexcept;
+
+#ifdef SOCKS5_WITH_TLS
+ErrorAwait RunConnect(tcp::socket& socket, TlsContext& tls,
+                      const tcp::endpoint& proxy_server_ep,
+                      const common::Address& target_server_addr,
+                      const auth::client::AuthOptions& auth_options,
+                      size_t timeout) noexcept;
+ErrorAwait RunConnect(tcp::socket& socket, TlsContext& tls,
+                      const tcp::endpoint& proxy_server_ep,
+                      const common::Address& target_server_addr,
+                      const auth::client::AuthOptions& auth_options) noexcept;
+#endif
 }  // namespace socks5::client
\ No newline at end of file
@@ -0,0 +1,32 @@
+#include <socks5/client/tls_context.hpp>
+#include <net/tls.hpp>
+
+namespace socks5::client {
+
+class TlsContext::Impl final {
+ public:
+  explicit Impl(net::TlsContextPtr context) noexcept
+      : context{std::move(context)} {}
+
+  net::TlsContextPtr context;
+};
+
+TlsContext::TlsContext(const std::string& ca_file, std::string server_name)
+    : impl_{std::make_unique<Impl>(
+          net::TlsContext::MakeClient(ca_file, std::move(server_name)))} {}
+
+TlsContext::TlsContext(NoVerification, std::string server_name)
+    : impl_{std::make_unique<Impl>(
+          net::TlsContext::MakeUnverifiedClient(std::move(server_name)))} {}
+
+TlsContext::~TlsContext() = default;
+
+uint64_t TlsContext::ResumedHandshakes() const noexcept {
+  return impl_->context->ResumedHandshakes();
+}
+
+ErrorAwait TlsContext::Handshake(tcp::socket& socket) noexcept {
+  co_return co_await impl_->context->Handshake(socket);
+}
+
+}  // namespace socks5::client
@@ -30,10 +30,60 @@ size_t Metrics::GetSentBytesTotal() const noexcept {
 #endif
 }
 
+void Metrics::AddUdpTargetServers(size_t num) noexcept {
+#ifndef SOCKS5_DISABLE_METRICS
+  udp_target_servers += num;
+#endif
+}
+
+void Metrics::RemoveUdpTargetServers(size_t num) noexcept {
+#ifndef SOCKS5_DISABLE_METRICS
+  udp_target_servers -= num;
+#endif
+}
+
+void Metrics::AddEvictedUdpTargetServers(size_t num) noexcept {
+#ifndef SOCKS5_DISABLE_METRICS
+  evicted_udp_target_servers_total += num;
+#endif
+}
+
+void Metrics::AddDroppedUdpDatagrams(size_t num) noexcept {
+#ifndef SOCKS5_DISABLE_METRICS
+  dropped_udp_datagrams_total += num;
+#endif
+}
+
+size_t Metrics::GetUdpTargetServers() const noexcept {
+#ifndef SOCKS5_DISABLE_METRICS
+  return udp_target_servers;
+#else
+  return 0;
+#endif
+}
+
+size_t Metrics::GetEvictedUdpTargetServersTotal() const noexcept {
+#ifndef SOCKS5_DISABLE_METRICS
+  return evicted_udp_target_servers_total;
+#else
+  return 0;
+#endif
+}
+
+size_t Metrics::GetDroppedUdpDatagramsTotal() const noexcept {
+#ifndef SOCKS5_DISABLE_METRICS
+  return dropped_udp_datagrams_total;
+#else
+  return 0;
+#endif
+}
+
 void Metrics::Clear() noexcept {
 #ifndef SOCKS5_DISABLE_METRICS
   recv_bytes_total = 0;
   sent_bytes_total = 0;
+  evicted_udp_target_servers_total = 0;
+  dropped_udp_datagrams_total = 0;
 #endif
 }
 
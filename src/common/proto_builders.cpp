@@ -61,17 +61,25 @@ proto::UserAuthRequest MakeUserAuthRequest(
 }
 
 proto::ClientGreeting MakeClientGreeting(
-    const auth::client::AuthOptions& options) noexcept {
+    const auth::client::AuthOptions& options, bool compressed_tunnel) noexcept {
   proto::ClientGreeting client_greeting;
   client_greeting.ver = proto::Version::kVersionVer5;
-  client_greeting.nmethods = options.Size();
   uint8_t i{};
   if (options.NoneAuth()) {
     client_greeting.methods[i++] = proto::AuthMethod::kAuthMethodNone;
   }
   if (options.UserAuth()) {
-    client_greeting.methods[i] = proto::AuthMethod::kAuthMethodUser;
+    client_greeting.methods[i++] = proto::AuthMethod::kAuthMethodUser;
   }
+  if (compressed_tunnel && options.NoneAuth()) {
+    client_greeting.methods[i++] =
+        proto::AuthMethod::kAuthMethodNoneCompressedTunnel;
+  }
+  if (compressed_tunnel && options.UserAuth()) {
+    client_greeting.methods[i++] =
+        proto::AuthMethod::kAuthMethodUserCompressedTunnel;
+  }
+  client_greeting.nmethods = i;
   return client_greeting;
 }
 
@@ -14,8 +14,11 @@ proto::Reply MakeReply(proto::ReplyRep reply_rep, uint8_t atyp,
                        unsigned short port = 0) noexcept;
 proto::Addr MakeAddr(const asio::ip::address& asio_addr, unsigned short port);
 proto::Addr MakeAddr(std::string_view domain, unsigned short port) noexcept;
+// The compressed tunnel variants of the methods are offered too if
+// compressed_tunnel is set.
 proto::ClientGreeting MakeClientGreeting(
-    const auth::client::AuthOptions& options) noexcept;
+    const auth::client::AuthOptions& options,
+    bool compressed_tunnel = false) noexcept;
 proto::UserAuthResponse MakeUserAuthResponse(
     proto::UserAuthStatus status) noexcept;
 proto::UserAuthRequest MakeUserAuthRequest(
@@ -0,0 +1,328 @@
+#include <common/tunnel_codec.hpp>
+#include <algorithm>
+#include <cstring>
+#include <optional>
+
+namespace socks5::common {
+
+namespace {
+
+constexpr size_t kMinMatch{4};
+// The LZ4 block format ends with literals, and its last match starts at
+// least kMatchFindLimit bytes before the end.
+constexpr size_t kLastLiterals{5};
+constexpr size_t kMatchFindLimit{12};
+constexpr size_t kHashBits{12};
+// Smaller blocks are sent raw.
+constexpr size_t kMinCompressSize{64};
+// A block is sent compressed if that saves at least 1/8 of it.
+constexpr size_t kMinSavingShift{3};
+constexpr size_t kMaxBackoffBlocks{64};
+
+uint32_t Read32(const uint8_t* data) noexcept {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+uint32_t Hash(uint32_t sequence) noexcept {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+class Writer final {
+ public:
+  Writer(uint8_t* data, size_t capacity) noexcept
+      : pos_{data}, end_{data + capacity} {}
+
+  bool Length(size_t length) noexcept {
+    for (; length >= 255; length -= 255) {
+      if (!Byte(255)) {
+        return false;
+      }
+    }
+    return Byte(static_cast<uint8_t>(length));
+  }
+
+  bool Byte(uint8_t byte) noexcept {
+    if (pos_ == end_) {
+      return false;
+    }
+    *pos_++ = byte;
+    return true;
+  }
+
+  bool Bytes(const uint8_t* data, size_t size) noexcept {
+    if (static_cast<size_t>(end_ - pos_) < size) {
+      return false;
+    }
+    std::memcpy(pos_, data, size);
+    pos_ += size;
+    return true;
+  }
+
+  uint8_t* Pos() const noexcept { return pos_; }
+
+ private:
+  uint8_t* pos_;
+  uint8_t* const end_;
+};
+
+bool WriteSequence(Writer& writer, const uint8_t* literals,
+                   size_t literals_size, size_t offset,
+                   size_t match_size) noexcept {
+  const auto token_literals = std::min<size_t>(literals_size, 15);
+  const auto token_match =
+      offset ? std::min<size_t>(match_size - kMinMatch, 15) : 0;
+  if (!writer.Byte(static_cast<uint8_t>(token_literals << 4 | token_match))) {
+    return false;
+  }
+  if (token_literals == 15 && !writer.Length(literals_size - 15)) {
+    return false;
+  }
+  if (!writer.Bytes(literals, literals_size)) {
+    return false;
+  }
+  if (!offset) {
+    return true;
+  }
+  if (!writer.Byte(static_cast<uint8_t>(offset)) ||
+      !writer.Byte(static_cast<uint8_t>(offset >> 8))) {
+    return false;
+  }
+  return token_match < 15 || writer.Length(match_size - kMinMatch - 15);
+}
+
+// Compresses a block of at most kTunnelMaxBlockSize bytes in the LZ4 block
+// format. Returns the compressed size, or 0 if it exceeds the capacity.
+size_t LzCompress(const uint8_t* src, size_t size, uint8_t* dst,
+                  size_t capacity, uint16_t* table) noexcept {
+  Writer writer{dst, capacity};
+  size_t anchor = 0;
+  if (size > kMatchFindLimit) {
+    std::fill_n(table, 1 << kHashBits, 0);
+    const auto find_limit = size - kMatchFindLimit;
+    const auto match_limit = size - kLastLiterals;
+    size_t pos = 1;
+    while (pos < find_limit) {
+      const auto sequence = Read32(src + pos);
+      auto& entry = table[Hash(sequence)];
+      size_t match = entry;
+      entry = static_cast<uint16_t>(pos);
+      if (match >= pos || Read32(src + match) != sequence) {
+        // Step faster through data without matches.
+        pos += 1 + ((pos - anchor) >> 6);
+        continue;
+      }
+      while (pos > anchor && match > 0 && src[pos - 1] == src[match - 1]) {
+        --pos;
+        --match;
+      }
+      auto match_size = kMinMatch;
+      while (pos + match_size < match_limit &&
+             src[match + match_size] == src[pos + match_size]) {
+        ++match_size;
+      }
+      if (!WriteSequence(writer, src + anchor, pos - anchor, pos - match,
+                         match_size)) {
+        return 0;
+      }
+      pos += match_size;
+      anchor = pos;
+      if (pos - 2 + sizeof(uint32_t) <= size) {
+        table[Hash(Read32(src + pos - 2))] = static_cast<uint16_t>(pos - 2);
+      }
+    }
+  }
+  if (!WriteSequence(writer, src + anchor, size - anchor, 0, 0)) {
+    return 0;
+  }
+  return static_cast<size_t>(writer.Pos() - dst);
+}
+
+std::optional<size_t> ReadLength(const uint8_t* src, size_t size,
+                                 size_t& pos) noexcept {
+  size_t length = 0;
+  for (;;) {
+    if (pos == size) {
+      return std::nullopt;
+    }
+    const auto byte = src[pos++];
+    length += byte;
+    if (byte != 255) {
+      return length;
+    }
+  }
+}
+
+// Returns false if the block is malformed or its decompressed size isn't
+// dst_size.
+bool LzDecompress(const uint8_t* src, size_t size, uint8_t* dst,
+                  size_t dst_size) noexcept {
+  size_t pos = 0;
+  size_t out = 0;
+  while (pos < size) {
+    const auto token = src[pos++];
+    size_t literals_size = token >> 4;
+    if (literals_size == 15) {
+      const auto length = ReadLength(src, size, pos);
+      if (!length) {
+        return false;
+      }
+      literals_size += *length;
+    }
+    if (literals_size > size - pos || literals_size > dst_size - out) {
+      return false;
+    }
+    // dst is null if the block is empty and the output was empty.
+    if (literals_size != 0) {
+      std::memcpy(dst + out, src + pos, literals_size);
+    }
+    pos += literals_size;
+    out += literals_size;
+    if (pos == size) {
+      break;
+    }
+    if (size - pos < 2) {
+      return false;
+    }
+    const size_t offset = src[pos] | src[pos + 1] << 8;
+    pos += 2;
+    if (offset == 0 || offset > out) {
+      return false;
+    }
+    size_t match_size = token & 0x0f;
+    if (match_size == 15) {
+      const auto length = ReadLength(src, size, pos);
+      if (!length) {
+        return false;
+      }
+      match_size += *length;
+    }
+    match_size += kMinMatch;
+    if (match_size > dst_size - out) {
+      return false;
+    }
+    // The match may overlap the bytes it produces.
+    const auto* from = dst + out - offset;
+    if (offset >= match_size) {
+      std::memcpy(dst + out, from, match_size);
+    } else {
+      for (size_t i = 0; i < match_size; ++i) {
+        dst[out + i] = from[i];
+      }
+    }
+    out += match_size;
+  }
+  return out == dst_size;
+}
+
+void WriteHeader(TunnelFrameType type, size_t stored_size,
+                 size_t original_size, char* header) noexcept {
+  header[0] = static_cast<char>(type);
+  header[1] = static_cast<char>(stored_size >> 8);
+  header[2] = static_cast<char>(stored_size);
+  header[3] = static_cast<char>(original_size >> 8);
+  header[4] = static_cast<char>(original_size);
+}
+
+// Decodes the whole frames at the start of the data. Returns the number of
+// bytes consumed or nullopt if a frame is malformed.
+std::optional<size_t> DecodeFrames(const uint8_t* data, size_t size,
+                                   std::vector<char>& out) {
+  size_t pos = 0;
+  while (size - pos >= kTunnelFrameHeaderSize) {
+    const auto* header = data + pos;
+    const auto type = static_cast<TunnelFrameType>(header[0]);
+    const size_t stored_size = header[1] << 8 | header[2];
+    const size_t original_size = header[3] << 8 | header[4];
+    if (original_size > kTunnelMaxBlockSize ||
+        (type == TunnelFrameType::kRaw && stored_size != original_size) ||
+        (type != TunnelFrameType::kRaw && type != TunnelFrameType::kLz)) {
+      return std::nullopt;
+    }
+    if (size - pos - kTunnelFrameHeaderSize < stored_size) {
+      break;
+    }
+    const auto* payload = header + kTunnelFrameHeaderSize;
+    const auto out_size = out.size();
+    out.resize(out_size + original_size);
+    auto* dst = reinterpret_cast<uint8_t*>(out.data() + out_size);
+    if (type == TunnelFrameType::kRaw) {
+      // out may still be empty, then dst is null.
+      if (stored_size != 0) {
+        std::memcpy(dst, payload, stored_size);
+      }
+    } else if (!LzDecompress(payload, stored_size, dst, original_size)) {
+      return std::nullopt;
+    }
+    pos += kTunnelFrameHeaderSize + stored_size;
+  }
+  return pos;
+}
+
+}  // namespace
+
+TunnelEncoder::TunnelEncoder() noexcept : table_{} {}
+
+void TunnelEncoder::Encode(const char* data, size_t size,
+                           std::vector<char>& out) {
+  const auto out_size = out.size();
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+  for (size_t pos = 0; pos < size; pos += kTunnelMaxBlockSize) {
+    EncodeBlock(bytes + pos, std::min(size - pos, kTunnelMaxBlockSize), out);
+  }
+  in_bytes_ += size;
+  out_bytes_ += out.size() - out_size;
+}
+
+void TunnelEncoder::EncodeBlock(const uint8_t* data, size_t size,
+                                std::vector<char>& out) {
+  static_assert(std::tuple_size_v<decltype(table_)> == 1 << kHashBits);
+  const auto header_pos = out.size();
+  if (size >= kMinCompressSize && skip_blocks_ == 0) {
+    const auto capacity = size - (size >> kMinSavingShift);
+    out.resize(header_pos + kTunnelFrameHeaderSize + capacity);
+    const auto compressed_size = LzCompress(
+        data, size,
+        reinterpret_cast<uint8_t*>(out.data() + header_pos +
+                                   kTunnelFrameHeaderSize),
+        capacity, table_.data());
+    if (compressed_size) {
+      out.resize(header_pos + kTunnelFrameHeaderSize + compressed_size);
+      WriteHeader(TunnelFrameType::kLz, compressed_size, size,
+                  out.data() + header_pos);
+      backoff_ = 0;
+      return;
+    }
+    backoff_ = std::min(std::max<size_t>(backoff_ * 2, 1), kMaxBackoffBlocks);
+    skip_blocks_ = backoff_;
+  } else if (skip_blocks_ > 0) {
+    --skip_blocks_;
+  }
+  out.resize(header_pos + kTunnelFrameHeaderSize + size);
+  WriteHeader(TunnelFrameType::kRaw, size, size, out.data() + header_pos);
+  std::memcpy(out.data() + header_pos + kTunnelFrameHeaderSize, data, size);
+}
+
+bool TunnelDecoder::Decode(const char* data, size_t size,
+                           std::vector<char>& out) {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+  if (pending_.empty()) {
+    const auto consumed = DecodeFrames(bytes, size, out);
+    if (!consumed) {
+      return false;
+    }
+    pending_.assign(bytes + *consumed, bytes + size);
+    return true;
+  }
+  pending_.insert(pending_.end(), bytes, bytes + size);
+  const auto consumed = DecodeFrames(pending_.data(), pending_.size(), out);
+  if (!consumed) {
+    return false;
+  }
+  pending_.erase(pending_.begin(),
+                 pending_.begin() + static_cast<ptrdiff_t>(*consumed));
+  return true;
+}
+
+}  // namespace socks5::common
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace socks5::common {
+
+// The stream of a compressed tunnel is a sequence of frames:
+// type(1 byte), stored size(2 bytes), original size(2 bytes), payload.
+// The sizes are in network byte order. A raw frame stores the data as is, an
+// lz frame stores it in the LZ4 block format. Every frame is compressed on its
+// own, so a frame is decoded as soon as it's received.
+constexpr size_t kTunnelFrameHeaderSize{5};
+constexpr size_t kTunnelMaxBlockSize{32768};
+
+enum class TunnelFrameType : uint8_t {
+  kRaw = 0,
+  kLz = 1,
+};
+
+// Splits data into frames and compresses those for which it pays. After a
+// block doesn't compress, the next ones are sent raw without trying, for a
+// number of blocks doubled on every failure, so incompressible streams, e.g.
+// TLS, cost almost nothing.
+class TunnelEncoder final {
+ public:
+  TunnelEncoder() noexcept;
+
+  // Appends the frames of the data to out.
+  void Encode(const char* data, size_t size, std::vector<char>& out);
+
+  // Bytes passed to Encode() and bytes of the frames made of them.
+  uint64_t InBytes() const noexcept { return in_bytes_; }
+  uint64_t OutBytes() const noexcept { return out_bytes_; }
+
+ private:
+  void EncodeBlock(const uint8_t* data, size_t size, std::vector<char>& out);
+
+  std::array<uint16_t, 4096> table_;
+  size_t skip_blocks_{0};
+  size_t backoff_{0};
+  uint64_t in_bytes_{0};
+  uint64_t out_bytes_{0};
+};
+
+class TunnelDecoder final {
+ public:
+  // Appends the data decoded from the next bytes of the stream to out. A frame
+  // split between the calls is kept until its rest is received. Returns false
+  // if the stream is malformed.
+  bool Decode(const char* data, size_t size, std::vector<char>& out);
+
+ private:
+  std::vector<uint8_t> pending_;
+};
+
+}  // namespace socks5::common
@@ -60,6 +60,15 @@ std::string ErrorCategory::message(int ev) const {
     case Error::kInvalidAddress: {
       return "Invalid address";
     }
+    case Error::kInvalidTunnelFrame: {
+      return "Invalid compressed tunnel frame";
+    }
+    case Error::kTlsHandshakeFailure: {
+      return "TLS handshake failure";
+    }
+    case Error::kKernelTlsNotAvailable: {
+      return "Kernel TLS is not available";
+    }
   }
   return "Unrecognized error";
 }
@@ -0,0 +1,29 @@
+#include <net/tcp_info.hpp>
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace socks5::net {
+
+server::TcpInfoOpt GetTcpInfo(tcp::socket& socket) noexcept {
+#ifdef __linux__
+  if (!socket.is_open()) {
+    return std::nullopt;
+  }
+  tcp_info info{};
+  socklen_t len = sizeof(info);
+  if (::getsockopt(socket.native_handle(), IPPROTO_TCP, TCP_INFO, &info,
+                   &len) != 0) {
+    return std::nullopt;
+  }
+  return server::TcpInfo{info.tcpi_rtt, info.tcpi_rttvar,
+                         info.tcpi_total_retrans, info.tcpi_lost,
+                         info.tcpi_snd_cwnd};
+#else
+  return std::nullopt;
+#endif
+}
+
+}  // namespace socks5::net
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <socks5/common/asio.hpp>
+#include <socks5/server/flow_record.hpp>
+
+namespace socks5::net {
+
+// Samples TCP_INFO of the socket. Returns std::nullopt if the socket is closed
+// or the platform doesn't support TCP_INFO.
+server::TcpInfoOpt GetTcpInfo(tcp::socket& socket) noexcept;
+
+}  // namespace socks5::net
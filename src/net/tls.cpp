@@ -0,0 +1,218 @@
+#include <net/tls.hpp>
+#include <socks5/error/error.hpp>
+#include <utils/logger.hpp>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <array>
+#include <stdexcept>
+
+namespace socks5::net {
+
+namespace {
+
+// Ciphers the kernel encrypts.
+constexpr auto kCipherList = "ECDHE+AESGCM:ECDHE+CHACHA20";
+
+using CtxPtr = std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)>;
+
+struct SslDeleter {
+  void operator()(SSL* ssl) const noexcept {
+    // OpenSSL marks the session of a connection freed without a shutdown as
+    // not resumable. No close_notify is sent, the socket is closed by its
+    // owner.
+    SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    SSL_free(ssl);
+  }
+};
+
+using SslPtr = std::unique_ptr<SSL, SslDeleter>;
+
+std::string LastError() {
+  std::array<char, 256> buf{};
+  ERR_error_string_n(ERR_get_error(), buf.data(), buf.size());
+  return buf.data();
+}
+
+[[noreturn]] void ThrowLastError(const std::string& msg) {
+  throw std::runtime_error{msg + ". " + LastError()};
+}
+
+CtxPtr MakeCtx(const SSL_METHOD* method) {
+  CtxPtr ctx{SSL_CTX_new(method), &SSL_CTX_free};
+  if (!ctx) {
+    ThrowLastError("Error creating TLS context");
+  }
+  SSL_CTX_set_min_proto_version(ctx.get(), TLS1_2_VERSION);
+  SSL_CTX_set_max_proto_version(ctx.get(), TLS1_2_VERSION);
+  auto options = SSL_OP_NO_RENEGOTIATION;
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS)
+  options |= SSL_OP_ENABLE_KTLS;
+#endif
+  SSL_CTX_set_options(ctx.get(), options);
+  if (SSL_CTX_set_cipher_list(ctx.get(), kCipherList) != 1) {
+    ThrowLastError("Error setting TLS ciphers");
+  }
+  return ctx;
+}
+
+// Both directions must be in kTLS, otherwise the plain io of the socket would
+// bypass the encryption. kTLS is used on Linux only, elsewhere the handshakes
+// fail with kKernelTlsNotAvailable.
+bool KernelTlsEnabled(SSL* ssl) noexcept {
+#if defined(__linux__) && defined(BIO_get_ktls_send) && \
+    defined(BIO_get_ktls_recv)
+  return BIO_get_ktls_send(SSL_get_wbio(ssl)) &&
+         BIO_get_ktls_recv(SSL_get_rbio(ssl));
+#else
+  return false;
+#endif
+}
+
+// OpenSSL does the io of the handshake on the socket itself, the coroutine
+// only waits for the socket to become ready.
+ErrorAwait RunHandshake(tcp::socket& socket, SSL* ssl) noexcept {
+  for (;;) {
+    ERR_clear_error();
+    const auto res = SSL_do_handshake(ssl);
+    if (res == 1) {
+      co_return error::Error::kSucceeded;
+    }
+    const auto ssl_err = SSL_get_error(ssl, res);
+    if (ssl_err != SSL_ERROR_WANT_READ && ssl_err != SSL_ERROR_WANT_WRITE) {
+      SOCKS5_LOG(debug, "TLS handshake failure. msg={}", LastError());
+      co_return error::Error::kTlsHandshakeFailure;
+    }
+    const auto [err] = co_await socket.async_wait(
+        ssl_err == SSL_ERROR_WANT_READ ? tcp::socket::wait_read
+                                       : tcp::socket::wait_write,
+        use_nothrow_awaitable);
+    if (err) {
+      co_return err;
+    }
+  }
+}
+
+}  // namespace
+
+void TlsContext::CtxDeleter::operator()(ssl_ctx_st* ctx) const noexcept {
+  SSL_CTX_free(ctx);
+}
+
+void TlsContext::SessionDeleter::operator()(
+    ssl_session_st* session) const noexcept {
+  SSL_SESSION_free(session);
+}
+
+std::unique_ptr<TlsContext> TlsContext::MakeServer(
+    const std::string& cert_chain_file, const std::string& private_key_file,
+    size_t session_timeout) {
+  auto ctx = MakeCtx(TLS_server_method());
+  if (SSL_CTX_use_certificate_chain_file(ctx.get(), cert_chain_file.c_str()) !=
+      1) {
+    ThrowLastError("Error loading TLS certificate chain " + cert_chain_file);
+  }
+  if (SSL_CTX_use_PrivateKey_file(ctx.get(), private_key_file.c_str(),
+                                  SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(ctx.get()) != 1) {
+    ThrowLastError("Error loading TLS private key " + private_key_file);
+  }
+  // Sessions are resumed with stateless session tickets, so the server
+  // threads don't share a session cache.
+  SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_OFF);
+  SSL_CTX_set_timeout(ctx.get(), static_cast<long>(session_timeout));
+  return std::unique_ptr<TlsContext>{
+      new TlsContext{ctx.release(), true, std::string{}}};
+}
+
+std::unique_ptr<TlsContext> TlsContext::MakeClient(const std::string& ca_file,
+                                                   std::string server_name) {
+  auto ctx = MakeCtx(TLS_client_method());
+  if (ca_file.empty()) {
+    if (SSL_CTX_set_default_verify_paths(ctx.get()) != 1) {
+      ThrowLastError("Error loading default TLS CA certificates");
+    }
+  } else if (SSL_CTX_load_verify_locations(ctx.get(), ca_file.c_str(),
+                                           nullptr) != 1) {
+    ThrowLastError("Error loading TLS CA certificates " + ca_file);
+  }
+  SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_PEER, nullptr);
+  return std::unique_ptr<TlsContext>{
+      new TlsContext{ctx.release(), false, std::move(server_name)}};
+}
+
+std::unique_ptr<TlsContext> TlsContext::MakeUnverifiedClient(
+    std::string server_name) {
+  auto ctx = MakeCtx(TLS_client_method());
+  SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_NONE, nullptr);
+  return std::unique_ptr<TlsContext>{
+      new TlsContext{ctx.release(), false, std::move(server_name)}};
+}
+
+TlsContext::TlsContext(ssl_ctx_st* ctx, bool server,
+                       std::string server_name) noexcept
+    : ctx_{ctx}, server_{server}, server_name_{std::move(server_name)} {}
+
+TlsContext::~TlsContext() = default;
+
+ErrorAwait TlsContext::Handshake(tcp::socket& socket) noexcept {
+  try {
+    SslPtr ssl{SSL_new(ctx_.get())};
+    if (!ssl || SSL_set_fd(ssl.get(), socket.native_handle()) != 1) {
+      SOCKS5_LOG(error, "Error creating TLS connection. msg={}", LastError());
+      co_return error::Error::kTlsHandshakeFailure;
+    }
+    boost::system::error_code err;
+    socket.native_non_blocking(true, err);
+    if (err) {
+      co_return err;
+    }
+    if (server_) {
+      SSL_set_accept_state(ssl.get());
+    } else {
+      SSL_set_connect_state(ssl.get());
+      if (!server_name_.empty() &&
+          (SSL_set_tlsext_host_name(ssl.get(), server_name_.c_str()) != 1 ||
+           SSL_set1_host(ssl.get(), server_name_.c_str()) != 1)) {
+        co_return error::Error::kTlsHandshakeFailure;
+      }
+      if (const auto session = GetSession()) {
+        SSL_set_session(ssl.get(), session.get());
+      }
+    }
+    err = co_await RunHandshake(socket, ssl.get());
+    if (err) {
+      co_return err;
+    }
+    if (SSL_session_reused(ssl.get())) {
+      resumed_handshakes_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!server_) {
+      SetSession(SessionPtr{SSL_get1_session(ssl.get())});
+    }
+    if (!KernelTlsEnabled(ssl.get())) {
+      co_return error::Error::kKernelTlsNotAvailable;
+    }
+    co_return error::Error::kSucceeded;
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "TLS handshake exception. {}", ex.what());
+    co_return error::Error::kTlsHandshakeFailure;
+  }
+}
+
+TlsContext::SessionPtr TlsContext::GetSession() noexcept {
+  std::lock_guard lk{session_mtx_};
+  if (!session_ || SSL_SESSION_up_ref(session_.get()) != 1) {
+    return nullptr;
+  }
+  return SessionPtr{session_.get()};
+}
+
+void TlsContext::SetSession(SessionPtr session) noexcept {
+  if (!session) {
+    return;
+  }
+  std::lock_guard lk{session_mtx_};
+  session_ = std::move(session);
+}
+
+}  // namespace socks5::net
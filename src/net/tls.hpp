@@ -0,0 +1,75 @@
+#pragma once
+
+#include <socks5/common/asio.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct ssl_ctx_st;
+struct ssl_session_st;
+
+namespace socks5::net {
+
+// OpenSSL context of socks5 over TLS. After the handshake the connection is
+// moved to kernel TLS(kTLS): the kernel encrypts and decrypts the records, so
+// the socket is used as a plain one by the handshake and the relays. Only TLS
+// 1.2 is negotiated, since TLS 1.3 sends session tickets and key updates after
+// the handshake in records on which plain reads of a kTLS socket fail.
+class TlsContext final : utils::NonCopyable {
+ public:
+  // Throw std::runtime_error if the certificates or the key can't be loaded.
+  static std::unique_ptr<TlsContext> MakeServer(
+      const std::string& cert_chain_file, const std::string& private_key_file,
+      size_t session_timeout);
+  // The server certificate is verified with the CA certificates of ca_file,
+  // or with the default ones of OpenSSL if it's empty. A non-empty
+  // server_name is sent in SNI and verified against the certificate.
+  static std::unique_ptr<TlsContext> MakeClient(const std::string& ca_file,
+                                                std::string server_name);
+  // Accepts any server certificate. For testing or networks where the proxy
+  // is trusted anyway.
+  static std::unique_ptr<TlsContext> MakeUnverifiedClient(
+      std::string server_name);
+
+  ~TlsContext();
+
+  // Runs the handshake on the connected socket and enables kTLS on it. The
+  // client resumes the session of its last handshake. Fails with
+  // kKernelTlsNotAvailable if kTLS can't be enabled, the socket must not be
+  // used then.
+  ErrorAwait Handshake(tcp::socket& socket) noexcept;
+
+  // Number of handshakes that resumed a session.
+  uint64_t ResumedHandshakes() const noexcept {
+    return resumed_handshakes_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct CtxDeleter {
+    void operator()(ssl_ctx_st* ctx) const noexcept;
+  };
+  struct SessionDeleter {
+    void operator()(ssl_session_st* session) const noexcept;
+  };
+  using SessionPtr = std::unique_ptr<ssl_session_st, SessionDeleter>;
+
+  TlsContext(ssl_ctx_st* ctx, bool server, std::string server_name) noexcept;
+
+  SessionPtr GetSession() noexcept;
+  void SetSession(SessionPtr session) noexcept;
+
+  std::unique_ptr<ssl_ctx_st, CtxDeleter> ctx_;
+  const bool server_;
+  const std::string server_name_;
+  // The session resumed by the next handshake of the client.
+  std::mutex session_mtx_;
+  SessionPtr session_;
+  std::atomic_uint64_t resumed_handshakes_{0};
+};
+
+using TlsContextPtr = std::unique_ptr<TlsContext>;
+
+}  // namespace socks5::net
@@ -0,0 +1,297 @@
+#include <net/udp_batch.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <span>
+#ifdef __linux__
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#endif
+
+#ifdef __linux__
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+namespace socks5::net {
+
+namespace {
+
+// Max payload of an IPv4 udp packet, a GSO packet can't be bigger.
+constexpr size_t kMaxSegmentationBytes{65507};
+
+}  // namespace
+
+#ifdef __linux__
+
+bool EnableUdpGro(udp::socket& socket) noexcept {
+  const int enable{1};
+  return ::setsockopt(socket.native_handle(), SOL_UDP, UDP_GRO, &enable,
+                      sizeof(enable)) == 0;
+}
+
+#else
+
+bool EnableUdpGro(udp::socket&) noexcept { return false; }
+
+#endif
+
+UdpRecvBatch::UdpRecvBatch(size_t capacity, size_t datagram_size, bool gro)
+    : capacity_{std::max<size_t>(capacity, 1)},
+      datagram_size_{datagram_size},
+      gro_{gro},
+      data_{std::make_unique<char[]>(capacity_ * datagram_size_)},
+      senders_(capacity_) {
+  datagrams_.reserve(gro_ ? capacity_ * kUdpMaxSegments : capacity_);
+#ifdef __linux__
+  msgs_.resize(capacity_);
+  iovs_.resize(capacity_);
+  if (gro_) {
+    controls_.resize(capacity_);
+  }
+  for (size_t i = 0; i < capacity_; ++i) {
+    iovs_[i].iov_base = data_.get() + i * datagram_size_;
+    iovs_[i].iov_len = datagram_size_;
+  }
+#endif
+}
+
+#ifdef __linux__
+
+size_t UdpRecvBatch::TryReceive(udp::socket& socket,
+                                boost::system::error_code& err) noexcept {
+  datagrams_.clear();
+  bytes_ = 0;
+  truncated_ = 0;
+  for (size_t i = 0; i < capacity_; ++i) {
+    auto& hdr = msgs_[i].msg_hdr;
+    hdr = {};
+    hdr.msg_name = senders_[i].data();
+    hdr.msg_namelen = static_cast<socklen_t>(senders_[i].capacity());
+    hdr.msg_iov = &iovs_[i];
+    hdr.msg_iovlen = 1;
+    if (gro_) {
+      hdr.msg_control = controls_[i].data;
+      hdr.msg_controllen = sizeof(controls_[i].data);
+    }
+    msgs_[i].msg_len = 0;
+  }
+  const auto received =
+      ::recvmmsg(socket.native_handle(), msgs_.data(),
+                 static_cast<unsigned int>(capacity_), MSG_DONTWAIT, nullptr);
+  if (received < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      err.assign(errno, boost::system::system_category());
+    }
+    return 0;
+  }
+  for (size_t i = 0; i < static_cast<size_t>(received); ++i) {
+    auto& hdr = msgs_[i].msg_hdr;
+    if (hdr.msg_flags & MSG_TRUNC) {
+      ++truncated_;
+      continue;
+    }
+    senders_[i].resize(hdr.msg_namelen);
+    auto* data = static_cast<char*>(iovs_[i].iov_base);
+    const size_t length = msgs_[i].msg_len;
+    bytes_ += length;
+    size_t segment_size{length};
+    if (gro_) {
+      for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg;
+           cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+          int gso_size{};
+          std::memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+          if (gso_size > 0) {
+            segment_size = static_cast<size_t>(gso_size);
+          }
+        }
+      }
+    }
+    if (length == 0) {
+      datagrams_.push_back({data, 0, i});
+      continue;
+    }
+    for (size_t offset = 0; offset < length; offset += segment_size) {
+      datagrams_.push_back(
+          {data + offset, std::min(segment_size, length - offset), i});
+    }
+  }
+  return datagrams_.size();
+}
+
+#else
+
+size_t UdpRecvBatch::TryReceive(udp::socket& socket,
+                                boost::system::error_code& err) noexcept {
+  datagrams_.clear();
+  bytes_ = 0;
+  truncated_ = 0;
+  socket.non_blocking(true, err);
+  if (err) {
+    return 0;
+  }
+  const auto received = socket.receive_from(
+      asio::buffer(data_.get(), datagram_size_), senders_[0], 0, err);
+  if (err == asio::error::would_block) {
+    err.clear();
+    return 0;
+  }
+  if (err == asio::error::message_size) {
+    err.clear();
+    truncated_ = 1;
+    return 0;
+  }
+  if (err) {
+    return 0;
+  }
+  datagrams_.push_back({data_.get(), received, 0});
+  bytes_ = received;
+  return datagrams_.size();
+}
+
+#endif
+
+UdpSendBatch::UdpSendBatch(size_t capacity, bool segmentation)
+    : capacity_{std::max<size_t>(capacity, 1)},
+      segmentation_{segmentation},
+      buffs_(capacity_),
+      buffs_num_(capacity_),
+      sizes_(capacity_) {
+  eps_.reserve(capacity_);
+#ifdef __linux__
+  msgs_.resize(capacity_);
+  iovs_.resize(capacity_ * kMaxBuffers);
+  msg_datagrams_.resize(capacity_);
+  if (segmentation_) {
+    controls_.resize(capacity_);
+  }
+#endif
+}
+
+size_t UdpSendBatch::SegmentsNum(size_t index) const noexcept {
+  const auto segment_size = sizes_[index];
+  if (!segmentation_ || segment_size == 0) {
+    return 1;
+  }
+  size_t num{1};
+  size_t bytes{segment_size};
+  for (auto next = index + 1; next < eps_.size() && num < kUdpMaxSegments;
+       ++next) {
+    if (eps_[next] != eps_[index] &&
+        (!eps_[next] || !eps_[index] || *eps_[next] != *eps_[index])) {
+      break;
+    }
+    // Every segment but the last one must be of the same size.
+    const auto size = sizes_[next];
+    if (size == 0 || size > segment_size ||
+        bytes + size > kMaxSegmentationBytes) {
+      break;
+    }
+    bytes += size;
+    ++num;
+    if (size < segment_size) {
+      break;
+    }
+  }
+  return num;
+}
+
+#ifdef __linux__
+
+size_t UdpSendBatch::TrySend(udp::socket& socket, size_t first,
+                             boost::system::error_code& err) noexcept {
+  assert(first < eps_.size());
+  size_t msgs_num{0};
+  size_t iovs_num{0};
+  bool segmented{false};
+  for (auto index = first; index < eps_.size(); ++msgs_num) {
+    const auto segments_num = SegmentsNum(index);
+    auto& hdr = msgs_[msgs_num].msg_hdr;
+    hdr = {};
+    if (eps_[index]) {
+      hdr.msg_name = const_cast<sockaddr*>(eps_[index]->data());
+      hdr.msg_namelen = static_cast<socklen_t>(eps_[index]->size());
+    }
+    hdr.msg_iov = &iovs_[iovs_num];
+    // The socks5 header and the payload of every segment are adjacent in the
+    // iovec array, so the kernel splits the packet into complete datagrams.
+    for (size_t i = 0; i < segments_num; ++i) {
+      const auto& buffs = buffs_[index + i];
+      for (size_t j = 0; j < buffs_num_[index + i]; ++j) {
+        iovs_[iovs_num].iov_base = const_cast<void*>(buffs[j].data());
+        iovs_[iovs_num].iov_len = buffs[j].size();
+        ++iovs_num;
+        ++hdr.msg_iovlen;
+      }
+    }
+    if (segments_num > 1) {
+      auto& control = controls_[msgs_num];
+      hdr.msg_control = control.data;
+      hdr.msg_controllen = sizeof(control.data);
+      auto* cmsg = CMSG_FIRSTHDR(&hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      const auto segment_size = static_cast<uint16_t>(sizes_[index]);
+      std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+      segmented = true;
+    }
+    msgs_[msgs_num].msg_len = 0;
+    msg_datagrams_[msgs_num] = segments_num;
+    index += segments_num;
+  }
+  const auto sent = ::sendmmsg(socket.native_handle(), msgs_.data(),
+                               static_cast<unsigned int>(msgs_num),
+                               MSG_DONTWAIT);
+  if (sent < 0) {
+    // The kernel or the device doesn't support GSO for the packet.
+    if (segmented && (errno == EIO || errno == EINVAL)) {
+      segmentation_ = false;
+      return TrySend(socket, first, err);
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      err.assign(errno, boost::system::system_category());
+    }
+    return 0;
+  }
+  size_t sent_datagrams{0};
+  for (size_t i = 0; i < static_cast<size_t>(sent); ++i) {
+    sent_datagrams += msg_datagrams_[i];
+  }
+  return sent_datagrams;
+}
+
+#else
+
+size_t UdpSendBatch::TrySend(udp::socket& socket, size_t first,
+                             boost::system::error_code& err) noexcept {
+  assert(first < eps_.size());
+  socket.non_blocking(true, err);
+  if (err) {
+    return 0;
+  }
+  const std::span buffs{buffs_[first].data(), buffs_num_[first]};
+  if (eps_[first]) {
+    socket.send_to(buffs, *eps_[first], 0, err);
+  } else {
+    socket.send(buffs, 0, err);
+  }
+  if (err == asio::error::would_block) {
+    err.clear();
+    return 0;
+  }
+  return err ? 0 : 1;
+}
+
+#endif
+
+}  // namespace socks5::net
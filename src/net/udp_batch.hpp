@@ -0,0 +1,182 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <memory>
+#include <vector>
+#include <socks5/common/asio.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+namespace socks5::net {
+
+// Max number of datagrams coalesced into one UDP GSO/GRO packet by the kernel.
+constexpr size_t kUdpMaxSegments{64};
+
+// Enables UDP_GRO on the socket, so the kernel may coalesce datagrams of a
+// flow into one packet. Returns false if GRO isn't supported.
+bool EnableUdpGro(udp::socket& socket) noexcept;
+
+// Datagrams received from a udp socket with one recvmmsg() call. Every
+// received packet gets a slot of a fixed size. Packets that don't fit into a
+// slot are truncated by the kernel, so they are dropped. With GRO a packet may
+// carry several datagrams of a flow, they are split back into datagrams. On
+// other platforms one datagram is received per call.
+class UdpRecvBatch final : utils::NonCopyable {
+ public:
+  UdpRecvBatch(size_t capacity, size_t datagram_size, bool gro = false);
+
+  size_t Capacity() const noexcept { return capacity_; }
+  size_t DatagramSize() const noexcept { return datagram_size_; }
+  // Number of received datagrams. May be bigger than the capacity with GRO.
+  size_t Size() const noexcept { return datagrams_.size(); }
+  // Total number of bytes of the received datagrams.
+  size_t Bytes() const noexcept { return bytes_; }
+  // Number of packets dropped by the last receive since they didn't fit into
+  // a slot.
+  size_t Truncated() const noexcept { return truncated_; }
+
+  char* Data(size_t index) noexcept { return datagrams_[index].data; }
+
+  size_t Length(size_t index) const noexcept {
+    return datagrams_[index].length;
+  }
+
+  const udp::endpoint& Sender(size_t index) const noexcept {
+    return senders_[datagrams_[index].slot];
+  }
+
+  // Receives the available datagrams without blocking. Returns the number of
+  // received datagrams, 0 if there are none, all of them were truncated or on
+  // error.
+  size_t TryReceive(udp::socket& socket,
+                    boost::system::error_code& err) noexcept;
+
+ private:
+  struct Datagram final {
+    char* data;
+    size_t length;
+    // Slot of the packet that carried the datagram.
+    size_t slot;
+  };
+
+  const size_t capacity_;
+  const size_t datagram_size_;
+  const bool gro_;
+  size_t bytes_{};
+  size_t truncated_{};
+  std::unique_ptr<char[]> data_;
+  std::vector<Datagram> datagrams_;
+  std::vector<udp::endpoint> senders_;
+#ifdef __linux__
+  struct alignas(cmsghdr) Control final {
+    char data[CMSG_SPACE(sizeof(int))];
+  };
+
+  std::vector<mmsghdr> msgs_;
+  std::vector<iovec> iovs_;
+  std::vector<Control> controls_;
+#endif
+};
+
+// Datagrams sent to a udp socket with one sendmmsg() call. A datagram is
+// gathered from up to kMaxBuffers buffers, e.g. a socks5 header and the
+// payload. The batch doesn't own the data and the endpoints, they must stay
+// valid until the batch is sent. Datagrams added without an endpoint are sent
+// to the peer of a connected socket. With segmentation runs of same-sized
+// datagrams to the same endpoint are sent as one UDP GSO packet. On other
+// platforms one datagram is sent per call.
+class UdpSendBatch final : utils::NonCopyable {
+ public:
+  static constexpr size_t kMaxBuffers{3};
+
+  explicit UdpSendBatch(size_t capacity, bool segmentation = false);
+
+  size_t Capacity() const noexcept { return capacity_; }
+  size_t Size() const noexcept { return eps_.size(); }
+  bool Empty() const noexcept { return eps_.empty(); }
+  bool Full() const noexcept { return eps_.size() == capacity_; }
+  // Total number of bytes of the datagrams in the batch.
+  size_t Bytes() const noexcept { return bytes_; }
+  // Segmentation is turned off if the kernel rejects a GSO packet.
+  bool Segmentation() const noexcept { return segmentation_; }
+
+  // The last buffer of a datagram is its payload.
+  size_t PayloadSize(size_t index) const noexcept {
+    return buffs_[index][buffs_num_[index] - 1].size();
+  }
+
+  void Add(const udp::endpoint& ep, const char* data, size_t size) noexcept {
+    Add(ep, std::array{asio::const_buffer{data, size}});
+  }
+
+  template <size_t BuffsNum>
+  void Add(const udp::endpoint& ep,
+           const std::array<asio::const_buffer, BuffsNum>& buffs) noexcept {
+    Add(&ep, buffs);
+  }
+
+  void Add(const char* data, size_t size) noexcept {
+    Add(nullptr, std::array{asio::const_buffer{data, size}});
+  }
+
+  template <size_t BuffsNum>
+  void Add(const std::array<asio::const_buffer, BuffsNum>& buffs) noexcept {
+    Add(nullptr, buffs);
+  }
+
+  void Clear() noexcept {
+    eps_.clear();
+    bytes_ = 0;
+  }
+
+  // Sends the datagrams starting from the first one without blocking. Returns
+  // the number of sent datagrams, 0 if the socket isn't writable or on error.
+  size_t TrySend(udp::socket& socket, size_t first,
+                 boost::system::error_code& err) noexcept;
+
+ private:
+  template <size_t BuffsNum>
+  void Add(const udp::endpoint* ep,
+           const std::array<asio::const_buffer, BuffsNum>& buffs) noexcept {
+    static_assert(BuffsNum > 0 && BuffsNum <= kMaxBuffers);
+    assert(!Full());
+    const auto index = eps_.size();
+    eps_.push_back(ep);
+    buffs_num_[index] = BuffsNum;
+    sizes_[index] = 0;
+    for (size_t i = 0; i < BuffsNum; ++i) {
+      buffs_[index][i] = buffs[i];
+      sizes_[index] += buffs[i].size();
+    }
+    bytes_ += sizes_[index];
+  }
+
+  // Number of datagrams starting from the index that can be sent as one GSO
+  // packet.
+  size_t SegmentsNum(size_t index) const noexcept;
+
+  const size_t capacity_;
+  bool segmentation_;
+  size_t bytes_{};
+  // Null for the datagrams to the peer of a connected socket.
+  std::vector<const udp::endpoint*> eps_;
+  std::vector<std::array<asio::const_buffer, kMaxBuffers>> buffs_;
+  std::vector<size_t> buffs_num_;
+  std::vector<size_t> sizes_;
+#ifdef __linux__
+  struct alignas(cmsghdr) Control final {
+    char data[CMSG_SPACE(sizeof(uint16_t))];
+  };
+
+  std::vector<mmsghdr> msgs_;
+  std::vector<iovec> iovs_;
+  std::vector<Control> controls_;
+  // Number of datagrams sent by every message.
+  std::vector<size_t> msg_datagrams_;
+#endif
+};
+
+}  // namespace socks5::net
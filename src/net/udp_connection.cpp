@@ -1,9 +1,85 @@
 #include <net/udp_connection.hpp>
 #include <common/addr_utils.hpp>
 #include <net/utils.hpp>
+#include <utils/logger.hpp>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <array>
+#include <cerrno>
+#include <memory>
+#endif
 
 namespace socks5::net {
 
+namespace {
+
+#ifdef __linux__
+
+// Max size of a UDP payload.
+constexpr size_t kMaxDatagramSize{65536};
+
+// Receives the next datagram without blocking into a pooled buffer. The part
+// of a bigger datagram that doesn't fit lands in an overflow buffer of the
+// thread and both parts are copied into a buffer of the datagram size, so a
+// datagram costs one system call whatever its size.
+size_t ReceivePooled(udp::socket& socket, utils::PooledBufferOpt& buf,
+                     udp::endpoint& sender_ep,
+                     boost::system::error_code& err) {
+  thread_local const auto overflow =
+      std::make_unique<char[]>(kMaxDatagramSize);
+  buf.emplace();
+  const auto pooled_size = buf->WritableBytes();
+  std::array<iovec, 2> iovs{{{buf->BeginWrite(), pooled_size},
+                             {overflow.get(), kMaxDatagramSize}}};
+  msghdr hdr{};
+  hdr.msg_name = sender_ep.data();
+  hdr.msg_namelen = static_cast<socklen_t>(sender_ep.capacity());
+  hdr.msg_iov = iovs.data();
+  hdr.msg_iovlen = iovs.size();
+  const auto received = ::recvmsg(socket.native_handle(), &hdr, MSG_DONTWAIT);
+  if (received < 0) {
+    err.assign(errno, boost::system::system_category());
+    return 0;
+  }
+  sender_ep.resize(hdr.msg_namelen);
+  const auto size = static_cast<size_t>(received);
+  if (size <= pooled_size) {
+    buf->HasWritten(size);
+    return size;
+  }
+  utils::PooledBuffer big_buf{size};
+  big_buf.Append(buf->BeginWrite(), pooled_size);
+  big_buf.Append(overflow.get(), size - pooled_size);
+  buf.reset();
+  buf.emplace(std::move(big_buf));
+  return size;
+}
+
+#else
+
+// FIONREAD returns the size of all the queued data on other platforms, which
+// is enough for the next datagram.
+size_t ReceivePooled(udp::socket& socket, utils::PooledBufferOpt& buf,
+                     udp::endpoint& sender_ep,
+                     boost::system::error_code& err) {
+  const auto available = socket.available(err);
+  if (err) {
+    return 0;
+  }
+  buf.emplace(available);
+  const auto received = socket.receive_from(
+      asio::buffer(buf->BeginWrite(), buf->WritableBytes()), sender_ep, 0,
+      err);
+  if (!err) {
+    buf->HasWritten(received);
+  }
+  return received;
+}
+
+#endif
+
+}  // namespace
+
 UdpConnection MakeUdpConnect(udp::socket socket,
                              common::Metrics& metrics) noexcept {
   return UdpConnection{std::move(socket), metrics};
@@ -51,6 +127,143 @@ UdpConnectErrorOptAwait UdpConnection::Send(const udp::endpoint& ep,
   }
 }
 
+UdpConnectErrorOpt UdpConnection::Connect(const udp::endpoint& ep) noexcept {
+  boost::system::error_code err;
+  socket_.connect(ep, err);
+  if (err) {
+    return MakeError("Error connecting UDP socket", err);
+  }
+  return std::nullopt;
+}
+
+UdpConnectErrorOptAwait UdpConnection::Send(const char* data,
+                                            size_t data_size) noexcept {
+  const auto [err, sent_bytes] = co_await socket_.async_send(
+      asio::buffer(data, data_size), use_nothrow_awaitable);
+  metrics_.AddSentBytes(sent_bytes);
+  // An ICMP error for an earlier datagram, the datagram isn't sent.
+  if (err == asio::error::connection_refused) {
+    co_return std::nullopt;
+  }
+  if (err) {
+    co_return MakeError("Error sending to UDP socket", err);
+  }
+  co_return std::nullopt;
+}
+
+UdpConnectErrorOptAwait UdpConnection::ReadBatch(
+    UdpRecvBatch& batch) noexcept {
+  for (;;) {
+    boost::system::error_code err;
+    const auto received = batch.TryReceive(socket_, err);
+    if (const auto truncated = batch.Truncated()) {
+      metrics_.AddDroppedUdpDatagrams(truncated);
+      SOCKS5_LOG(debug,
+                 "UDP datagrams bigger than {} bytes dropped. Socket: {}. "
+                 "num={}",
+                 batch.DatagramSize(), LocalAddrStr(), truncated);
+    }
+    if (received != 0) {
+      metrics_.AddRecvBytes(batch.Bytes());
+      co_return std::nullopt;
+    }
+    // An ICMP error reported on a connected socket, the next call receives
+    // the datagrams.
+    if (err == asio::error::connection_refused) {
+      continue;
+    }
+    if (err) {
+      co_return MakeError("Error receiving from UDP socket", err);
+    }
+    // Only truncated datagrams were received, more may be queued.
+    if (batch.Truncated() != 0) {
+      continue;
+    }
+    const auto [wait_err] = co_await socket_.async_wait(
+        udp::socket::wait_read, use_nothrow_awaitable);
+    if (wait_err) {
+      co_return MakeError("Error receiving from UDP socket", wait_err);
+    }
+  }
+}
+
+UdpConnectErrorOptAwait UdpConnection::SendBatch(
+    UdpSendBatch& batch) noexcept {
+  size_t sent{0};
+  while (sent < batch.Size()) {
+    boost::system::error_code err;
+    sent += batch.TrySend(socket_, sent, err);
+    // An ICMP error reported on a connected socket, the batch is resent.
+    if (err == asio::error::connection_refused) {
+      continue;
+    }
+    if (err) {
+      co_return MakeError("Error sending to UDP socket", err);
+    }
+    if (sent == batch.Size()) {
+      break;
+    }
+    const auto [wait_err] = co_await socket_.async_wait(
+        udp::socket::wait_write, use_nothrow_awaitable);
+    if (wait_err) {
+      co_return MakeError("Error sending to UDP socket", wait_err);
+    }
+  }
+  metrics_.AddSentBytes(batch.Bytes());
+  co_return std::nullopt;
+}
+
+UdpEndpointOrErrorAwait UdpConnection::ReadPooled(
+    utils::PooledBufferOpt& buf) noexcept {
+  buf.reset();
+  boost::system::error_code err;
+  if (!socket_.non_blocking()) {
+    socket_.non_blocking(true, err);
+    if (err) {
+      co_return std::make_pair(
+          MakeError("Error receiving from UDP socket", err), std::nullopt);
+    }
+  }
+  // The reactor reports readiness once per arrival, so the queued datagrams
+  // are received before waiting.
+  for (;;) {
+    udp::endpoint sender_ep;
+    size_t recv_bytes{0};
+    try {
+      recv_bytes = ReceivePooled(socket_, buf, sender_ep, err);
+    } catch (const std::exception&) {
+      buf.reset();
+      co_return std::make_pair(
+          MakeError("Exception while receiving from UDP socket",
+                    std::current_exception()),
+          std::nullopt);
+    }
+    if (!err) {
+      metrics_.AddRecvBytes(recv_bytes);
+      co_return std::make_pair(std::nullopt, std::move(sender_ep));
+    }
+    buf.reset();
+    // An ICMP error reported on a connected socket, the next datagram is
+    // received.
+    if (err == asio::error::connection_refused) {
+      err.clear();
+      continue;
+    }
+    if (err != asio::error::would_block) {
+      co_return std::make_pair(
+          MakeError("Error receiving from UDP socket", err), std::nullopt);
+    }
+    err.clear();
+    const auto [wait_err] = co_await socket_.async_wait(
+        udp::socket::wait_read, use_nothrow_awaitable);
+    if (wait_err) {
+      co_return std::make_pair(
+          MakeError("Error receiving from UDP socket", wait_err),
+          std::nullopt);
+    }
+  }
+}
+
 UdpConnectErrorOpt UdpConnection::Cancel() noexcept {
   try {
     boost::system::error_code err;
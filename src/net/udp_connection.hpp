@@ -4,6 +4,8 @@
 #include <socks5/common/metrics.hpp>
 #include <utils/timeout.hpp>
 #include <net/connection_error.hpp>
+#include <net/udp_batch.hpp>
+#include <utils/buffer_pool.hpp>
 
 namespace socks5::net {
 
@@ -24,7 +26,22 @@ class UdpConnection final : utils::NonCopyable {
                                size_t data_size) noexcept;
   UdpConnectErrorOptAwait Send(const udp::endpoint& ep, const char* data,
                                size_t data_size, size_t tmo) noexcept;
+  // Connects the socket to the endpoint. The kernel caches the route and
+  // drops datagrams from other senders.
+  UdpConnectErrorOpt Connect(const udp::endpoint& ep) noexcept;
+  // Sends to the peer of a connected socket.
+  UdpConnectErrorOptAwait Send(const char* data, size_t data_size) noexcept;
   UdpConnectErrorOpt Cancel() noexcept;
+  // Waits for datagrams and receives as many of them as fit into the batch.
+  UdpConnectErrorOptAwait ReadBatch(UdpRecvBatch& batch) noexcept;
+  // Sends all the datagrams of the batch, waiting for the socket to become
+  // writable if needed.
+  UdpConnectErrorOptAwait SendBatch(UdpSendBatch& batch) noexcept;
+  // Receives the next datagram into a buffer of its size, most datagrams fit
+  // into a pooled buffer. Waits only if no datagram is queued, the buffer is
+  // released before waiting, so no buffer is held while the socket is idle.
+  // ICMP errors reported on connected sockets are skipped.
+  UdpEndpointOrErrorAwait ReadPooled(utils::PooledBufferOpt& buf) noexcept;
   UdpEndpointOrError LocalEndpoint() noexcept;
   void SetLocalAddrStr() noexcept;
   const LocalAddrString& LocalAddrStr() noexcept;
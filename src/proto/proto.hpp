@@ -30,6 +30,11 @@ enum AuthMethod : uint8_t {
   kAuthMethodNDSAuth = 0x07,
   kAuthMethodMultiAuth = 0x08,
   kAuthMethodJsonParamBlock = 0x09,
+  // Private methods of this library (X'80' to X'FE'): None and User, after
+  // which the data of a CONNECT relay goes through a compressed tunnel.
+  // Servers that don't know them choose one of the standard methods.
+  kAuthMethodNoneCompressedTunnel = 0x80,
+  kAuthMethodUserCompressedTunnel = 0x81,
   kAuthMethodMethodDeny = 0xFF,
 };
 
@@ -0,0 +1,365 @@
+#include <socks5/server/content_matcher.hpp>
+#include <utils/byte_set.hpp>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <utility>
+
+namespace socks5::server {
+
+namespace {
+
+constexpr uint32_t kRoot{0};
+constexpr uint32_t kNone{std::numeric_limits<uint32_t>::max()};
+// Set in a transition to a state where a pattern ends.
+constexpr uint32_t kMatchFlag{0x80000000};
+// Memory for the states with a full transition table. The shallow states,
+// where the scan spends most of the time, are full, the deeper ones keep
+// only their own transitions and fall back to their failure links.
+constexpr size_t kMaxDenseBytes{16 * 1024 * 1024};
+// The prefilter only pays off if few bytes start a pattern.
+constexpr size_t kMaxPrefilterBytes{64};
+
+uint8_t ToLower(uint8_t byte) noexcept {
+  return byte >= 'A' && byte <= 'Z' ? byte + ('a' - 'A') : byte;
+}
+
+struct TrieNode final {
+  uint32_t Find(uint8_t cls) const noexcept {
+    for (const auto& [edge_cls, target] : edges) {
+      if (edge_cls == cls) {
+        return target;
+      }
+    }
+    return kNone;
+  }
+
+  std::vector<std::pair<uint8_t, uint32_t>> edges;
+  uint32_t fail{kRoot};
+  std::vector<uint32_t> patterns;
+};
+
+}  // namespace
+
+class ContentMatcher::Impl final {
+ public:
+  Impl(const std::vector<ContentPattern>& patterns, bool case_insensitive)
+      : patterns_{patterns} {
+    MakeClasses(case_insensitive);
+    auto trie = MakeTrie();
+    const auto order = LinkTrie(trie);
+    Compile(trie, order);
+    utils::ByteSet starts{};
+    size_t starts_num{0};
+    for (size_t byte = 0; byte < starts.size(); ++byte) {
+      starts[byte] = dense_[classes_[byte]] != kRoot;
+      starts_num += starts[byte];
+    }
+    finder_ = utils::ByteSetFinder{starts};
+    prefilter_ = starts_num <= kMaxPrefilterBytes;
+  }
+
+  std::optional<ContentMatch> Scan(Stream& stream, const char* data,
+                                   size_t size,
+                                   const ContentMatchCb& on_match) const {
+    const auto* begin = reinterpret_cast<const uint8_t*>(data);
+    const auto* end = begin + size;
+    auto state = stream.state;
+    for (const auto* pos = begin; pos != end;) {
+      if (state == kRoot && prefilter_) {
+        pos = finder_.Find(pos, end);
+        if (pos == end) {
+          break;
+        }
+      }
+      state = Next(state, classes_[*pos++]);
+      if (state & kMatchFlag) {
+        state &= ~kMatchFlag;
+        const auto offset = stream.offset + static_cast<uint64_t>(pos - begin);
+        if (auto blocked = Report(state, offset, stream, on_match)) {
+          stream.state = state;
+          stream.offset = offset;
+          return blocked;
+        }
+      }
+    }
+    stream.state = state;
+    stream.offset += size;
+    return std::nullopt;
+  }
+
+  size_t PatternsNum() const noexcept { return patterns_.size(); }
+
+ private:
+  // Every byte used by the patterns gets its own class, the others share
+  // one, so the rows of the transition table are as short as possible.
+  void MakeClasses(bool case_insensitive) {
+    std::array<bool, 256> used{};
+    for (auto& pattern : patterns_) {
+      if (pattern.bytes.empty()) {
+        throw std::invalid_argument{"Empty content pattern"};
+      }
+      for (auto& byte : pattern.bytes) {
+        if (case_insensitive) {
+          byte = static_cast<char>(ToLower(static_cast<uint8_t>(byte)));
+        }
+        used[static_cast<uint8_t>(byte)] = true;
+      }
+    }
+    size_t unused_class{kNone};
+    for (size_t byte = 0; byte < used.size(); ++byte) {
+      if (used[byte]) {
+        classes_[byte] = static_cast<uint8_t>(classes_num_++);
+        continue;
+      }
+      if (unused_class == kNone) {
+        unused_class = classes_num_++;
+      }
+      classes_[byte] = static_cast<uint8_t>(unused_class);
+    }
+    if (case_insensitive) {
+      for (uint8_t byte = 'A'; byte <= 'Z'; ++byte) {
+        classes_[byte] = classes_[ToLower(byte)];
+      }
+    }
+  }
+
+  std::vector<TrieNode> MakeTrie() const {
+    std::vector<TrieNode> trie(1);
+    for (size_t i = 0; i < patterns_.size(); ++i) {
+      uint32_t node{kRoot};
+      for (const auto byte : patterns_[i].bytes) {
+        const auto cls = classes_[static_cast<uint8_t>(byte)];
+        auto next = trie[node].Find(cls);
+        if (next == kNone) {
+          next = static_cast<uint32_t>(trie.size());
+          trie[node].edges.emplace_back(cls, next);
+          trie.emplace_back();
+        }
+        node = next;
+      }
+      trie[node].patterns.push_back(static_cast<uint32_t>(i));
+    }
+    return trie;
+  }
+
+  // Sets the failure links. Returns the nodes in breadth-first order, a
+  // failure link always points to an earlier node.
+  static std::vector<uint32_t> LinkTrie(std::vector<TrieNode>& trie) {
+    std::vector<uint32_t> order{kRoot};
+    order.reserve(trie.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      const auto node = order[i];
+      for (const auto& [cls, child] : trie[node].edges) {
+        order.push_back(child);
+        if (node == kRoot) {
+          continue;
+        }
+        auto fail = trie[node].fail;
+        auto target = trie[fail].Find(cls);
+        while (target == kNone && fail != kRoot) {
+          fail = trie[fail].fail;
+          target = trie[fail].Find(cls);
+        }
+        trie[child].fail = target == kNone ? kRoot : target;
+      }
+    }
+    return order;
+  }
+
+  void Compile(const std::vector<TrieNode>& trie,
+               const std::vector<uint32_t>& order) {
+    const auto states_num = order.size();
+    std::vector<uint32_t> ids(states_num);
+    for (size_t i = 0; i < states_num; ++i) {
+      ids[order[i]] = static_cast<uint32_t>(i);
+    }
+
+    out_begin_.reserve(states_num + 1);
+    dict_links_.assign(states_num, kNone);
+    fails_.assign(states_num, kRoot);
+    for (size_t i = 0; i < states_num; ++i) {
+      const auto& node = trie[order[i]];
+      out_begin_.push_back(static_cast<uint32_t>(out_patterns_.size()));
+      out_patterns_.insert(out_patterns_.end(), node.patterns.begin(),
+                           node.patterns.end());
+      if (i == kRoot) {
+        continue;
+      }
+      const auto fail = ids[node.fail];
+      fails_[i] = fail;
+      dict_links_[i] =
+          trie[node.fail].patterns.empty() ? dict_links_[fail] : fail;
+    }
+    out_begin_.push_back(static_cast<uint32_t>(out_patterns_.size()));
+    const auto target_of = [&](uint32_t node) {
+      const auto id = ids[node];
+      const bool match =
+          !trie[node].patterns.empty() || dict_links_[id] != kNone;
+      return match ? id | kMatchFlag : id;
+    };
+
+    dense_num_ = std::min(
+        states_num,
+        std::max<size_t>(kMaxDenseBytes / (classes_num_ * sizeof(uint32_t)),
+                         1));
+    dense_.assign(dense_num_ * classes_num_, kRoot);
+    for (size_t i = 0; i < dense_num_; ++i) {
+      const auto& node = trie[order[i]];
+      auto* row = dense_.data() + i * classes_num_;
+      if (i != kRoot) {
+        const auto* fail_row = dense_.data() + fails_[i] * classes_num_;
+        std::copy(fail_row, fail_row + classes_num_, row);
+      }
+      for (const auto& [cls, child] : node.edges) {
+        row[cls] = target_of(child);
+      }
+    }
+
+    edges_begin_.assign(dense_num_ + 1, 0);
+    for (size_t i = dense_num_; i < states_num; ++i) {
+      auto edges = trie[order[i]].edges;
+      std::sort(edges.begin(), edges.end());
+      for (const auto& [cls, child] : edges) {
+        edge_classes_.push_back(cls);
+        edge_targets_.push_back(target_of(child));
+      }
+      edges_begin_.push_back(static_cast<uint32_t>(edge_classes_.size()));
+    }
+  }
+
+  uint32_t Next(uint32_t state, uint8_t cls) const noexcept {
+    for (;;) {
+      if (state < dense_num_) {
+        return dense_[state * classes_num_ + cls];
+      }
+      const auto begin = edge_classes_.begin() + edges_begin_[state];
+      const auto end = edge_classes_.begin() + edges_begin_[state + 1];
+      const auto it = std::lower_bound(begin, end, cls);
+      if (it != end && *it == cls) {
+        return edge_targets_[static_cast<size_t>(it - edge_classes_.begin())];
+      }
+      state = fails_[state];
+    }
+  }
+
+  std::optional<ContentMatch> Report(uint32_t state, uint64_t end,
+                                     const Stream& stream,
+                                     const ContentMatchCb& on_match) const {
+    for (; state != kNone; state = dict_links_[state]) {
+      for (auto i = out_begin_[state]; i < out_begin_[state + 1]; ++i) {
+        const auto& pattern = patterns_[out_patterns_[i]];
+        const ContentMatch match{pattern.id, pattern.action, end,
+                                 stream.from_client};
+        const auto verdict = on_match && on_match(match);
+        if (pattern.action == ContentAction::kBlock ||
+            (pattern.action == ContentAction::kCallback && verdict)) {
+          return match;
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::vector<ContentPattern> patterns_;
+  std::array<uint8_t, 256> classes_{};
+  size_t classes_num_{0};
+  // Full rows of the first dense_num_ states in breadth-first order.
+  std::vector<uint32_t> dense_;
+  size_t dense_num_{0};
+  // Sorted own transitions of the other states, indexed by the state.
+  std::vector<uint32_t> edges_begin_;
+  std::vector<uint8_t> edge_classes_;
+  std::vector<uint32_t> edge_targets_;
+  std::vector<uint32_t> fails_;
+  // The patterns ending in a state are its own ones and the ones of the
+  // states on its dictionary link chain.
+  std::vector<uint32_t> out_begin_;
+  std::vector<uint32_t> out_patterns_;
+  std::vector<uint32_t> dict_links_;
+  // Finds the bytes leaving the root state.
+  utils::ByteSetFinder finder_{utils::ByteSet{}};
+  bool prefilter_{false};
+};
+
+ContentMatcher::ContentMatcher(const std::vector<ContentPattern>& patterns,
+                               bool case_insensitive)
+    : impl_{std::make_shared<const Impl>(patterns, case_insensitive)} {}
+
+ContentMatcher::~ContentMatcher() = default;
+ContentMatcher::ContentMatcher(const ContentMatcher&) = default;
+ContentMatcher::ContentMatcher(ContentMatcher&&) noexcept = default;
+ContentMatcher& ContentMatcher::operator=(const ContentMatcher&) = default;
+ContentMatcher& ContentMatcher::operator=(ContentMatcher&&) noexcept = default;
+
+std::optional<ContentMatch> ContentMatcher::Scan(
+    Stream& stream, const char* data, size_t size,
+    const ContentMatchCb& on_match) const {
+  return impl_->Scan(stream, data, size, on_match);
+}
+
+size_t ContentMatcher::PatternsNum() const noexcept {
+  return impl_->PatternsNum();
+}
+
+ContentMatchStage::ContentMatchStage(ContentMatcher matcher, bool from_client,
+                                     ContentMatchCb on_match)
+    : matcher_{std::move(matcher)},
+      stream_{.from_client = from_client},
+      on_match_{std::move(on_match)} {}
+
+void ContentMatchStage::operator()(RelayBuffer& buf) {
+  if (const auto blocked =
+          matcher_.Scan(stream_, buf.Data(), buf.Size(), on_match_)) {
+    throw ContentBlockedError{blocked->pattern_id};
+  }
+}
+
+TcpRelayDataProcessor MakeTcpRelayContentProcessor(ContentMatcher matcher,
+                                                   ContentMatchCb on_match) {
+  TcpRelayDataProcessor processor;
+  processor.client_to_server_in_place =
+      [matcher, on_match](const tcp::endpoint&, const tcp::endpoint&) {
+        return TcpRelayInPlaceDataProcessorCb{
+            ContentMatchStage{matcher, true, on_match}};
+      };
+  processor.server_to_client_in_place =
+      [matcher = std::move(matcher), on_match = std::move(on_match)](
+          const tcp::endpoint&, const tcp::endpoint&) {
+        return TcpRelayInPlaceDataProcessorCb{
+            ContentMatchStage{matcher, false, on_match}};
+      };
+  return processor;
+}
+
+UdpRelayDataProcessor MakeUdpRelayContentProcessor(ContentMatcher matcher,
+                                                   ContentMatchCb on_match) {
+  UdpRelayDataProcessor processor;
+  processor.client_to_server =
+      [matcher, on_match](
+          const udp::endpoint&) -> UdpRelayDataFromClientProcessorCb {
+    return [matcher, on_match](const char* data, size_t size,
+                               const udp::endpoint&,
+                               const RelayDataSender& send) {
+      ContentMatcher::Stream stream{.from_client = true};
+      if (!matcher.Scan(stream, data, size, on_match)) {
+        send(data, size);
+      }
+    };
+  };
+  processor.server_to_client =
+      [matcher = std::move(matcher), on_match = std::move(on_match)](
+          const udp::endpoint&,
+          const udp::endpoint&) -> UdpRelayDataProcessorCb {
+    return [matcher, on_match](const char* data, size_t size,
+                               const RelayDataSender& send) {
+      ContentMatcher::Stream stream{.from_client = false};
+      if (!matcher.Scan(stream, data, size, on_match)) {
+        send(data, size);
+      }
+    };
+  };
+  return processor;
+}
+
+}  // namespace socks5::server
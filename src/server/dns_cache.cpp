@@ -0,0 +1,361 @@
+#include <server/dns_cache.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace socks5::server {
+
+namespace {
+
+constexpr size_t kShardsNum{16};
+constexpr size_t kHeaderSize{12};
+constexpr size_t kQuestionTail{4};
+constexpr size_t kRecordTail{10};
+// Guards against loops of compression pointers.
+constexpr size_t kMaxNamePointers{16};
+// Answers aren't kept longer, even if their records live longer.
+constexpr uint32_t kMaxTtl{3600};
+// Max number of outstanding queries on a socket to a resolver.
+constexpr size_t kMaxPendingQueries{64};
+
+constexpr uint16_t kFlagQr{0x8000};
+constexpr uint16_t kOpcodeMask{0x7800};
+constexpr uint16_t kFlagTc{0x0200};
+constexpr uint16_t kFlagRd{0x0100};
+constexpr uint16_t kFlagCd{0x0010};
+constexpr uint16_t kRcodeMask{0x000f};
+constexpr uint16_t kRcodeNoError{0};
+constexpr uint16_t kRcodeNxDomain{3};
+constexpr uint16_t kTypeOpt{41};
+// DNSSEC OK bit of the TTL field of an OPT record.
+constexpr uint32_t kOptDo{0x8000};
+
+uint16_t Read16(const uint8_t* data) noexcept {
+  return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+uint32_t Read32(const uint8_t* data) noexcept {
+  return (static_cast<uint32_t>(Read16(data)) << 16) | Read16(data + 2);
+}
+
+void Write32(uint8_t* data, uint32_t value) noexcept {
+  data[0] = static_cast<uint8_t>(value >> 24);
+  data[1] = static_cast<uint8_t>(value >> 16);
+  data[2] = static_cast<uint8_t>(value >> 8);
+  data[3] = static_cast<uint8_t>(value);
+}
+
+// Returns the offset after the name at offset or 0 if the name is malformed.
+// Compression pointers are followed, the lowercased labels are appended to
+// out if it isn't null.
+size_t ReadName(const uint8_t* msg, size_t size, size_t offset,
+                std::string* out) {
+  size_t end{0};
+  size_t pointers{0};
+  for (;;) {
+    if (offset >= size) {
+      return 0;
+    }
+    const auto len = msg[offset];
+    if ((len & 0xc0) == 0xc0) {
+      if (offset + 1 >= size || ++pointers > kMaxNamePointers) {
+        return 0;
+      }
+      if (end == 0) {
+        end = offset + 2;
+      }
+      offset = ((len & 0x3f) << 8) | msg[offset + 1];
+      continue;
+    }
+    if ((len & 0xc0) != 0 || offset + 1 + len > size) {
+      return 0;
+    }
+    if (out) {
+      out->push_back(static_cast<char>(len));
+      for (size_t i = offset + 1; i < offset + 1 + len; ++i) {
+        const auto c = msg[i];
+        out->push_back(static_cast<char>(c >= 'A' && c <= 'Z' ? c + 32 : c));
+      }
+    }
+    offset += 1 + len;
+    if (len == 0) {
+      return end != 0 ? end : offset;
+    }
+  }
+}
+
+// The answer depends on the resolver, the question, the RD and CD flags and
+// EDNS. The key is built from the query and the answer alike, since the
+// answer repeats all of them. Returns the offset after the question or 0 if
+// the message is malformed.
+size_t MakeKey(const udp::endpoint& resolver, const uint8_t* msg, size_t size,
+               std::string& key) {
+  key.clear();
+  const auto addr = resolver.address();
+  if (addr.is_v4()) {
+    const auto bytes = addr.to_v4().to_bytes();
+    key.append(bytes.begin(), bytes.end());
+  } else {
+    const auto bytes = addr.to_v6().to_bytes();
+    key.append(bytes.begin(), bytes.end());
+  }
+  const auto port = resolver.port();
+  key.push_back(static_cast<char>(port >> 8));
+  key.push_back(static_cast<char>(port));
+  const auto flags = Read16(msg + 2) & (kFlagRd | kFlagCd);
+  key.push_back(static_cast<char>(flags >> 8));
+  key.push_back(static_cast<char>(flags));
+  auto offset = ReadName(msg, size, kHeaderSize, &key);
+  if (offset == 0 || offset + kQuestionTail > size) {
+    return 0;
+  }
+  key.append(reinterpret_cast<const char*>(msg + offset), kQuestionTail);
+  return offset + kQuestionTail;
+}
+
+// Skips the resource record at offset. Returns the offset after it or 0 if
+// the record is malformed. tail is set to the offset of the fields after the
+// name: type, class, TTL and rdata length.
+size_t SkipRecord(const uint8_t* msg, size_t size, size_t offset,
+                  size_t& tail) {
+  tail = ReadName(msg, size, offset, nullptr);
+  if (tail == 0 || tail + kRecordTail > size) {
+    return 0;
+  }
+  const auto rdata_end = tail + kRecordTail + Read16(msg + tail + 8);
+  return rdata_end <= size ? rdata_end : 0;
+}
+
+// Appends the lowercased name, type and class of the question to question.
+// Returns false if the message is malformed or has not exactly one question.
+bool ReadQuestion(const uint8_t* msg, size_t size, std::string& question) {
+  if (size < kHeaderSize || Read16(msg + 4) != 1) {
+    return false;
+  }
+  const auto offset = ReadName(msg, size, kHeaderSize, &question);
+  if (offset == 0 || offset + kQuestionTail > size) {
+    return false;
+  }
+  question.append(reinterpret_cast<const char*>(msg + offset), kQuestionTail);
+  return true;
+}
+
+// 0 - no EDNS, 1 - EDNS, 2 - EDNS with the DNSSEC OK bit.
+char EdnsKind(const uint8_t* record_tail) noexcept {
+  return (Read32(record_tail + 4) & kOptDo) != 0 ? 2 : 1;
+}
+
+}  // namespace
+
+struct DnsCache::Entry final {
+  std::vector<char> answer;
+  // Offset after the question of the answer.
+  size_t question_end;
+  // Offsets of the TTL fields in the answer and their values when it was
+  // stored.
+  std::vector<std::pair<size_t, uint32_t>> ttls;
+  Clock::time_point stored;
+  Clock::time_point expires;
+};
+
+struct DnsCache::Shard final {
+  std::mutex mutex;
+  std::unordered_map<std::string, Entry> entries;
+};
+
+DnsCache::DnsCache(const std::vector<ResolverAddr>& resolvers,
+                   size_t capacity)
+    : shard_capacity_{std::max<size_t>((capacity + kShardsNum - 1) /
+                                           kShardsNum,
+                                       1)},
+      shards_{std::make_unique<Shard[]>(kShardsNum)} {
+  resolvers_.reserve(resolvers.size());
+  for (const auto& [addr, port] : resolvers) {
+    resolvers_.emplace_back(asio::ip::make_address(addr), port);
+  }
+}
+
+DnsCache::~DnsCache() = default;
+
+bool DnsCache::IsResolver(const udp::endpoint& ep) const noexcept {
+  return std::find(resolvers_.begin(), resolvers_.end(), ep) !=
+         resolvers_.end();
+}
+
+bool DnsCache::Lookup(const udp::endpoint& resolver, const char* query,
+                      size_t size, std::vector<char>& answer,
+                      Clock::time_point now) {
+  const auto* msg = reinterpret_cast<const uint8_t*>(query);
+  if (size < kHeaderSize || (Read16(msg + 2) & (kFlagQr | kOpcodeMask)) ||
+      Read16(msg + 4) != 1 || Read16(msg + 6) != 0 || Read16(msg + 8) != 0) {
+    return false;
+  }
+  // The key is rebuilt for every query, the buffer is reused.
+  thread_local std::string key;
+  auto offset = MakeKey(resolver, msg, size, key);
+  if (offset == 0) {
+    return false;
+  }
+  const auto question_end = offset;
+  char edns{0};
+  for (auto additional = Read16(msg + 10); additional > 0; --additional) {
+    size_t tail{};
+    offset = SkipRecord(msg, size, offset, tail);
+    if (offset == 0) {
+      return false;
+    }
+    if (Read16(msg + tail) == kTypeOpt) {
+      edns = EdnsKind(msg + tail);
+    }
+  }
+  key.push_back(edns);
+
+  auto& shard = GetShard(key);
+  std::lock_guard lock{shard.mutex};
+  const auto it = shard.entries.find(key);
+  if (it == shard.entries.end()) {
+    return false;
+  }
+  const auto& entry = it->second;
+  if (now >= entry.expires) {
+    shard.entries.erase(it);
+    return false;
+  }
+  // Questions aren't compressed, so the questions of the same key differ in
+  // the letter case only. The question of the query replaces the cached one.
+  if (question_end != entry.question_end) {
+    return false;
+  }
+  answer.assign(entry.answer.begin(), entry.answer.end());
+  answer[0] = query[0];
+  answer[1] = query[1];
+  std::copy(query + kHeaderSize, query + question_end,
+            answer.begin() + kHeaderSize);
+  const auto age = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::seconds>(now - entry.stored)
+          .count());
+  auto* data = reinterpret_cast<uint8_t*>(answer.data());
+  for (const auto& [ttl_offset, ttl] : entry.ttls) {
+    Write32(data + ttl_offset, ttl > age ? ttl - age : 0);
+  }
+  return true;
+}
+
+void DnsCache::Store(const udp::endpoint& resolver, const char* answer,
+                     size_t size, Clock::time_point now) {
+  const auto* msg = reinterpret_cast<const uint8_t*>(answer);
+  if (size < kHeaderSize) {
+    return;
+  }
+  const auto flags = Read16(msg + 2);
+  const auto rcode = flags & kRcodeMask;
+  if (!(flags & kFlagQr) || (flags & (kOpcodeMask | kFlagTc)) ||
+      (rcode != kRcodeNoError && rcode != kRcodeNxDomain) ||
+      Read16(msg + 4) != 1) {
+    return;
+  }
+  std::string key;
+  auto offset = MakeKey(resolver, msg, size, key);
+  if (offset == 0) {
+    return;
+  }
+  Entry entry;
+  entry.question_end = offset;
+  char edns{0};
+  auto min_ttl = std::numeric_limits<uint32_t>::max();
+  const size_t records = Read16(msg + 6) + Read16(msg + 8) + Read16(msg + 10);
+  for (size_t i = 0; i < records; ++i) {
+    size_t tail{};
+    offset = SkipRecord(msg, size, offset, tail);
+    if (offset == 0) {
+      return;
+    }
+    if (Read16(msg + tail) == kTypeOpt) {
+      // Options like COOKIE or Client Subnet must not reach other clients.
+      if (Read16(msg + tail + 8) != 0) {
+        return;
+      }
+      edns = EdnsKind(msg + tail);
+      continue;
+    }
+    const auto ttl = Read32(msg + tail + 4);
+    entry.ttls.emplace_back(tail + 4, ttl);
+    min_ttl = std::min(min_ttl, ttl);
+  }
+  // An answer without records has no TTL to respect.
+  if (entry.ttls.empty() || min_ttl == 0) {
+    return;
+  }
+  key.push_back(edns);
+  entry.answer.assign(answer, answer + size);
+  entry.stored = now;
+  entry.expires = now + std::chrono::seconds{std::min(min_ttl, kMaxTtl)};
+
+  auto& shard = GetShard(key);
+  std::lock_guard lock{shard.mutex};
+  if (shard.entries.size() >= shard_capacity_ && !shard.entries.count(key)) {
+    std::erase_if(shard.entries, [now](const auto& item) {
+      return now >= item.second.expires;
+    });
+    if (shard.entries.size() >= shard_capacity_) {
+      shard.entries.erase(shard.entries.begin());
+    }
+  }
+  shard.entries.insert_or_assign(std::move(key), std::move(entry));
+}
+
+size_t DnsCache::Size() const noexcept {
+  size_t size{0};
+  for (size_t i = 0; i < kShardsNum; ++i) {
+    std::lock_guard lock{shards_[i].mutex};
+    size += shards_[i].entries.size();
+  }
+  return size;
+}
+
+DnsCache::Shard& DnsCache::GetShard(const std::string& key) const noexcept {
+  return shards_[std::hash<std::string>{}(key) % kShardsNum];
+}
+
+void DnsPendingQueries::Add(const char* query, size_t size) {
+  const auto* msg = reinterpret_cast<const uint8_t*>(query);
+  Query pending{0, {}};
+  if (size < kHeaderSize || (Read16(msg + 2) & (kFlagQr | kOpcodeMask)) ||
+      !ReadQuestion(msg, size, pending.question)) {
+    return;
+  }
+  pending.id = Read16(msg);
+  if (queries_.size() == kMaxPendingQueries) {
+    queries_.erase(queries_.begin());
+  }
+  queries_.push_back(std::move(pending));
+}
+
+bool DnsPendingQueries::Match(const char* answer, size_t size) {
+  if (queries_.empty()) {
+    return false;
+  }
+  const auto* msg = reinterpret_cast<const uint8_t*>(answer);
+  // The question is rebuilt for every answer, the buffer is reused.
+  thread_local std::string question;
+  question.clear();
+  if (!ReadQuestion(msg, size, question)) {
+    return false;
+  }
+  const auto id = Read16(msg);
+  const auto it = std::find_if(
+      queries_.begin(), queries_.end(), [&](const Query& query) {
+        return query.id == id && query.question == question;
+      });
+  if (it == queries_.end()) {
+    return false;
+  }
+  queries_.erase(it);
+  return true;
+}
+
+}  // namespace socks5::server
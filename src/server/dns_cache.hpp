@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <socks5/common/asio.hpp>
+#include <socks5/server/config.hpp>
+#include <socks5/utils/non_copyable.hpp>
+
+namespace socks5::server {
+
+// Packet cache of the DNS answers relayed by the udp relay. Only the answers
+// of the configured resolvers to standard queries are cached, for the min TTL
+// of their records. A cached answer is served with the transaction id and the
+// question of the query, so the letter case of the query is kept, and the
+// TTLs decreased by its age. Answers with EDNS options aren't cached, since
+// the options, e.g. cookies, belong to the client that asked. The cache is
+// split into shards with their own locks, so it may be shared by all the
+// server threads.
+class DnsCache final : utils::NonCopyable {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Throws if the address of a resolver is invalid.
+  DnsCache(const std::vector<ResolverAddr>& resolvers, size_t capacity);
+  ~DnsCache();
+
+  // Whether the datagrams to the endpoint are queries to a cached resolver.
+  bool IsResolver(const udp::endpoint& ep) const noexcept;
+
+  // Writes the cached answer to the query into answer. Returns false if
+  // there is no fresh answer.
+  bool Lookup(const udp::endpoint& resolver, const char* query, size_t size,
+              std::vector<char>& answer, Clock::time_point now = Clock::now());
+
+  // Caches a NOERROR or NXDOMAIN answer of the resolver unless it's
+  // truncated or malformed. The answer must be matched to a query sent to the
+  // resolver with DnsPendingQueries.
+  void Store(const udp::endpoint& resolver, const char* answer, size_t size,
+             Clock::time_point now = Clock::now());
+
+  size_t Size() const noexcept;
+
+ private:
+  struct Entry;
+  struct Shard;
+
+  Shard& GetShard(const std::string& key) const noexcept;
+
+  std::vector<udp::endpoint> resolvers_;
+  size_t shard_capacity_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+// Queries forwarded to a cached resolver through one socket. A datagram from
+// the resolver is cached only if it answers one of them, so a spoofed answer
+// must guess the transaction id and the question of an outstanding query.
+class DnsPendingQueries final {
+ public:
+  // Remembers a standard query. The oldest query is forgotten if there are
+  // too many of them.
+  void Add(const char* query, size_t size);
+
+  // Forgets the query answered by the datagram. Returns false if the datagram
+  // doesn't answer an outstanding query.
+  bool Match(const char* answer, size_t size);
+
+  size_t Size() const noexcept { return queries_.size(); }
+
+ private:
+  struct Query final {
+    uint16_t id;
+    std::string question;
+  };
+
+  std::vector<Query> queries_;
+};
+
+}  // namespace socks5::server
@@ -0,0 +1,159 @@
+#include <server/flight_recorder.hpp>
+#include <utils/logger.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+namespace socks5::server {
+
+namespace {
+
+template <typename T>
+void Write(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}  // namespace
+
+FlightRecorder::FlightRecorder(size_t capacity)
+    : capacity_{capacity == 0 ? 0 : std::bit_ceil(capacity)},
+      mask_{capacity_ == 0 ? 0 : capacity_ - 1},
+      id_{next_id_.fetch_add(1, std::memory_order_relaxed)} {}
+
+FlightRecorder::~FlightRecorder() {
+  if (signal_io_context_) {
+    signal_io_context_->stop();
+  }
+  if (signal_thread_.joinable()) {
+    signal_thread_.join();
+  }
+}
+
+void FlightRecorder::Dump(std::ostream& out) const {
+  std::vector<std::pair<uint32_t, std::vector<FlightEvent>>> threads;
+  {
+    std::lock_guard lk{mtx_};
+    threads.reserve(rings_.size());
+    for (const auto& ring : rings_) {
+      threads.emplace_back(ring->thread_index, ReadRing(*ring));
+    }
+  }
+  FlightDumpHeader header;
+  std::memcpy(header.magic, kFlightDumpMagic, sizeof(header.magic));
+  header.version = kFlightDumpVersion;
+  header.threads_num = static_cast<uint32_t>(threads.size());
+  header.steady_now_ns = SteadyNowNs();
+  header.system_now_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  Write(out, header);
+  for (const auto& [thread_index, events] : threads) {
+    Write(out, FlightDumpThread{thread_index,
+                                static_cast<uint32_t>(events.size())});
+    const auto size = events.size() * sizeof(FlightEvent);
+    out.write(reinterpret_cast<const char*>(events.data()),
+              static_cast<std::streamsize>(size));
+  }
+  out.flush();
+}
+
+void FlightRecorder::DumpOnSignal(int signal_number, std::string path) {
+  dump_path_ = std::move(path);
+  signal_io_context_ = std::make_unique<asio::io_context>();
+  signals_ =
+      std::make_unique<asio::signal_set>(*signal_io_context_, signal_number);
+  AsyncWaitSignal();
+  signal_thread_ = std::jthread{[this] {
+    try {
+      signal_io_context_->run();
+    } catch (const std::exception& ex) {
+      SOCKS5_LOG(error, "Flight recorder signal thread exception. {}",
+                 ex.what());
+    }
+  }};
+}
+
+FlightRecorder::Ring* FlightRecorder::AttachThread() noexcept {
+  if (capacity_ == 0) {
+    thread_cache_ = {id_, nullptr};
+    return nullptr;
+  }
+  try {
+    std::lock_guard lk{mtx_};
+    // The cache holds one recorder, so a thread that records to several ones
+    // comes back for the ring it already has.
+    const auto this_thread_id = std::this_thread::get_id();
+    const auto it = std::ranges::find_if(rings_, [&](const auto& ring) {
+      return ring->owner == this_thread_id;
+    });
+    if (it != rings_.end()) {
+      thread_cache_ = {id_, it->get()};
+      return thread_cache_.ring;
+    }
+    rings_.push_back(std::make_unique<Ring>(
+        static_cast<uint32_t>(rings_.size()), capacity_));
+    thread_cache_ = {id_, rings_.back().get()};
+    return thread_cache_.ring;
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "Flight recorder ring allocation failed. {}", ex.what());
+  }
+  return nullptr;
+}
+
+std::vector<FlightEvent> FlightRecorder::ReadRing(const Ring& ring) const {
+  const auto head = ring.head.load(std::memory_order_acquire);
+  const auto begin = head > capacity_ ? head - capacity_ : 0;
+  std::vector<FlightEvent> events;
+  events.reserve(head - begin);
+  for (auto pos = begin; pos < head; ++pos) {
+    const auto& slot = ring.slots[pos & mask_];
+    FlightEvent event;
+    event.timestamp_ns = slot.timestamp_ns.load(std::memory_order_relaxed);
+    event.session_id = slot.session_id.load(std::memory_order_relaxed);
+    event.type = static_cast<FlightEventType>(
+        slot.type.load(std::memory_order_relaxed));
+    event.arg0 = slot.arg0.load(std::memory_order_relaxed);
+    event.arg1 = slot.arg1.load(std::memory_order_relaxed);
+    events.push_back(event);
+  }
+  // The writer may have overwritten the oldest events while they were copied.
+  // The slot of the event being recorded now is dropped as well.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const auto new_head = ring.head.load(std::memory_order_relaxed);
+  const auto valid_begin = new_head >= capacity_ ? new_head - capacity_ + 1 : 0;
+  if (valid_begin > begin) {
+    const auto overwritten =
+        std::min<uint64_t>(valid_begin - begin, events.size());
+    events.erase(events.begin(),
+                 events.begin() + static_cast<std::ptrdiff_t>(overwritten));
+  }
+  return events;
+}
+
+void FlightRecorder::AsyncWaitSignal() {
+  signals_->async_wait([this](const boost::system::error_code& err, int) {
+    if (err) {
+      return;
+    }
+    DumpToFile();
+    AsyncWaitSignal();
+  });
+}
+
+void FlightRecorder::DumpToFile() const noexcept {
+  try {
+    std::ofstream out{dump_path_, std::ios::binary | std::ios::trunc};
+    if (!out) {
+      SOCKS5_LOG(error, "Can't open flight recorder dump file {}", dump_path_);
+      return;
+    }
+    Dump(out);
+    SOCKS5_LOG(info, "Flight recorder dumped to {}", dump_path_);
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "Flight recorder dump exception. {}", ex.what());
+  }
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <socks5/common/asio.hpp>
+#include <socks5/server/flight_event.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <utils/spsc_queue.hpp>
+
+namespace socks5::server {
+
+// Keeps the last events of every thread in fixed size rings. A ring has a
+// single writer, its thread, so recording an event is a few relaxed stores
+// without any locks or allocations. Old events are overwritten. Dump() may be
+// called from any thread at any time and skips the events that are overwritten
+// while they are copied. The oldest slot of a full ring may be being
+// overwritten, so at most capacity - 1 events of a ring are dumped.
+class FlightRecorder final : utils::NonCopyable {
+ public:
+  // Capacity is rounded up to a power of two. 0 disables the recorder.
+  explicit FlightRecorder(size_t capacity);
+  ~FlightRecorder();
+
+  bool Enabled() const noexcept { return capacity_ != 0; }
+
+  void Record(uint64_t session_id, FlightEventType type, uint32_t arg0 = 0,
+              uint64_t arg1 = 0) noexcept {
+    auto* ring = GetThreadRing();
+    if (!ring) {
+      return;
+    }
+    const auto pos = ring->head.load(std::memory_order_relaxed);
+    // The slot is claimed by the head store of the previous event. Dump()
+    // must not see the new fields before the claim.
+    std::atomic_thread_fence(std::memory_order_release);
+    auto& slot = ring->slots[pos & mask_];
+    slot.timestamp_ns.store(SteadyNowNs(), std::memory_order_relaxed);
+    slot.session_id.store(session_id, std::memory_order_relaxed);
+    slot.type.store(static_cast<uint32_t>(type), std::memory_order_relaxed);
+    slot.arg0.store(arg0, std::memory_order_relaxed);
+    slot.arg1.store(arg1, std::memory_order_relaxed);
+    ring->head.store(pos + 1, std::memory_order_release);
+  }
+
+  // Writes the binary dump described in socks5/server/flight_event.hpp.
+  void Dump(std::ostream& out) const;
+
+  // Dumps the recorder into the file each time the signal is received. The
+  // signal is handled on a dedicated thread, so the dump works even if all
+  // the server threads are stalled. Must be called once.
+  void DumpOnSignal(int signal_number, std::string path);
+
+ private:
+  struct Slot final {
+    std::atomic_int64_t timestamp_ns{};
+    std::atomic_uint64_t session_id{};
+    std::atomic_uint32_t type{};
+    std::atomic_uint32_t arg0{};
+    std::atomic_uint64_t arg1{};
+  };
+
+  struct Ring final {
+    Ring(uint32_t index, size_t capacity)
+        : thread_index{index},
+          owner{std::this_thread::get_id()},
+          slots{std::make_unique<Slot[]>(capacity)} {}
+
+    // Number of events ever recorded to the ring.
+    alignas(utils::kCacheLineSize) std::atomic_uint64_t head{};
+    const uint32_t thread_index;
+    const std::thread::id owner;
+    std::unique_ptr<Slot[]> slots;
+  };
+
+  static int64_t SteadyNowNs() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  Ring* GetThreadRing() noexcept {
+    if (thread_cache_.owner_id == id_) {
+      return thread_cache_.ring;
+    }
+    return AttachThread();
+  }
+
+  Ring* AttachThread() noexcept;
+  std::vector<FlightEvent> ReadRing(const Ring& ring) const;
+  void AsyncWaitSignal();
+  void DumpToFile() const noexcept;
+
+  static inline std::atomic_uint64_t next_id_{1};
+  // Ring of the current thread in the recorder that owns it. Recorder ids are
+  // never reused, so a stale entry is never mistaken for a current one.
+  static inline thread_local struct {
+    uint64_t owner_id;
+    Ring* ring;
+  } thread_cache_{};
+
+  const size_t capacity_;
+  const size_t mask_;
+  const uint64_t id_;
+  mutable std::mutex mtx_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+  std::string dump_path_;
+  std::unique_ptr<asio::io_context> signal_io_context_;
+  std::unique_ptr<asio::signal_set> signals_;
+  std::jthread signal_thread_;
+};
+
+}  // namespace socks5::server
@@ -0,0 +1,69 @@
+#include <server/flow_recorder.hpp>
+#include <utils/logger.hpp>
+
+namespace socks5::server {
+
+FlowRecorder::FlowRecorder(FlowRecordCb cb, size_t queue_capacity)
+    : cb_{std::move(cb)}, queues_{queue_capacity} {
+  if (cb_) {
+    collector_ = std::jthread{
+        [this](std::stop_token stop_token) { Collect(std::move(stop_token)); }};
+  }
+}
+
+FlowRecorder::~FlowRecorder() { Stop(); }
+
+bool FlowRecorder::Enabled() const noexcept { return static_cast<bool>(cb_); }
+
+void FlowRecorder::Push(FlowRecord&& record) noexcept {
+  if (!cb_) {
+    return;
+  }
+  try {
+    if (!queues_.GetThreadQueue().TryPush(std::move(record))) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  } catch (const std::exception& ex) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    SOCKS5_LOG(error, "Flow record queue allocation failure. {}", ex.what());
+  }
+}
+
+size_t FlowRecorder::Dropped() const noexcept {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+void FlowRecorder::Stop() noexcept {
+  if (!collector_.joinable()) {
+    return;
+  }
+  collector_.request_stop();
+  collector_.join();
+  try {
+    Drain();
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "Flow recorder exception. {}", ex.what());
+  }
+}
+
+void FlowRecorder::Collect(std::stop_token stop_token) {
+  while (!stop_token.stop_requested()) {
+    if (Drain() != 0) {
+      continue;
+    }
+    std::unique_lock lk{mtx_};
+    cv_.wait_for(lk, stop_token, kCollectInterval, [] { return false; });
+  }
+}
+
+size_t FlowRecorder::Drain() {
+  return queues_.ConsumeAll([this](FlowRecord&& record) {
+    try {
+      cb_(record);
+    } catch (const std::exception& ex) {
+      SOCKS5_LOG(error, "Flow record callback exception. {}", ex.what());
+    }
+  });
+}
+
+}  // namespace socks5::server
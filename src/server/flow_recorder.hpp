@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <socks5/server/flow_record.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <utils/thread_queues.hpp>
+
+namespace socks5::server {
+
+// Collects flow records of closed sessions. Every thread that pushes records
+// gets its own lock-free queue, so Push() never blocks the relay thread. A
+// background collector thread drains the queues and calls the user callback.
+// If a queue is full, the record is dropped and counted.
+class FlowRecorder final : utils::NonCopyable {
+ public:
+  static constexpr size_t kDefaultQueueCapacity{1024};
+  static constexpr std::chrono::milliseconds kCollectInterval{50};
+
+  explicit FlowRecorder(FlowRecordCb cb,
+                        size_t queue_capacity = kDefaultQueueCapacity);
+  ~FlowRecorder();
+
+  bool Enabled() const noexcept;
+  void Push(FlowRecord&& record) noexcept;
+  size_t Dropped() const noexcept;
+
+  // Stops the collector thread and delivers the remaining records. Called by
+  // the destructor.
+  void Stop() noexcept;
+
+ private:
+  void Collect(std::stop_token stop_token);
+  size_t Drain();
+
+  const FlowRecordCb cb_;
+  utils::ThreadQueues<FlowRecord> queues_;
+  std::mutex mtx_;
+  std::condition_variable_any cv_;
+  std::atomic_size_t dropped_{};
+  std::jthread collector_;
+};
+
+}  // namespace socks5::server
@@ -5,6 +5,8 @@
 #include <socks5/utils/type_traits.hpp>
 #include <net/utils.hpp>
 #include <common/proto_builders.hpp>
+#include <utils/probes.hpp>
+#include <server/shared_udp_relay.hpp>
 
 namespace socks5::server {
 
@@ -59,19 +61,36 @@ proto::Reply MakeReply(const tcp::endpoint& ep) noexcept {
 }  // namespace
 
 Handshake::Handshake(net::TcpConnection& connect, const Config& config,
-                     const auth::server::UserAuthCb& user_auth_cb) noexcept
-    : connect_{connect}, config_{config}, user_auth_cb_{user_auth_cb} {}
+                     const auth::server::UserAuthCb& user_auth_cb,
+                     Session& session,
+                     const SharedUdpRelay* shared_udp_relay,
+                     bool compressed_tunnel) noexcept
+    : connect_{connect},
+      config_{config},
+      user_auth_cb_{user_auth_cb},
+      session_{session},
+      shared_udp_relay_{shared_udp_relay},
+      compressed_tunnel_{compressed_tunnel} {}
 
 HandshakeResultOptAwait Handshake::Run() noexcept {
+  SOCKS5_PROBE1(handshake_start, session_.Id());
+  session_.Record(FlightEventType::kHandshakeStart);
   try {
     auto handshake_res = co_await (
         RunImpl() ||
         utils::Timeout(std::chrono::seconds{config_.handshake_timeout}));
     if (handshake_res.index() == 1) {
+      SOCKS5_PROBE2(handshake_end, session_.Id(), false);
+      session_.Record(FlightEventType::kHandshakeEnd, false);
       co_return std::nullopt;
     }
-    co_return std::move(std::get<0>(handshake_res));
+    auto& res = std::get<0>(handshake_res);
+    SOCKS5_PROBE2(handshake_end, session_.Id(), res.has_value());
+    session_.Record(FlightEventType::kHandshakeEnd, res.has_value());
+    co_return std::move(res);
   } catch (const std::exception& ex) {
+    SOCKS5_PROBE2(handshake_end, session_.Id(), false);
+    session_.Record(FlightEventType::kHandshakeEnd, false);
     SOCKS5_LOG(error, "Socks5 handshake exception. Client: {}. {}",
                net::ToString(connect_), ex.what());
     co_return std::nullopt;
@@ -102,23 +121,42 @@ BoolAwait Handshake::Auth() noexcept {
   const auto auth_method = ChoiceAuthMethod(*client_greeting);
   if (config_.enable_user_auth &&
       auth_method == proto::AuthMethod::kAuthMethodUser) {
+    compressed_tunnel_selected_ =
+        ChoiceCompressedTunnel(*client_greeting, auth_method);
     if (const auto err = co_await connect_.Send(
-            serializers::Serialize(common::MakeServerChoice(auth_method)))) {
+            serializers::Serialize(common::MakeServerChoice(
+                compressed_tunnel_selected_
+                    ? proto::AuthMethod::kAuthMethodUserCompressedTunnel
+                    : auth_method)))) {
       SOCKS5_LOG(debug, net::MakeErrorMsg(*err, connect_));
       co_return false;
     }
     auth::server::UserAuth user_auth{
         connect_, user_auth_cb_,
         auth::server::MakeConfig(config_.auth_username, config_.auth_password)};
-    if (!co_await user_auth.Run()) {
+    const auto auth_success = co_await user_auth.Run();
+    SOCKS5_PROBE3(auth_result, session_.Id(), static_cast<int>(auth_method),
+                  auth_success);
+    session_.Record(FlightEventType::kAuthResult, auth_method, auth_success);
+    if (!auth_success) {
       SOCKS5_LOG(debug, "Authentication failure. Client: {}",
                  net::ToString(connect_));
       co_return false;
     }
+    session_.SetUser(user_auth.Username());
     co_return true;
   }
-  if (const auto err = co_await connect_.Send(serializers::Serialize(
-          common::MakeServerChoice(proto::AuthMethod::kAuthMethodNone)))) {
+  SOCKS5_PROBE3(auth_result, session_.Id(),
+                static_cast<int>(proto::AuthMethod::kAuthMethodNone), true);
+  session_.Record(FlightEventType::kAuthResult,
+                  proto::AuthMethod::kAuthMethodNone, true);
+  compressed_tunnel_selected_ = ChoiceCompressedTunnel(
+      *client_greeting, proto::AuthMethod::kAuthMethodNone);
+  if (const auto err = co_await connect_.Send(
+          serializers::Serialize(common::MakeServerChoice(
+              compressed_tunnel_selected_
+                  ? proto::AuthMethod::kAuthMethodNoneCompressedTunnel
+                  : proto::AuthMethod::kAuthMethodNone)))) {
     SOCKS5_LOG(debug, net::MakeErrorMsg(*err, connect_));
     co_return false;
   }
@@ -154,12 +192,33 @@ proto::AuthMethod Handshake::ChoiceAuthMethod(
   return proto::AuthMethod::kAuthMethodNone;
 }
 
+// The client asks for a compressed tunnel by offering the private variant of
+// the chosen auth method.
+bool Handshake::ChoiceCompressedTunnel(
+    const proto::ClientGreeting& client_greeting,
+    proto::AuthMethod auth_method) const noexcept {
+  if (!compressed_tunnel_) {
+    return false;
+  }
+  const auto tunnel_method =
+      auth_method == proto::AuthMethod::kAuthMethodUser
+          ? proto::AuthMethod::kAuthMethodUserCompressedTunnel
+          : proto::AuthMethod::kAuthMethodNoneCompressedTunnel;
+  for (uint8_t i = 0; i < client_greeting.nmethods; ++i) {
+    if (client_greeting.methods[i] == tunnel_method) {
+      return true;
+    }
+  }
+  return false;
+}
+
 HandshakeResultOptAwait Handshake::ProcessRequest() noexcept {
   try {
     const auto request = co_await ReadRequest();
     if (!request) {
       co_return std::nullopt;
     }
+    session_.SetRequest(*request);
     co_return co_await ProcessCmd(*request);
   } catch (const std::exception& ex) {
     SOCKS5_LOG(debug, "Exception occurred while processing request. {}",
@@ -218,7 +277,12 @@ HandshakeResultOptAwait Handshake::ProcessCmd(const proto::Request& request) {
 
 HandshakeResultOptAwait Handshake::ProcessConnectCmd(
     const proto::Request& request) {
+  SOCKS5_PROBE1(connect_start, session_.Id());
+  session_.Record(FlightEventType::kConnectStart);
   auto [connect_err, socket] = co_await net::Connect(request.dst_addr);
+  SOCKS5_PROBE2(connect_end, session_.Id(), connect_err.value());
+  session_.Record(FlightEventType::kConnectEnd,
+                  static_cast<uint32_t>(connect_err.value()));
   if (connect_err) {
     SOCKS5_LOG(debug, "Connect error. Client: {}, Server: {}. msg={}",
                net::ToString(connect_), common::ToString(request.dst_addr),
@@ -237,7 +301,7 @@ HandshakeResultOptAwait Handshake::ProcessConnectCmd(
   if (connect_err) {
     co_return std::nullopt;
   }
-  co_return ConnectCmdResult{std::move(*socket)};
+  co_return ConnectCmdResult{std::move(*socket), compressed_tunnel_selected_};
 }
 
 HandshakeResultOptAwait Handshake::ProcessUdpAssociateCmd(
@@ -252,6 +316,16 @@ HandshakeResultOptAwait Handshake::ProcessUdpAssociateCmd(
     co_await connect_.Send(buf);
     co_return std::nullopt;
   }
+  if (shared_udp_relay_) {
+    const auto buf = serializers::Serialize(common::MakeReply(
+        rep_and_addr_pair->first, shared_udp_relay_->Endpoint()));
+    if (const auto err = co_await connect_.Send(buf)) {
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, connect_));
+      co_return std::nullopt;
+    }
+    co_return SharedUdpAssociateCmdResult{
+        std::move(*rep_and_addr_pair->second)};
+  }
   auto proxy_socket = net::MakeOpenSocket<udp>(
       co_await asio::this_coro::executor, config_.listener_addr.first, 0);
   const auto buf = serializers::Serialize(common::MakeReply(
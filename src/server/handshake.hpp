@@ -10,12 +10,15 @@
 #include <socks5/server/config.hpp>
 #include <net/tcp_connection.hpp>
 #include <auth/server/user_auth.hpp>
+#include <server/session.hpp>
 
 namespace socks5::server {
 
 struct ConnectCmdResult final {
   // Target server socket.
   tcp::socket socket;
+  // The client asked for a compressed tunnel and the server accepted.
+  bool compressed_tunnel{false};
 };
 
 struct UdpAssociateCmdResult final {
@@ -26,13 +29,21 @@ struct UdpAssociateCmdResult final {
   proto::Addr client_addr;
 };
 
+// UDP ASSOCIATE served by the SharedUdpRelay.
+struct SharedUdpAssociateCmdResult final {
+  // The client address from which the proxy expects datagrams. If the port is
+  // zero, then the client can have any port.
+  proto::Addr client_addr;
+};
+
 struct BindCmdResult final {
   // Accepted socket from target server.
   tcp::socket socket;
 };
 
 using HandshakeResult =
-    std::variant<ConnectCmdResult, UdpAssociateCmdResult, BindCmdResult>;
+    std::variant<ConnectCmdResult, UdpAssociateCmdResult, BindCmdResult,
+                 SharedUdpAssociateCmdResult>;
 using HandshakeResultOpt = std::optional<HandshakeResult>;
 using HandshakeResultOptAwait = asio::awaitable<HandshakeResultOpt>;
 
@@ -48,10 +59,17 @@ using AcceptedConnectForBindCmdOptAwait =
 
 }  // namespace detail
 
+class SharedUdpRelay;
+
 class Handshake final : utils::NonCopyable {
  public:
+  // UDP ASSOCIATE is served by the shared udp relay if it isn't null. The
+  // compressed tunnel auth methods are chosen if compressed_tunnel is set, a
+  // CONNECT after them is relayed through a compressed tunnel.
   Handshake(net::TcpConnection& connect, const Config& config,
-            const auth::server::UserAuthCb& user_auth_cb) noexcept;
+            const auth::server::UserAuthCb& user_auth_cb, Session& session,
+            const SharedUdpRelay* shared_udp_relay = nullptr,
+            bool compressed_tunnel = false) noexcept;
   HandshakeResultOptAwait Run() noexcept;
 
  private:
@@ -60,6 +78,8 @@ class Handshake final : utils::NonCopyable {
   ClientGreetingOptAwait ReadClientGreeting() noexcept;
   proto::AuthMethod ChoiceAuthMethod(
       const proto::ClientGreeting& client_greeting) noexcept;
+  bool ChoiceCompressedTunnel(const proto::ClientGreeting& client_greeting,
+                              proto::AuthMethod auth_method) const noexcept;
   RequestOptAwait ReadRequest() noexcept;
   HandshakeResultOptAwait ProcessRequest() noexcept;
   HandshakeResultOptAwait ProcessCmd(const proto::Request& request);
@@ -134,6 +154,11 @@ class Handshake final : utils::NonCopyable {
   net::TcpConnection& connect_;
   const Config& config_;
   const auth::server::UserAuthCb& user_auth_cb_;
+  Session& session_;
+  const SharedUdpRelay* shared_udp_relay_;
+  const bool compressed_tunnel_;
+  // Whether the compressed tunnel variant of the auth method was chosen.
+  bool compressed_tunnel_selected_{false};
 };
 
 }  // namespace socks5::server
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include <socks5/common/metrics.hpp>
 #include <net/utils.hpp>
 #include <server/relay_data_processors.hpp>
+#include <server/server_context.hpp>
+#include <utils/probes.hpp>
 
 namespace socks5::server {
 
@@ -21,7 +23,8 @@ class Listener final : public std::enable_shared_from_this<Listener<Proxy>>,
            const Config& config, common::Metrics& metrics,
            const auth::server::UserAuthCb& user_auth_cb,
            const TcpRelayDataProcessor& tcp_data_processor,
-           const UdpRelayDataProcessor& udp_data_processor) noexcept
+           const UdpRelayDataProcessor& udp_data_processor,
+           ServerContext& context) noexcept
       : io_context_{io_context},
         acceptor_{io_context},
         tcp_relay_handler_{tcp_relay_handler},
@@ -31,7 +34,8 @@ class Listener final : public std::enable_shared_from_this<Listener<Proxy>>,
         metrics_{metrics},
         user_auth_cb_{user_auth_cb},
         tcp_relay_data_processor_{tcp_data_processor},
-        udp_relay_data_processor_{udp_data_processor} {
+        udp_relay_data_processor_{udp_data_processor},
+        context_{context} {
     acceptor_.open(endpoint_.protocol());
     acceptor_.set_option(asio::socket_base::reuse_address(true));
     acceptor_.bind(endpoint_);
@@ -51,13 +55,17 @@ class Listener final : public std::enable_shared_from_this<Listener<Proxy>>,
   VoidAwait Listen() noexcept {
     for (;;) {
       try {
-        auto [err, socket] =
-            co_await acceptor_.async_accept(use_nothrow_awaitable);
+        // Every session runs on its own strand. The client socket is bound to
+        // it, so the session can be killed from any thread.
+        auto [err, socket] = co_await acceptor_.async_accept(
+            asio::any_io_executor{asio::make_strand(io_context_)},
+            use_nothrow_awaitable);
         if (err) {
           SOCKS5_LOG(debug, "Error accepting new connection. msg={}",
                      err.message());
           continue;
         }
+        SOCKS5_PROBE1(accept, socket.native_handle());
         SOCKS5_LOG(debug, "New connection accepted: {}",
                    net::ToString<tcp>(socket));
         if (config_.tcp_nodelay) {
@@ -71,11 +79,13 @@ class Listener final : public std::enable_shared_from_this<Listener<Proxy>>,
   }
 
   void AsyncRunProxy(tcp::socket socket) {
+    const auto executor = socket.get_executor();
     asio::co_spawn(
-        asio::make_strand(io_context_),
+        executor,
         RunProxy<Proxy>(io_context_, std::move(socket), tcp_relay_handler_,
                         udp_relay_handler_, config_, metrics_, user_auth_cb_,
-                        tcp_relay_data_processor_, udp_relay_data_processor_),
+                        tcp_relay_data_processor_, udp_relay_data_processor_,
+                        context_),
         asio::detached);
   }
 
@@ -89,6 +99,7 @@ class Listener final : public std::enable_shared_from_this<Listener<Proxy>>,
   const auth::server::UserAuthCb& user_auth_cb_;
   const TcpRelayDataProcessor& tcp_relay_data_processor_;
   const UdpRelayDataProcessor& udp_relay_data_processor_;
+  ServerContext& context_;
 };
 
 }  // namespace socks5::server
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include <server/loop_stats.hpp>
+#include <algorithm>
+
+namespace socks5::server {
+
+namespace {
+
+std::atomic_uint64_t next_loop_stats_id{1};
+
+// Slot of the current thread in the LoopStats that runs on it. LoopStats ids
+// are never reused, so a stale entry is never mistaken for a current one.
+struct ThreadSlotCache final {
+  uint64_t loop_stats_id{};
+  size_t index{};
+};
+
+thread_local ThreadSlotCache thread_slot_cache;
+
+int64_t SteadyNowNs() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Increment(std::atomic_uint64_t& counter, uint64_t value = 1) noexcept {
+  // The counter has a single writer, so a read-modify-write isn't needed.
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+}  // namespace
+
+LoopStats::LoopStats(size_t threads_num, bool count_handlers)
+    : threads_num_{std::max<size_t>(threads_num, 1)},
+      count_handlers_{count_handlers},
+      id_{next_loop_stats_id.fetch_add(1, std::memory_order_relaxed)},
+      slots_{std::make_unique<Slot[]>(threads_num_)} {}
+
+void LoopStats::RunThread(asio::io_context& io_context) {
+  auto* slot = CurrentSlot();
+  if (!slot) {
+    const auto index = next_index_.fetch_add(1, std::memory_order_relaxed);
+    if (index < threads_num_) {
+      slot = &slots_[index];
+      thread_slot_cache = ThreadSlotCache{id_, index};
+      slot->start_time_ns.store(SteadyNowNs(), std::memory_order_relaxed);
+      slot->attached.store(true, std::memory_order_release);
+    }
+  }
+  if (!slot || !count_handlers_) {
+    io_context.run();
+    return;
+  }
+  RunCounted(io_context, *slot);
+}
+
+void LoopStats::RunCounted(asio::io_context& io_context, Slot& slot) {
+  for (;;) {
+    // Ready handlers are timed one by one, so a handler that blocks the thread
+    // counts as busy. run_one() doesn't tell the wait for a handler from its
+    // execution, so the handler that ends a wait is counted as idle.
+    const auto start_ns = SteadyNowNs();
+    if (io_context.poll_one() != 0) {
+      Increment(slot.busy_ns, static_cast<uint64_t>(SteadyNowNs() - start_ns));
+      Increment(slot.handlers);
+      continue;
+    }
+    if (io_context.stopped() || io_context.run_one() == 0) {
+      return;
+    }
+    Increment(slot.handlers);
+  }
+}
+
+void LoopStats::StartLagProbes(asio::io_context& io_context,
+                               std::chrono::milliseconds interval) {
+  if (interval.count() == 0 || lag_probes_started_.exchange(true)) {
+    return;
+  }
+  for (size_t i = 0; i < threads_num_; ++i) {
+    asio::co_spawn(io_context, RunLagProbe(interval), asio::detached);
+  }
+}
+
+VoidAwait LoopStats::RunLagProbe(std::chrono::milliseconds interval) noexcept {
+  try {
+    const auto executor = co_await asio::this_coro::executor;
+    asio::steady_timer timer{executor};
+    for (;;) {
+      timer.expires_after(interval);
+      const auto [err] = co_await timer.async_wait(use_nothrow_awaitable);
+      if (err) {
+        co_return;
+      }
+      const auto posted = std::chrono::steady_clock::now();
+      co_await asio::post(executor, asio::use_awaitable);
+      const auto lag = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - posted)
+                           .count();
+      auto* slot = CurrentSlot();
+      if (!slot) {
+        continue;
+      }
+      const auto lag_us = static_cast<uint64_t>(lag);
+      Increment(slot->lag_samples);
+      Increment(slot->lag_total_us, lag_us);
+      slot->last_lag_us.store(lag_us, std::memory_order_relaxed);
+      if (lag_us > slot->max_lag_us.load(std::memory_order_relaxed)) {
+        slot->max_lag_us.store(lag_us, std::memory_order_relaxed);
+      }
+    }
+  } catch (...) {
+  }
+}
+
+size_t LoopStats::SessionStarted() noexcept {
+  const auto index = CurrentIndex();
+  if (index != kNoThread) {
+    slots_[index].live_sessions.fetch_add(1, std::memory_order_relaxed);
+  }
+  return index;
+}
+
+void LoopStats::SessionFinished(size_t thread_index) noexcept {
+  if (thread_index < threads_num_) {
+    slots_[thread_index].live_sessions.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+void LoopStats::Reset() noexcept {
+  next_index_.store(0, std::memory_order_relaxed);
+  for (size_t i = 0; i < threads_num_; ++i) {
+    auto& slot = slots_[i];
+    slot.attached.store(false, std::memory_order_relaxed);
+    slot.handlers.store(0, std::memory_order_relaxed);
+    slot.busy_ns.store(0, std::memory_order_relaxed);
+    slot.lag_samples.store(0, std::memory_order_relaxed);
+    slot.lag_total_us.store(0, std::memory_order_relaxed);
+    slot.last_lag_us.store(0, std::memory_order_relaxed);
+    slot.max_lag_us.store(0, std::memory_order_relaxed);
+  }
+}
+
+ThreadStatsVec LoopStats::Get() const {
+  ThreadStatsVec stats;
+  stats.reserve(threads_num_);
+  const auto now_ns = SteadyNowNs();
+  for (size_t i = 0; i < threads_num_; ++i) {
+    const auto& slot = slots_[i];
+    ThreadStats thread_stats;
+    thread_stats.handlers_total = slot.handlers.load(std::memory_order_relaxed);
+    thread_stats.lag_samples_total =
+        slot.lag_samples.load(std::memory_order_relaxed);
+    thread_stats.lag_total = std::chrono::microseconds{
+        slot.lag_total_us.load(std::memory_order_relaxed)};
+    thread_stats.last_lag = std::chrono::microseconds{
+        slot.last_lag_us.load(std::memory_order_relaxed)};
+    thread_stats.max_lag = std::chrono::microseconds{
+        slot.max_lag_us.load(std::memory_order_relaxed)};
+    thread_stats.live_sessions =
+        slot.live_sessions.load(std::memory_order_relaxed);
+    if (count_handlers_ && slot.attached.load(std::memory_order_acquire)) {
+      thread_stats.busy_time =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::nanoseconds{
+                  slot.busy_ns.load(std::memory_order_relaxed)});
+      const auto wall_time =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::nanoseconds{
+                  now_ns -
+                  slot.start_time_ns.load(std::memory_order_relaxed)});
+      thread_stats.idle_time = std::max(wall_time - thread_stats.busy_time,
+                                        std::chrono::microseconds::zero());
+    }
+    stats.push_back(thread_stats);
+  }
+  return stats;
+}
+
+LoopStats::Slot* LoopStats::CurrentSlot() noexcept {
+  const auto index = CurrentIndex();
+  return index == kNoThread ? nullptr : &slots_[index];
+}
+
+size_t LoopStats::CurrentIndex() const noexcept {
+  const auto& cache = thread_slot_cache;
+  return cache.loop_stats_id == id_ ? cache.index : kNoThread;
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <socks5/common/asio.hpp>
+#include <socks5/server/thread_stats.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <utils/spsc_queue.hpp>
+
+namespace socks5::server {
+
+// Scheduler statistics of the server threads. Every thread that runs the
+// io_context through RunThread() gets its own slot. Counters of a slot are
+// written by its thread only, except the number of live sessions, since a
+// session may be destroyed on another thread.
+class LoopStats final : utils::NonCopyable {
+ public:
+  static constexpr size_t kNoThread{static_cast<size_t>(-1)};
+
+  // Handlers are counted and timed only if count_handlers is set, it costs two
+  // clock reads and a scheduler round trip per handler.
+  explicit LoopStats(size_t threads_num, bool count_handlers = false);
+
+  // Runs the io_context on the calling thread. If handlers are counted, it's
+  // run handler by handler to count them and the wall time spent in them.
+  // Returns when the io_context is stopped or runs out of work.
+  void RunThread(asio::io_context& io_context);
+
+  // Spawns one lag probe per thread. Every probe posts a handler each interval
+  // and records its scheduling delay in the slot of the thread that executed
+  // it. Probes are spawned once and survive io_context restarts.
+  void StartLagProbes(asio::io_context& io_context,
+                      std::chrono::milliseconds interval);
+
+  // Returns the slot index of the calling thread or kNoThread for threads
+  // that don't run the io_context.
+  size_t SessionStarted() noexcept;
+  void SessionFinished(size_t thread_index) noexcept;
+
+  // Clears the counters and forgets the threads. Must be called while no
+  // thread runs the io_context.
+  void Reset() noexcept;
+
+  ThreadStatsVec Get() const;
+
+ private:
+  struct alignas(utils::kCacheLineSize) Slot final {
+    std::atomic_bool attached{};
+    std::atomic_int64_t start_time_ns{};
+    std::atomic_uint64_t handlers{};
+    std::atomic_uint64_t busy_ns{};
+    std::atomic_uint64_t lag_samples{};
+    std::atomic_uint64_t lag_total_us{};
+    std::atomic_uint64_t last_lag_us{};
+    std::atomic_uint64_t max_lag_us{};
+    std::atomic_uint64_t live_sessions{};
+  };
+
+  VoidAwait RunLagProbe(std::chrono::milliseconds interval) noexcept;
+  Slot* CurrentSlot() noexcept;
+  size_t CurrentIndex() const noexcept;
+
+  void RunCounted(asio::io_context& io_context, Slot& slot);
+
+  const size_t threads_num_;
+  const bool count_handlers_;
+  const uint64_t id_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic_size_t next_index_{};
+  std::atomic_bool lag_probes_started_{};
+};
+
+}  // namespace socks5::server
@@ -0,0 +1,132 @@
+#include <server/offload_pool.hpp>
+#include <utils/logger.hpp>
+#include <algorithm>
+#include <stdexcept>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace socks5::server {
+
+namespace {
+
+void PinThread(int cpu) noexcept {
+#ifdef __linux__
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  if (const auto err =
+          pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set)) {
+    SOCKS5_LOG(warn, "Failed to pin offload thread to CPU {}. Error: {}", cpu,
+               err);
+  }
+#else
+  (void)cpu;
+#endif
+}
+
+}  // namespace
+
+OffloadPool::OffloadPool(size_t threads_num, size_t max_inflight_bytes,
+                         const std::vector<int>& cpus)
+    : state_{std::make_shared<State>(max_inflight_bytes)},
+      work_guard_{asio::make_work_guard(io_context_)} {
+  if (threads_num == 0) {
+    throw std::runtime_error{
+        "The number of offload threads must be greater than 0"};
+  }
+  threads_.reserve(threads_num);
+  for (size_t i = 0; i < threads_num; ++i) {
+    const auto cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    threads_.emplace_back([this, cpu] {
+      if (cpu >= 0) {
+        PinThread(cpu);
+      }
+      for (;;) {
+        try {
+          io_context_.run();
+          return;
+        } catch (const std::exception& ex) {
+          SOCKS5_LOG(error, "Offload thread exception: {}", ex.what());
+        }
+      }
+    });
+  }
+}
+
+OffloadPool::~OffloadPool() {
+  work_guard_.reset();
+  io_context_.stop();
+  threads_.clear();
+}
+
+size_t OffloadPool::InflightBytes() const noexcept {
+  std::lock_guard lock{state_->mutex};
+  return state_->inflight_bytes;
+}
+
+bool OffloadPool::Fits(const State& state, size_t bytes) noexcept {
+  return state.inflight_bytes == 0 ||
+         state.inflight_bytes + bytes <= state.max_inflight_bytes;
+}
+
+void OffloadPool::Acquire(const StatePtr& state, size_t bytes,
+                          Handler handler) {
+  std::unique_lock lock{state->mutex};
+  if (state->waiters.empty() && Fits(*state, bytes)) {
+    state->inflight_bytes += bytes;
+    lock.unlock();
+    Complete(std::move(handler), {});
+    return;
+  }
+  const auto id = state->next_waiter_id++;
+  auto slot = asio::get_associated_cancellation_slot(handler);
+  // The slot is assigned before the waiter is published, since Release() on
+  // another thread may resume the caller as soon as the lock is released. The
+  // waiter is looked up by id, it may have got room already.
+  if (slot.is_connected()) {
+    slot.assign([state, id](asio::cancellation_type) {
+      std::unique_lock lock{state->mutex};
+      const auto it =
+          std::find_if(state->waiters.begin(), state->waiters.end(),
+                       [id](const Waiter& waiter) { return waiter.id == id; });
+      if (it == state->waiters.end()) {
+        return;
+      }
+      auto waiter_handler = std::move(it->handler);
+      state->waiters.erase(it);
+      lock.unlock();
+      Complete(std::move(waiter_handler), asio::error::operation_aborted);
+    });
+  }
+  state->waiters.push_back({id, bytes, std::move(handler)});
+}
+
+void OffloadPool::Release(const StatePtr& state, size_t bytes) noexcept {
+  std::vector<Handler> ready;
+  {
+    std::lock_guard lock{state->mutex};
+    state->inflight_bytes -= bytes;
+    while (!state->waiters.empty() &&
+           Fits(*state, state->waiters.front().bytes)) {
+      auto& waiter = state->waiters.front();
+      state->inflight_bytes += waiter.bytes;
+      ready.push_back(std::move(waiter.handler));
+      state->waiters.pop_front();
+    }
+  }
+  for (auto& handler : ready) {
+    Complete(std::move(handler), {});
+  }
+}
+
+// The handler is never completed inline, it's posted to its own executor.
+void OffloadPool::Complete(Handler handler, boost::system::error_code err) {
+  const auto executor = asio::get_associated_executor(handler);
+  asio::post(executor, [handler = std::move(handler), err]() mutable {
+    std::move(handler)(err);
+  });
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <socks5/common/asio.hpp>
+#include <socks5/utils/non_copyable.hpp>
+
+namespace socks5::server {
+
+// Threads on which the tcp relays run their synchronous data processors, so
+// heavy processors don't starve the io of the server threads. The relayed
+// bytes queued to or processed by the pool are bounded. Relays wait for room
+// in FIFO order, and the data of a relay is processed in order since it waits
+// for every chunk.
+class OffloadPool final : utils::NonCopyable {
+ public:
+  // cpus are the CPUs the threads are pinned to round-robin, pinning is
+  // skipped if it's empty or unsupported. Throws if threads_num is 0.
+  OffloadPool(size_t threads_num, size_t max_inflight_bytes,
+              const std::vector<int>& cpus);
+  // Joins the threads. The work that hasn't started is dropped.
+  ~OffloadPool();
+
+  // Runs fn on a pool thread after waiting for room for bytes, then resumes
+  // the caller on its own executor. Exceptions of fn are rethrown to the
+  // caller.
+  template <typename Fn>
+  VoidAwait Run(size_t bytes, Fn& fn) {
+    const auto state = state_;
+    co_await asio::async_initiate<decltype(asio::use_awaitable),
+                                  void(boost::system::error_code)>(
+        [state, bytes](auto handler) {
+          Acquire(state, bytes, std::move(handler));
+        },
+        asio::use_awaitable);
+    const InflightGuard guard{state, bytes};
+    co_await asio::co_spawn(
+        io_context_,
+        [&fn]() -> VoidAwait {
+          fn();
+          co_return;
+        },
+        asio::use_awaitable);
+  }
+
+  size_t InflightBytes() const noexcept;
+
+ private:
+  using Handler =
+      asio::any_completion_handler<void(boost::system::error_code)>;
+
+  struct Waiter final {
+    uint64_t id;
+    size_t bytes;
+    Handler handler;
+  };
+
+  // Outlives the pool, the relays waiting for room keep it.
+  struct State final {
+    explicit State(size_t max_inflight) : max_inflight_bytes{max_inflight} {}
+
+    std::mutex mutex;
+    const size_t max_inflight_bytes;
+    size_t inflight_bytes{0};
+    uint64_t next_waiter_id{0};
+    std::list<Waiter> waiters;
+  };
+  using StatePtr = std::shared_ptr<State>;
+
+  struct InflightGuard final {
+    ~InflightGuard() { Release(state, bytes); }
+
+    StatePtr state;
+    size_t bytes;
+  };
+
+  // A chunk always fits into an empty pool, whatever its size.
+  static bool Fits(const State& state, size_t bytes) noexcept;
+  static void Acquire(const StatePtr& state, size_t bytes, Handler handler);
+  static void Release(const StatePtr& state, size_t bytes) noexcept;
+  static void Complete(Handler handler, boost::system::error_code err);
+
+  StatePtr state_;
+  asio::io_context io_context_;
+  asio::executor_work_guard<asio::io_context::executor_type> work_guard_;
+  std::vector<std::jthread> threads_;
+};
+
+}  // namespace socks5::server
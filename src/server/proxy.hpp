@@ -6,8 +6,15 @@
 #include <socks5/utils/non_copyable.hpp>
 #include <net/utils.hpp>
 #include <server/udp_relay.hpp>
+#include <server/session.hpp>
+#include <server/server_context.hpp>
+#include <server/shared_udp_relay.hpp>
+#include <utils/timeout.hpp>
 #include <socks5/common/asio.hpp>
 #include <socks5/server/config.hpp>
+#ifdef SOCKS5_WITH_TLS
+#include <net/tls.hpp>
+#endif
 
 namespace socks5::server {
 
@@ -22,7 +29,8 @@ class Proxy final : utils::NonCopyable {
         const UdpRelayHandler& udp_relay_handler, const Config& config,
         common::Metrics& metrics, const auth::server::UserAuthCb& user_auth_cb,
         const TcpRelayDataProcessor& tcp_data_processor,
-        const UdpRelayDataProcessor& udp_data_processor) noexcept
+        const UdpRelayDataProcessor& udp_data_processor,
+        ServerContext& context) noexcept
       : io_context_{io_context},
         connect_{std::move(connect)},
         tcp_relay_handler_{tcp_relay_handler},
@@ -31,11 +39,29 @@ class Proxy final : utils::NonCopyable {
         metrics_{metrics},
         user_auth_cb_{user_auth_cb},
         tcp_relay_data_processor_{tcp_data_processor},
-        udp_relay_data_processor_{udp_data_processor} {}
+        udp_relay_data_processor_{udp_data_processor},
+        session_{context, connect_.GetSocket()},
+        shared_udp_relay_{kSharedUdpRelaySupported
+                              ? context.GetSharedUdpRelay()
+                              : nullptr}
+#ifdef SOCKS5_WITH_TLS
+        ,
+        tls_context_{context.GetTlsContext()}
+#endif
+  {
+  }
 
   VoidAwait Run() noexcept {
     try {
-      Handshake handshake{connect_, config_, user_auth_cb_};
+#ifdef SOCKS5_WITH_TLS
+      if (tls_context_ && !co_await AcceptTls()) {
+        co_return connect_.Stop();
+      }
+#endif
+      const auto compressed_tunnel =
+          kCompressedTunnelSupported && config_.tcp_compressed_tunnel;
+      Handshake handshake{connect_,  config_,          user_auth_cb_,
+                          session_, shared_udp_relay_, compressed_tunnel};
       auto handshake_res = co_await handshake.Run();
       if (!handshake_res) {
         SOCKS5_LOG(debug, "Handshake failure. Client: {}",
@@ -49,6 +75,42 @@ class Proxy final : utils::NonCopyable {
   }
 
  private:
+  // Custom udp relay handlers own the proxy socket, so only the default
+  // handler can be replaced with the shared udp relay.
+  static constexpr bool kSharedUdpRelaySupported =
+      std::is_same_v<std::decay_t<UdpRelayHandler>, DefaultUdpRelayHandlerCb>;
+  // Custom tcp relay handlers and data processors get the data as the client
+  // sent it, so only the default handler relays compressed tunnels.
+  static constexpr bool kCompressedTunnelSupported =
+      std::is_same_v<std::decay_t<TcpRelayHandler>, DefaultTcpRelayHandlerCb>;
+
+#ifdef SOCKS5_WITH_TLS
+  // The socket is moved to kTLS by the TLS handshake, so the socks5 handshake
+  // and the relays use it as a plain one.
+  BoolAwait AcceptTls() noexcept {
+    try {
+      const auto res = co_await (
+          tls_context_->Handshake(connect_.GetSocket()) ||
+          utils::Timeout(std::chrono::seconds{config_.handshake_timeout}));
+      if (res.index() == 1) {
+        SOCKS5_LOG(debug, "TLS handshake timeout expired. Client: {}",
+                   net::ToString(connect_));
+        co_return false;
+      }
+      if (const auto& err = std::get<0>(res)) {
+        SOCKS5_LOG(debug, "TLS handshake failure. Client: {}. msg={}",
+                   net::ToString(connect_), err.message());
+        co_return false;
+      }
+      co_return true;
+    } catch (const std::exception& ex) {
+      SOCKS5_LOG(error, "TLS handshake exception. Client: {}. {}",
+                 net::ToString(connect_), ex.what());
+      co_return false;
+    }
+  }
+#endif
+
   VoidAwait Relay(HandshakeResult& handshake_res) {
     co_await std::visit(
         [this](auto& cmd_result) -> VoidAwait {
@@ -58,6 +120,7 @@ class Proxy final : utils::NonCopyable {
   }
 
   VoidAwait RunRelay(ConnectCmdResult& connect_cmd_res) noexcept {
+    session_.SetState(SessionState::kTcpRelay);
     TcpRelay tcp_relay{
         io_context_,
         std::move(connect_),
@@ -65,11 +128,18 @@ class Proxy final : utils::NonCopyable {
         tcp_relay_handler_,
         config_,
         metrics_,
-        tcp_relay_data_processor_};
+        tcp_relay_data_processor_,
+        session_};
+    if constexpr (kCompressedTunnelSupported) {
+      if (connect_cmd_res.compressed_tunnel) {
+        co_return co_await tcp_relay.RunCompressedTunnel();
+      }
+    }
     co_await tcp_relay.Run();
   }
 
   VoidAwait RunRelay(UdpAssociateCmdResult& udp_associate_cmd_res) noexcept {
+    session_.SetState(SessionState::kUdpRelay);
     UdpRelay udp_relay{
         io_context_,
         std::move(connect_),
@@ -79,11 +149,19 @@ class Proxy final : utils::NonCopyable {
         udp_relay_handler_,
         config_,
         metrics_,
-        udp_relay_data_processor_};
+        udp_relay_data_processor_,
+        session_};
     co_await udp_relay.Run();
   }
 
+  VoidAwait RunRelay(SharedUdpAssociateCmdResult& cmd_res) noexcept {
+    session_.SetState(SessionState::kUdpRelay);
+    co_await shared_udp_relay_->Relay(std::move(connect_),
+                                      std::move(cmd_res.client_addr), session_);
+  }
+
   VoidAwait RunRelay(BindCmdResult& bind_cmd_res) noexcept {
+    session_.SetState(SessionState::kTcpRelay);
     TcpRelay tcp_relay{
         io_context_,
         std::move(connect_),
@@ -91,7 +169,8 @@ class Proxy final : utils::NonCopyable {
         tcp_relay_handler_,
         config_,
         metrics_,
-        tcp_relay_data_processor_};
+        tcp_relay_data_processor_,
+        session_};
     co_await tcp_relay.Run();
   }
 
@@ -104,6 +183,11 @@ class Proxy final : utils::NonCopyable {
   const auth::server::UserAuthCb& user_auth_cb_;
   const TcpRelayDataProcessor& tcp_relay_data_processor_;
   const UdpRelayDataProcessor& udp_relay_data_processor_;
+  Session session_;
+  SharedUdpRelay* shared_udp_relay_;
+#ifdef SOCKS5_WITH_TLS
+  net::TlsContext* tls_context_;
+#endif
 };
 
 template <typename Proxy>
@@ -113,7 +197,8 @@ VoidAwait RunProxy(asio::io_context& io_context, tcp::socket socket,
                    const Config& config, common::Metrics& metrics,
                    const auth::server::UserAuthCb& user_auth_cb,
                    const TcpRelayDataProcessor& tcp_data_processor,
-                   const UdpRelayDataProcessor& udp_data_processor) noexcept {
+                   const UdpRelayDataProcessor& udp_data_processor,
+                   ServerContext& context) noexcept {
   Proxy proxy{io_context,
               net::MakeTcpConnect(std::move(socket), metrics),
               tcp_relay,
@@ -122,7 +207,8 @@ VoidAwait RunProxy(asio::io_context& io_context, tcp::socket socket,
               metrics,
               user_auth_cb,
               tcp_data_processor,
-              udp_data_processor};
+              udp_data_processor,
+              context};
   co_await proxy.Run();
 }
 
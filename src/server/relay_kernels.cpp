@@ -0,0 +1,428 @@
+#include <socks5/server/relay_kernels.hpp>
+#include <utils/byte_set.hpp>
+#include <utils/cpu_features.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#ifdef SOCKS5_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace socks5::server {
+
+namespace {
+
+// The widest vector register of the kernels.
+constexpr size_t kMaxVectorSize{32};
+
+template <typename T>
+T Load(const uint8_t* data) noexcept {
+  T value;
+  std::memcpy(&value, data, sizeof(value));
+  if constexpr (std::endian::native == std::endian::big) {
+    if constexpr (sizeof(T) == 8) {
+      value = __builtin_bswap64(value);
+    } else {
+      value = __builtin_bswap32(value);
+    }
+  }
+  return value;
+}
+
+// XORs the data with the repeated key starting at pos, returns the position
+// in the key after the data.
+using XorFn = size_t (*)(uint8_t* data, size_t size, const uint8_t* key,
+                         size_t key_size, size_t pos);
+
+size_t XorScalar(uint8_t* data, size_t size, const uint8_t* key,
+                 size_t key_size, size_t pos) noexcept {
+  const auto step = sizeof(uint64_t) % key_size;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t block;
+    uint64_t key_block;
+    std::memcpy(&block, data + i, sizeof(block));
+    std::memcpy(&key_block, key + pos, sizeof(key_block));
+    block ^= key_block;
+    std::memcpy(data + i, &block, sizeof(block));
+    pos += step;
+    if (pos >= key_size) {
+      pos -= key_size;
+    }
+  }
+  for (; i < size; ++i) {
+    data[i] ^= key[pos];
+    if (++pos == key_size) {
+      pos = 0;
+    }
+  }
+  return pos;
+}
+
+#ifdef SOCKS5_X86_SIMD
+
+__attribute__((target("avx2"))) size_t XorAvx2(uint8_t* data, size_t size,
+                                               const uint8_t* key,
+                                               size_t key_size,
+                                               size_t pos) noexcept {
+  const auto step = sizeof(__m256i) % key_size;
+  size_t i = 0;
+  for (; i + sizeof(__m256i) <= size; i += sizeof(__m256i)) {
+    auto* block = reinterpret_cast<__m256i*>(data + i);
+    const auto key_block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + pos));
+    _mm256_storeu_si256(
+        block, _mm256_xor_si256(_mm256_loadu_si256(block), key_block));
+    pos += step;
+    if (pos >= key_size) {
+      pos -= key_size;
+    }
+  }
+  return XorScalar(data + i, size - i, key, key_size, pos);
+}
+
+#else
+
+size_t XorAvx2(uint8_t* data, size_t size, const uint8_t* key,
+               size_t key_size, size_t pos) noexcept {
+  return XorScalar(data, size, key, key_size, pos);
+}
+
+#endif
+
+XorFn SelectXor() noexcept {
+  static const XorFn xor_fn = utils::CpuHasAvx2() ? XorAvx2 : XorScalar;
+  return xor_fn;
+}
+
+using TranslateFn = void (*)(uint8_t* data, size_t size,
+                             const uint8_t* table);
+
+void TranslateScalar(uint8_t* data, size_t size,
+                     const uint8_t* table) noexcept {
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = table[data[i]];
+  }
+}
+
+#ifdef SOCKS5_X86_SIMD
+
+// A byte is looked up in the 16-byte row of the table selected by its high
+// nibble with a shuffle by its low nibble, every row is tried and the result
+// of the matching one is kept.
+__attribute__((target("ssse3"))) void TranslateSsse3(
+    uint8_t* data, size_t size, const uint8_t* table) noexcept {
+  __m128i rows[16];
+  for (size_t hi = 0; hi < std::size(rows); ++hi) {
+    rows[hi] =
+        _mm_load_si128(reinterpret_cast<const __m128i*>(table + hi * 16));
+  }
+  const auto nibble = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + sizeof(__m128i) <= size; i += sizeof(__m128i)) {
+    auto* block = reinterpret_cast<__m128i*>(data + i);
+    const auto bytes = _mm_loadu_si128(block);
+    const auto lo = _mm_and_si128(bytes, nibble);
+    const auto hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+    auto result = _mm_setzero_si128();
+    for (size_t row = 0; row < std::size(rows); ++row) {
+      const auto in_row =
+          _mm_cmpeq_epi8(hi, _mm_set1_epi8(static_cast<char>(row)));
+      result = _mm_or_si128(
+          result, _mm_and_si128(in_row, _mm_shuffle_epi8(rows[row], lo)));
+    }
+    _mm_storeu_si128(block, result);
+  }
+  TranslateScalar(data + i, size - i, table);
+}
+
+__attribute__((target("avx2"))) void TranslateAvx2(
+    uint8_t* data, size_t size, const uint8_t* table) noexcept {
+  __m256i rows[16];
+  for (size_t hi = 0; hi < std::size(rows); ++hi) {
+    rows[hi] = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(table + hi * 16)));
+  }
+  const auto nibble = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + sizeof(__m256i) <= size; i += sizeof(__m256i)) {
+    auto* block = reinterpret_cast<__m256i*>(data + i);
+    const auto bytes = _mm256_loadu_si256(block);
+    const auto lo = _mm256_and_si256(bytes, nibble);
+    const auto hi = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble);
+    auto result = _mm256_setzero_si256();
+    for (size_t row = 0; row < std::size(rows); ++row) {
+      const auto in_row =
+          _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(static_cast<char>(row)));
+      result = _mm256_or_si256(
+          result,
+          _mm256_and_si256(in_row, _mm256_shuffle_epi8(rows[row], lo)));
+    }
+    _mm256_storeu_si256(block, result);
+  }
+  TranslateSsse3(data + i, size - i, table);
+}
+
+#else
+
+void TranslateSsse3(uint8_t* data, size_t size,
+                    const uint8_t* table) noexcept {
+  TranslateScalar(data, size, table);
+}
+
+void TranslateAvx2(uint8_t* data, size_t size, const uint8_t* table) noexcept {
+  TranslateScalar(data, size, table);
+}
+
+#endif
+
+TranslateFn SelectTranslate() noexcept {
+  static const TranslateFn translate_fn =
+      utils::CpuHasAvx2()    ? TranslateAvx2
+      : utils::CpuHasSsse3() ? TranslateSsse3
+                             : TranslateScalar;
+  return translate_fn;
+}
+
+#if !defined(__ARM_FEATURE_CRC32)
+
+// Reflected polynomial of CRC-32C.
+constexpr uint32_t kCrc32cPoly{0x82f63b78};
+
+constexpr std::array<uint32_t, 256> MakeCrc32cTable() noexcept {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t byte = 0; byte < table.size(); ++byte) {
+    auto crc = byte;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (crc & 1 ? kCrc32cPoly : 0);
+    }
+    table[byte] = crc;
+  }
+  return table;
+}
+
+constexpr auto kCrc32cTable = MakeCrc32cTable();
+
+#endif
+
+using Crc32cFn = uint32_t (*)(uint32_t crc, const uint8_t* data, size_t size);
+
+uint32_t Crc32cScalar(uint32_t crc, const uint8_t* data,
+                      size_t size) noexcept {
+#if defined(__ARM_FEATURE_CRC32)
+  for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+    crc = __crc32cd(crc, Load<uint64_t>(data));
+    data += sizeof(uint64_t);
+  }
+  for (; size > 0; --size) {
+    crc = __crc32cb(crc, *data++);
+  }
+#else
+  for (; size > 0; --size) {
+    crc = (crc >> 8) ^ kCrc32cTable[(crc ^ *data++) & 0xff];
+  }
+#endif
+  return crc;
+}
+
+#ifdef SOCKS5_X86_SIMD
+
+__attribute__((target("sse4.2"))) uint32_t Crc32cSse42(
+    uint32_t crc, const uint8_t* data, size_t size) noexcept {
+#ifdef __x86_64__
+  uint64_t crc64 = crc;
+  for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+    crc64 = _mm_crc32_u64(crc64, Load<uint64_t>(data));
+    data += sizeof(uint64_t);
+  }
+  crc = static_cast<uint32_t>(crc64);
+#endif
+  for (; size >= sizeof(uint32_t); size -= sizeof(uint32_t)) {
+    crc = _mm_crc32_u32(crc, Load<uint32_t>(data));
+    data += sizeof(uint32_t);
+  }
+  for (; size > 0; --size) {
+    crc = _mm_crc32_u8(crc, *data++);
+  }
+  return crc;
+}
+
+#else
+
+uint32_t Crc32cSse42(uint32_t crc, const uint8_t* data, size_t size) noexcept {
+  return Crc32cScalar(crc, data, size);
+}
+
+#endif
+
+Crc32cFn SelectCrc32c() noexcept {
+  static const Crc32cFn crc32c_fn =
+      utils::CpuHasSse42() ? Crc32cSse42 : Crc32cScalar;
+  return crc32c_fn;
+}
+
+constexpr uint64_t kPrime1{0x9e3779b185ebca87};
+constexpr uint64_t kPrime2{0xc2b2ae3d27d4eb4f};
+constexpr uint64_t kPrime3{0x165667b19e3779f9};
+constexpr uint64_t kPrime4{0x85ebca77c2b2ae63};
+constexpr uint64_t kPrime5{0x27d4eb2f165667c5};
+constexpr size_t kStripeSize{32};
+
+uint64_t XxRound(uint64_t acc, uint64_t input) noexcept {
+  acc += input * kPrime2;
+  return std::rotl(acc, 31) * kPrime1;
+}
+
+uint64_t XxMergeRound(uint64_t acc, uint64_t value) noexcept {
+  acc ^= XxRound(0, value);
+  return acc * kPrime1 + kPrime4;
+}
+
+// Consumes the whole stripes of the data, returns the number of bytes
+// consumed.
+size_t XxStripes(std::array<uint64_t, 4>& acc, const uint8_t* data,
+                 size_t size) noexcept {
+  auto [acc1, acc2, acc3, acc4] = acc;
+  const auto* const begin = data;
+  for (; size >= kStripeSize; size -= kStripeSize, data += kStripeSize) {
+    acc1 = XxRound(acc1, Load<uint64_t>(data));
+    acc2 = XxRound(acc2, Load<uint64_t>(data + 8));
+    acc3 = XxRound(acc3, Load<uint64_t>(data + 16));
+    acc4 = XxRound(acc4, Load<uint64_t>(data + 24));
+  }
+  acc = {acc1, acc2, acc3, acc4};
+  return static_cast<size_t>(data - begin);
+}
+
+}  // namespace
+
+XorStream::XorStream(std::string_view key) : key_size_{key.size()} {
+  if (key.empty()) {
+    throw std::invalid_argument{"XorStream key is empty"};
+  }
+  key_.resize(key_size_ + kMaxVectorSize);
+  for (size_t i = 0; i < key_.size(); ++i) {
+    key_[i] = static_cast<uint8_t>(key[i % key_size_]);
+  }
+}
+
+void XorStream::Process(char* data, size_t size) noexcept {
+  pos_ = SelectXor()(reinterpret_cast<uint8_t*>(data), size, key_.data(),
+                     key_size_, pos_);
+}
+
+ByteTranslator::ByteTranslator(const Table& table) noexcept : table_{table} {}
+
+void ByteTranslator::Process(char* data, size_t size) const noexcept {
+  SelectTranslate()(reinterpret_cast<uint8_t*>(data), size, table_.data());
+}
+
+DelimiterScanner::DelimiterScanner(std::string_view delimiters,
+                                   DelimiterCb on_delimiter)
+    : on_delimiter_{std::move(on_delimiter)} {
+  utils::ByteSet set{};
+  for (const auto delimiter : delimiters) {
+    set[static_cast<uint8_t>(delimiter)] = true;
+  }
+  finder_ = std::make_shared<const utils::ByteSetFinder>(set);
+}
+
+const char* DelimiterScanner::Find(const char* begin,
+                                   const char* end) const noexcept {
+  return reinterpret_cast<const char*>(
+      finder_->Find(reinterpret_cast<const uint8_t*>(begin),
+                    reinterpret_cast<const uint8_t*>(end)));
+}
+
+void DelimiterScanner::Update(const char* data, size_t size) {
+  const auto* const end = data + size;
+  for (auto* pos = Find(data, end); pos != end; pos = Find(pos + 1, end)) {
+    ++count_;
+    if (on_delimiter_) {
+      on_delimiter_(offset_ + static_cast<uint64_t>(pos - data));
+    }
+  }
+  offset_ += size;
+}
+
+void Crc32c::Update(const char* data, size_t size) noexcept {
+  crc_ = SelectCrc32c()(crc_, reinterpret_cast<const uint8_t*>(data), size);
+}
+
+XxHash64::XxHash64(uint64_t seed) noexcept : seed_{seed} { Reset(); }
+
+void XxHash64::Reset() noexcept {
+  acc_ = {seed_ + kPrime1 + kPrime2, seed_ + kPrime2, seed_, seed_ - kPrime1};
+  total_size_ = 0;
+  tail_size_ = 0;
+}
+
+void XxHash64::Update(const char* data, size_t size) noexcept {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+  total_size_ += size;
+  if (tail_size_ > 0) {
+    const auto copied = std::min(size, kStripeSize - tail_size_);
+    std::memcpy(tail_.data() + tail_size_, bytes, copied);
+    tail_size_ += copied;
+    bytes += copied;
+    size -= copied;
+    if (tail_size_ < kStripeSize) {
+      return;
+    }
+    XxStripes(acc_, tail_.data(), kStripeSize);
+    tail_size_ = 0;
+  }
+  const auto consumed = XxStripes(acc_, bytes, size);
+  tail_size_ = size - consumed;
+  std::memcpy(tail_.data(), bytes + consumed, tail_size_);
+}
+
+uint64_t XxHash64::Value() const noexcept {
+  uint64_t hash;
+  if (total_size_ >= kStripeSize) {
+    const auto& [acc1, acc2, acc3, acc4] = acc_;
+    hash = std::rotl(acc1, 1) + std::rotl(acc2, 7) + std::rotl(acc3, 12) +
+           std::rotl(acc4, 18);
+    for (const auto acc : acc_) {
+      hash = XxMergeRound(hash, acc);
+    }
+  } else {
+    hash = seed_ + kPrime5;
+  }
+  hash += total_size_;
+
+  const auto* data = tail_.data();
+  auto size = tail_size_;
+  for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+    hash ^= XxRound(0, Load<uint64_t>(data));
+    hash = std::rotl(hash, 27) * kPrime1 + kPrime4;
+    data += sizeof(uint64_t);
+  }
+  if (size >= sizeof(uint32_t)) {
+    hash ^= Load<uint32_t>(data) * kPrime1;
+    hash = std::rotl(hash, 23) * kPrime2 + kPrime3;
+    data += sizeof(uint32_t);
+    size -= sizeof(uint32_t);
+  }
+  for (; size > 0; --size) {
+    hash ^= *data++ * kPrime5;
+    hash = std::rotl(hash, 11) * kPrime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+}  // namespace socks5::server
@@ -3,11 +3,15 @@
 #include <utils/logger.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 #include <server/listener.hpp>
+#include <server/server_context.hpp>
 #include <mutex>
 
 namespace socks5::server {
 
 struct Server::Impl {
+  // Sessions may access the context until the io_context destroys them, so it
+  // is destroyed last.
+  detail::ServerContextPtr context;
   IoContextPtr io_context;
   std::any tcp_relay_handler;
   std::any udp_relay_handler;
@@ -27,8 +31,10 @@ Server::Server(IoContextPtr io_context, std::any tcp_relay_handler,
                common::MetricsPtr metrics,
                auth::server::UserAuthCbPtr user_auth_cb,
                TcpRelayDataProcessorPtr tcp_data_processor,
-               UdpRelayDataProcessorPtr udp_data_processor)
-    : impl_{std::move(io_context),
+               UdpRelayDataProcessorPtr udp_data_processor,
+               detail::ServerContextPtr context)
+    : impl_{std::move(context),
+            std::move(io_context),
             std::move(tcp_relay_handler),
             std::move(udp_relay_handler),
             std::move(listener_runner),
@@ -53,10 +59,14 @@ void Server::Run() {
   SOCKS5_LOG(info, "Socks5 server started");
   ResetComponents();
   RunListener();
-  const auto thread_cb = [this] {
+  auto& loop_stats = impl_->context->GetLoopStats();
+  loop_stats.StartLagProbes(
+      *impl_->io_context,
+      std::chrono::milliseconds{impl_->config->loop_lag_probe_interval});
+  const auto thread_cb = [this, &loop_stats] {
     while (!impl_->io_context->stopped()) {
       try {
-        impl_->io_context->run();
+        loop_stats.RunThread(*impl_->io_context);
       } catch (const std::exception& ex) {
         SOCKS5_LOG(error, "Unhandled exception: {}", ex.what());
       } catch (...) {
@@ -81,6 +91,26 @@ size_t Server::GetSentBytesTotal() const noexcept {
   return impl_->metrics->GetSentBytesTotal();
 }
 
+size_t Server::GetDroppedFlowRecordsTotal() const noexcept {
+  return impl_->context->GetFlowRecorder().Dropped();
+}
+
+ThreadStatsVec Server::GetThreadStats() const {
+  return impl_->context->GetLoopStats().Get();
+}
+
+SessionInfoVec Server::GetSessions() const {
+  return impl_->context->GetSessionRegistry().Snapshot();
+}
+
+size_t Server::KillSessions(const SessionPredicate& pred) {
+  return impl_->context->GetSessionRegistry().Kill(pred);
+}
+
+void Server::DumpFlightRecorder(std::ostream& out) const {
+  impl_->context->GetFlightRecorder().Dump(out);
+}
+
 void Server::Stop() noexcept {
   impl_->io_context->stop();
   SOCKS5_LOG(info, "Socks5 server stopped");
@@ -93,6 +123,7 @@ void Server::RunListener() const { impl_->listener_runner(); }
 void Server::ResetComponents() {
   impl_->io_context->restart();
   impl_->metrics->Clear();
+  impl_->context->GetLoopStats().Reset();
 }
 
 asio::io_context& Server::IOContext() noexcept { return *impl_->io_context; }
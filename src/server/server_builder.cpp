@@ -6,11 +6,18 @@
 #include <socks5/server/config.hpp>
 #include <net/tcp_connection.hpp>
 #include <net/udp_connection.hpp>
+#ifdef SOCKS5_WITH_TLS
+#include <net/tls.hpp>
+#endif
 #include <socks5/common/metrics.hpp>
 #include <server/handshake.hpp>
 #include <socks5/server/handler_defs.hpp>
 #include <socks5/server/server_builder.hpp>
 #include <server/relay_data_processors.hpp>
+#include <server/server_context.hpp>
+#include <server/shared_udp_relay.hpp>
+#include <server/dns_cache.hpp>
+#include <server/offload_pool.hpp>
 #include <type_traits>
 #include <utility>
 
@@ -26,6 +33,7 @@ template <typename TcpRelayHandler, typename UdpRelayHandler>
 Server MakeServer(TcpRelayHandler tcp_relay_handler,
                   UdpRelayHandler udp_relay_handler, Config config,
                   auth::server::UserAuthCb user_auth_cb,
+                  FlowRecordCb flow_record_cb,
                   TcpRelayDataProcessor tcp_data_processor =
                       MakeDefaultTcpRelayDataProcessor(),
                   UdpRelayDataProcessor udp_data_processor =
@@ -43,6 +51,14 @@ Server MakeServer(TcpRelayHandler tcp_relay_handler,
       std::make_shared<TcpRelayDataProcessor>(std::move(tcp_data_processor));
   const auto udp_data_processor_ptr =
       std::make_shared<UdpRelayDataProcessor>(std::move(udp_data_processor));
+  const auto context_ptr = std::make_shared<ServerContext>(
+      std::move(flow_record_cb), config_ptr->threads_num,
+      config_ptr->flight_recorder_capacity, config_ptr->loop_handler_stats);
+  if (config_ptr->flight_recorder_dump_signal != 0) {
+    context_ptr->GetFlightRecorder().DumpOnSignal(
+        config_ptr->flight_recorder_dump_signal,
+        config_ptr->flight_recorder_dump_path);
+  }
   const auto listener =
       std::make_shared<Listener<ServerProxy<TcpRelayHandler, UdpRelayHandler>>>(
           *io_context_ptr,
@@ -50,17 +66,49 @@ Server MakeServer(TcpRelayHandler tcp_relay_handler,
                         config_ptr->listener_addr.second},
           *tcp_relay_handler_ptr, *udp_relay_handler_ptr, *config_ptr,
           *metrics_ptr, *user_auth_cb_ptr, *tcp_data_processor_ptr,
-          *udp_data_processor_ptr);
+          *udp_data_processor_ptr, *context_ptr);
+  SharedUdpRelayPtr shared_udp_relay;
+  if (config_ptr->udp_shared_relay) {
+    shared_udp_relay = std::make_shared<SharedUdpRelay>(
+        *io_context_ptr, *config_ptr, *metrics_ptr);
+    context_ptr->SetSharedUdpRelay(shared_udp_relay.get());
+  }
+  std::shared_ptr<OffloadPool> offload_pool;
+  if (config_ptr->tcp_offload_threads != 0) {
+    offload_pool = std::make_shared<OffloadPool>(
+        config_ptr->tcp_offload_threads,
+        config_ptr->tcp_offload_max_inflight_bytes,
+        config_ptr->tcp_offload_cpus);
+    context_ptr->SetOffloadPool(offload_pool.get());
+  }
+#ifdef SOCKS5_WITH_TLS
+  if (config_ptr->tls) {
+    context_ptr->SetTlsContext(net::TlsContext::MakeServer(
+        config_ptr->tls_cert_chain_file, config_ptr->tls_private_key_file,
+        config_ptr->tls_session_timeout));
+  }
+#endif
+  if (config_ptr->udp_dns_cache) {
+    context_ptr->SetDnsCache(
+        std::make_unique<DnsCache>(config_ptr->udp_dns_cache_resolvers,
+                                   config_ptr->udp_dns_cache_size));
+  }
 
   return Server{std::move(io_context_ptr),
                 std::move(tcp_relay_handler_ptr),
                 std::move(udp_relay_handler_ptr),
-                [listener]() { listener->Run(); },
+                [listener, shared_udp_relay, offload_pool]() {
+                  if (shared_udp_relay) {
+                    shared_udp_relay->Run();
+                  }
+                  listener->Run();
+                },
                 std::move(config_ptr),
                 std::move(metrics_ptr),
                 std::move(user_auth_cb_ptr),
                 std::move(tcp_data_processor_ptr),
-                std::move(udp_data_processor_ptr)};
+                std::move(udp_data_processor_ptr),
+                std::move(context_ptr)};
 }
 
 }  // namespace
@@ -68,11 +116,12 @@ Server MakeServer(TcpRelayHandler tcp_relay_handler,
 struct ServerBuilder::Impl {
   Config config;
   auth::server::UserAuthCb user_auth_cb;
+  FlowRecordCb flow_record_cb;
 };
 
 ServerBuilder::ServerBuilder(std::string addr, unsigned short port,
                              size_t threads_num)
-    : impl_{Config{}, auth::server::DefaultUserAuthCb} {
+    : impl_{Config{}, auth::server::DefaultUserAuthCb, FlowRecordCb{}} {
   impl_->config.listener_addr = std::make_pair(std::move(addr), port);
   impl_->config.threads_num = threads_num;
 }
@@ -109,12 +158,63 @@ ServerBuilder& ServerBuilder::SetUdpRelayTimeout(size_t timeout) noexcept {
   return *this;
 }
 
+ServerBuilder& ServerBuilder::SetUdpBatchSize(size_t size) noexcept {
+  impl_->config.udp_batch_size = size;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::SetUdpBatchDatagramSize(size_t size) noexcept {
+  impl_->config.udp_batch_datagram_size = size;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::SetUdpMaxTargetServers(size_t max) noexcept {
+  impl_->config.udp_max_target_servers = max;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::SetUdpTargetServerIdleTimeout(
+    size_t timeout) noexcept {
+  impl_->config.udp_target_server_idle_timeout = timeout;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::SetLoopLagProbeInterval(
+    size_t interval) noexcept {
+  impl_->config.loop_lag_probe_interval = interval;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::EnableLoopHandlerStats(
+    bool enable_loop_handler_stats) noexcept {
+  impl_->config.loop_handler_stats = enable_loop_handler_stats;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::SetFlightRecorderCapacity(
+    size_t capacity) noexcept {
+  impl_->config.flight_recorder_capacity = capacity;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::SetFlightRecorderDumpSignal(
+    int signal_number, std::string path) noexcept {
+  impl_->config.flight_recorder_dump_signal = signal_number;
+  impl_->config.flight_recorder_dump_path = std::move(path);
+  return *this;
+}
+
 ServerBuilder& ServerBuilder::SetUserAuthCb(
     auth::server::UserAuthCb user_auth_cb) {
   impl_->user_auth_cb = std::move(user_auth_cb);
   return *this;
 }
 
+ServerBuilder& ServerBuilder::SetFlowRecordCb(FlowRecordCb flow_record_cb) {
+  impl_->flow_record_cb = std::move(flow_record_cb);
+  return *this;
+}
+
 ServerBuilder& ServerBuilder::SetAuthUsername(
     std::string auth_username) noexcept {
   impl_->config.auth_username = std::move(auth_username);
@@ -138,6 +238,66 @@ ServerBuilder& ServerBuilder::EnableTcpNodelay(
   return *this;
 }
 
+ServerBuilder& ServerBuilder::EnableCompressedTunnel(
+    bool enable_compressed_tunnel) noexcept {
+  impl_->config.tcp_compressed_tunnel = enable_compressed_tunnel;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::EnableUdpGso(bool enable_udp_gso) noexcept {
+  impl_->config.udp_gso = enable_udp_gso;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::EnableUdpGro(bool enable_udp_gro) noexcept {
+  impl_->config.udp_gro = enable_udp_gro;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::EnableUdpConnectedTargets(
+    bool enable_udp_connect_targets) noexcept {
+  impl_->config.udp_connect_targets = enable_udp_connect_targets;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::EnableUdpSharedRelay(
+    bool enable_udp_shared_relay, unsigned short port) noexcept {
+  impl_->config.udp_shared_relay = enable_udp_shared_relay;
+  impl_->config.udp_shared_relay_port = port;
+  return *this;
+}
+
+#ifdef SOCKS5_WITH_TLS
+ServerBuilder& ServerBuilder::EnableTls(bool enable_tls,
+                                        std::string cert_chain_file,
+                                        std::string private_key_file,
+                                        size_t session_timeout) noexcept {
+  impl_->config.tls = enable_tls;
+  impl_->config.tls_cert_chain_file = std::move(cert_chain_file);
+  impl_->config.tls_private_key_file = std::move(private_key_file);
+  impl_->config.tls_session_timeout = session_timeout;
+  return *this;
+}
+#endif
+
+ServerBuilder& ServerBuilder::EnableUdpDnsCache(
+    bool enable_udp_dns_cache, std::vector<ResolverAddr> resolvers,
+    size_t size) noexcept {
+  impl_->config.udp_dns_cache = enable_udp_dns_cache;
+  impl_->config.udp_dns_cache_resolvers = std::move(resolvers);
+  impl_->config.udp_dns_cache_size = size;
+  return *this;
+}
+
+ServerBuilder& ServerBuilder::SetTcpOffloadThreads(
+    size_t threads_num, size_t max_inflight_bytes,
+    std::vector<int> cpus) noexcept {
+  impl_->config.tcp_offload_threads = threads_num;
+  impl_->config.tcp_offload_max_inflight_bytes = max_inflight_bytes;
+  impl_->config.tcp_offload_cpus = std::move(cpus);
+  return *this;
+}
+
 ServerBuilder& ServerBuilder::NeedToValidateAcceptedConnectionInBindCmd(
     bool need_to_validate) noexcept {
   impl_->config.bind_validate_accepted_conn = need_to_validate;
@@ -153,58 +313,64 @@ Server ServerBuilder::Dispatch(auto&& lhs, auto&& rhs) {
                                detail::UdpHandlerWrapper::DataProcessor>) {
     return MakeServer(TcpRelayHandlerWithDataProcessor,
                       UdpRelayHandlerWithDataProcessor, impl_->config,
-                      impl_->user_auth_cb, std::forward<decltype(lhs)>(lhs),
+                      impl_->user_auth_cb, impl_->flow_record_cb,
+                      std::forward<decltype(lhs)>(lhs),
                       std::forward<decltype(rhs)>(rhs));
   } else if constexpr (std::is_same_v<
                            LhsType, detail::TcpHandlerWrapper::DataProcessor> &&
                        std::is_same_v<RhsType,
                                       detail::UdpHandlerWrapper::DefaultTag>) {
     return MakeServer(TcpRelayHandlerWithDataProcessor, DefaultUdpRelayHandler,
-                      impl_->config, impl_->user_auth_cb,
+                      impl_->config, impl_->user_auth_cb, impl_->flow_record_cb,
                       std::forward<decltype(lhs)>(lhs));
   } else if constexpr (std::is_same_v<
                            LhsType, detail::TcpHandlerWrapper::DataProcessor>) {
     return MakeServer(TcpRelayHandlerWithDataProcessor,
                       std::forward<decltype(rhs)>(rhs), impl_->config,
-                      impl_->user_auth_cb, std::forward<decltype(lhs)>(lhs));
+                      impl_->user_auth_cb, impl_->flow_record_cb,
+                      std::forward<decltype(lhs)>(lhs));
   } else if constexpr (std::is_same_v<
                            RhsType, detail::UdpHandlerWrapper::DataProcessor> &&
                        std::is_same_v<LhsType,
                                       detail::TcpHandlerWrapper::DefaultTag>) {
     return MakeServer(DefaultTcpRelayHandler, UdpRelayHandlerWithDataProcessor,
-                      impl_->config, impl_->user_auth_cb,
+                      impl_->config, impl_->user_auth_cb, impl_->flow_record_cb,
                       MakeDefaultTcpRelayDataProcessor(),
                       std::forward<decltype(rhs)>(rhs));
   } else if constexpr (std::is_same_v<
                            RhsType, detail::UdpHandlerWrapper::DataProcessor>) {
     return MakeServer(std::forward<decltype(lhs)>(lhs),
                       UdpRelayHandlerWithDataProcessor, impl_->config,
-                      impl_->user_auth_cb, MakeDefaultTcpRelayDataProcessor(),
+                      impl_->user_auth_cb, impl_->flow_record_cb,
+                      MakeDefaultTcpRelayDataProcessor(),
                       std::forward<decltype(rhs)>(rhs));
   } else if constexpr (std::is_same_v<LhsType,
                                       detail::TcpHandlerWrapper::DefaultTag> &&
                        std::is_same_v<RhsType,
                                       detail::UdpHandlerWrapper::DefaultTag>) {
     return MakeServer(DefaultTcpRelayHandler, DefaultUdpRelayHandler,
-                      impl_->config, impl_->user_auth_cb);
+                      impl_->config, impl_->user_auth_cb,
+                      impl_->flow_record_cb);
   } else if constexpr (std::is_same_v<LhsType,
                                       detail::TcpHandlerWrapper::DefaultTag>) {
     return MakeServer(DefaultTcpRelayHandler, std::forward<decltype(rhs)>(rhs),
-                      impl_->config, impl_->user_auth_cb);
+                      impl_->config, impl_->user_auth_cb,
+                      impl_->flow_record_cb);
   } else if constexpr (std::is_same_v<RhsType,
                                       detail::UdpHandlerWrapper::DefaultTag>) {
     return MakeServer(std::forward<decltype(lhs)>(lhs), DefaultUdpRelayHandler,
-                      impl_->config, impl_->user_auth_cb);
+                      impl_->config, impl_->user_auth_cb,
+                      impl_->flow_record_cb);
   } else {
     return MakeServer(std::forward<decltype(lhs)>(lhs),
                       std::forward<decltype(rhs)>(rhs), impl_->config,
-                      impl_->user_auth_cb);
+                      impl_->user_auth_cb, impl_->flow_record_cb);
   }
 };
 
 Server ServerBuilder::Build() {
   return MakeServer(DefaultTcpRelayHandler, DefaultUdpRelayHandler,
-                    impl_->config, impl_->user_auth_cb);
+                    impl_->config, impl_->user_auth_cb, impl_->flow_record_cb);
 }
 
 Server ServerBuilder::Build(detail::TcpHandlerWrapper lhs_wrapper,
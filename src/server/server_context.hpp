@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <socks5/server/flow_record.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <server/dns_cache.hpp>
+#include <server/flight_recorder.hpp>
+#include <server/flow_recorder.hpp>
+#include <server/loop_stats.hpp>
+#include <server/session_registry.hpp>
+#ifdef SOCKS5_WITH_TLS
+#include <net/tls.hpp>
+#endif
+
+namespace socks5::server {
+
+class SharedUdpRelay;
+class OffloadPool;
+
+// Runtime state shared by all sessions of one server instance. Outlives the
+// io_context, so sessions may access it until they are destroyed.
+class ServerContext final : utils::NonCopyable {
+ public:
+  explicit ServerContext(FlowRecordCb flow_record_cb = {},
+                         size_t threads_num = 1,
+                         size_t flight_recorder_capacity = 0,
+                         bool loop_handler_stats = false)
+      : flow_recorder_{std::move(flow_record_cb)},
+        loop_stats_{threads_num, loop_handler_stats},
+        session_registry_{threads_num},
+        flight_recorder_{flight_recorder_capacity} {}
+
+  uint64_t NextSessionId() noexcept {
+    return next_session_id_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  FlowRecorder& GetFlowRecorder() noexcept { return flow_recorder_; }
+  const FlowRecorder& GetFlowRecorder() const noexcept {
+    return flow_recorder_;
+  }
+
+  LoopStats& GetLoopStats() noexcept { return loop_stats_; }
+  const LoopStats& GetLoopStats() const noexcept { return loop_stats_; }
+
+  FlightRecorder& GetFlightRecorder() noexcept { return flight_recorder_; }
+  const FlightRecorder& GetFlightRecorder() const noexcept {
+    return flight_recorder_;
+  }
+
+  SessionRegistry& GetSessionRegistry() noexcept { return session_registry_; }
+  const SessionRegistry& GetSessionRegistry() const noexcept {
+    return session_registry_;
+  }
+
+  // Null if the shared udp relay is disabled. The relay is owned by the
+  // listener of the server.
+  SharedUdpRelay* GetSharedUdpRelay() const noexcept {
+    return shared_udp_relay_;
+  }
+  void SetSharedUdpRelay(SharedUdpRelay* relay) noexcept {
+    shared_udp_relay_ = relay;
+  }
+
+  // Null if the tcp data processors run on the server threads. The pool is
+  // owned by the listener of the server, so it's destroyed before the
+  // io_context and the work in progress never outlives the sessions.
+  OffloadPool* GetOffloadPool() const noexcept { return offload_pool_; }
+  void SetOffloadPool(OffloadPool* pool) noexcept { offload_pool_ = pool; }
+
+#ifdef SOCKS5_WITH_TLS
+  // Null if TLS is disabled.
+  net::TlsContext* GetTlsContext() const noexcept { return tls_context_.get(); }
+  void SetTlsContext(net::TlsContextPtr context) noexcept {
+    tls_context_ = std::move(context);
+  }
+#endif
+
+  // Null if the DNS cache is disabled.
+  DnsCache* GetDnsCache() const noexcept { return dns_cache_.get(); }
+  void SetDnsCache(std::unique_ptr<DnsCache> cache) noexcept {
+    dns_cache_ = std::move(cache);
+  }
+
+ private:
+  std::atomic_uint64_t next_session_id_{1};
+  FlowRecorder flow_recorder_;
+  LoopStats loop_stats_;
+  SessionRegistry session_registry_;
+  FlightRecorder flight_recorder_;
+  SharedUdpRelay* shared_udp_relay_{};
+  OffloadPool* offload_pool_{};
+  std::unique_ptr<DnsCache> dns_cache_;
+#ifdef SOCKS5_WITH_TLS
+  net::TlsContextPtr tls_context_;
+#endif
+};
+
+}  // namespace socks5::server
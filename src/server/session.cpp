@@ -0,0 +1,184 @@
+#include <server/session.hpp>
+#include <server/server_context.hpp>
+#include <common/addr_utils.hpp>
+#include <net/tcp_info.hpp>
+#include <utils/logger.hpp>
+#include <utils/probes.hpp>
+
+namespace socks5::server {
+
+namespace {
+
+SessionCommand MakeSessionCommand(uint8_t cmd) noexcept {
+  switch (cmd) {
+    case proto::RequestCmd::kRequestCmdConnect:
+      return SessionCommand::kConnect;
+    case proto::RequestCmd::kRequestCmdBind:
+      return SessionCommand::kBind;
+    case proto::RequestCmd::kRequestCmdUdpAssociate:
+      return SessionCommand::kUdpAssociate;
+  }
+  return SessionCommand::kUnknown;
+}
+
+}  // namespace
+
+Session::Session() noexcept
+    : start_{std::chrono::system_clock::now()},
+      steady_start_{std::chrono::steady_clock::now()} {}
+
+Session::Session(ServerContext& context, tcp::socket& client) noexcept
+    : context_{&context},
+      flight_recorder_{context.GetFlightRecorder().Enabled()
+                           ? &context.GetFlightRecorder()
+                           : nullptr},
+      id_{context.NextSessionId()},
+      thread_index_{context.GetLoopStats().SessionStarted()},
+      start_{std::chrono::system_clock::now()},
+      steady_start_{std::chrono::steady_clock::now()},
+      executor_{client.get_executor()} {
+  boost::system::error_code err;
+  client_ep_ = client.remote_endpoint(err);
+  if (client.is_open()) {
+    client_handle_ = client.native_handle();
+  }
+  context.GetSessionRegistry().Register(*this);
+}
+
+Session::~Session() {
+  if (context_) {
+    context_->GetSessionRegistry().Unregister(*this);
+    context_->GetLoopStats().SessionFinished(thread_index_);
+  }
+}
+
+uint64_t Session::Id() const noexcept { return id_; }
+
+const tcp::endpoint& Session::ClientEndpoint() const noexcept {
+  return client_ep_;
+}
+
+template <typename Func>
+void Session::Update(Func&& func) {
+  if (context_) {
+    context_->GetSessionRegistry().Update(*this, std::forward<Func>(func));
+    return;
+  }
+  func();
+}
+
+void Session::SetRequest(const proto::Request& request) noexcept {
+  Update([&] {
+    command_ = MakeSessionCommand(request.cmd);
+    target_ = request.dst_addr;
+  });
+}
+
+void Session::SetUser(std::string_view user) {
+  Update([&] { user_ = user; });
+}
+
+void Session::SetState(SessionState state) noexcept {
+  Update([&] { state_ = state; });
+}
+
+void Session::SetKillable(bool killable) noexcept {
+  Update([&] { killable_ = killable; });
+}
+
+bool Session::Killed() const noexcept { return killed_; }
+
+uint64_t Session::RelayedBytes(Direction direction) const noexcept {
+  const auto& counter = direction == Direction::kClientToTarget
+                            ? bytes_from_client_
+                            : bytes_from_target_;
+  return counter.load(std::memory_order_relaxed);
+}
+
+void Session::Close(CloseReason reason, tcp::socket& client,
+                    tcp::socket& target) noexcept {
+  Close(reason, client, &target);
+}
+
+void Session::Close(CloseReason reason, tcp::socket& client) noexcept {
+  Close(reason, client, nullptr);
+}
+
+void Session::Close(CloseReason reason, tcp::socket& client,
+                    tcp::socket* target) noexcept {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  if (killed_) {
+    reason = CloseReason::kKilled;
+  }
+  SOCKS5_PROBE4(session_close, id_, static_cast<int>(reason),
+                RelayedBytes(Direction::kClientToTarget),
+                RelayedBytes(Direction::kTargetToClient));
+  Record(FlightEventType::kSessionClose, static_cast<uint32_t>(reason),
+         RelayedBytes(Direction::kClientToTarget) +
+             RelayedBytes(Direction::kTargetToClient));
+  if (!context_ || !context_->GetFlowRecorder().Enabled()) {
+    return;
+  }
+  try {
+    FlowRecord record;
+    record.session_id = id_;
+    record.command = command_;
+    record.client = client_ep_;
+    if (target_) {
+      record.target = common::ToString(*target_);
+    }
+    record.user = user_;
+    record.bytes_from_client = RelayedBytes(Direction::kClientToTarget);
+    record.bytes_from_target = RelayedBytes(Direction::kTargetToClient);
+    record.start = start_;
+    record.duration = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - steady_start_);
+    record.close_reason = reason;
+    record.client_tcp_info = net::GetTcpInfo(client);
+    if (target) {
+      record.target_tcp_info = net::GetTcpInfo(*target);
+    }
+    context_->GetFlowRecorder().Push(std::move(record));
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "Flow record exception. Session: {}. {}", id_,
+               ex.what());
+  }
+}
+
+SessionInfo Session::Info(std::chrono::steady_clock::time_point now) const {
+  SessionInfo info;
+  info.session_id = id_;
+  info.command = command_;
+  info.state = state_;
+  info.client = client_ep_;
+  if (target_) {
+    info.target = common::ToString(*target_);
+  }
+  info.user = user_;
+  info.bytes_from_client = RelayedBytes(Direction::kClientToTarget);
+  info.bytes_from_target = RelayedBytes(Direction::kTargetToClient);
+  info.start = start_;
+  info.age = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - steady_start_);
+  info.killable = killable_;
+  return info;
+}
+
+void Session::Kill() noexcept {
+  if (killed_ || !killable_) {
+    return;
+  }
+  killed_ = true;
+  Record(FlightEventType::kSessionKilled);
+  SOCKS5_LOG(debug, "Session killed. Session: {}", id_);
+  if (client_handle_) {
+    // Shutdown wakes up the pending operations of every stage with an error,
+    // while the socket itself stays owned by the stage that uses it.
+    ::shutdown(*client_handle_, asio::socket_base::shutdown_both);
+  }
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <socks5/common/asio.hpp>
+#include <socks5/server/flow_record.hpp>
+#include <socks5/server/session_info.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <proto/proto.hpp>
+#include <server/flight_recorder.hpp>
+
+namespace socks5::server {
+
+class ServerContext;
+
+// State of one client connection from accept to close. Owned by the Proxy, so
+// its address is stable for the whole lifetime of the connection. A session
+// attached to a server is listed in its SessionRegistry while it's alive.
+class Session final : utils::NonCopyable {
+ public:
+  enum class Direction : uint8_t {
+    kClientToTarget,
+    kTargetToClient,
+  };
+
+  // Constructs a session that isn't attached to any server. Such a session
+  // keeps its state, but produces no flow records and can't be killed.
+  Session() noexcept;
+  // The session is killed on the executor of the client socket, so the socket
+  // must be bound to the executor(strand) that runs the session.
+  Session(ServerContext& context, tcp::socket& client) noexcept;
+  ~Session();
+
+  uint64_t Id() const noexcept;
+  // Null if the session isn't attached to a server.
+  ServerContext* Context() const noexcept { return context_; }
+  const tcp::endpoint& ClientEndpoint() const noexcept;
+
+  void SetRequest(const proto::Request& request) noexcept;
+  void SetUser(std::string_view user);
+  void SetState(SessionState state) noexcept;
+  // Custom relay handlers own the sockets and may close them at any moment,
+  // so the sessions they serve are marked as not killable.
+  void SetKillable(bool killable) noexcept;
+  bool Killed() const noexcept;
+
+  void AddRelayedBytes(Direction direction, size_t bytes) noexcept {
+    auto& counter = direction == Direction::kClientToTarget
+                        ? bytes_from_client_
+                        : bytes_from_target_;
+    counter.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  uint64_t RelayedBytes(Direction direction) const noexcept;
+
+  // Records an event of the session to the flight recorder of the server.
+  void Record(FlightEventType type, uint32_t arg0 = 0,
+              uint64_t arg1 = 0) noexcept {
+    if (flight_recorder_) {
+      flight_recorder_->Record(id_, type, arg0, arg1);
+    }
+  }
+
+  // Produces the flow record of the session. TCP_INFO is sampled from the
+  // passed sockets, so they must still be open. Only the first call has an
+  // effect.
+  void Close(CloseReason reason, tcp::socket& client,
+             tcp::socket& target) noexcept;
+  void Close(CloseReason reason, tcp::socket& client) noexcept;
+
+ private:
+  friend class SessionRegistry;
+
+  void Close(CloseReason reason, tcp::socket& client,
+             tcp::socket* target) noexcept;
+  template <typename Func>
+  void Update(Func&& func);
+  // Both are called by the SessionRegistry under the lock of the session list.
+  SessionInfo Info(std::chrono::steady_clock::time_point now) const;
+  void Kill() noexcept;
+
+  ServerContext* context_{};
+  // Null if the flight recorder is disabled.
+  FlightRecorder* flight_recorder_{};
+  uint64_t id_{};
+  // Index of the server thread the session was started on.
+  size_t thread_index_{};
+  tcp::endpoint client_ep_;
+  std::chrono::system_clock::time_point start_;
+  std::chrono::steady_clock::time_point steady_start_;
+  SessionCommand command_{SessionCommand::kUnknown};
+  std::optional<proto::Addr> target_;
+  std::string user_;
+  std::atomic_uint64_t bytes_from_client_{};
+  std::atomic_uint64_t bytes_from_target_{};
+  SessionState state_{SessionState::kHandshake};
+  bool killable_{true};
+  bool killed_{false};
+  bool closed_{false};
+  // Executor and native handle of the client socket. The handle stays the same
+  // while the socket is moved between the stages of the session.
+  asio::any_io_executor executor_;
+  std::optional<tcp::socket::native_handle_type> client_handle_;
+  // Hooks of the intrusive list of the SessionRegistry.
+  Session* prev_{};
+  Session* next_{};
+};
+
+}  // namespace socks5::server
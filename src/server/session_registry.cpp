@@ -0,0 +1,100 @@
+#include <server/session_registry.hpp>
+#include <server/session.hpp>
+#include <algorithm>
+#include <unordered_set>
+
+namespace socks5::server {
+
+SessionRegistry::SessionRegistry(size_t threads_num)
+    : shards_num_{std::max<size_t>(threads_num, 1) + 1},
+      shards_{std::make_unique<Shard[]>(shards_num_)} {}
+
+void SessionRegistry::Register(Session& session) noexcept {
+  auto& shard = GetShard(session);
+  std::lock_guard lk{shard.mtx};
+  session.prev_ = nullptr;
+  session.next_ = shard.head;
+  if (shard.head) {
+    shard.head->prev_ = &session;
+  }
+  shard.head = &session;
+}
+
+void SessionRegistry::Unregister(Session& session) noexcept {
+  auto& shard = GetShard(session);
+  std::lock_guard lk{shard.mtx};
+  if (session.prev_) {
+    session.prev_->next_ = session.next_;
+  } else if (shard.head == &session) {
+    shard.head = session.next_;
+  }
+  if (session.next_) {
+    session.next_->prev_ = session.prev_;
+  }
+  session.prev_ = nullptr;
+  session.next_ = nullptr;
+}
+
+SessionInfoVec SessionRegistry::Snapshot() const {
+  SessionInfoVec sessions;
+  const auto now = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < shards_num_; ++i) {
+    auto& shard = shards_[i];
+    std::lock_guard lk{shard.mtx};
+    for (auto* session = shard.head; session; session = session->next_) {
+      sessions.push_back(session->Info(now));
+    }
+  }
+  return sessions;
+}
+
+size_t SessionRegistry::Kill(const SessionPredicate& pred) {
+  std::unordered_set<uint64_t> ids;
+  for (const auto& info : Snapshot()) {
+    if (pred(info)) {
+      ids.insert(info.session_id);
+    }
+  }
+  if (ids.empty()) {
+    return 0;
+  }
+  size_t requested{0};
+  for (size_t i = 0; i < shards_num_; ++i) {
+    auto& shard = shards_[i];
+    std::lock_guard lk{shard.mtx};
+    for (auto* session = shard.head; session; session = session->next_) {
+      if (!ids.contains(session->id_) || !session->killable_ ||
+          !session->executor_) {
+        continue;
+      }
+      // The session may finish before the handler runs, so the handler looks
+      // it up again instead of touching it directly.
+      asio::post(session->executor_,
+                 [this, i, session, session_id = session->id_] {
+                   KillOnExecutor(i, session, session_id);
+                 });
+      ++requested;
+    }
+  }
+  return requested;
+}
+
+SessionRegistry::Shard& SessionRegistry::GetShard(
+    const Session& session) const noexcept {
+  return shards_[std::min(session.thread_index_, shards_num_ - 1)];
+}
+
+void SessionRegistry::KillOnExecutor(size_t shard_index,
+                                     const Session* session,
+                                     uint64_t session_id) noexcept {
+  auto& shard = shards_[shard_index];
+  std::lock_guard lk{shard.mtx};
+  for (auto* current = shard.head; current; current = current->next_) {
+    if (current == session && current->id_ == session_id) {
+      current->Kill();
+      return;
+    }
+  }
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <socks5/server/session_info.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <utils/spsc_queue.hpp>
+
+namespace socks5::server {
+
+class Session;
+
+// Registry of the live sessions of one server instance. Sessions are linked
+// into intrusive lists, one list per server thread plus one for sessions
+// started outside the server threads, so registration and removal are O(1),
+// allocate nothing and never contend with other threads. The lock of a list is
+// shared only with the rare snapshot and kill requests.
+class SessionRegistry final : utils::NonCopyable {
+ public:
+  explicit SessionRegistry(size_t threads_num);
+
+  void Register(Session& session) noexcept;
+  void Unregister(Session& session) noexcept;
+
+  // Calls the function under the lock of the list of the session. Session
+  // fields that are read by Snapshot() must be changed this way.
+  template <typename Func>
+  void Update(const Session& session, Func&& func) {
+    std::lock_guard lk{GetShard(session).mtx};
+    func();
+  }
+
+  // Returns the state of all the live sessions. Every session is read under
+  // the lock of its list, so the fields of one session are consistent.
+  SessionInfoVec Snapshot() const;
+
+  // Requests to kill the sessions selected by the predicate. The predicate is
+  // called without holding any lock. Sessions are killed asynchronously on
+  // their own executors. Returns the number of sessions requested to kill.
+  size_t Kill(const SessionPredicate& pred);
+
+ private:
+  struct alignas(utils::kCacheLineSize) Shard final {
+    std::mutex mtx;
+    Session* head{};
+  };
+
+  Shard& GetShard(const Session& session) const noexcept;
+  void KillOnExecutor(size_t shard_index, const Session* session,
+                      uint64_t session_id) noexcept;
+
+  const size_t shards_num_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+}  // namespace socks5::server
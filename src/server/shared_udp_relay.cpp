@@ -0,0 +1,617 @@
+#include <server/shared_udp_relay.hpp>
+#include <common/addr_utils.hpp>
+#include <common/defs.hpp>
+#include <common/socks5_datagram_io.hpp>
+#include <common/socks5_datagram_validator.hpp>
+#include <net/connection_error.hpp>
+#include <net/udp_batch.hpp>
+#include <net/udp_connection.hpp>
+#include <net/utils.hpp>
+#include <parsers/parsers.hpp>
+#include <serializers/serializers.hpp>
+#include <socks5/utils/buffer.hpp>
+#include <socks5/utils/watchdog.hpp>
+#include <utils/logger.hpp>
+#include <utils/probes.hpp>
+#include <utils/spsc_queue.hpp>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+
+namespace socks5::server {
+
+namespace {
+
+constexpr size_t kTcpBufSize{512};
+// Number of lock stripes of the association table.
+constexpr size_t kTablesNum{16};
+
+struct AddressHash final {
+  size_t operator()(const asio::ip::address& addr) const noexcept {
+    if (addr.is_v4()) {
+      return std::hash<uint32_t>{}(addr.to_v4().to_uint());
+    }
+    const auto bytes = addr.to_v6().to_bytes();
+    return std::hash<std::string_view>{}(std::string_view{
+        reinterpret_cast<const char*>(bytes.data()), bytes.size()});
+  }
+};
+
+struct EndpointHash final {
+  size_t operator()(const udp::endpoint& ep) const noexcept {
+    return AddressHash{}(ep.address()) * 31 + ep.port();
+  }
+};
+
+// The first alternative is the client tcp connection, the second one is the
+// watchdog.
+using RelayResult = std::variant<std::monostate, std::monostate>;
+
+VoidAwait ReadUntilClosed(net::TcpConnection& client) noexcept {
+  utils::StaticBuffer<kTcpBufSize> buf;
+  for (;;) {
+    if (const auto err = co_await client.ReadSome(buf)) {
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, client));
+      co_return;
+    }
+    buf.Clear();
+  }
+}
+
+net::UdpRecvBatch MakeRecvBatch(const Config& config) {
+  // Without batching a slot must fit any datagram.
+  if (config.udp_batch_size > 1) {
+    return net::UdpRecvBatch{config.udp_batch_size,
+                             config.udp_batch_datagram_size};
+  }
+  return net::UdpRecvBatch{1, kDatagramMaxLen};
+}
+
+}  // namespace
+
+struct SharedUdpRelay::Target final {
+  udp::endpoint ep;
+  // Null while the domain name of the target server is being resolved.
+  EgressSocketPtr egress;
+  Shard* shard{};
+};
+
+struct SharedUdpRelay::Association final {
+  Association(Session& session, utils::Watchdog& watchdog,
+              udp::endpoint client_ep) noexcept
+      : session{session}, watchdog{watchdog}, client_ep{std::move(client_ep)} {}
+
+  // Both return false if the association is finished. The session and the
+  // watchdog must not be touched after that.
+  bool OnDatagramIn(Session::Direction direction, size_t size) noexcept {
+    std::lock_guard lk{mtx};
+    if (finished) {
+      return false;
+    }
+    watchdog.Update();
+    SOCKS5_PROBE3(udp_datagram_in, session.Id(), static_cast<int>(direction),
+                  size);
+    session.Record(FlightEventType::kUdpDatagramIn,
+                   static_cast<uint32_t>(direction), size);
+    session.AddRelayedBytes(direction, size);
+    return true;
+  }
+
+  bool OnDatagramOut(Session::Direction direction, size_t size) noexcept {
+    std::lock_guard lk{mtx};
+    if (finished) {
+      return false;
+    }
+    watchdog.Update();
+    SOCKS5_PROBE3(udp_datagram_out, session.Id(), static_cast<int>(direction),
+                  size);
+    session.Record(FlightEventType::kUdpDatagramOut,
+                   static_cast<uint32_t>(direction), size);
+    return true;
+  }
+
+  std::mutex mtx;
+  bool finished{false};
+  Session& session;
+  utils::Watchdog& watchdog;
+  // The port is 0 until the first datagram if the client didn't specify it.
+  // Changed under the lock of the table.
+  udp::endpoint client_ep;
+  std::unordered_map<proto::Addr, Target, common::Hash, common::EqualTo>
+      targets;
+};
+
+struct SharedUdpRelay::Route final {
+  std::weak_ptr<Association> association;
+  // Serialized target server address as the client sent it.
+  AddrBuf addr;
+};
+
+struct SharedUdpRelay::EgressSocket final {
+  EgressSocket(uint64_t id, net::UdpConnection connect) noexcept
+      : id{id}, connect{std::move(connect)} {}
+
+  const uint64_t id;
+  net::UdpConnection connect;
+  // Association of every target server endpoint.
+  std::unordered_map<udp::endpoint, Route, EndpointHash> routes;
+  // Set when the socket is reclaimed, its reader exits quietly.
+  bool reclaimed{false};
+};
+
+// Egress sockets of a target server endpoint. Sockets with ids up to scanned
+// either route the endpoint or are in free.
+struct SharedUdpRelay::TargetRoutes final {
+  size_t routed{};
+  uint64_t scanned{};
+  // Ids of the sockets whose route of the endpoint was removed. Some of the
+  // sockets may be reclaimed since then.
+  std::vector<uint64_t> free;
+};
+
+struct SharedUdpRelay::Shard final {
+  Shard(asio::any_io_executor strand, net::UdpConnection ingress) noexcept
+      : strand{std::move(strand)}, ingress{std::move(ingress)} {}
+
+  asio::any_io_executor strand;
+  net::UdpConnection ingress;
+  // By id, i.e. in the order of creation. The oldest socket is never
+  // reclaimed.
+  std::map<uint64_t, EgressSocketPtr> egress;
+  uint64_t next_egress_id{1};
+  std::unordered_map<udp::endpoint, TargetRoutes, EndpointHash> target_routes;
+};
+
+struct alignas(utils::kCacheLineSize) SharedUdpRelay::Table final {
+  std::mutex mtx;
+  std::unordered_map<udp::endpoint, AssociationPtr, EndpointHash> bound;
+  // Associations waiting for the first datagram, by the client address.
+  std::unordered_map<asio::ip::address, std::deque<AssociationPtr>,
+                     AddressHash>
+      unbound;
+};
+
+SharedUdpRelay::SharedUdpRelay(asio::io_context& io_context,
+                               const Config& config, common::Metrics& metrics)
+    : io_context_{io_context},
+      config_{config},
+      metrics_{metrics},
+      endpoint_{asio::ip::make_address(config.listener_addr.first),
+                config.udp_shared_relay_port},
+      tables_{std::make_unique<Table[]>(kTablesNum)} {
+#ifdef SO_REUSEPORT
+  const auto shards_num = std::max<size_t>(config_.threads_num, 1);
+#else
+  const size_t shards_num{1};
+#endif
+  for (size_t i = 0; i < shards_num; ++i) {
+    asio::any_io_executor strand{asio::make_strand(io_context_)};
+    udp::socket socket{strand, endpoint_.protocol()};
+#ifdef SO_REUSEPORT
+    socket.set_option(
+        asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>{true});
+#endif
+    socket.bind(endpoint_);
+    // The first shard picks the port if it isn't specified.
+    endpoint_ = socket.local_endpoint();
+    shards_.push_back(std::make_unique<Shard>(
+        std::move(strand), net::MakeUdpConnect(std::move(socket), metrics_)));
+  }
+}
+
+SharedUdpRelay::~SharedUdpRelay() = default;
+
+void SharedUdpRelay::Run() {
+  if (started_.exchange(true)) {
+    return;
+  }
+  SOCKS5_LOG(info, "Socks5 shared udp relay started on {}. Shards: {}",
+             net::ToString<udp>(endpoint_), shards_.size());
+  for (auto& shard : shards_) {
+    asio::co_spawn(
+        shard->strand,
+        [self = shared_from_this(), &shard = *shard] {
+          return self->ReadClients(shard);
+        },
+        asio::detached);
+  }
+}
+
+VoidAwait SharedUdpRelay::Relay(net::TcpConnection client,
+                                proto::Addr client_addr,
+                                Session& session) noexcept {
+  try {
+    utils::Watchdog watchdog{co_await asio::this_coro::executor,
+                             config_.udp_relay_timeout};
+    const auto association = Associate(
+        net::MakeEndpointFromIP<udp>(client_addr), session, watchdog);
+    if (!association) {
+      SOCKS5_LOG(debug,
+                 "Shared udp relay. The client address is used by another "
+                 "association. Client: {}",
+                 common::ToString(client_addr));
+      session.Close(CloseReason::kError, client.GetSocket());
+      co_return;
+    }
+    SOCKS5_LOG(debug,
+               "Shared udp relay association started. Client tcp socket: {}. "
+               "Expected client udp addr: {}",
+               net::ToString(client), common::ToString(client_addr));
+    watchdog.Update();
+    RelayResult res;
+    try {
+      res = co_await (ReadUntilClosed(client) || watchdog.Run());
+    } catch (const std::exception&) {
+      Dissociate(association);
+      throw;
+    }
+    Dissociate(association);
+    if (res.index() == 1) {
+      session.Record(FlightEventType::kWatchdogExpired, 0,
+                     config_.udp_relay_timeout);
+    }
+    session.Close(
+        res.index() == 0 ? CloseReason::kClientClosed : CloseReason::kTimeout,
+        client.GetSocket());
+    SOCKS5_LOG(debug,
+               "Shared udp relay association finished. Client udp addr: {}",
+               common::ToString(client_addr));
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "Shared udp relay exception. {}", ex.what());
+    session.Close(CloseReason::kError, client.GetSocket());
+  }
+}
+
+SharedUdpRelay::AssociationPtr SharedUdpRelay::Associate(
+    const udp::endpoint& client_ep, Session& session,
+    utils::Watchdog& watchdog) {
+  auto association =
+      std::make_shared<Association>(session, watchdog, client_ep);
+  auto& table = GetTable(client_ep.address());
+  std::lock_guard lk{table.mtx};
+  if (client_ep.port() == 0) {
+    table.unbound[client_ep.address()].push_back(association);
+    return association;
+  }
+  if (!table.bound.emplace(client_ep, association).second) {
+    return nullptr;
+  }
+  return association;
+}
+
+void SharedUdpRelay::Dissociate(const AssociationPtr& association) noexcept {
+  {
+    std::lock_guard lk{association->mtx};
+    association->finished = true;
+  }
+  {
+    auto& table = GetTable(association->client_ep.address());
+    std::lock_guard lk{table.mtx};
+    const auto& client_ep = association->client_ep;
+    if (const auto it = table.bound.find(client_ep);
+        it != table.bound.end() && it->second == association) {
+      table.bound.erase(it);
+    } else if (const auto it = table.unbound.find(client_ep.address());
+               it != table.unbound.end()) {
+      std::erase(it->second, association);
+      if (it->second.empty()) {
+        table.unbound.erase(it);
+      }
+    }
+  }
+  std::lock_guard lk{association->mtx};
+  for (const auto& [addr, target] : association->targets) {
+    if (!target.egress) {
+      continue;
+    }
+    // Routes are owned by the strand of the shard.
+    asio::post(target.shard->strand,
+               [self = shared_from_this(), association, shard = target.shard,
+                egress = target.egress, ep = target.ep] {
+                 const auto it = egress->routes.find(ep);
+                 if (it == egress->routes.end()) {
+                   return;
+                 }
+                 const auto owner = it->second.association.lock();
+                 if (!owner || owner == association) {
+                   self->RemoveRoute(*shard, *egress, ep);
+                 }
+               });
+  }
+}
+
+SharedUdpRelay::AssociationPtr SharedUdpRelay::FindAssociation(
+    const udp::endpoint& sender_ep) {
+  auto& table = GetTable(sender_ep.address());
+  std::lock_guard lk{table.mtx};
+  if (const auto it = table.bound.find(sender_ep); it != table.bound.end()) {
+    return it->second;
+  }
+  const auto it = table.unbound.find(sender_ep.address());
+  if (it == table.unbound.end()) {
+    return nullptr;
+  }
+  // The first datagram from the address binds the oldest association that
+  // waits for it.
+  auto association = std::move(it->second.front());
+  it->second.pop_front();
+  if (it->second.empty()) {
+    table.unbound.erase(it);
+  }
+  association->client_ep = sender_ep;
+  table.bound.emplace(sender_ep, association);
+  return association;
+}
+
+SharedUdpRelay::Table& SharedUdpRelay::GetTable(
+    const asio::ip::address& addr) const noexcept {
+  return tables_[AddressHash{}(addr) % kTablesNum];
+}
+
+VoidAwait SharedUdpRelay::ReadClients(Shard& shard) noexcept {
+  try {
+    auto batch = MakeRecvBatch(config_);
+    for (;;) {
+      if (const auto err = co_await shard.ingress.ReadBatch(batch)) {
+        SOCKS5_LOG(error, net::MakeErrorMsg(*err, shard.ingress));
+        co_return;
+      }
+      for (size_t i = 0; i < batch.Size(); ++i) {
+        co_await ProcessClientDatagram(shard, batch.Data(i), batch.Length(i),
+                                       batch.Sender(i));
+      }
+    }
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "Shared udp relay exception. {}", ex.what());
+  }
+}
+
+VoidAwait SharedUdpRelay::ProcessClientDatagram(
+    Shard& shard, char* data, size_t size,
+    const udp::endpoint& sender_ep) noexcept {
+  try {
+    const auto association = FindAssociation(sender_ep);
+    if (!association) {
+      SOCKS5_LOG(debug,
+                 "Shared udp relay. No association for the datagram sender. "
+                 "Sender: {}",
+                 net::ToString<udp>(sender_ep));
+      co_return;
+    }
+    utils::Buffer buf{data, size};
+    buf.HasWritten(size);
+    if (!common::ValidateDatagramLength(buf)) {
+      co_return;
+    }
+    const auto datagram = parsers::ParseDatagram(buf);
+    if (datagram.header.frag != proto::UdpFrag::kUdpFragNoFrag) {
+      co_return;
+    }
+    const auto* payload = reinterpret_cast<const char*>(datagram.data.data);
+    const auto payload_size = datagram.data.data_size;
+    if (!association->OnDatagramIn(Session::Direction::kClientToTarget,
+                                   payload_size)) {
+      co_return;
+    }
+    const auto& addr = datagram.header.addr;
+    EgressSocketPtr egress;
+    udp::endpoint target_ep;
+    {
+      std::lock_guard lk{association->mtx};
+      if (const auto it = association->targets.find(addr);
+          it != association->targets.end()) {
+        // Datagrams to a target that is being resolved are dropped.
+        if (!it->second.egress) {
+          metrics_.AddDroppedUdpDatagrams(1);
+          co_return;
+        }
+        egress = it->second.egress;
+        target_ep = it->second.ep;
+      } else if (addr.atyp == proto::AddrType::kAddrTypeDomainName) {
+        association->targets.emplace(addr, Target{});
+      }
+    }
+    if (!egress) {
+      if (addr.atyp == proto::AddrType::kAddrTypeDomainName) {
+        asio::co_spawn(
+            shard.strand,
+            [self = shared_from_this(), &shard, association, addr,
+             data = std::vector<char>(payload, payload + payload_size)]() {
+              return self->ResolveTarget(shard, association, addr,
+                                         std::move(data));
+            },
+            asio::detached);
+        co_return;
+      }
+      target_ep = net::MakeEndpointFromIP<udp>(addr);
+      egress = AddTarget(shard, association, addr, target_ep);
+      if (!egress) {
+        co_return;
+      }
+    }
+    co_await SendToTarget(association, *egress, target_ep, payload,
+                          payload_size);
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "Shared udp relay exception. {}", ex.what());
+  }
+}
+
+VoidAwait SharedUdpRelay::ResolveTarget(Shard& shard,
+                                        AssociationPtr association,
+                                        proto::Addr addr,
+                                        std::vector<char> data) noexcept {
+  try {
+    const auto [err, ep] = co_await net::MakeEndpoint<udp>(addr);
+    if (err) {
+      SOCKS5_LOG(debug,
+                 "Shared udp relay. Endpoint error. Client: {}. Target: {}. "
+                 "msg={}",
+                 net::ToString<udp>(association->client_ep),
+                 common::ToString(addr), err.message());
+      std::lock_guard lk{association->mtx};
+      association->targets.erase(addr);
+      co_return;
+    }
+    const auto egress = AddTarget(shard, association, addr, *ep);
+    if (!egress) {
+      co_return;
+    }
+    co_await SendToTarget(association, *egress, *ep, data.data(),
+                          data.size());
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "Shared udp relay exception. {}", ex.what());
+  }
+}
+
+VoidAwait SharedUdpRelay::SendToTarget(const AssociationPtr& association,
+                                       EgressSocket& egress,
+                                       udp::endpoint target_ep,
+                                       const char* data,
+                                       size_t size) noexcept {
+  if (const auto err = co_await egress.connect.Send(target_ep, data, size)) {
+    SOCKS5_LOG(debug, net::MakeErrorMsg(*err, egress.connect));
+    co_return;
+  }
+  association->OnDatagramOut(Session::Direction::kClientToTarget, size);
+}
+
+SharedUdpRelay::EgressSocketPtr SharedUdpRelay::AddTarget(
+    Shard& shard, const AssociationPtr& association, const proto::Addr& addr,
+    const udp::endpoint& ep) {
+  std::lock_guard lk{association->mtx};
+  if (association->finished) {
+    return nullptr;
+  }
+  // Another address of the association may resolve to the same endpoint, its
+  // route is reused.
+  const auto same_ep =
+      std::ranges::find_if(association->targets, [&](const auto& target) {
+        return target.second.egress && target.second.shard == &shard &&
+               target.second.ep == ep;
+      });
+  auto egress = same_ep != association->targets.end()
+                    ? same_ep->second.egress
+                    : AcquireEgress(shard, ep);
+  egress->routes.insert_or_assign(
+      ep, Route{association, serializers::Serialize(addr)});
+  association->targets.insert_or_assign(addr, Target{ep, egress, &shard});
+  return egress;
+}
+
+SharedUdpRelay::EgressSocketPtr SharedUdpRelay::AcquireEgress(
+    Shard& shard, const udp::endpoint& target_ep) {
+  auto& target_routes = shard.target_routes[target_ep];
+  while (!target_routes.free.empty()) {
+    const auto id = target_routes.free.back();
+    target_routes.free.pop_back();
+    if (const auto it = shard.egress.find(id); it != shard.egress.end()) {
+      ++target_routes.routed;
+      return it->second;
+    }
+  }
+  if (const auto it = shard.egress.upper_bound(target_routes.scanned);
+      it != shard.egress.end()) {
+    target_routes.scanned = it->first;
+    ++target_routes.routed;
+    return it->second;
+  }
+  const auto id = shard.next_egress_id++;
+  auto egress = std::make_shared<EgressSocket>(
+      id, net::MakeUdpConnect(net::MakeOpenSocket<udp>(
+                                  shard.strand, config_.listener_addr.first, 0),
+                              metrics_));
+  shard.egress.emplace(id, egress);
+  target_routes.scanned = id;
+  ++target_routes.routed;
+  SOCKS5_LOG(debug,
+             "Shared udp relay. Added egress socket {}. Egress sockets of the "
+             "shard: {}",
+             net::ToString(egress->connect), shard.egress.size());
+  asio::co_spawn(
+      shard.strand,
+      [self = shared_from_this(), &shard, egress] {
+        return self->ReadTargets(shard, egress);
+      },
+      asio::detached);
+  return egress;
+}
+
+void SharedUdpRelay::RemoveRoute(Shard& shard, EgressSocket& egress,
+                                 const udp::endpoint& target_ep) noexcept {
+  egress.routes.erase(target_ep);
+  if (const auto it = shard.target_routes.find(target_ep);
+      it != shard.target_routes.end()) {
+    if (--it->second.routed == 0) {
+      shard.target_routes.erase(it);
+    } else {
+      try {
+        it->second.free.push_back(egress.id);
+      } catch (const std::exception&) {
+        // The socket is just not reused for the endpoint.
+      }
+    }
+  }
+  if (!egress.routes.empty() || egress.reclaimed ||
+      egress.id == shard.egress.begin()->first) {
+    return;
+  }
+  // The reader exits and releases the socket.
+  SOCKS5_LOG(debug,
+             "Shared udp relay. Reclaimed egress socket {}. Egress sockets of "
+             "the shard: {}",
+             net::ToString(egress.connect), shard.egress.size() - 1);
+  egress.reclaimed = true;
+  egress.connect.Stop();
+  shard.egress.erase(egress.id);
+}
+
+VoidAwait SharedUdpRelay::ReadTargets(Shard& shard,
+                                      EgressSocketPtr egress_ptr) noexcept {
+  auto& egress = *egress_ptr;
+  try {
+    auto batch = MakeRecvBatch(config_);
+    for (;;) {
+      if (const auto err = co_await egress.connect.ReadBatch(batch)) {
+        if (!egress.reclaimed) {
+          SOCKS5_LOG(error, net::MakeErrorMsg(*err, egress.connect));
+        }
+        co_return;
+      }
+      for (size_t i = 0; i < batch.Size() && !egress.reclaimed; ++i) {
+        const auto it = egress.routes.find(batch.Sender(i));
+        if (it == egress.routes.end()) {
+          continue;
+        }
+        const auto association = it->second.association.lock();
+        if (!association) {
+          RemoveRoute(shard, egress, batch.Sender(i));
+          continue;
+        }
+        // The route may be removed while the datagram is being sent.
+        auto addr = it->second.addr;
+        const auto size = batch.Length(i);
+        if (!association->OnDatagramIn(Session::Direction::kTargetToClient,
+                                       size)) {
+          continue;
+        }
+        // The client endpoint is bound on this strand before any route of the
+        // association is added.
+        const auto buffs = common::MakeDatagramBuffs(utils::MakeBuffer(addr),
+                                                     batch.Data(i), size);
+        if (const auto err =
+                co_await shard.ingress.Send(association->client_ep, buffs)) {
+          SOCKS5_LOG(debug, net::MakeErrorMsg(*err, shard.ingress));
+          continue;
+        }
+        association->OnDatagramOut(Session::Direction::kTargetToClient, size);
+      }
+    }
+  } catch (const std::exception& ex) {
+    SOCKS5_LOG(error, "Shared udp relay exception. {}", ex.what());
+  }
+}
+
+}  // namespace socks5::server
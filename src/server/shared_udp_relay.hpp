@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <socks5/common/asio.hpp>
+#include <socks5/common/metrics.hpp>
+#include <socks5/server/config.hpp>
+#include <socks5/utils/non_copyable.hpp>
+#include <socks5/utils/watchdog.hpp>
+#include <net/tcp_connection.hpp>
+#include <proto/proto.hpp>
+#include <server/session.hpp>
+
+namespace socks5::server {
+
+// Relays the datagrams of all the UDP associations through a single udp port.
+// Every server thread gets its own socket bound to the port with SO_REUSEPORT,
+// a shard. Datagrams of clients are demultiplexed to associations by the client
+// endpoint. The first datagram binds an association that didn't specify its
+// client port. Datagrams to target servers are sent from a pool of egress
+// sockets of the shard. An egress socket routes a target server endpoint to a
+// single association, so the pool has as many sockets as the associations that
+// talk to the same target server at the same time, e.g. to a resolver. Free
+// sockets are indexed by the target endpoint, and the sockets left without
+// routes are closed except the oldest one. All the io of a shard runs on its
+// strand.
+class SharedUdpRelay final
+    : public std::enable_shared_from_this<SharedUdpRelay>,
+      utils::NonCopyable {
+ public:
+  SharedUdpRelay(asio::io_context& io_context, const Config& config,
+                 common::Metrics& metrics);
+  ~SharedUdpRelay();
+
+  // Starts reading the shards. Only the first call has an effect.
+  void Run();
+
+  // Endpoint to which the clients send their datagrams.
+  const udp::endpoint& Endpoint() const noexcept { return endpoint_; }
+
+  // Relays the datagrams of the association until the client closes the tcp
+  // connection or the association is idle for udp_relay_timeout.
+  VoidAwait Relay(net::TcpConnection client, proto::Addr client_addr,
+                  Session& session) noexcept;
+
+ private:
+  struct Association;
+  struct Target;
+  struct Route;
+  struct EgressSocket;
+  struct TargetRoutes;
+  struct Shard;
+  struct Table;
+
+  using AssociationPtr = std::shared_ptr<Association>;
+  using EgressSocketPtr = std::shared_ptr<EgressSocket>;
+
+  AssociationPtr Associate(const udp::endpoint& client_ep, Session& session,
+                           utils::Watchdog& watchdog);
+  void Dissociate(const AssociationPtr& association) noexcept;
+  AssociationPtr FindAssociation(const udp::endpoint& sender_ep);
+  Table& GetTable(const asio::ip::address& addr) const noexcept;
+
+  VoidAwait ReadClients(Shard& shard) noexcept;
+  VoidAwait ProcessClientDatagram(Shard& shard, char* data, size_t size,
+                                  const udp::endpoint& sender_ep) noexcept;
+  VoidAwait ResolveTarget(Shard& shard, AssociationPtr association,
+                          proto::Addr addr, std::vector<char> data) noexcept;
+  VoidAwait SendToTarget(const AssociationPtr& association,
+                         EgressSocket& egress, udp::endpoint target_ep,
+                         const char* data, size_t size) noexcept;
+  // Returns null if the association is finished.
+  EgressSocketPtr AddTarget(Shard& shard, const AssociationPtr& association,
+                            const proto::Addr& addr, const udp::endpoint& ep);
+  // Returns a socket that doesn't route the endpoint yet.
+  EgressSocketPtr AcquireEgress(Shard& shard, const udp::endpoint& target_ep);
+  // Reclaims the socket if it has no routes left.
+  void RemoveRoute(Shard& shard, EgressSocket& egress,
+                   const udp::endpoint& target_ep) noexcept;
+  VoidAwait ReadTargets(Shard& shard, EgressSocketPtr egress) noexcept;
+
+  asio::io_context& io_context_;
+  const Config& config_;
+  common::Metrics& metrics_;
+  udp::endpoint endpoint_;
+  std::atomic_bool started_{false};
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::unique_ptr<Table[]> tables_;
+};
+
+using SharedUdpRelayPtr = std::shared_ptr<SharedUdpRelay>;
+
+}  // namespace socks5::server
@@ -4,8 +4,15 @@
 #include <net/utils.hpp>
 #include <socks5/common/asio.hpp>
 #include <server/relay_data_processors.hpp>
-#include <server/sent_relay_data.hpp>
+#include <server/offload_pool.hpp>
+#include <server/server_context.hpp>
+#include <common/tunnel_codec.hpp>
 #include <socks5/utils/watchdog.hpp>
+#include <utils/probes.hpp>
+#include <array>
+#include <type_traits>
+#include <variant>
+#include <vector>
 
 namespace socks5::server {
 
@@ -17,65 +24,271 @@ constexpr size_t kRelayBufSize{SOCKS5_TCP_RELAY_BUF_SIZE};
 constexpr size_t kRelayBufSize{16384};
 #endif
 
-VoidAwait Relay(net::TcpConnection& from, net::TcpConnection& to,
-                utils::Watchdog& watchdog) noexcept {
-  utils::StaticBuffer<kRelayBufSize> buf;
+// Room around the data read by a relay with an in-place data processor.
+#ifdef SOCKS5_TCP_RELAY_BUF_HEADROOM
+constexpr size_t kRelayBufHeadroom{SOCKS5_TCP_RELAY_BUF_HEADROOM};
+#else
+constexpr size_t kRelayBufHeadroom{256};
+#endif
+
+#ifdef SOCKS5_TCP_RELAY_BUF_TAILROOM
+constexpr size_t kRelayBufTailroom{SOCKS5_TCP_RELAY_BUF_TAILROOM};
+#else
+constexpr size_t kRelayBufTailroom{256};
+#endif
+
+// The reason why a relay loop in one direction has finished.
+enum class RelayEnd {
+  // Reading from the source connection failed.
+  kRead,
+  // Sending to the destination connection failed.
+  kSend,
+  // The data processor has thrown an exception.
+  kError,
+};
+
+using RelayEndAwait = asio::awaitable<RelayEnd>;
+using RelayResult = std::variant<RelayEnd, RelayEnd, std::monostate>;
+
+// The first relay in RelayResult relays data from the client to the target
+// server, the second one in the opposite direction, the third alternative is
+// the watchdog.
+CloseReason MakeCloseReason(const RelayResult& res) noexcept {
+  const auto make_reason = [](RelayEnd end, CloseReason read_reason,
+                              CloseReason send_reason) {
+    switch (end) {
+      case RelayEnd::kRead:
+        return read_reason;
+      case RelayEnd::kSend:
+        return send_reason;
+      case RelayEnd::kError:
+        break;
+    }
+    return CloseReason::kError;
+  };
+  switch (res.index()) {
+    case 0:
+      return make_reason(std::get<0>(res), CloseReason::kClientClosed,
+                         CloseReason::kTargetClosed);
+    case 1:
+      return make_reason(std::get<1>(res), CloseReason::kTargetClosed,
+                         CloseReason::kClientClosed);
+  }
+  return CloseReason::kTimeout;
+}
+
+// buf is owned by the caller, so a relay with a data processor that has
+// detached continues in its own buffer.
+RelayEndAwait Relay(net::TcpConnection& from, net::TcpConnection& to,
+                    utils::Watchdog& watchdog, Session& session,
+                    Session::Direction direction, utils::Buffer& buf) noexcept {
+  buf.Clear();
   for (;;) {
     watchdog.Update();
     if (const auto err = co_await from.ReadSome(buf)) {
       SOCKS5_LOG(debug, net::MakeErrorMsg(*err, from));
-      co_return;
+      co_return RelayEnd::kRead;
     }
+    const auto size = buf.ReadableBytes();
+    SOCKS5_PROBE3(tcp_relay_read, session.Id(), static_cast<int>(direction),
+                  size);
+    session.Record(FlightEventType::kTcpRelayRead,
+                   static_cast<uint32_t>(direction), size);
+    session.AddRelayedBytes(direction, size);
     watchdog.Update();
     if (const auto err = co_await to.Send(buf)) {
       SOCKS5_LOG(debug, net::MakeErrorMsg(*err, to));
-      co_return;
+      co_return RelayEnd::kSend;
+    }
+    SOCKS5_PROBE3(tcp_relay_write, session.Id(), static_cast<int>(direction),
+                  size);
+    session.Record(FlightEventType::kTcpRelayWrite,
+                   static_cast<uint32_t>(direction), size);
+    buf.Clear();
+  }
+}
+
+// Relays the data of a compressed tunnel from the client, the frames are
+// decoded as soon as they are received.
+RelayEndAwait RelayFromTunnel(net::TcpConnection& from, net::TcpConnection& to,
+                              utils::Watchdog& watchdog, Session& session,
+                              utils::Buffer& buf) {
+  constexpr auto kDirection = Session::Direction::kClientToTarget;
+  common::TunnelDecoder decoder;
+  std::vector<char> data;
+  buf.Clear();
+  for (;;) {
+    watchdog.Update();
+    if (const auto err = co_await from.ReadSome(buf)) {
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, from));
+      co_return RelayEnd::kRead;
+    }
+    SOCKS5_PROBE3(tcp_relay_read, session.Id(), static_cast<int>(kDirection),
+                  buf.ReadableBytes());
+    session.Record(FlightEventType::kTcpRelayRead,
+                   static_cast<uint32_t>(kDirection), buf.ReadableBytes());
+    data.clear();
+    if (!decoder.Decode(buf.BeginRead(), buf.ReadableBytes(), data)) {
+      SOCKS5_LOG(debug, "Invalid compressed tunnel frame. Client: {}",
+                 net::ToString(from));
+      co_return RelayEnd::kError;
+    }
+    buf.Clear();
+    if (data.empty()) {
+      continue;
+    }
+    session.AddRelayedBytes(kDirection, data.size());
+    watchdog.Update();
+    if (const auto err = co_await to.Send(data.data(), data.size())) {
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, to));
+      co_return RelayEnd::kSend;
+    }
+    SOCKS5_PROBE3(tcp_relay_write, session.Id(), static_cast<int>(kDirection),
+                  data.size());
+    session.Record(FlightEventType::kTcpRelayWrite,
+                   static_cast<uint32_t>(kDirection), data.size());
+  }
+}
+
+// Relays the data of the target server to the client of a compressed tunnel.
+RelayEndAwait RelayToTunnel(net::TcpConnection& from, net::TcpConnection& to,
+                            utils::Watchdog& watchdog, Session& session,
+                            utils::Buffer& buf,
+                            common::TunnelEncoder& encoder) {
+  constexpr auto kDirection = Session::Direction::kTargetToClient;
+  std::vector<char> frames;
+  buf.Clear();
+  for (;;) {
+    watchdog.Update();
+    if (const auto err = co_await from.ReadSome(buf)) {
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, from));
+      co_return RelayEnd::kRead;
     }
+    const auto size = buf.ReadableBytes();
+    SOCKS5_PROBE3(tcp_relay_read, session.Id(), static_cast<int>(kDirection),
+                  size);
+    session.Record(FlightEventType::kTcpRelayRead,
+                   static_cast<uint32_t>(kDirection), size);
+    session.AddRelayedBytes(kDirection, size);
+    frames.clear();
+    encoder.Encode(buf.BeginRead(), size, frames);
     buf.Clear();
+    watchdog.Update();
+    if (const auto err = co_await to.Send(frames.data(), frames.size())) {
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, to));
+      co_return RelayEnd::kSend;
+    }
+    SOCKS5_PROBE3(tcp_relay_write, session.Id(), static_cast<int>(kDirection),
+                  frames.size());
+    session.Record(FlightEventType::kTcpRelayWrite,
+                   static_cast<uint32_t>(kDirection), frames.size());
   }
 }
 
+// Processor is TcpRelayDataProcessorCb, TcpRelayInlineDataProcessorCb,
+// TcpRelayInPlaceDataProcessorCb or TcpRelayAsyncDataProcessorCb. The inline
+// one gets the sink directly instead of a RelayDataSender wrapping it. The
+// in-place one gets the relay buffer with headroom and tailroom, and the relay
+// sends it without a copy. The async one is awaited before the next read, so
+// the data stays in order and the reads stop while it's suspended. Once the
+// processor detaches, the rest of the data is relayed by the plain Relay().
+template <typename Processor>
 class RelayWithDataProcessor final {
  public:
-  RelayWithDataProcessor(
-      const tcp::endpoint& from_ep, const tcp::endpoint& to_ep,
-      net::TcpConnection& from, net::TcpConnection& to,
-      utils::Watchdog& watchdog,
-      const TcpRelayDataProcessorCreatorCb& data_processor_creator) noexcept
+  template <typename Creator>
+  RelayWithDataProcessor(const tcp::endpoint& from_ep,
+                         const tcp::endpoint& to_ep, net::TcpConnection& from,
+                         net::TcpConnection& to, utils::Watchdog& watchdog,
+                         const Creator& data_processor_creator,
+                         Session& session, Session::Direction direction)
       : from_ep_{from_ep},
         to_ep_{to_ep},
         from_{from},
         to_{to},
         watchdog_{watchdog},
-        data_processor_{data_processor_creator(from_ep_, to_ep_)} {}
+        data_processor_{data_processor_creator(from_ep_, to_ep_)},
+        session_{session},
+        direction_{direction},
+        offload_pool_{session.Context() ? session.Context()->GetOffloadPool()
+                                        : nullptr} {}
 
-  VoidAwait Relay() {
-    sent_data_.Clear();
+  RelayEndAwait Relay() {
+    sink_.Clear();
     buf_.Clear();
     for (;;) {
       watchdog_.Update();
       if (const auto err = co_await from_.ReadSome(buf_)) {
         SOCKS5_LOG(debug, net::MakeErrorMsg(*err, from_));
-        co_return;
+        co_return RelayEnd::kRead;
       }
+      SOCKS5_PROBE3(tcp_relay_read, session_.Id(),
+                    static_cast<int>(direction_), buf_.ReadableBytes());
+      session_.Record(FlightEventType::kTcpRelayRead,
+                      static_cast<uint32_t>(direction_), buf_.ReadableBytes());
+      session_.AddRelayedBytes(direction_, buf_.ReadableBytes());
       watchdog_.Update();
-      data_processor_(
-          buf_.BeginRead(), buf_.ReadableBytes(),
-          [&](const char* data, size_t size) { SendToBuf(data, size); });
+      if constexpr (std::is_same_v<Processor, TcpRelayAsyncDataProcessorCb>) {
+        co_await data_processor_(buf_.BeginRead(), buf_.ReadableBytes(),
+                                 sink_);
+      } else if (offload_pool_) {
+        const auto process = [this] { Process(); };
+        co_await offload_pool_->Run(buf_.ReadableBytes(), process);
+      } else {
+        Process();
+      }
       watchdog_.Update();
-      if (!co_await sent_data_.ForEach(
-              [&](const RelayData& relay_data) noexcept -> BoolAwait {
-                co_return co_await SendToNet(std::move(relay_data));
-              })) {
-        co_return;
+      for (const auto& relay_data : sink_.Data()) {
+        if (!co_await SendToNet(relay_data)) {
+          co_return RelayEnd::kSend;
+        }
+      }
+      sink_.Clear();
+      if (detached_ || sink_.Detached()) {
+        co_return co_await Detach();
       }
-      sent_data_.Clear();
       buf_.Clear();
     }
   }
 
  private:
-  void SendToBuf(const char* data, size_t size) { sent_data_.Send(data, size); }
+  static constexpr bool kInPlace{
+      std::is_same_v<Processor, TcpRelayInPlaceDataProcessorCb>};
+  static constexpr size_t kHeadroom{kInPlace ? kRelayBufHeadroom : 0};
+  static constexpr size_t kTailroom{kInPlace ? kRelayBufTailroom : 0};
+
+  // Runs a synchronous processor. It may run on a thread of the offload pool,
+  // so it touches only the buffer, the sink and the processor.
+  void Process() {
+    if constexpr (kInPlace) {
+      RelayBuffer relay_buf{storage_.data(), storage_.data() + storage_.size(),
+                            buf_.BeginRead(), buf_.ReadableBytes()};
+      data_processor_(relay_buf);
+      if (relay_buf.Size() > 0) {
+        sink_.Send(relay_buf.Data(), relay_buf.Size());
+      }
+      detached_ = relay_buf.Detached();
+    } else if constexpr (std::is_same_v<Processor,
+                                        TcpRelayInlineDataProcessorCb>) {
+      data_processor_(buf_.BeginRead(), buf_.ReadableBytes(), sink_);
+    } else {
+      data_processor_(
+          buf_.BeginRead(), buf_.ReadableBytes(),
+          [&](const char* data, size_t size) { sink_.Send(data, size); });
+    }
+  }
+
+  // The processor isn't needed anymore, its state is released before the
+  // plain relay takes over.
+  RelayEndAwait Detach() {
+    SOCKS5_LOG(debug, "Tcp relay data processor detached. From: {}. To: {}",
+               net::ToString(from_), net::ToString(to_));
+    session_.Record(FlightEventType::kTcpRelayDetached,
+                    static_cast<uint32_t>(direction_),
+                    session_.RelayedBytes(direction_));
+    data_processor_ = Processor{};
+    co_return co_await server::Relay(from_, to_, watchdog_, session_,
+                                     direction_, buf_);
+  }
 
   BoolAwait SendToNet(const RelayData& relay_data) noexcept {
     watchdog_.Update();
@@ -84,6 +297,10 @@ class RelayWithDataProcessor final {
       SOCKS5_LOG(debug, net::MakeErrorMsg(*err, to_));
       co_return false;
     }
+    SOCKS5_PROBE3(tcp_relay_write, session_.Id(), static_cast<int>(direction_),
+                  relay_data.second);
+    session_.Record(FlightEventType::kTcpRelayWrite,
+                    static_cast<uint32_t>(direction_), relay_data.second);
     co_return true;
   }
 
@@ -92,37 +309,97 @@ class RelayWithDataProcessor final {
   net::TcpConnection& from_;
   net::TcpConnection& to_;
   utils::Watchdog& watchdog_;
-  const TcpRelayDataProcessorCb data_processor_;
-  SentRelayData sent_data_;
-  utils::StaticBuffer<kRelayBufSize> buf_;
+  Processor data_processor_;
+  Session& session_;
+  const Session::Direction direction_;
+  // Null if the processor runs on the server thread.
+  OffloadPool* const offload_pool_;
+  RelayDataSink sink_;
+  // Set by an in-place processor, the others detach through the sink.
+  bool detached_{false};
+  // Data is read between the headroom and the tailroom.
+  std::array<char, kHeadroom + kRelayBufSize + kTailroom> storage_;
+  utils::Buffer buf_{storage_.data() + kHeadroom, kRelayBufSize};
 };
 
-VoidAwait RunRelayWithDataProcessor(
+template <typename Processor, typename Creator>
+RelayEndAwait RunRelay(const tcp::endpoint& from_ep, const tcp::endpoint& to_ep,
+                       net::TcpConnection& from, net::TcpConnection& to,
+                       utils::Watchdog& watchdog, const Creator& creator,
+                       Session& session, Session::Direction direction) {
+  RelayWithDataProcessor<Processor> relay_with_data_processor{
+      from_ep, to_ep, from, to, watchdog, creator, session, direction};
+  co_return co_await relay_with_data_processor.Relay();
+}
+
+// The in-place processor is used if its creator is set for the direction,
+// then the inline one, then the async one, then the std::function one.
+RelayEndAwait RunRelayWithDataProcessor(
     const tcp::endpoint& from_ep, const tcp::endpoint& to_ep,
     net::TcpConnection& from, net::TcpConnection& to, utils::Watchdog& watchdog,
-    const TcpRelayDataProcessorCreatorCb& data_processor_creator) {
+    const TcpRelayDataProcessor& data_processor, Session& session,
+    Session::Direction direction) {
+  const auto client_to_target =
+      direction == Session::Direction::kClientToTarget;
+  const auto& in_place = client_to_target
+                             ? data_processor.client_to_server_in_place
+                             : data_processor.server_to_client_in_place;
+  const auto& inline_processor = client_to_target
+                                     ? data_processor.client_to_server_inline
+                                     : data_processor.server_to_client_inline;
+  const auto& async_processor = client_to_target
+                                    ? data_processor.client_to_server_async
+                                    : data_processor.server_to_client_async;
+  const auto& processor = client_to_target ? data_processor.client_to_server
+                                           : data_processor.server_to_client;
   try {
-    RelayWithDataProcessor relay_with_data_processor{
-        from_ep, to_ep, from, to, watchdog, data_processor_creator};
-    co_await relay_with_data_processor.Relay();
+    if (in_place) {
+      co_return co_await RunRelay<TcpRelayInPlaceDataProcessorCb>(
+          from_ep, to_ep, from, to, watchdog, in_place, session, direction);
+    }
+    if (inline_processor) {
+      co_return co_await RunRelay<TcpRelayInlineDataProcessorCb>(
+          from_ep, to_ep, from, to, watchdog, inline_processor, session,
+          direction);
+    }
+    if (async_processor) {
+      co_return co_await RunRelay<TcpRelayAsyncDataProcessorCb>(
+          from_ep, to_ep, from, to, watchdog, async_processor, session,
+          direction);
+    }
+    co_return co_await RunRelay<TcpRelayDataProcessorCb>(
+        from_ep, to_ep, from, to, watchdog, processor, session, direction);
   } catch (const std::exception& ex) {
     SOCKS5_LOG(debug, "Tcp relay exception. From: {}. To: {}. {}",
                net::ToString(from), net::ToString(to), ex.what());
   }
+  co_return RelayEnd::kError;
 }
 
 }  // namespace
 
 VoidAwait DefaultTcpRelayHandler(net::TcpConnection from, net::TcpConnection to,
-                                 const Config& config) {
+                                 const Config& config, Session& session) {
   SOCKS5_LOG(debug, "Tcp relay started. Client: {}. Server: {}",
              net::ToString(from), net::ToString(to));
   try {
     utils::Watchdog watchdog{co_await asio::this_coro::executor,
                              config.tcp_relay_timeout};
-    co_await (Relay(from, to, watchdog) || Relay(to, from, watchdog) ||
-              watchdog.Run());
+    utils::StaticBuffer<kRelayBufSize> client_buf;
+    utils::StaticBuffer<kRelayBufSize> target_buf;
+    const auto res = co_await (
+        Relay(from, to, watchdog, session, Session::Direction::kClientToTarget,
+              client_buf) ||
+        Relay(to, from, watchdog, session, Session::Direction::kTargetToClient,
+              target_buf) ||
+        watchdog.Run());
+    if (res.index() == 2) {
+      session.Record(FlightEventType::kWatchdogExpired, 0,
+                     config.tcp_relay_timeout);
+    }
+    session.Close(MakeCloseReason(res), from.GetSocket(), to.GetSocket());
   } catch (const std::exception&) {
+    session.Close(CloseReason::kError, from.GetSocket(), to.GetSocket());
     SOCKS5_LOG(debug,
                "Tcp relay finished with exception. Client: {}. Server: {}",
                net::ToString(from), net::ToString(to));
@@ -132,31 +409,76 @@ VoidAwait DefaultTcpRelayHandler(net::TcpConnection from, net::TcpConnection to,
              net::ToString(from), net::ToString(to));
 }
 
+VoidAwait CompressedTunnelRelayHandler(net::TcpConnection from,
+                                       net::TcpConnection to,
+                                       const Config& config, Session& session) {
+  SOCKS5_LOG(debug, "Compressed tunnel relay started. Client: {}. Server: {}",
+             net::ToString(from), net::ToString(to));
+  common::TunnelEncoder encoder;
+  try {
+    utils::Watchdog watchdog{co_await asio::this_coro::executor,
+                             config.tcp_relay_timeout};
+    utils::StaticBuffer<kRelayBufSize> client_buf;
+    utils::StaticBuffer<kRelayBufSize> target_buf;
+    const auto res = co_await (
+        RelayFromTunnel(from, to, watchdog, session, client_buf) ||
+        RelayToTunnel(to, from, watchdog, session, target_buf, encoder) ||
+        watchdog.Run());
+    if (res.index() == 2) {
+      session.Record(FlightEventType::kWatchdogExpired, 0,
+                     config.tcp_relay_timeout);
+    }
+    session.Close(MakeCloseReason(res), from.GetSocket(), to.GetSocket());
+  } catch (const std::exception&) {
+    session.Close(CloseReason::kError, from.GetSocket(), to.GetSocket());
+    SOCKS5_LOG(debug,
+               "Compressed tunnel relay finished with exception. Client: {}. "
+               "Server: {}",
+               net::ToString(from), net::ToString(to));
+    throw;
+  }
+  SOCKS5_LOG(debug,
+             "Compressed tunnel relay finished. Client: {}. Server: {}. "
+             "Sent to client: {} bytes as {}",
+             net::ToString(from), net::ToString(to), encoder.InBytes(),
+             encoder.OutBytes());
+}
+
 VoidAwait TcpRelayHandlerWithDataProcessor(
     net::TcpConnection from, net::TcpConnection to, const Config& config,
-    const TcpRelayDataProcessor& tcp_relay_data_processor) {
+    const TcpRelayDataProcessor& tcp_relay_data_processor, Session& session) {
   SOCKS5_LOG(debug, "Tcp relay started. Client: {}. Server: {}",
              net::ToString(from), net::ToString(to));
   const auto [from_err, from_ep] = from.RemoteEndpoint();
   if (from_err) {
     SOCKS5_LOG(debug, net::MakeErrorMsg(*from_err, from));
+    session.Close(CloseReason::kClientClosed, from.GetSocket(), to.GetSocket());
     co_return;
   }
   const auto [to_err, to_ep] = to.RemoteEndpoint();
   if (to_err) {
     SOCKS5_LOG(debug, to_err->Msg());
+    session.Close(CloseReason::kTargetClosed, from.GetSocket(), to.GetSocket());
     co_return;
   }
   try {
     utils::Watchdog watchdog{co_await asio::this_coro::executor,
                              config.tcp_relay_timeout};
-    co_await (
+    const auto res = co_await (
         RunRelayWithDataProcessor(*from_ep, *to_ep, from, to, watchdog,
-                                  tcp_relay_data_processor.client_to_server) ||
+                                  tcp_relay_data_processor, session,
+                                  Session::Direction::kClientToTarget) ||
         RunRelayWithDataProcessor(*to_ep, *from_ep, to, from, watchdog,
-                                  tcp_relay_data_processor.server_to_client) ||
+                                  tcp_relay_data_processor, session,
+                                  Session::Direction::kTargetToClient) ||
         watchdog.Run());
+    if (res.index() == 2) {
+      session.Record(FlightEventType::kWatchdogExpired, 0,
+                     config.tcp_relay_timeout);
+    }
+    session.Close(MakeCloseReason(res), from.GetSocket(), to.GetSocket());
   } catch (const std::exception&) {
+    session.Close(CloseReason::kError, from.GetSocket(), to.GetSocket());
     SOCKS5_LOG(debug, "Tcp relay finished. Client: {}. Server: {}",
                net::ToString(from), net::ToString(to));
     throw;
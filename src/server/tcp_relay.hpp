@@ -8,6 +8,7 @@
 #include <socks5/common/metrics.hpp>
 #include <socks5/server/handler_defs.hpp>
 #include <server/relay_data_processors.hpp>
+#include <server/session.hpp>
 #include <type_traits>
 
 namespace socks5::server {
@@ -47,10 +48,14 @@ struct InvalidTcpHandler : std::false_type {};
 
 using DefaultTcpRelayHandlerCb = VoidAwait (*)(net::TcpConnection,
                                                net::TcpConnection,
-                                               const Config&);
+                                               const Config&, Session&);
 using TcpRelayHandlerWithDataProcessorCb =
     VoidAwait (*)(net::TcpConnection, net::TcpConnection, const Config&,
-                  const TcpRelayDataProcessor&);
+                  const TcpRelayDataProcessor&, Session&);
+
+VoidAwait CompressedTunnelRelayHandler(net::TcpConnection client,
+                                       net::TcpConnection target,
+                                       const Config& config, Session& session);
 
 template <typename Handler>
 class TcpRelay final : utils::NonCopyable {
@@ -60,31 +65,49 @@ class TcpRelay final : utils::NonCopyable {
   TcpRelay(asio::io_context& io_context, net::TcpConnection client,
            net::TcpConnection server, const RelayHandler& handler,
            const Config& config, common::Metrics& metrics,
-           const TcpRelayDataProcessor& tcp_data_processor) noexcept
+           const TcpRelayDataProcessor& tcp_data_processor,
+           Session& session) noexcept
       : io_context_{io_context},
         client_{std::move(client)},
         server_{std::move(server)},
         handler_{handler},
         config_{config},
         metrics_{metrics},
-        tcp_relay_data_processor_{tcp_data_processor} {}
+        tcp_relay_data_processor_{tcp_data_processor},
+        session_{session} {}
 
   VoidAwait Run() noexcept { co_await Relay(); }
 
+  // Relays a CONNECT whose client leg is a compressed tunnel, only the default
+  // handler accepts one.
+  VoidAwait RunCompressedTunnel() noexcept {
+    try {
+      co_await CompressedTunnelRelayHandler(std::move(client_),
+                                            std::move(server_), config_,
+                                            session_);
+    } catch (const std::exception& ex) {
+      SOCKS5_LOG(error, "Tcp relay exception. Client: {}. Server: {}. {}",
+                 net::ToString(client_), net::ToString(server_), ex.what());
+    }
+  }
+
  private:
   VoidAwait Relay() noexcept {
     try {
       if constexpr (std::is_same_v<std::decay_t<Handler>,
                                    DefaultTcpRelayHandlerCb>) {
-        co_await handler_(std::move(client_), std::move(server_), config_);
+        co_await handler_(std::move(client_), std::move(server_), config_,
+                          session_);
       } else if constexpr (std::is_same_v<std::decay_t<Handler>,
                                           TcpRelayHandlerWithDataProcessorCb>) {
         co_await handler_(std::move(client_), std::move(server_), config_,
-                          tcp_relay_data_processor_);
+                          tcp_relay_data_processor_, session_);
       } else if constexpr (detail::IsCoroTcpRelayHandlerV<Handler>) {
+        session_.SetKillable(false);
         co_await handler_(io_context_, std::move(client_.GetSocket()),
                           std::move(server_.GetSocket()), config_, metrics_);
       } else if constexpr (detail::IsTcpRelayHandlerV<Handler>) {
+        session_.SetKillable(false);
         handler_(io_context_, std::move(client_.GetSocket()),
                  std::move(server_.GetSocket()), config_, metrics_);
       } else {
@@ -105,12 +128,13 @@ class TcpRelay final : utils::NonCopyable {
   const Config& config_;
   common::Metrics& metrics_;
   const TcpRelayDataProcessor& tcp_relay_data_processor_;
+  Session& session_;
 };
 
 VoidAwait DefaultTcpRelayHandler(net::TcpConnection from, net::TcpConnection to,
-                                 const Config& config);
+                                 const Config& config, Session& session);
 VoidAwait TcpRelayHandlerWithDataProcessor(
     net::TcpConnection from, net::TcpConnection to, const Config& config,
-    const TcpRelayDataProcessor& data_processor);
+    const TcpRelayDataProcessor& data_processor, Session& session);
 
 }  // namespace socks5::server
\ No newline at end of file
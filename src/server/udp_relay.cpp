@@ -2,22 +2,35 @@
 #include <common/addr_utils.hpp>
 #include <net/utils.hpp>
 #include <socks5/utils/buffer.hpp>
+#include <utils/buffer_pool.hpp>
 #include <proto/proto.hpp>
 #include <server/udp_relay.hpp>
+#include <server/server_context.hpp>
+#include <server/dns_cache.hpp>
 #include <parsers/parsers.hpp>
 #include <serializers/serializers.hpp>
 #include <common/defs.hpp>
-#include <server/sent_relay_data.hpp>
 #include <net/connection_error.hpp>
 #include <common/proto_builders.hpp>
 #include <common/socks5_datagram_validator.hpp>
 #include <common/socks5_datagram_io.hpp>
 #include <socks5/utils/watchdog.hpp>
+#include <utils/probes.hpp>
+#include <chrono>
+#include <list>
+#include <type_traits>
+#include <variant>
+#include <vector>
 
 namespace socks5::server {
 
 namespace {
 
+struct TargetServerData;
+
+// Target servers from the most to the least recently active.
+using TargetServersLru = std::list<TargetServerData*>;
+
 struct TargetServerData final {
   // Connection for recv/send data to target server.
   net::UdpConnection connect;
@@ -25,6 +38,26 @@ struct TargetServerData final {
   udp::endpoint ep;
   // Targert server serialized address.
   AddrBuf addr;
+  // Datagrams to send to the target server with one system call.
+  net::UdpSendBatch batch;
+  // Time of the last datagram from or to the target server. Updated only if
+  // eviction is enabled.
+  std::chrono::steady_clock::time_point last_active{};
+  // Key of the target server and its position in the list of recently active
+  // target servers. Set only if eviction is enabled.
+  const proto::Addr* key{nullptr};
+  TargetServersLru::iterator lru_pos{};
+  // The socket is closed, the reader of the target server removes it.
+  bool evicted{false};
+  // The target server is a resolver whose answers are cached.
+  bool dns{false};
+  // Queries sent to the resolver, only their answers are cached.
+  DnsPendingQueries dns_queries;
+  // Referenced by a batch being processed, so it isn't evicted.
+  bool pinned{false};
+  // Number of datagrams being sent outside of a batch. The target server
+  // isn't evicted while it's not 0.
+  size_t sends{0};
 };
 
 using TargetServerDataRef = std::reference_wrapper<TargetServerData>;
@@ -33,23 +66,42 @@ using TargetServerOpt = std::optional<TargetServer>;
 using TargetServerOptAwait = asio::awaitable<TargetServerOpt>;
 using TargetServers = std::unordered_map<proto::Addr, TargetServerData,
                                          common::Hash, common::EqualTo>;
+// Extracted nodes keep the addresses of the evicted target servers stable
+// while their readers are finishing.
+using EvictedTargetServers = std::list<TargetServers::node_type>;
+using Clock = std::chrono::steady_clock;
 using DatagramOrError = std::pair<net::UdpConnectErrorOpt, DatagramOpt>;
 using DatagramOrErrorAwait = asio::awaitable<DatagramOrError>;
 
 constexpr size_t kTcpBufSize{4096};
+// Max number of datagrams queued to a target server while its domain name is
+// being resolved. The rest are dropped.
+constexpr size_t kMaxPendingDatagrams{16};
+// Max number of target servers of an association being resolved at once.
+constexpr size_t kMaxPendingTargetServers{64};
 
 template <typename Derived>
 class HandlerBase : utils::NonCopyable {
  public:
   HandlerBase(net::TcpConnection client, net::UdpConnection proxy,
               const proto::Addr& client_addr, utils::Watchdog& watchdog,
-              const Config& config, common::Metrics& metrics) noexcept
+              const Config& config, Session& session,
+              common::Metrics& metrics) noexcept
       : client_{std::move(client)},
         proxy_{std::move(proxy)},
         expected_client_ep_{net::MakeEndpointFromIP<udp>(client_addr)},
         watchdog_{watchdog},
         config_{config},
-        metrics_{metrics} {}
+        session_{session},
+        metrics_{metrics},
+        dns_cache_{config.udp_dns_cache && session.Context()
+                       ? session.Context()->GetDnsCache()
+                       : nullptr} {}
+
+  ~HandlerBase() {
+    metrics_.RemoveUdpTargetServers(target_servers_.size() +
+                                    evicted_target_servers_.size());
+  }
 
   VoidAwait ProcessTcp() noexcept {
     utils::StaticBuffer<kTcpBufSize> buf;
@@ -64,6 +116,21 @@ class HandlerBase : utils::NonCopyable {
 
   const std::string& ProxyAddrStr() noexcept { return net::ToString(proxy_); }
 
+  void Close(CloseReason reason) noexcept {
+    session_.Close(reason, client_.GetSocket());
+  }
+
+  // Stops all the io of the relay. The coroutines spawned by the handler may
+  // outlive the relay, they must not start any io after that.
+  void Stop() noexcept {
+    stopped_ = true;
+    for (auto& target_server : target_servers_) {
+      target_server.second.connect.Stop();
+    }
+    client_.Stop();
+    proxy_.Stop();
+  }
+
   std::string ClientAddrStr() const {
     if (client_ep_) {
       return net::ToString<udp>(*client_ep_);
@@ -72,73 +139,122 @@ class HandlerBase : utils::NonCopyable {
   }
 
  protected:
-  template <typename Buffer>
-  DatagramOrErrorAwait RecvClientDatagram(Buffer& buf) noexcept {
+  // The datagram points into buf, it's valid until the next call.
+  DatagramOrErrorAwait RecvClientDatagram(
+      utils::PooledBufferOpt& buf) noexcept {
     watchdog_.Update();
-    const auto [err, sender_ep] = co_await proxy_.Read(buf);
+    const auto [err, sender_ep] = co_await proxy_.ReadPooled(buf);
     if (err) {
       co_return std::make_pair(std::move(err), std::nullopt);
     }
-    if (!VerifyDatagramSender(*sender_ep)) {
-      co_return std::make_pair(std::nullopt, std::nullopt);
+    co_return std::make_pair(std::nullopt,
+                             ParseClientDatagram(*buf, *sender_ep));
+  }
+
+  template <typename Buffer>
+  DatagramOpt ParseClientDatagram(Buffer& buf,
+                                  const udp::endpoint& sender_ep) noexcept {
+    if (!VerifyDatagramSender(sender_ep)) {
+      return std::nullopt;
     }
     // The first verified client address is saved and used in the future for
     // relaying and verification.
     if (!client_ep_) {
       client_ep_ = sender_ep;
-      expected_client_ep_ = std::move(*sender_ep);
+      expected_client_ep_ = sender_ep;
     }
     if (!common::ValidateDatagramLength(buf)) {
-      co_return std::make_pair(std::nullopt, std::nullopt);
+      return std::nullopt;
     }
     const auto datagram = parsers::ParseDatagram(buf);
     if (datagram.header.frag != proto::UdpFrag::kUdpFragNoFrag) {
-      co_return std::make_pair(std::nullopt, std::nullopt);
+      return std::nullopt;
     }
-    co_return std::make_pair(std::nullopt, std::move(datagram));
+    return datagram;
   }
 
   TargetServerOptAwait FindOrMakeTargetServer(
       const proto::Addr& addr) noexcept {
     try {
-      if (auto target_server = GetTargetServer(addr)) {
+      if (auto target_server = FindTargetServer(addr)) {
         co_return target_server;
       }
-      auto connect = net::MakeUdpConnect(
-          net::MakeOpenSocket<udp>(co_await asio::this_coro::executor,
-                                   config_.listener_addr.first, 0),
-          metrics_);
       const auto [err, ep] = co_await net::MakeEndpoint<udp>(addr);
       if (err) {
-        SOCKS5_LOG(debug,
-                   "Udp relay. Endpoint error. Proxy: {}. Client: {}. Target: "
-                   "{}. msg={}",
-                   net::ToString(proxy_), net::ToString<udp>(*client_ep_),
-                   common::ToString(addr), err.message());
+        LogEndpointError(addr, err);
         co_return std::nullopt;
       }
-      auto target_server = AddTargetServer(addr, std::move(connect), *ep);
-      SOCKS5_LOG(debug,
-                 "Udp relay. Added new target server. Proxy: {}. Client: {}. "
-                 "Target server: {}",
-                 net::ToString(proxy_), net::ToString<udp>(*client_ep_),
-                 net::ToString(target_server.second.get().connect));
-      reinterpret_cast<Derived*>(this)->RunTargetServerHandler(
-          co_await asio::this_coro::executor, target_server);
-      co_return target_server;
+      co_return MakeTargetServer(co_await asio::this_coro::executor, addr,
+                                 *ep);
     } catch (const std::exception& ex) {
       SOCKS5_LOG(error, "Udp relay exception. {}", ex.what());
       co_return std::nullopt;
     }
   }
 
+  TargetServerOpt FindTargetServer(const proto::Addr& addr) noexcept {
+    auto target_server = GetTargetServer(addr);
+    if (target_server) {
+      Touch(target_server->second.get());
+      EvictIdleTargetServers();
+    }
+    return target_server;
+  }
+
+  // Opens a socket for the resolved target server and starts its reader.
+  TargetServerOpt MakeTargetServer(const asio::any_io_executor& executor,
+                                   const proto::Addr& addr,
+                                   const udp::endpoint& ep) {
+    auto connect = net::MakeUdpConnect(
+        net::MakeOpenSocket<udp>(executor, config_.listener_addr.first, 0),
+        metrics_);
+    if (config_.udp_connect_targets) {
+      if (const auto err = connect.Connect(ep)) {
+        SOCKS5_LOG(debug, net::MakeErrorMsg(*err, connect));
+        return std::nullopt;
+      }
+    }
+    EvictIdleTargetServers();
+    if (config_.udp_max_target_servers != 0 &&
+        target_servers_.size() >= config_.udp_max_target_servers) {
+      EvictLeastRecentTargetServer();
+    }
+    auto target_server = AddTargetServer(addr, std::move(connect), ep);
+    Touch(target_server.second.get());
+    target_server.second.get().dns = dns_cache_ && dns_cache_->IsResolver(ep);
+    SOCKS5_LOG(debug,
+               "Udp relay. Added new target server. Proxy: {}. Client: {}. "
+               "Target server: {}",
+               net::ToString(proxy_), net::ToString<udp>(*client_ep_),
+               net::ToString(target_server.second.get().connect));
+    reinterpret_cast<Derived*>(this)->RunTargetServerHandler(executor,
+                                                             target_server);
+    return target_server;
+  }
+
+  void LogEndpointError(const proto::Addr& addr,
+                        const boost::system::error_code& err) {
+    SOCKS5_LOG(debug,
+               "Udp relay. Endpoint error. Proxy: {}. Client: {}. Target: "
+               "{}. msg={}",
+               net::ToString(proxy_), net::ToString<udp>(*client_ep_),
+               common::ToString(addr), err.message());
+  }
+
   TargetServer AddTargetServer(const proto::Addr& addr,
                                net::UdpConnection&& connect, udp::endpoint ep) {
     const auto it = target_servers_.insert(
         {addr, TargetServerData{std::move(connect), std::move(ep),
-                                serializers::Serialize(addr)}});
-    return std::make_pair(std::ref(it.first->first),
-                          std::ref(it.first->second));
+                                serializers::Serialize(addr),
+                                net::UdpSendBatch{config_.udp_batch_size,
+                                                  config_.udp_gso}}});
+    metrics_.AddUdpTargetServers(1);
+    auto& data = it.first->second;
+    if (EvictionEnabled()) {
+      data.key = &it.first->first;
+      data.lru_pos = lru_.insert(lru_.begin(), &data);
+    }
+    return std::make_pair(std::ref(it.first->first), std::ref(data));
   }
 
   TargetServerOpt GetTargetServer(const proto::Addr& addr) {
@@ -149,6 +265,167 @@ class HandlerBase : utils::NonCopyable {
     return std::nullopt;
   }
 
+  // The target server can't be evicted until the datagram is sent, so it's
+  // valid after the call.
+  net::UdpConnectErrorOptAwait SendToTargetServer(
+      TargetServerData& target_server_data, const char* data,
+      size_t size) noexcept {
+    if (target_server_data.dns) {
+      target_server_data.dns_queries.Add(data, size);
+    }
+    ++target_server_data.sends;
+    auto err =
+        config_.udp_connect_targets
+            ? co_await target_server_data.connect.Send(data, size)
+            : co_await target_server_data.connect.Send(target_server_data.ep,
+                                                       data, size);
+    --target_server_data.sends;
+    co_return err;
+  }
+
+  // Receives the next datagram of the target server. Datagrams of other
+  // senders are dropped, by the kernel if the socket is connected.
+  net::UdpConnectErrorOptAwait RecvTargetServerDatagram(
+      TargetServerData& target_server_data,
+      utils::PooledBufferOpt& buf) noexcept {
+    for (;;) {
+      const auto [err, sender_ep] =
+          co_await target_server_data.connect.ReadPooled(buf);
+      if (err || config_.udp_connect_targets ||
+          target_server_data.ep == *sender_ep) {
+        co_return err;
+      }
+    }
+  }
+
+  void AddToTargetServerBatch(TargetServerData& target_server_data,
+                              const char* data, size_t size) {
+    if (target_server_data.dns) {
+      target_server_data.dns_queries.Add(data, size);
+    }
+    if (config_.udp_connect_targets) {
+      target_server_data.batch.Add(data, size);
+    } else {
+      target_server_data.batch.Add(target_server_data.ep, data, size);
+    }
+  }
+
+  // Sends and clears the batch of the target server.
+  BoolAwait SendTargetServerBatch(
+      TargetServerData& target_server_data) noexcept {
+    auto& target_batch = target_server_data.batch;
+    watchdog_.Update();
+    if (const auto err =
+            co_await target_server_data.connect.SendBatch(target_batch)) {
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, target_server_data.connect));
+      co_return false;
+    }
+    for (size_t i = 0; i < target_batch.Size(); ++i) {
+      OnDatagramOut(Session::Direction::kClientToTarget,
+                    target_batch.PayloadSize(i));
+    }
+    target_batch.Clear();
+    co_return true;
+  }
+
+  BoolAwait SendClientBatch(net::UdpSendBatch& client_batch) noexcept {
+    watchdog_.Update();
+    if (const auto err = co_await proxy_.SendBatch(client_batch)) {
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, proxy_));
+      proxy_.Cancel();
+      co_return false;
+    }
+    for (size_t i = 0; i < client_batch.Size(); ++i) {
+      OnDatagramOut(Session::Direction::kTargetToClient,
+                    client_batch.PayloadSize(i));
+    }
+    client_batch.Clear();
+    co_return true;
+  }
+
+  bool EvictionEnabled() const noexcept {
+    return config_.udp_max_target_servers != 0 ||
+           config_.udp_target_server_idle_timeout != 0;
+  }
+
+  void Touch(TargetServerData& target_server_data) noexcept {
+    if (EvictionEnabled() && !target_server_data.evicted) {
+      target_server_data.last_active = Clock::now();
+      lru_.splice(lru_.begin(), lru_, target_server_data.lru_pos);
+    }
+  }
+
+  // Idle target servers are looked for at most twice per idle timeout on the
+  // client datagram path. If the client is silent too, the whole association
+  // expires by udp_relay_timeout. Target servers with datagrams pending in a
+  // batch or being sent, or pinned, aren't evicted.
+  void EvictIdleTargetServers() noexcept {
+    const auto timeout = config_.udp_target_server_idle_timeout;
+    if (timeout == 0) {
+      return;
+    }
+    const auto now = Clock::now();
+    if (now < next_idle_check_) {
+      return;
+    }
+    const std::chrono::seconds idle_timeout{timeout};
+    next_idle_check_ = now + idle_timeout / 2;
+    // Only the idle tail of the list is visited.
+    for (auto it = lru_.end(); it != lru_.begin();) {
+      auto& data = **--it;
+      if (now - data.last_active < idle_timeout) {
+        break;
+      }
+      if (Evictable(data)) {
+        it = EvictTargetServer(data, true);
+      }
+    }
+  }
+
+  // The least recent target server is usually evictable, only the ones busy
+  // sending are skipped.
+  void EvictLeastRecentTargetServer() noexcept {
+    for (auto it = lru_.end(); it != lru_.begin();) {
+      auto& data = **--it;
+      if (Evictable(data)) {
+        EvictTargetServer(data, false);
+        return;
+      }
+    }
+  }
+
+  static bool Evictable(const TargetServerData& data) noexcept {
+    return data.batch.Empty() && !data.pinned && data.sends == 0;
+  }
+
+  // Returns the position in the list that followed the target server.
+  TargetServersLru::iterator EvictTargetServer(TargetServerData& data,
+                                               bool idle) noexcept {
+    SOCKS5_LOG(debug,
+               "Udp relay. Evicted target server. Proxy: {}. Client: {}. "
+               "Target server: {}. Idle: {}",
+               net::ToString(proxy_), ClientAddrStr(),
+               common::ToString(*data.key), idle);
+    data.evicted = true;
+    data.connect.Stop();
+    const auto next = lru_.erase(data.lru_pos);
+    evicted_target_servers_.push_back(
+        target_servers_.extract(target_servers_.find(*data.key)));
+    metrics_.AddEvictedUdpTargetServers(1);
+    session_.Record(FlightEventType::kUdpTargetEvicted, idle ? 1 : 0,
+                    target_servers_.size());
+    return next;
+  }
+
+  // Called by the reader of an evicted target server when it's finished.
+  void RemoveEvictedTargetServer(
+      const TargetServerData& target_server_data) noexcept {
+    evicted_target_servers_.remove_if([&](const auto& node) {
+      return &node.mapped() == &target_server_data;
+    });
+    metrics_.RemoveUdpTargetServers(1);
+  }
+
   bool VerifyDatagramSender(const udp::endpoint& accepted_sender) noexcept {
     if (expected_client_ep_.address() != accepted_sender.address()) {
       SOCKS5_LOG(debug,
@@ -175,12 +452,19 @@ class HandlerBase : utils::NonCopyable {
     return true;
   }
 
-  void Stop() noexcept {
-    for (auto& target_server : target_servers_) {
-      target_server.second.connect.Stop();
-    }
-    client_.Stop();
-    proxy_.Stop();
+  void OnDatagramIn(Session::Direction direction, size_t size) noexcept {
+    SOCKS5_PROBE3(udp_datagram_in, session_.Id(), static_cast<int>(direction),
+                  size);
+    session_.Record(FlightEventType::kUdpDatagramIn,
+                    static_cast<uint32_t>(direction), size);
+    session_.AddRelayedBytes(direction, size);
+  }
+
+  void OnDatagramOut(Session::Direction direction, size_t size) noexcept {
+    SOCKS5_PROBE3(udp_datagram_out, session_.Id(), static_cast<int>(direction),
+                  size);
+    session_.Record(FlightEventType::kUdpDatagramOut,
+                    static_cast<uint32_t>(direction), size);
   }
 
   net::TcpConnection client_;
@@ -189,8 +473,16 @@ class HandlerBase : utils::NonCopyable {
   UdpEndpointOpt client_ep_;
   utils::Watchdog& watchdog_;
   TargetServers target_servers_;
+  EvictedTargetServers evicted_target_servers_;
+  // Empty if eviction is disabled.
+  TargetServersLru lru_;
+  Clock::time_point next_idle_check_{};
+  bool stopped_{false};
   const Config& config_;
+  Session& session_;
   common::Metrics& metrics_;
+  // Null if the DNS cache is disabled.
+  DnsCache* dns_cache_;
 };
 
 class Handler final : public HandlerBase<Handler>,
@@ -200,15 +492,19 @@ class Handler final : public HandlerBase<Handler>,
   friend HandlerBase<Handler>;
 
   VoidAwait ProcessUdp() noexcept {
-    utils::StaticBuffer<kDatagramMaxLen> buf;
+    if (config_.udp_batch_size > 1) {
+      co_return co_await ProcessUdpBatch();
+    }
+    const auto executor = co_await asio::this_coro::executor;
+    utils::PooledBufferOpt buf;
     for (;;) {
-      buf.Clear();
       const auto [err, datagram] = co_await RecvClientDatagram(buf);
       if (err) {
         SOCKS5_LOG(debug, net::MakeErrorMsg(*err, proxy_));
         co_return Stop();
       }
-      if (!datagram) {
+      if (!datagram || QueueForResolution(executor, *datagram) ||
+          co_await AnswerFromDnsCache(*datagram)) {
         continue;
       }
       auto target_server =
@@ -217,43 +513,282 @@ class Handler final : public HandlerBase<Handler>,
         co_return Stop();
       }
       auto& target_server_data = target_server->second.get();
+      OnDatagramIn(Session::Direction::kClientToTarget,
+                   datagram->data.data_size);
       watchdog_.Update();
-      if (const auto err = co_await target_server_data.connect.Send(
-              target_server_data.ep,
+      if (const auto err = co_await SendToTargetServer(
+              target_server_data,
               reinterpret_cast<const char*>(datagram->data.data),
               datagram->data.data_size)) {
+        if (stopped_) {
+          co_return;
+        }
+        if (target_server_data.evicted) {
+          metrics_.AddDroppedUdpDatagrams(1);
+          continue;
+        }
         SOCKS5_LOG(debug, net::MakeErrorMsg(*err, target_server_data.connect));
         co_return Stop();
       }
+      OnDatagramOut(Session::Direction::kClientToTarget,
+                    datagram->data.data_size);
     }
   }
 
  private:
+  using PendingDatagrams = std::vector<std::vector<char>>;
+  using PendingTargetServers =
+      std::unordered_map<proto::Addr, PendingDatagrams, common::Hash,
+                         common::EqualTo>;
+
+  // Answers a query to a cached resolver from the DNS cache. Returns true if
+  // the query was answered, the target server isn't even opened then.
+  BoolAwait AnswerFromDnsCache(const proto::Datagram& datagram) noexcept {
+    const auto& addr = datagram.header.addr;
+    if (!dns_cache_ || addr.atyp == proto::AddrType::kAddrTypeDomainName) {
+      co_return false;
+    }
+    const auto resolver_ep = net::MakeEndpointFromIP<udp>(addr);
+    const auto* data = reinterpret_cast<const char*>(datagram.data.data);
+    const auto size = datagram.data.data_size;
+    if (!dns_cache_->IsResolver(resolver_ep) ||
+        !dns_cache_->Lookup(resolver_ep, data, size, dns_answer_)) {
+      co_return false;
+    }
+    OnDatagramIn(Session::Direction::kClientToTarget, size);
+    const auto addr_buf = serializers::Serialize(addr);
+    const auto buffs =
+        common::MakeDatagramBuffs(utils::MakeBuffer(addr_buf),
+                                  dns_answer_.data(), dns_answer_.size());
+    watchdog_.Update();
+    if (const auto err = co_await proxy_.Send(*client_ep_, buffs)) {
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, proxy_));
+      Stop();
+      co_return true;
+    }
+    OnDatagramOut(Session::Direction::kTargetToClient, dns_answer_.size());
+    co_return true;
+  }
+
+  // Domain names of new target servers are resolved in the background, so the
+  // client datagrams to the other target servers aren't delayed. Returns true
+  // if the datagram was queued until the target server is resolved or
+  // dropped.
+  bool QueueForResolution(const asio::any_io_executor& executor,
+                          const proto::Datagram& datagram) {
+    const auto& addr = datagram.header.addr;
+    if (!pending_target_servers_.empty()) {
+      const auto it = pending_target_servers_.find(addr);
+      if (it != pending_target_servers_.end()) {
+        QueueDatagram(it->second, datagram);
+        return true;
+      }
+    }
+    if (addr.atyp != proto::AddrType::kAddrTypeDomainName ||
+        GetTargetServer(addr)) {
+      return false;
+    }
+    if (pending_target_servers_.size() >= kMaxPendingTargetServers) {
+      metrics_.AddDroppedUdpDatagrams(1);
+      return true;
+    }
+    QueueDatagram(pending_target_servers_[addr], datagram);
+    asio::co_spawn(
+        executor,
+        [self = this->shared_from_this(), addr, this] {
+          return ResolveTargetServer(addr);
+        },
+        asio::detached);
+    return true;
+  }
+
+  void QueueDatagram(PendingDatagrams& datagrams,
+                     const proto::Datagram& datagram) {
+    if (datagrams.size() == kMaxPendingDatagrams) {
+      metrics_.AddDroppedUdpDatagrams(1);
+      return;
+    }
+    const auto* data = reinterpret_cast<const char*>(datagram.data.data);
+    datagrams.emplace_back(data, data + datagram.data.data_size);
+    OnDatagramIn(Session::Direction::kClientToTarget,
+                 datagram.data.data_size);
+  }
+
+  // Resolves the target server and sends the queued datagrams to it. New
+  // datagrams are queued until all the queued ones are sent, so the order is
+  // kept. If the name can't be resolved, the datagrams are dropped and the
+  // next datagram to the target server starts a new resolution.
+  VoidAwait ResolveTargetServer(proto::Addr addr) noexcept {
+    auto& datagrams = pending_target_servers_[addr];
+    size_t sent{0};
+    try {
+      const auto executor = co_await asio::this_coro::executor;
+      const auto [err, ep] = co_await net::MakeEndpoint<udp>(addr);
+      TargetServerOpt target_server;
+      if (err) {
+        LogEndpointError(addr, err);
+      } else if (!stopped_) {
+        target_server = MakeTargetServer(executor, addr, *ep);
+      }
+      for (; target_server && sent < datagrams.size() && !stopped_; ++sent) {
+        // The vector may grow while the datagram is being sent.
+        const auto data = std::move(datagrams[sent]);
+        auto& target_server_data = target_server->second.get();
+        watchdog_.Update();
+        if (const auto send_err = co_await SendToTargetServer(
+                target_server_data, data.data(), data.size())) {
+          if (!stopped_ && !target_server_data.evicted) {
+            SOCKS5_LOG(debug, net::MakeErrorMsg(*send_err,
+                                                target_server_data.connect));
+            Stop();
+          }
+          break;
+        }
+        OnDatagramOut(Session::Direction::kClientToTarget, data.size());
+      }
+    } catch (const std::exception& ex) {
+      SOCKS5_LOG(error, "Udp relay exception. {}", ex.what());
+    }
+    metrics_.AddDroppedUdpDatagrams(datagrams.size() - sent);
+    pending_target_servers_.erase(addr);
+  }
+
+  // Receives a batch of datagrams from the client, groups them by the target
+  // server and sends every group with one system call.
+  VoidAwait ProcessUdpBatch() noexcept {
+    const auto executor = co_await asio::this_coro::executor;
+    net::UdpRecvBatch batch{config_.udp_batch_size,
+                            config_.udp_batch_datagram_size};
+    std::vector<TargetServerData*> pending;
+    for (;;) {
+      watchdog_.Update();
+      if (const auto err = co_await proxy_.ReadBatch(batch)) {
+        SOCKS5_LOG(debug, net::MakeErrorMsg(*err, proxy_));
+        co_return Stop();
+      }
+      for (size_t i = 0; i < batch.Size(); ++i) {
+        utils::Buffer buf{batch.Data(i), batch.DatagramSize()};
+        buf.HasWritten(batch.Length(i));
+        const auto datagram = ParseClientDatagram(buf, batch.Sender(i));
+        if (!datagram || QueueForResolution(executor, *datagram) ||
+            co_await AnswerFromDnsCache(*datagram)) {
+          continue;
+        }
+        auto target_server =
+            co_await FindOrMakeTargetServer(datagram->header.addr);
+        if (!target_server) {
+          co_return Stop();
+        }
+        auto& target_server_data = target_server->second.get();
+        if (target_server_data.batch.Empty()) {
+          pending.push_back(&target_server_data);
+        }
+        AddToTargetServerBatch(
+            target_server_data,
+            reinterpret_cast<const char*>(datagram->data.data),
+            datagram->data.data_size);
+        OnDatagramIn(Session::Direction::kClientToTarget,
+                     datagram->data.data_size);
+      }
+      for (auto* target_server_data : pending) {
+        if (!co_await SendTargetServerBatch(*target_server_data)) {
+          co_return Stop();
+        }
+      }
+      pending.clear();
+    }
+  }
+
   VoidAwait ProcessTargetServer(TargetServer target_server) noexcept {
-    utils::StaticBuffer<kDatagramMaxLen> buf;
+    if (config_.udp_batch_size > 1) {
+      co_return co_await ProcessTargetServerBatch(std::move(target_server));
+    }
+    utils::PooledBufferOpt buf;
     auto& target_server_data = target_server.second.get();
     for (;;) {
-      buf.Clear();
       watchdog_.Update();
-      const auto [err, sender_ep] =
-          co_await target_server_data.connect.Read(buf);
-      if (err) {
+      if (const auto err =
+              co_await RecvTargetServerDatagram(target_server_data, buf)) {
+        if (target_server_data.evicted) {
+          co_return RemoveEvictedTargetServer(target_server_data);
+        }
         SOCKS5_LOG(debug, net::MakeErrorMsg(*err, target_server_data.connect));
         proxy_.Cancel();
         co_return;
       }
-      if (target_server_data.ep != *sender_ep) {
-        continue;
+      Touch(target_server_data);
+      if (target_server_data.dns &&
+          target_server_data.dns_queries.Match(buf->Begin(),
+                                               buf->ReadableBytes())) {
+        dns_cache_->Store(target_server_data.ep, buf->Begin(),
+                          buf->ReadableBytes());
       }
+      OnDatagramIn(Session::Direction::kTargetToClient, buf->ReadableBytes());
       const auto buffs =
           common::MakeDatagramBuffs(utils::MakeBuffer(target_server_data.addr),
-                                    buf.Begin(), buf.ReadableBytes());
+                                    buf->Begin(), buf->ReadableBytes());
       watchdog_.Update();
       if (const auto err = co_await proxy_.Send(*client_ep_, buffs)) {
         SOCKS5_LOG(debug, net::MakeErrorMsg(*err, proxy_));
         proxy_.Cancel();
         co_return;
       }
+      OnDatagramOut(Session::Direction::kTargetToClient, buf->ReadableBytes());
+    }
+  }
+
+  // Receives a batch of datagrams from the target server and sends them to
+  // the client with one system call.
+  VoidAwait ProcessTargetServerBatch(TargetServer target_server) noexcept {
+    auto& target_server_data = target_server.second.get();
+    auto& connect = target_server_data.connect;
+    // A GRO packet carries up to net::kUdpMaxSegments datagrams, so fewer but
+    // bigger slots are used.
+    const auto gro =
+        config_.udp_gro && net::EnableUdpGro(connect.GetSocket());
+    net::UdpRecvBatch batch =
+        gro ? net::UdpRecvBatch{config_.udp_batch_size / net::kUdpMaxSegments,
+                                kDatagramMaxLen, true}
+            : net::UdpRecvBatch{config_.udp_batch_size,
+                                config_.udp_batch_datagram_size};
+    net::UdpSendBatch client_batch{config_.udp_batch_size, config_.udp_gso};
+    // Socks5 headers and payloads of the datagrams of client_batch.
+    std::vector<common::DatagramBuffs> buffs(client_batch.Capacity());
+    const auto addr_buf = utils::MakeBuffer(target_server_data.addr);
+    for (;;) {
+      watchdog_.Update();
+      if (const auto err = co_await connect.ReadBatch(batch)) {
+        if (target_server_data.evicted) {
+          co_return RemoveEvictedTargetServer(target_server_data);
+        }
+        SOCKS5_LOG(debug, net::MakeErrorMsg(*err, connect));
+        proxy_.Cancel();
+        co_return;
+      }
+      Touch(target_server_data);
+      for (size_t i = 0; i < batch.Size(); ++i) {
+        if (!config_.udp_connect_targets &&
+            target_server_data.ep != batch.Sender(i)) {
+          continue;
+        }
+        if (target_server_data.dns &&
+            target_server_data.dns_queries.Match(batch.Data(i),
+                                                 batch.Length(i))) {
+          dns_cache_->Store(target_server_data.ep, batch.Data(i),
+                            batch.Length(i));
+        }
+        OnDatagramIn(Session::Direction::kTargetToClient, batch.Length(i));
+        auto& datagram_buffs = buffs[client_batch.Size()];
+        datagram_buffs = common::MakeDatagramBuffs(addr_buf, batch.Data(i),
+                                                   batch.Length(i));
+        client_batch.Add(*client_ep_, datagram_buffs);
+        if (client_batch.Full() && !co_await SendClientBatch(client_batch)) {
+          co_return;
+        }
+      }
+      if (!client_batch.Empty() && !co_await SendClientBatch(client_batch)) {
+        co_return;
+      }
     }
   }
 
@@ -266,6 +801,10 @@ class Handler final : public HandlerBase<Handler>,
         },
         asio::detached);
   }
+
+  PendingTargetServers pending_target_servers_;
+  // Reused for the answers served from the DNS cache.
+  std::vector<char> dns_answer_;
 };
 
 class HandlerWithDataProcessor final
@@ -277,18 +816,30 @@ class HandlerWithDataProcessor final
   HandlerWithDataProcessor(net::TcpConnection client, net::UdpConnection proxy,
                            const proto::Addr& client_addr,
                            utils::Watchdog& watchdog, const Config& config,
-                           common::Metrics& metrics,
+                           Session& session, common::Metrics& metrics,
                            const UdpRelayDataProcessor& data_processor) noexcept
       : HandlerBase<HandlerWithDataProcessor>(
             std::move(client), std::move(proxy), client_addr, watchdog,
-            std::move(config), metrics),
+            std::move(config), session, metrics),
         udp_relay_data_processor_{data_processor} {}
 
   VoidAwait ProcessUdp() noexcept {
     try {
-      const auto data_processor =
-          udp_relay_data_processor_.client_to_server(expected_client_ep_);
-      co_await RelayDataFromClient(data_processor);
+      if (udp_relay_data_processor_.client_to_server_batch) {
+        const auto data_processor =
+            udp_relay_data_processor_.client_to_server_batch(
+                expected_client_ep_);
+        co_await RelayBatchesFromClient(data_processor);
+      } else if (udp_relay_data_processor_.client_to_server_async) {
+        const auto data_processor =
+            udp_relay_data_processor_.client_to_server_async(
+                expected_client_ep_);
+        co_await RelayDataFromClient(data_processor);
+      } else {
+        const auto data_processor =
+            udp_relay_data_processor_.client_to_server(expected_client_ep_);
+        co_await RelayDataFromClient(data_processor);
+      }
     } catch (const std::exception& ex) {
       SOCKS5_LOG(
           debug, "Udp relay exception. Proxy: {}. Client: {}. {}",
@@ -300,13 +851,15 @@ class HandlerWithDataProcessor final
   }
 
  private:
-  VoidAwait RelayDataFromClient(
-      const UdpRelayDataFromClientProcessorCb& data_processor) {
-    utils::StaticBuffer<kDatagramMaxLen> buf;
-    SentRelayData sent_data;
+  // Processor is UdpRelayDataFromClientProcessorCb or
+  // UdpRelayAsyncDataFromClientProcessorCb. The async one is awaited before
+  // the next datagram is received.
+  template <typename Processor>
+  VoidAwait RelayDataFromClient(const Processor& data_processor) {
+    utils::PooledBufferOpt buf;
+    RelayDataSink sink;
     for (;;) {
-      buf.Clear();
-      sent_data.Clear();
+      sink.Clear();
       const auto [err, datagram] = co_await RecvClientDatagram(buf);
       if (err) {
         SOCKS5_LOG(debug, net::MakeErrorMsg(*err, proxy_));
@@ -321,25 +874,45 @@ class HandlerWithDataProcessor final
         co_return Stop();
       }
       auto& target_server_data = target_server->second.get();
-      data_processor(
-          reinterpret_cast<const char*>(datagram->data.data),
-          datagram->data.data_size, target_server_data.ep,
-          [&](const char* data, size_t size) { sent_data.Send(data, size); });
-      if (!co_await sent_data.ForEach(
-              [&](const RelayData& relay_data) noexcept -> BoolAwait {
-                co_return co_await SendToNet(target_server_data.connect,
-                                             target_server_data.ep, relay_data);
-              })) {
-        co_return Stop();
+      OnDatagramIn(Session::Direction::kClientToTarget,
+                   datagram->data.data_size);
+      const auto* payload = reinterpret_cast<const char*>(datagram->data.data);
+      const auto payload_size = datagram->data.data_size;
+      if constexpr (std::is_same_v<Processor,
+                                   UdpRelayAsyncDataFromClientProcessorCb>) {
+        co_await data_processor(payload, payload_size, target_server_data.ep,
+                                sink);
+      } else {
+        data_processor(
+            payload, payload_size, target_server_data.ep,
+            [&](const char* data, size_t size) { sink.Send(data, size); });
+      }
+      for (const auto& relay_data : sink.Data()) {
+        if (!co_await SendToTarget(target_server_data, relay_data)) {
+          co_return Stop();
+        }
       }
     }
   }
 
   VoidAwait ProcessTargetServer(TargetServer target_server) noexcept {
     try {
-      const auto data_processor = udp_relay_data_processor_.server_to_client(
-          *client_ep_, target_server.second.get().ep);
-      co_await RelayDataFromServer(target_server, data_processor);
+      const auto& target_server_ep = target_server.second.get().ep;
+      if (udp_relay_data_processor_.server_to_client_batch) {
+        const auto data_processor =
+            udp_relay_data_processor_.server_to_client_batch(*client_ep_,
+                                                             target_server_ep);
+        co_await RelayBatchesFromServer(target_server, data_processor);
+      } else if (udp_relay_data_processor_.server_to_client_async) {
+        const auto data_processor =
+            udp_relay_data_processor_.server_to_client_async(*client_ep_,
+                                                             target_server_ep);
+        co_await RelayDataFromServer(target_server, data_processor);
+      } else {
+        const auto data_processor = udp_relay_data_processor_.server_to_client(
+            *client_ep_, target_server_ep);
+        co_await RelayDataFromServer(target_server, data_processor);
+      }
     } catch (const std::exception& ex) {
       SOCKS5_LOG(
           debug,
@@ -350,34 +923,172 @@ class HandlerWithDataProcessor final
     }
   }
 
+  // Processor is UdpRelayDataProcessorCb or UdpRelayAsyncDataProcessorCb.
+  // The async one is awaited before the next datagram is received.
+  template <typename Processor>
   VoidAwait RelayDataFromServer(const TargetServer& target_server,
-                                const UdpRelayDataProcessorCb& data_processor) {
-    utils::StaticBuffer<kDatagramMaxLen> buf;
-    SentRelayData sent_data;
+                                const Processor& data_processor) {
+    utils::PooledBufferOpt buf;
+    RelayDataSink sink;
     auto& target_server_data = target_server.second.get();
     for (;;) {
-      buf.Clear();
-      sent_data.Clear();
+      sink.Clear();
       watchdog_.Update();
-      const auto [err, sender_ep] =
-          co_await target_server_data.connect.Read(buf);
-      if (err) {
+      if (const auto err =
+              co_await RecvTargetServerDatagram(target_server_data, buf)) {
+        if (target_server_data.evicted) {
+          co_return RemoveEvictedTargetServer(target_server_data);
+        }
         SOCKS5_LOG(debug, net::MakeErrorMsg(*err, target_server_data.connect));
         proxy_.Cancel();
         co_return;
       }
-      if (target_server_data.ep != *sender_ep) {
-        continue;
+      Touch(target_server_data);
+      OnDatagramIn(Session::Direction::kTargetToClient, buf->ReadableBytes());
+      if constexpr (std::is_same_v<Processor, UdpRelayAsyncDataProcessorCb>) {
+        co_await data_processor(buf->BeginRead(), buf->ReadableBytes(), sink);
+      } else {
+        data_processor(
+            buf->BeginRead(), buf->ReadableBytes(),
+            [&](const char* data, size_t size) { sink.Send(data, size); });
+      }
+      for (const auto& relay_data : sink.Data()) {
+        if (!co_await SendToNet(target_server_data, relay_data)) {
+          co_return Stop();
+        }
       }
-      data_processor(
-          buf.BeginRead(), buf.ReadableBytes(),
-          [&](const char* data, size_t size) { sent_data.Send(data, size); });
-      if (!co_await sent_data.ForEach(
-              [&](const RelayData& relay_data) noexcept -> BoolAwait {
-                co_return co_await SendToNet(target_server_data, relay_data);
-              })) {
+    }
+  }
+
+  // The datagrams received from the client with one system call are passed to
+  // the processor at once. Its output is grouped by the target server, every
+  // group is sent with one system call.
+  VoidAwait RelayBatchesFromClient(
+      const UdpRelayBatchDataProcessorCb& data_processor) {
+    net::UdpRecvBatch batch{config_.udp_batch_size, BatchDatagramSize()};
+    std::vector<UdpRelayDatagram> datagrams;
+    std::vector<TargetServerData*> targets;
+    std::vector<TargetServerData*> pending;
+    UdpRelayBatchSender sender;
+    for (;;) {
+      watchdog_.Update();
+      if (const auto err = co_await proxy_.ReadBatch(batch)) {
+        SOCKS5_LOG(debug, net::MakeErrorMsg(*err, proxy_));
         co_return Stop();
       }
+      datagrams.clear();
+      targets.clear();
+      for (size_t i = 0; i < batch.Size(); ++i) {
+        utils::Buffer buf{batch.Data(i), batch.DatagramSize()};
+        buf.HasWritten(batch.Length(i));
+        const auto datagram = ParseClientDatagram(buf, batch.Sender(i));
+        if (!datagram) {
+          continue;
+        }
+        auto target_server =
+            co_await FindOrMakeTargetServer(datagram->header.addr);
+        if (!target_server) {
+          Unpin(targets);
+          co_return Stop();
+        }
+        auto& target_server_data = target_server->second.get();
+        target_server_data.pinned = true;
+        OnDatagramIn(Session::Direction::kClientToTarget,
+                     datagram->data.data_size);
+        datagrams.push_back(
+            {reinterpret_cast<const char*>(datagram->data.data),
+             datagram->data.data_size, &target_server_data.ep});
+        targets.push_back(&target_server_data);
+      }
+      if (datagrams.empty()) {
+        continue;
+      }
+      sender.Clear();
+      data_processor(datagrams, sender);
+      Unpin(targets);
+      for (const auto& datagram : sender.Datagrams()) {
+        auto* target_server_data = targets.at(datagram.index);
+        if (target_server_data->batch.Empty()) {
+          pending.push_back(target_server_data);
+        } else if (target_server_data->batch.Full() &&
+                   !co_await SendTargetServerBatch(*target_server_data)) {
+          co_return Stop();
+        }
+        AddToTargetServerBatch(*target_server_data, datagram.data,
+                               datagram.size);
+      }
+      for (auto* target_server_data : pending) {
+        if (!co_await SendTargetServerBatch(*target_server_data)) {
+          co_return Stop();
+        }
+      }
+      pending.clear();
+    }
+  }
+
+  VoidAwait RelayBatchesFromServer(
+      const TargetServer& target_server,
+      const UdpRelayBatchDataProcessorCb& data_processor) {
+    auto& target_server_data = target_server.second.get();
+    auto& connect = target_server_data.connect;
+    net::UdpRecvBatch batch{config_.udp_batch_size, BatchDatagramSize()};
+    net::UdpSendBatch client_batch{config_.udp_batch_size, config_.udp_gso};
+    // Socks5 headers and payloads of the datagrams of client_batch.
+    std::vector<common::DatagramBuffs> buffs(client_batch.Capacity());
+    const auto addr_buf = utils::MakeBuffer(target_server_data.addr);
+    std::vector<UdpRelayDatagram> datagrams;
+    UdpRelayBatchSender sender;
+    for (;;) {
+      watchdog_.Update();
+      if (const auto err = co_await connect.ReadBatch(batch)) {
+        if (target_server_data.evicted) {
+          co_return RemoveEvictedTargetServer(target_server_data);
+        }
+        SOCKS5_LOG(debug, net::MakeErrorMsg(*err, connect));
+        proxy_.Cancel();
+        co_return;
+      }
+      Touch(target_server_data);
+      datagrams.clear();
+      for (size_t i = 0; i < batch.Size(); ++i) {
+        if (!config_.udp_connect_targets &&
+            target_server_data.ep != batch.Sender(i)) {
+          continue;
+        }
+        OnDatagramIn(Session::Direction::kTargetToClient, batch.Length(i));
+        datagrams.push_back(
+            {batch.Data(i), batch.Length(i), &target_server_data.ep});
+      }
+      if (datagrams.empty()) {
+        continue;
+      }
+      sender.Clear();
+      data_processor(datagrams, sender);
+      for (const auto& datagram : sender.Datagrams()) {
+        auto& datagram_buffs = buffs[client_batch.Size()];
+        datagram_buffs =
+            common::MakeDatagramBuffs(addr_buf, datagram.data, datagram.size);
+        client_batch.Add(*client_ep_, datagram_buffs);
+        if (client_batch.Full() && !co_await SendClientBatch(client_batch)) {
+          co_return;
+        }
+      }
+      if (!client_batch.Empty() && !co_await SendClientBatch(client_batch)) {
+        co_return;
+      }
+    }
+  }
+
+  // Without batching the datagrams are received one by one, so they aren't
+  // limited by udp_batch_datagram_size.
+  size_t BatchDatagramSize() const noexcept {
+    return config_.udp_batch_size > 1 ? config_.udp_batch_datagram_size
+                                      : kDatagramMaxLen;
+  }
+
+  static void Unpin(const std::vector<TargetServerData*>& targets) noexcept {
+    for (auto* target_server_data : targets) {
+      target_server_data->pinned = false;
     }
   }
 
@@ -391,15 +1102,20 @@ class HandlerWithDataProcessor final
         asio::detached);
   }
 
-  BoolAwait SendToNet(net::UdpConnection& connect, const udp::endpoint& ep,
-                      const RelayData& relay_data) noexcept {
+  BoolAwait SendToTarget(TargetServerData& target_server,
+                         const RelayData& relay_data) noexcept {
     watchdog_.Update();
-    if (const auto err = co_await connect.Send(
-            ep, reinterpret_cast<const char*>(relay_data.first),
+    if (const auto err = co_await SendToTargetServer(
+            target_server, reinterpret_cast<const char*>(relay_data.first),
             relay_data.second)) {
-      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, connect));
+      if (target_server.evicted) {
+        metrics_.AddDroppedUdpDatagrams(1);
+        co_return true;
+      }
+      SOCKS5_LOG(debug, net::MakeErrorMsg(*err, target_server.connect));
       co_return false;
     }
+    OnDatagramOut(Session::Direction::kClientToTarget, relay_data.second);
     co_return true;
   }
 
@@ -413,16 +1129,32 @@ class HandlerWithDataProcessor final
       SOCKS5_LOG(debug, net::MakeErrorMsg(*err, proxy_));
       co_return false;
     }
+    OnDatagramOut(Session::Direction::kTargetToClient, relay_data.second);
     co_return true;
   }
 
   const UdpRelayDataProcessor& udp_relay_data_processor_;
 };
 
+// The first alternative in RelayResult is the udp relay, the second one is the
+// client tcp connection, the third one is the watchdog.
+using RelayResult =
+    std::variant<std::monostate, std::monostate, std::monostate>;
+
+CloseReason MakeCloseReason(const RelayResult& res) noexcept {
+  switch (res.index()) {
+    case 0:
+      return CloseReason::kError;
+    case 1:
+      return CloseReason::kClientClosed;
+  }
+  return CloseReason::kTimeout;
+}
+
 template <typename T, typename... Args>
 VoidAwait RunRelayHandler(net::TcpConnection client, net::UdpConnection proxy,
                           const proto::Addr& client_addr, const Config& config,
-                          Args&&... args) {
+                          Session& session, Args&&... args) {
   SOCKS5_LOG(debug,
              "Udp relay started. Client tcp socket: {}. Proxy udp socket: {}. "
              "Expected client udp addr: {}",
@@ -432,15 +1164,27 @@ VoidAwait RunRelayHandler(net::TcpConnection client, net::UdpConnection proxy,
   try {
     utils::Watchdog watchdog{co_await asio::this_coro::executor,
                              config.udp_relay_timeout};
-    handler =
-        std::make_shared<T>(std::move(client), std::move(proxy), client_addr,
-                            watchdog, config, std::forward<Args>(args)...);
-    co_await (handler->ProcessUdp() || handler->ProcessTcp() || watchdog.Run());
+    handler = std::make_shared<T>(std::move(client), std::move(proxy),
+                                  client_addr, watchdog, config, session,
+                                  std::forward<Args>(args)...);
+    const auto res = co_await (handler->ProcessUdp() || handler->ProcessTcp() ||
+                               watchdog.Run());
+    if (res.index() == 2) {
+      session.Record(FlightEventType::kWatchdogExpired, 0,
+                     config.udp_relay_timeout);
+    }
+    handler->Close(MakeCloseReason(res));
+    handler->Stop();
     SOCKS5_LOG(debug,
                "Udp relay finished. Proxy udp socket: {}. "
                "Client udp addr: {}",
                handler->ProxyAddrStr(), handler->ClientAddrStr());
   } catch (const std::exception&) {
+    if (!handler) {
+      throw;
+    }
+    handler->Close(CloseReason::kError);
+    handler->Stop();
     SOCKS5_LOG(debug,
                "Udp relay finished. Proxy udp socket: {}. "
                "Client udp addr: {}",
@@ -454,18 +1198,18 @@ VoidAwait RunRelayHandler(net::TcpConnection client, net::UdpConnection proxy,
 VoidAwait DefaultUdpRelayHandler(net::TcpConnection client,
                                  net::UdpConnection proxy,
                                  proto::Addr client_addr, const Config& config,
-                                 common::Metrics& metrics) {
+                                 common::Metrics& metrics, Session& session) {
   co_await RunRelayHandler<Handler>(std::move(client), std::move(proxy),
-                                    client_addr, config, metrics);
+                                    client_addr, config, session, metrics);
 }
 
 VoidAwait UdpRelayHandlerWithDataProcessor(
     net::TcpConnection client, net::UdpConnection proxy,
     proto::Addr client_addr, const Config& config, common::Metrics& metrics,
-    const UdpRelayDataProcessor& data_processor) {
+    const UdpRelayDataProcessor& data_processor, Session& session) {
   co_await RunRelayHandler<HandlerWithDataProcessor>(
-      std::move(client), std::move(proxy), client_addr, config, metrics,
-      data_processor);
+      std::move(client), std::move(proxy), client_addr, config, session,
+      metrics, data_processor);
 }
 
 }  // namespace socks5::server
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include <socks5/common/metrics.hpp>
 #include <socks5/server/handler_defs.hpp>
 #include <server/relay_data_processors.hpp>
+#include <server/session.hpp>
 #include <type_traits>
 
 namespace socks5::server {
@@ -52,10 +53,11 @@ struct InvalidUdpHandler : std::false_type {};
 
 using DefaultUdpRelayHandlerCb = VoidAwait (*)(net::TcpConnection,
                                                net::UdpConnection, proto::Addr,
-                                               const Config&, common::Metrics&);
+                                               const Config&, common::Metrics&,
+                                               Session&);
 using UdpRelayHandlerWithDataProcessorCb = VoidAwait (*)(
     net::TcpConnection, net::UdpConnection, proto::Addr, const Config&,
-    common::Metrics&, const UdpRelayDataProcessor&);
+    common::Metrics&, const UdpRelayDataProcessor&, Session&);
 
 template <typename Handler>
 class UdpRelay final : utils::NonCopyable {
@@ -66,7 +68,8 @@ class UdpRelay final : utils::NonCopyable {
            net::UdpConnection proxy, proto::Addr client_addr,
            const RelayHandler& handler, const Config& config,
            common::Metrics& metrics,
-           const UdpRelayDataProcessor& udp_data_processor) noexcept
+           const UdpRelayDataProcessor& udp_data_processor,
+           Session& session) noexcept
       : io_context_{io_context},
         client_{std::move(client)},
         proxy_{std::move(proxy)},
@@ -74,7 +77,8 @@ class UdpRelay final : utils::NonCopyable {
         handler_{handler},
         config_{config},
         metrics_{metrics},
-        udp_relay_data_processor_{udp_data_processor} {}
+        udp_relay_data_processor_{udp_data_processor},
+        session_{session} {}
 
   VoidAwait Run() noexcept { co_await Relay(); }
 
@@ -84,18 +88,20 @@ class UdpRelay final : utils::NonCopyable {
       if constexpr (std::is_same_v<std::decay_t<Handler>,
                                    DefaultUdpRelayHandlerCb>) {
         co_await handler_(std::move(client_), std::move(proxy_),
-                          std::move(client_addr_), config_, metrics_);
+                          std::move(client_addr_), config_, metrics_, session_);
       } else if constexpr (std::is_same_v<std::decay_t<Handler>,
                                           UdpRelayHandlerWithDataProcessorCb>) {
         co_await handler_(std::move(client_), std::move(proxy_),
                           std::move(client_addr_), config_, metrics_,
-                          udp_relay_data_processor_);
+                          udp_relay_data_processor_, session_);
       } else if constexpr (detail::IsCoroUdpRelayHandlerV<Handler>) {
+        session_.SetKillable(false);
         co_await handler_(io_context_, std::move(client_.GetSocket()),
                           std::move(proxy_.GetSocket()),
                           common::Address{std::move(client_addr_)}, config_,
                           metrics_);
       } else if constexpr (detail::IsUdpRelayHandlerV<Handler>) {
+        session_.SetKillable(false);
         handler_(io_context_, std::move(client_.GetSocket()),
                  std::move(proxy_.GetSocket()),
                  common::Address{std::move(client_addr_)}, config_, metrics_);
@@ -117,15 +123,16 @@ class UdpRelay final : utils::NonCopyable {
   const Config& config_;
   common::Metrics& metrics_;
   const UdpRelayDataProcessor& udp_relay_data_processor_;
+  Session& session_;
 };
 
 VoidAwait DefaultUdpRelayHandler(net::TcpConnection client,
                                  net::UdpConnection proxy,
                                  proto::Addr client_addr, const Config& config,
-                                 common::Metrics& metrics);
+                                 common::Metrics& metrics, Session& session);
 VoidAwait UdpRelayHandlerWithDataProcessor(
     net::TcpConnection client, net::UdpConnection proxy,
     proto::Addr client_addr, const Config& config, common::Metrics& metrics,
-    const UdpRelayDataProcessor& data_processor);
+    const UdpRelayDataProcessor& data_processor, Session& session);
 
 }  // namespace socks5::server
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include <utils/async_logger.hpp>
+
+namespace socks5::logger {
+
+AsyncLogger& AsyncLogger::Instance() {
+  static AsyncLogger async_logger;
+  return async_logger;
+}
+
+AsyncLogger::AsyncLogger() {
+  // The logger callback must outlive the async logger, because the remaining
+  // records are written in the destructor.
+  GetLogger();
+}
+
+AsyncLogger::~AsyncLogger() { Stop(); }
+
+void AsyncLogger::Start(OverflowPolicy policy, size_t queue_capacity) {
+  std::lock_guard lk{start_stop_mtx_};
+  policy_.store(policy, std::memory_order_relaxed);
+  queues_.SetQueueCapacity(queue_capacity);
+  if (!writer_.joinable()) {
+    writer_ = std::jthread{
+        [this](std::stop_token stop_token) { Run(std::move(stop_token)); }};
+  }
+  detail::IsAsyncLoggingEnabled().store(true, std::memory_order_relaxed);
+}
+
+void AsyncLogger::Stop() noexcept {
+  std::lock_guard lk{start_stop_mtx_};
+  detail::IsAsyncLoggingEnabled().store(false, std::memory_order_relaxed);
+  if (!writer_.joinable()) {
+    return;
+  }
+  writer_.request_stop();
+  writer_.join();
+  Write();
+}
+
+void AsyncLogger::Push(detail::LogRecord&& record) noexcept {
+  try {
+    auto& queue = queues_.GetThreadQueue();
+    while (!queue.TryPush(std::move(record))) {
+      if (policy_.load(std::memory_order_relaxed) == OverflowPolicy::kDrop) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      if (!detail::IsAsyncLoggingEnabled().load(std::memory_order_relaxed)) {
+        // The writer thread may be already stopped, so nobody will free space
+        // in the queue.
+        Write(GetLogger(), record);
+        return;
+      }
+      wakeup_.store(true, std::memory_order_relaxed);
+      cv_.notify_one();
+      std::this_thread::yield();
+    }
+  } catch (...) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+size_t AsyncLogger::Dropped() const noexcept {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+void AsyncLogger::Run(std::stop_token stop_token) {
+  while (!stop_token.stop_requested()) {
+    if (Write() != 0) {
+      continue;
+    }
+    std::unique_lock lk{mtx_};
+    cv_.wait_for(lk, stop_token, kWriteInterval, [this] {
+      return wakeup_.exchange(false, std::memory_order_relaxed);
+    });
+  }
+}
+
+size_t AsyncLogger::Write() noexcept {
+  try {
+    const auto logger = GetLogger();
+    return queues_.ConsumeAll(
+        [this, &logger](detail::LogRecord&& record) { Write(logger, record); });
+  } catch (...) {
+    return 0;
+  }
+}
+
+void AsyncLogger::Write(const LoggerCbPtr& logger,
+                        const detail::LogRecord& record) noexcept {
+  try {
+    (*logger)(record.Filename(), record.Line(), record.Funcname(),
+              record.GetLevel(), record.Format());
+  } catch (const std::exception& ex) {
+    try {
+      (*logger)(record.Filename(), record.Line(), record.Funcname(),
+                record.GetLevel(), ex.what());
+    } catch (...) {
+    }
+  }
+}
+
+}  // namespace socks5::logger
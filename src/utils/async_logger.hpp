@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <socks5/utils/non_copyable.hpp>
+#include <utils/logger.hpp>
+#include <utils/thread_queues.hpp>
+
+namespace socks5::logger {
+
+// Backend of the asynchronous logging. Logging threads push records with
+// captured arguments into their own lock-free queues. A background writer
+// thread formats the records and passes them to the current logger callback.
+class AsyncLogger final : utils::NonCopyable {
+ public:
+  static constexpr std::chrono::milliseconds kWriteInterval{10};
+
+  static AsyncLogger& Instance();
+
+  // Starts the writer thread. Queue capacity is applied to the threads that
+  // haven't logged yet.
+  void Start(OverflowPolicy policy, size_t queue_capacity);
+  // Stops the writer thread and writes the remaining records.
+  void Stop() noexcept;
+
+  void Push(detail::LogRecord&& record) noexcept;
+  size_t Dropped() const noexcept;
+
+ private:
+  AsyncLogger();
+  ~AsyncLogger();
+
+  void Run(std::stop_token stop_token);
+  size_t Write() noexcept;
+  void Write(const LoggerCbPtr& logger,
+             const detail::LogRecord& record) noexcept;
+
+  std::atomic<OverflowPolicy> policy_{OverflowPolicy::kDrop};
+  utils::ThreadQueues<detail::LogRecord> queues_{
+      kDefaultAsyncLogQueueCapacity};
+  std::atomic_size_t dropped_{};
+  std::atomic_bool wakeup_{};
+  std::mutex mtx_;
+  std::condition_variable_any cv_;
+  std::mutex start_stop_mtx_;
+  std::jthread writer_;
+};
+
+}  // namespace socks5::logger
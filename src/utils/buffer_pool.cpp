@@ -0,0 +1,69 @@
+#include <utils/buffer_pool.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace socks5::utils {
+
+namespace {
+
+// Max number of free buffers cached by a thread.
+constexpr size_t kMaxCachedBuffers{256};
+
+struct FreeList final {
+  FreeList() { buffers.reserve(kMaxCachedBuffers); }
+
+  ~FreeList();
+
+  std::vector<char*> buffers;
+};
+
+thread_local FreeList free_list;
+// Buffers destroyed after the free list of the thread are freed.
+thread_local bool free_list_destroyed{false};
+
+FreeList::~FreeList() {
+  for (auto* buf : buffers) {
+    delete[] buf;
+  }
+  free_list_destroyed = true;
+}
+
+char* Allocate(size_t size) {
+  if (size > kPooledBufferSize) {
+    return new char[size];
+  }
+  auto& buffers = free_list.buffers;
+  if (buffers.empty()) {
+    return new char[kPooledBufferSize];
+  }
+  auto* buf = buffers.back();
+  buffers.pop_back();
+  return buf;
+}
+
+}  // namespace
+
+PooledBuffer::PooledBuffer(size_t size)
+    : Buffer{Allocate(size), std::max(size, kPooledBufferSize)} {}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept : Buffer{other} {
+  other.buf_ = nullptr;
+}
+
+PooledBuffer::~PooledBuffer() {
+  if (!buf_) {
+    return;
+  }
+  if (!Pooled() || free_list_destroyed ||
+      free_list.buffers.size() == kMaxCachedBuffers) {
+    delete[] buf_;
+    return;
+  }
+  free_list.buffers.push_back(buf_);
+}
+
+size_t PooledBuffersCached() noexcept {
+  return free_list_destroyed ? 0 : free_list.buffers.size();
+}
+
+}  // namespace socks5::utils
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <optional>
+#include <socks5/utils/buffer.hpp>
+
+namespace socks5::utils {
+
+// Size of a pooled buffer. Fits a datagram of the ethernet MTU with the
+// biggest socks5 header.
+constexpr size_t kPooledBufferSize{2048};
+
+// Buffer of at least the requested size. Buffers of up to kPooledBufferSize
+// bytes are taken from a free list of the calling thread and are returned to
+// the free list of the thread that destroys them. Bigger buffers are allocated
+// on the heap and freed.
+class PooledBuffer final : public Buffer {
+ public:
+  explicit PooledBuffer(size_t size = kPooledBufferSize);
+  PooledBuffer(PooledBuffer&& other) noexcept;
+  PooledBuffer(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(PooledBuffer&&) = delete;
+  ~PooledBuffer();
+
+  bool Pooled() const noexcept { return Size() == kPooledBufferSize; }
+};
+
+using PooledBufferOpt = std::optional<PooledBuffer>;
+
+// Number of free buffers cached by the calling thread.
+size_t PooledBuffersCached() noexcept;
+
+}  // namespace socks5::utils
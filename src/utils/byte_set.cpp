@@ -0,0 +1,137 @@
+#include <utils/byte_set.hpp>
+#include <utils/cpu_features.hpp>
+#include <algorithm>
+#include <vector>
+
+#ifdef SOCKS5_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace socks5::utils {
+
+namespace {
+
+constexpr size_t kBucketsNum{8};
+
+}  // namespace
+
+ByteSetFinder::ByteSetFinder(const ByteSet& set) noexcept
+    : set_{set}, find_{FindScalar} {
+  // The high nibbles with the same set of low nibbles share a bucket, the
+  // filter is exact if there are no more than kBucketsNum such sets.
+  std::array<uint16_t, 16> lo_sets{};
+  for (size_t byte = 0; byte < set_.size(); ++byte) {
+    if (set_[byte]) {
+      lo_sets[byte >> 4] |= static_cast<uint16_t>(1 << (byte & 0x0f));
+    }
+  }
+  std::vector<uint16_t> buckets;
+  for (size_t hi = 0; hi < lo_sets.size(); ++hi) {
+    if (lo_sets[hi] == 0) {
+      continue;
+    }
+    auto it = std::find(buckets.begin(), buckets.end(), lo_sets[hi]);
+    if (it == buckets.end()) {
+      it = buckets.insert(buckets.end(), lo_sets[hi]);
+    }
+    const auto bucket = static_cast<size_t>(it - buckets.begin()) % kBucketsNum;
+    hi_masks_[hi] |= static_cast<uint8_t>(1 << bucket);
+    for (size_t lo = 0; lo < lo_masks_.size(); ++lo) {
+      if (lo_sets[hi] & (1 << lo)) {
+        lo_masks_[lo] |= static_cast<uint8_t>(1 << bucket);
+      }
+    }
+  }
+  if (CpuHasAvx2()) {
+    find_ = FindAvx2;
+  } else if (CpuHasSsse3()) {
+    find_ = FindSsse3;
+  }
+}
+
+const uint8_t* ByteSetFinder::FindScalar(const ByteSetFinder& finder,
+                                         const uint8_t* begin,
+                                         const uint8_t* end) noexcept {
+  for (; begin != end; ++begin) {
+    if (finder.set_[*begin]) {
+      return begin;
+    }
+  }
+  return end;
+}
+
+#ifdef SOCKS5_X86_SIMD
+
+__attribute__((target("ssse3"))) const uint8_t* ByteSetFinder::FindSsse3(
+    const ByteSetFinder& finder, const uint8_t* begin,
+    const uint8_t* end) noexcept {
+  const auto lo_masks = _mm_load_si128(
+      reinterpret_cast<const __m128i*>(finder.lo_masks_.data()));
+  const auto hi_masks = _mm_load_si128(
+      reinterpret_cast<const __m128i*>(finder.hi_masks_.data()));
+  const auto nibble = _mm_set1_epi8(0x0f);
+  const auto zero = _mm_setzero_si128();
+  for (; end - begin >= 16; begin += 16) {
+    const auto data =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    const auto lo = _mm_shuffle_epi8(lo_masks, _mm_and_si128(data, nibble));
+    const auto hi = _mm_shuffle_epi8(
+        hi_masks, _mm_and_si128(_mm_srli_epi16(data, 4), nibble));
+    auto candidates = static_cast<uint32_t>(
+        ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero)) &
+        0xffff);
+    for (; candidates != 0; candidates &= candidates - 1) {
+      const auto* pos = begin + __builtin_ctz(candidates);
+      if (finder.set_[*pos]) {
+        return pos;
+      }
+    }
+  }
+  return FindScalar(finder, begin, end);
+}
+
+__attribute__((target("avx2"))) const uint8_t* ByteSetFinder::FindAvx2(
+    const ByteSetFinder& finder, const uint8_t* begin,
+    const uint8_t* end) noexcept {
+  const auto lo_masks = _mm256_broadcastsi128_si256(_mm_load_si128(
+      reinterpret_cast<const __m128i*>(finder.lo_masks_.data())));
+  const auto hi_masks = _mm256_broadcastsi128_si256(_mm_load_si128(
+      reinterpret_cast<const __m128i*>(finder.hi_masks_.data())));
+  const auto nibble = _mm256_set1_epi8(0x0f);
+  const auto zero = _mm256_setzero_si256();
+  for (; end - begin >= 32; begin += 32) {
+    const auto data =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+    const auto lo =
+        _mm256_shuffle_epi8(lo_masks, _mm256_and_si256(data, nibble));
+    const auto hi = _mm256_shuffle_epi8(
+        hi_masks, _mm256_and_si256(_mm256_srli_epi16(data, 4), nibble));
+    auto candidates = ~static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero)));
+    for (; candidates != 0; candidates &= candidates - 1) {
+      const auto* pos = begin + __builtin_ctz(candidates);
+      if (finder.set_[*pos]) {
+        return pos;
+      }
+    }
+  }
+  return FindSsse3(finder, begin, end);
+}
+
+#else
+
+const uint8_t* ByteSetFinder::FindSsse3(const ByteSetFinder& finder,
+                                        const uint8_t* begin,
+                                        const uint8_t* end) noexcept {
+  return FindScalar(finder, begin, end);
+}
+
+const uint8_t* ByteSetFinder::FindAvx2(const ByteSetFinder& finder,
+                                       const uint8_t* begin,
+                                       const uint8_t* end) noexcept {
+  return FindScalar(finder, begin, end);
+}
+
+#endif
+
+}  // namespace socks5::utils
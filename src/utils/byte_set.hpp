@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace socks5::utils {
+
+using ByteSet = std::array<bool, 256>;
+
+// Finds the first byte of a set in a range. The range is tested 32 or 16
+// bytes at a time with nibble lookup tables(the shufti technique) if the CPU
+// supports AVX2 or SSSE3, which is checked at runtime. A set with more than 8
+// distinct groups of low nibbles gives false candidates, they are filtered
+// out with the set itself.
+class ByteSetFinder final {
+ public:
+  explicit ByteSetFinder(const ByteSet& set) noexcept;
+
+  // Returns end if there is no byte of the set in the range.
+  const uint8_t* Find(const uint8_t* begin, const uint8_t* end) const noexcept {
+    return find_(*this, begin, end);
+  }
+
+  bool Contains(uint8_t byte) const noexcept { return set_[byte]; }
+
+ private:
+  using FindFn = const uint8_t* (*)(const ByteSetFinder&, const uint8_t*,
+                                    const uint8_t*) noexcept;
+
+  static const uint8_t* FindScalar(const ByteSetFinder& finder,
+                                   const uint8_t* begin,
+                                   const uint8_t* end) noexcept;
+  static const uint8_t* FindSsse3(const ByteSetFinder& finder,
+                                  const uint8_t* begin,
+                                  const uint8_t* end) noexcept;
+  static const uint8_t* FindAvx2(const ByteSetFinder& finder,
+                                 const uint8_t* begin,
+                                 const uint8_t* end) noexcept;
+
+  ByteSet set_;
+  // Bit i of lo_masks_[n] is set if the bucket i has a byte with the low
+  // nibble n, the same for hi_masks_ and the high nibble.
+  alignas(16) std::array<uint8_t, 16> lo_masks_{};
+  alignas(16) std::array<uint8_t, 16> hi_masks_{};
+  FindFn find_;
+};
+
+}  // namespace socks5::utils
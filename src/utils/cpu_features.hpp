@@ -0,0 +1,39 @@
+#pragma once
+
+// The SIMD kernels are compiled with the target attribute and picked at
+// runtime, so the library runs on any CPU of the architecture. The checks may
+// run in static initializers, so the CPU model is initialized explicitly.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOCKS5_X86_SIMD
+#endif
+
+namespace socks5::utils {
+
+inline bool CpuHasAvx2() noexcept {
+#ifdef SOCKS5_X86_SIMD
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+inline bool CpuHasSsse3() noexcept {
+#ifdef SOCKS5_X86_SIMD
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3");
+#else
+  return false;
+#endif
+}
+
+inline bool CpuHasSse42() noexcept {
+#ifdef SOCKS5_X86_SIMD
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+#else
+  return false;
+#endif
+}
+
+}  // namespace socks5::utils
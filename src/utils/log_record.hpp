@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <fmt/core.h>
+
+namespace socks5::logger {
+
+enum Level : int;
+
+namespace detail {
+
+// Arguments are captured by value. Strings and C strings are copied, because
+// they may be destroyed before the record is formatted.
+template <typename T>
+using CapturedArg =
+    std::conditional_t<std::is_convertible_v<const T&, std::string_view>,
+                       std::string, std::decay_t<T>>;
+
+// Log message with captured, but not yet formatted arguments. Formatting is
+// deferred to the thread that writes the record, so the logging thread only
+// copies the arguments into the inline storage. If the arguments don't fit
+// into the storage, the message is formatted eagerly.
+class LogRecord final {
+ public:
+  static constexpr size_t kArgsStorageSize{192};
+
+  LogRecord() noexcept = default;
+
+  template <typename Args, typename... Ts>
+  LogRecord(const char* filename, int line, const char* funcname, Level lvl,
+            fmt::string_view fmt, std::in_place_type_t<Args>, Ts&&... args)
+      : filename_{filename},
+        line_{line},
+        funcname_{funcname},
+        lvl_{lvl},
+        fmt_{fmt},
+        ops_{&ArgsOpsImpl<Args>::kOps} {
+    static_assert(kFitsStorage<Args>);
+    new (storage_) Args{std::forward<Ts>(args)...};
+  }
+
+  LogRecord(LogRecord&& other) noexcept { MoveFrom(other); }
+
+  LogRecord& operator=(LogRecord&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      MoveFrom(other);
+    }
+    return *this;
+  }
+
+  ~LogRecord() { Reset(); }
+
+  template <typename Args>
+  static constexpr bool kFitsStorage =
+      sizeof(Args) <= kArgsStorageSize &&
+      alignof(Args) <= alignof(std::max_align_t) &&
+      std::is_nothrow_move_constructible_v<Args>;
+
+  std::string Format() const {
+    return ops_ ? ops_->format(fmt_, storage_) : std::string{};
+  }
+
+  const char* Filename() const noexcept { return filename_; }
+  int Line() const noexcept { return line_; }
+  const char* Funcname() const noexcept { return funcname_; }
+  Level GetLevel() const noexcept { return lvl_; }
+
+ private:
+  struct ArgsOps final {
+    void (*move)(void* dst, void* src) noexcept;
+    void (*destroy)(void* args) noexcept;
+    std::string (*format)(fmt::string_view fmt, const void* args);
+  };
+
+  template <typename Args>
+  struct ArgsOpsImpl final {
+    static void Move(void* dst, void* src) noexcept {
+      auto* src_args = static_cast<Args*>(src);
+      new (dst) Args{std::move(*src_args)};
+      src_args->~Args();
+    }
+
+    static void Destroy(void* args) noexcept {
+      static_cast<Args*>(args)->~Args();
+    }
+
+    static std::string Format(fmt::string_view fmt, const void* args) {
+      return std::apply(
+          [fmt](const auto&... captured) {
+            return fmt::vformat(fmt, fmt::make_format_args(captured...));
+          },
+          *static_cast<const Args*>(args));
+    }
+
+    static constexpr ArgsOps kOps{Move, Destroy, Format};
+  };
+
+  void MoveFrom(LogRecord& other) noexcept {
+    filename_ = other.filename_;
+    line_ = other.line_;
+    funcname_ = other.funcname_;
+    lvl_ = other.lvl_;
+    fmt_ = other.fmt_;
+    ops_ = std::exchange(other.ops_, nullptr);
+    if (ops_) {
+      ops_->move(storage_, other.storage_);
+    }
+  }
+
+  void Reset() noexcept {
+    if (ops_) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+  const char* filename_{};
+  int line_{};
+  const char* funcname_{};
+  Level lvl_{};
+  fmt::string_view fmt_;
+  const ArgsOps* ops_{};
+  alignas(std::max_align_t) std::byte storage_[kArgsStorageSize];
+};
+
+template <typename... Args>
+LogRecord MakeLogRecord(const char* filename, int line, const char* funcname,
+                        Level lvl, fmt::format_string<Args...> fmt,
+                        Args&&... args) {
+  using Captured = std::tuple<CapturedArg<Args>...>;
+  if constexpr (LogRecord::kFitsStorage<Captured> &&
+                std::is_constructible_v<Captured, Args&&...>) {
+    return LogRecord{filename,
+                     line,
+                     funcname,
+                     lvl,
+                     static_cast<fmt::string_view>(fmt),
+                     std::in_place_type<Captured>,
+                     std::forward<Args>(args)...};
+  } else {
+    return LogRecord{filename,
+                     line,
+                     funcname,
+                     lvl,
+                     "{}",
+                     std::in_place_type<std::tuple<std::string>>,
+                     fmt::format(fmt, std::forward<Args>(args)...)};
+  }
+}
+
+template <typename T>
+  requires(!std::is_array_v<std::remove_cvref_t<T>>)
+LogRecord MakeLogRecord(const char* filename, int line, const char* funcname,
+                        Level lvl, T&& msg) {
+  return LogRecord{filename,
+                   line,
+                   funcname,
+                   lvl,
+                   "{}",
+                   std::in_place_type<std::tuple<std::string>>,
+                   std::string{std::forward<T>(msg)}};
+}
+
+}  // namespace detail
+
+}  // namespace socks5::logger
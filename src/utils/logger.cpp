@@ -1,4 +1,5 @@
 #include <utils/logger.hpp>
+#include <utils/async_logger.hpp>
 #include <spdlog/async.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -81,7 +82,9 @@ std::atomic_bool& IsLoggingEnabled() {
 
 void EnableLogging(bool enable) { IsLoggingEnabled() = enable; }
 
-LoggerCbPtr GetLogger() {
+namespace {
+
+LoggerCbAtomicPtr& GetLoggerCb() {
   static LoggerCbAtomicPtr logger_cb{std::make_shared<LoggerCb>(
       [logger = std::make_shared<StdoutLogger>(kDefaultLogLevel)](
           const char* filename, int line, const char* funcname, Level lvl,
@@ -92,14 +95,18 @@ LoggerCbPtr GetLogger() {
   return logger_cb;
 }
 
+}  // namespace
+
+LoggerCbPtr GetLogger() { return GetLoggerCb().load(); }
+
 void SetLogger(LoggerCb logger_cb, Level lvl) {
   SetLevel(lvl);
-  GetLogger() = std::make_shared<LoggerCb>(std::move(logger_cb));
+  GetLoggerCb() = std::make_shared<LoggerCb>(std::move(logger_cb));
 }
 
 void SetLogger(LoggerBasePtr logger) {
   SetLevel(logger->GetLevel());
-  GetLogger() = std::make_shared<LoggerCb>(
+  GetLoggerCb() = std::make_shared<LoggerCb>(
       [logger = logger](const char* filename, int line, const char* funcname,
                         Level lvl, const std::string& msg) {
         logger->Log(filename, line, funcname, lvl, msg);
@@ -113,4 +120,30 @@ LogLevelAtomic& GetLevel() noexcept {
 
 void SetLevel(Level lvl) noexcept { GetLevel() = lvl; }
 
+void EnableAsyncLogging(bool enable, OverflowPolicy policy,
+                        size_t queue_capacity) {
+  if (enable) {
+    AsyncLogger::Instance().Start(policy, queue_capacity);
+  } else {
+    AsyncLogger::Instance().Stop();
+  }
+}
+
+size_t GetDroppedLogMessagesTotal() noexcept {
+  return AsyncLogger::Instance().Dropped();
+}
+
+namespace detail {
+
+std::atomic_bool& IsAsyncLoggingEnabled() noexcept {
+  static std::atomic_bool async_logging_enabled{false};
+  return async_logging_enabled;
+}
+
+void LogAsync(LogRecord&& record) noexcept {
+  AsyncLogger::Instance().Push(std::move(record));
+}
+
+}  // namespace detail
+
 }  // namespace socks5::logger
\ No newline at end of file
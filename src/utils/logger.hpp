@@ -5,6 +5,7 @@
 #include <fmt/core.h>
 #include <socks5/utils/non_copyable.hpp>
 #include <spdlog/spdlog.h>
+#include <utils/log_record.hpp>
 
 namespace socks5::logger {
 
@@ -30,6 +31,13 @@ using LoggerCbAtomicPtr = std::atomic<std::shared_ptr<LoggerCb>>;
 using LogLevelAtomic = std::atomic<Level>;
 using LogLevelOpt = std::optional<Level>;
 
+enum class OverflowPolicy {
+  kDrop,
+  kBlock,
+};
+
+inline constexpr size_t kDefaultAsyncLogQueueCapacity{8192};
+
 void EnableLogging(bool enable);
 std::atomic_bool& IsLoggingEnabled();
 
@@ -40,6 +48,11 @@ void SetLogger(LoggerBasePtr logger);
 LogLevelAtomic& GetLevel() noexcept;
 void SetLevel(Level lvl) noexcept;
 
+void EnableAsyncLogging(
+    bool enable, OverflowPolicy policy = OverflowPolicy::kDrop,
+    size_t queue_capacity = kDefaultAsyncLogQueueCapacity);
+size_t GetDroppedLogMessagesTotal() noexcept;
+
 class LoggerBase : utils::NonCopyable {
  public:
   static const std::string kDefaultLogFormat;
@@ -86,15 +99,40 @@ std::string Fmt(fmt::format_string<Args...> fmt, Args&&... args) {
   return fmt::format(fmt, std::forward<Args>(args)...);
 }
 
+std::atomic_bool& IsAsyncLoggingEnabled() noexcept;
+void LogAsync(LogRecord&& record) noexcept;
+
 }  // namespace detail
 
+// Log levels for SOCKS5_MIN_LOG_LEVEL.
+#define SOCKS5_LOG_LEVEL_TRACE 0
+#define SOCKS5_LOG_LEVEL_DEBUG 1
+#define SOCKS5_LOG_LEVEL_INFO 2
+#define SOCKS5_LOG_LEVEL_WARN 3
+#define SOCKS5_LOG_LEVEL_ERROR 4
+#define SOCKS5_LOG_LEVEL_CRITICAL 5
+#define SOCKS5_LOG_LEVEL_OFF 6
+
+// SOCKS5_LOG calls with a level below SOCKS5_MIN_LOG_LEVEL are removed at
+// compile time together with their arguments.
+#ifndef SOCKS5_MIN_LOG_LEVEL
+#define SOCKS5_MIN_LOG_LEVEL SOCKS5_LOG_LEVEL_TRACE
+#endif
+
 #define SOCKS5_LOG_LEVEL(LEVEL) socks5::logger::Level::LEVEL
 
 #define SOCKS5_CHECK_LOG_LEVEL(LEVEL) \
   (SOCKS5_LOG_LEVEL(LEVEL) >= socks5::logger::GetLevel().load())
 
+#define SOCKS5_CHECK_LOG_COMPILED(LEVEL) \
+  (SOCKS5_LOG_LEVEL(LEVEL) >= SOCKS5_MIN_LOG_LEVEL)
+
 #define SOCKS5_CHECK_LOGGING_ENABLED() socks5::logger::IsLoggingEnabled().load()
 
+#define SOCKS5_CHECK_ASYNC_LOGGING_ENABLED()              \
+  socks5::logger::detail::IsAsyncLoggingEnabled().load( \
+      std::memory_order_relaxed)
+
 #define SOCKS5_CHECK_NEED_TO_LOG(LEVEL) \
   SOCKS5_CHECK_LOGGING_ENABLED() && SOCKS5_CHECK_LOG_LEVEL(LEVEL)
 
@@ -111,8 +149,32 @@ std::string Fmt(fmt::format_string<Args...> fmt, Args&&... args) {
     }                                                                    \
   } while (0)
 
+#define SOCKS5_LOG_ASYNC(LEVEL, ...)                                         \
+  do {                                                                       \
+    try {                                                                    \
+      if (SOCKS5_CHECK_NEED_TO_LOG(LEVEL)) {                                 \
+        socks5::logger::detail::LogAsync(                                    \
+            socks5::logger::detail::MakeLogRecord(__FILE__, __LINE__,        \
+                                                  __func__,                  \
+                                                  SOCKS5_LOG_LEVEL(LEVEL),   \
+                                                  __VA_ARGS__));             \
+      }                                                                      \
+    } catch (const std::exception& ex) {                                     \
+      (*SOCKS5_GET_LOGGER())(__FILE__, __LINE__, __func__,                   \
+                             SOCKS5_LOG_LEVEL(LEVEL), ex.what());            \
+    }                                                                        \
+  } while (0)
+
 #define SOCKS5_GET_LOGGER() socks5::logger::GetLogger()
-#define SOCKS5_LOG(LEVEL, ...) \
-  SOCKS5_LOG_TO_LOGGER(SOCKS5_GET_LOGGER(), LEVEL, ##__VA_ARGS__)
+#define SOCKS5_LOG(LEVEL, ...)                                          \
+  do {                                                                  \
+    if constexpr (SOCKS5_CHECK_LOG_COMPILED(LEVEL)) {                   \
+      if (SOCKS5_CHECK_ASYNC_LOGGING_ENABLED()) {                       \
+        SOCKS5_LOG_ASYNC(LEVEL, ##__VA_ARGS__);                         \
+      } else {                                                          \
+        SOCKS5_LOG_TO_LOGGER(SOCKS5_GET_LOGGER(), LEVEL, ##__VA_ARGS__); \
+      }                                                                 \
+    }                                                                   \
+  } while (0)
 
 }  // namespace socks5::logger
\ No newline at end of file
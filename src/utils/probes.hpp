@@ -0,0 +1,64 @@
+#pragma once
+
+// Linux USDT probes of the "socks5" provider. A probe is a single nop
+// instruction until a tracer(bpftrace, perf, systemtap) attaches to it, so
+// probe arguments must be cheap to compute and must be integers or pointers.
+// Without <sys/sdt.h> or with SOCKS5_DISABLE_USDT defined the probes compile
+// to nothing.
+//
+// Probes and their arguments:
+//   accept(fd)
+//   handshake_start(session_id)
+//   handshake_end(session_id, success)
+//   auth_result(session_id, auth_method, success)
+//   connect_start(session_id)
+//   connect_end(session_id, error_code)
+//   tcp_relay_read(session_id, direction, bytes)
+//   tcp_relay_write(session_id, direction, bytes)
+//   udp_datagram_in(session_id, direction, bytes)
+//   udp_datagram_out(session_id, direction, bytes)
+//   watchdog_expired(interval_sec)
+//   session_close(session_id, close_reason, bytes_from_client,
+//                 bytes_from_target)
+//
+// direction is 0 for client to target and 1 for target to client.
+//
+// Example: bpftrace -e 'usdt:/path/to/server:socks5:tcp_relay_read
+//   { @bytes[arg1] = sum(arg2); }'
+
+#if defined(__linux__) && !defined(SOCKS5_DISABLE_USDT) && \
+    __has_include(<sys/sdt.h>)
+
+#include <sys/sdt.h>
+
+#define SOCKS5_PROBE(NAME) DTRACE_PROBE(socks5, NAME)
+#define SOCKS5_PROBE1(NAME, A1) DTRACE_PROBE1(socks5, NAME, A1)
+#define SOCKS5_PROBE2(NAME, A1, A2) DTRACE_PROBE2(socks5, NAME, A1, A2)
+#define SOCKS5_PROBE3(NAME, A1, A2, A3) \
+  DTRACE_PROBE3(socks5, NAME, A1, A2, A3)
+#define SOCKS5_PROBE4(NAME, A1, A2, A3, A4) \
+  DTRACE_PROBE4(socks5, NAME, A1, A2, A3, A4)
+
+#else
+
+#define SOCKS5_PROBE(NAME) \
+  do {                     \
+  } while (0)
+#define SOCKS5_PROBE1(NAME, A1) \
+  do {                          \
+    (void)sizeof(A1);           \
+  } while (0)
+#define SOCKS5_PROBE2(NAME, A1, A2)     \
+  do {                                  \
+    (void)sizeof(A1), (void)sizeof(A2); \
+  } while (0)
+#define SOCKS5_PROBE3(NAME, A1, A2, A3)                   \
+  do {                                                    \
+    (void)sizeof(A1), (void)sizeof(A2), (void)sizeof(A3); \
+  } while (0)
+#define SOCKS5_PROBE4(NAME, A1, A2, A3, A4)                                 \
+  do {                                                                      \
+    (void)sizeof(A1), (void)sizeof(A2), (void)sizeof(A3), (void)sizeof(A4); \
+  } while (0)
+
+#endif
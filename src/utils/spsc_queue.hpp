@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <socks5/utils/non_copyable.hpp>
+
+namespace socks5::utils {
+
+inline constexpr size_t kCacheLineSize{64};
+
+// Bounded lock-free single-producer/single-consumer ring buffer. TryPush may
+// be called from one thread and TryPop/ConsumeAll from another one
+// concurrently. The capacity is rounded up to a power of two.
+template <typename T>
+class SpscQueue final : NonCopyable {
+ public:
+  static_assert(std::is_default_constructible_v<T>);
+  static_assert(std::is_nothrow_move_assignable_v<T>);
+
+  explicit SpscQueue(size_t capacity)
+      : capacity_{std::bit_ceil(capacity < 2 ? size_t{2} : capacity)},
+        mask_{capacity_ - 1},
+        slots_{std::make_unique<T[]>(capacity_)} {}
+
+  bool TryPush(T&& value) noexcept {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == capacity_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == capacity_) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPop(T& value) noexcept {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return false;
+      }
+    }
+    value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Pops all the elements available at the moment of the call. Returns the
+  // number of consumed elements.
+  template <typename Consumer>
+  size_t ConsumeAll(Consumer&& consumer) {
+    const auto head = head_.load(std::memory_order_relaxed);
+    const auto tail = tail_.load(std::memory_order_acquire);
+    for (auto i = head; i != tail; ++i) {
+      T value{std::move(slots_[i & mask_])};
+      head_.store(i + 1, std::memory_order_release);
+      consumer(std::move(value));
+    }
+    return tail - head;
+  }
+
+  bool Empty() const noexcept {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  size_t Capacity() const noexcept { return capacity_; }
+
+ private:
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<T[]> slots_;
+  // Consumer side.
+  alignas(kCacheLineSize) std::atomic_size_t head_{};
+  size_t cached_tail_{};
+  // Producer side.
+  alignas(kCacheLineSize) std::atomic_size_t tail_{};
+  size_t cached_head_{};
+};
+
+}  // namespace socks5::utils
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <socks5/utils/non_copyable.hpp>
+#include <utils/spsc_queue.hpp>
+
+namespace socks5::utils {
+
+// Set of SPSC queues with one queue per producer thread, so producers never
+// contend with each other. A single consumer drains all the queues. Queues of
+// exited threads are kept until the set is destroyed, which is fine for the
+// fixed size thread pools of the library.
+template <typename T>
+class ThreadQueues final : NonCopyable {
+ public:
+  using Queue = SpscQueue<T>;
+
+  explicit ThreadQueues(size_t queue_capacity)
+      : queue_capacity_{queue_capacity},
+        id_{next_id_.fetch_add(1, std::memory_order_relaxed)} {}
+
+  // Returns the queue of the calling thread. The first call from a thread
+  // allocates the queue.
+  Queue& GetThreadQueue() {
+    auto& cache = thread_cache_;
+    if (cache.owner_id == id_) {
+      return *cache.queue;
+    }
+    std::lock_guard lk{mtx_};
+    auto& queue = queues_[std::this_thread::get_id()];
+    if (!queue) {
+      queue = std::make_unique<Queue>(
+          queue_capacity_.load(std::memory_order_relaxed));
+    }
+    cache = ThreadCache{id_, queue.get()};
+    return *queue;
+  }
+
+  // Capacity of the queues of threads that haven't got a queue yet.
+  void SetQueueCapacity(size_t queue_capacity) noexcept {
+    queue_capacity_.store(queue_capacity, std::memory_order_relaxed);
+  }
+
+  // Pops all the available elements from all the queues. Must be called from
+  // one thread at a time. Returns the number of consumed elements.
+  template <typename Consumer>
+  size_t ConsumeAll(Consumer&& consumer) {
+    size_t consumed{0};
+    for (auto* queue : GetQueues()) {
+      consumed += queue->ConsumeAll(consumer);
+    }
+    return consumed;
+  }
+
+ private:
+  // Queue of the current thread in the set that used it last. Set ids are never
+  // reused, so a stale entry can't point to a queue of a destroyed set.
+  struct ThreadCache final {
+    uint64_t owner_id{};
+    Queue* queue{};
+  };
+
+  std::vector<Queue*> GetQueues() {
+    std::vector<Queue*> queues;
+    std::lock_guard lk{mtx_};
+    queues.reserve(queues_.size());
+    for (const auto& [thread_id, queue] : queues_) {
+      queues.push_back(queue.get());
+    }
+    return queues;
+  }
+
+  static inline std::atomic_uint64_t next_id_{1};
+  static inline thread_local ThreadCache thread_cache_;
+
+  std::atomic_size_t queue_capacity_;
+  const uint64_t id_;
+  std::mutex mtx_;
+  std::unordered_map<std::thread::id, std::unique_ptr<Queue>> queues_;
+};
+
+}  // namespace socks5::utils
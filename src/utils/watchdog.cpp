@@ -1,5 +1,6 @@
 #include <socks5/utils/watchdog.hpp>
 #include <utils/logger.hpp>
+#include <utils/probes.hpp>
 
 namespace socks5::utils {
 
@@ -55,6 +56,7 @@ VoidAwait Watchdog::Run() noexcept {
       }
       const auto diff = now - impl_->last_update_time;
       if (diff >= impl_->interval) {
+        SOCKS5_PROBE1(watchdog_expired, impl_->interval);
         impl_->cancel.emit(asio::cancellation_type::terminal);
         co_return;
       }
@@ -123,4 +123,69 @@ TEST_F(ConnectHandshakeTest, Run) {
   EXPECT_TRUE(completed);
 }
 
+TEST_F(ConnectHandshakeTest, CompressedTunnel) {
+  ConnectClient();
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    auth::client::AuthOptions auth_options;
+    auth_options.AddAuthMethod<auth::client::AuthMethod::kNone>();
+    asio::ip::tcp::endpoint ep{asio::ip::make_address("10.0.0.1"), 1234};
+    common::Address target_server_addr{ep};
+
+    ConnectHandshake handshake{client_socket_, target_server_addr,
+                               auth_options, true};
+
+    auto handshake_future =
+        asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
+
+    utils::StaticBuffer<1024> buf;
+    co_await asio::async_read(server_socket_, asio::buffer(buf.BeginWrite(), 4),
+                              asio::use_awaitable);
+    buf.HasWritten(4);
+    EXPECT_EQ(buf.Read<decltype(proto::ClientGreeting::ver)>(),
+              proto::Version::kVersionVer5);
+    EXPECT_EQ(buf.Read<decltype(proto::ClientGreeting::nmethods)>(), 2);
+    EXPECT_EQ(buf.Read<uint8_t>(), proto::AuthMethod::kAuthMethodNone);
+    EXPECT_EQ(buf.Read<uint8_t>(),
+              proto::AuthMethod::kAuthMethodNoneCompressedTunnel);
+    const auto server_choice_buf = serializers::Serialize(
+        common::MakeServerChoice(
+            proto::AuthMethod::kAuthMethodNoneCompressedTunnel));
+    co_await asio::async_write(server_socket_,
+                               asio::buffer(server_choice_buf.BeginRead(),
+                                            server_choice_buf.ReadableBytes()),
+                               asio::use_awaitable);
+    RequestBuf request_buf;
+    co_await asio::async_read(
+        server_socket_,
+        asio::buffer(request_buf.BeginWrite(),
+                     kRequestFirst4FieldsSize + common::kIPv4AddrSize),
+        asio::use_awaitable);
+    request_buf.HasWritten(kRequestFirst4FieldsSize + common::kIPv4AddrSize);
+    const auto request = parsers::ParseRequest(request_buf);
+    EXPECT_EQ(request.rsv, 0);
+
+    tcp::endpoint ep2{asio::ip::make_address("192.168.1.1"), 8080};
+    const auto reply =
+        common::MakeReply(proto::ReplyRep::kReplyRepSuccess, ep2);
+    const auto reply_buf = serializers::Serialize(reply);
+    co_await asio::async_write(
+        server_socket_,
+        asio::buffer(reply_buf.BeginRead(), reply_buf.ReadableBytes()),
+        asio::use_awaitable);
+
+    co_await utils::Timeout(50);
+    auto result = handshake_future.get();
+    EXPECT_EQ(result, error::Error::kSucceeded);
+    EXPECT_TRUE(handshake.CompressedTunnel());
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
 }  // namespace socks5::client
\ No newline at end of file
@@ -21,6 +21,31 @@ TEST(MetricsTest, BasicOperationsEnabled) {
   EXPECT_EQ(metrics.GetSentBytesTotal(), 0);
 }
 
+TEST(MetricsTest, UdpTargetServers) {
+  Metrics metrics;
+
+  metrics.AddUdpTargetServers(3);
+  metrics.RemoveUdpTargetServers(1);
+  metrics.AddEvictedUdpTargetServers(1);
+  EXPECT_EQ(metrics.GetUdpTargetServers(), 2);
+  EXPECT_EQ(metrics.GetEvictedUdpTargetServersTotal(), 1);
+
+  metrics.Clear();
+  EXPECT_EQ(metrics.GetUdpTargetServers(), 2);
+  EXPECT_EQ(metrics.GetEvictedUdpTargetServersTotal(), 0);
+}
+
+TEST(MetricsTest, DroppedUdpDatagrams) {
+  Metrics metrics;
+
+  metrics.AddDroppedUdpDatagrams(2);
+  metrics.AddDroppedUdpDatagrams(3);
+  EXPECT_EQ(metrics.GetDroppedUdpDatagramsTotal(), 5);
+
+  metrics.Clear();
+  EXPECT_EQ(metrics.GetDroppedUdpDatagramsTotal(), 0);
+}
+
 TEST(MetricsTest, ThreadSafety) {
   Metrics metrics;
   constexpr size_t kThreadCount{4};
@@ -81,6 +81,23 @@ TEST(ProtoBuildersTest, MakeClientGreeting) {
   EXPECT_EQ(greeting.methods[1], proto::AuthMethod::kAuthMethodUser);
 }
 
+TEST(ProtoBuildersTest, MakeClientGreetingCompressedTunnel) {
+  auth::client::AuthOptions options;
+  options.AddAuthMethod<auth::client::AuthMethod::kNone>();
+  options.AddAuthMethod<auth::client::AuthMethod::kUser>("user1", "password1");
+
+  const auto greeting = MakeClientGreeting(options, true);
+
+  EXPECT_EQ(greeting.ver, proto::Version::kVersionVer5);
+  EXPECT_EQ(greeting.nmethods, 4);
+  EXPECT_EQ(greeting.methods[0], proto::AuthMethod::kAuthMethodNone);
+  EXPECT_EQ(greeting.methods[1], proto::AuthMethod::kAuthMethodUser);
+  EXPECT_EQ(greeting.methods[2],
+            proto::AuthMethod::kAuthMethodNoneCompressedTunnel);
+  EXPECT_EQ(greeting.methods[3],
+            proto::AuthMethod::kAuthMethodUserCompressedTunnel);
+}
+
 TEST(ProtoBuildersTest, MakeReply) {
   const auto reply = MakeReply(proto::ReplyRep::kReplyRepSuccess,
                                proto::AddrType::kAddrTypeIPv4, 8080);
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include <common/tunnel_codec.hpp>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace socks5::common {
+
+namespace {
+
+std::string RandomData(size_t size, uint32_t seed) {
+  std::mt19937 gen{seed};
+  std::uniform_int_distribution<int> byte{0, 255};
+  std::string data(size, '\0');
+  for (auto& c : data) {
+    c = static_cast<char>(byte(gen));
+  }
+  return data;
+}
+
+std::string JsonData(size_t size) {
+  std::string data;
+  for (size_t i = 0; data.size() < size; ++i) {
+    data += R"({"id":)" + std::to_string(i) +
+            R"(,"status":"active","tags":["api","v2"],"score":)" +
+            std::to_string(i * 7 % 100) + "}\n";
+  }
+  data.resize(size);
+  return data;
+}
+
+// Decodes the frames fed in chunks of the given size.
+std::string Decode(const std::vector<char>& frames, size_t chunk_size) {
+  TunnelDecoder decoder;
+  std::vector<char> out;
+  for (size_t pos = 0; pos < frames.size(); pos += chunk_size) {
+    const auto size = std::min(chunk_size, frames.size() - pos);
+    EXPECT_TRUE(decoder.Decode(frames.data() + pos, size, out));
+  }
+  return std::string{out.begin(), out.end()};
+}
+
+}  // namespace
+
+TEST(TunnelCodecTest, CompressibleData) {
+  const auto data = JsonData(100000);
+  TunnelEncoder encoder;
+  std::vector<char> frames;
+  encoder.Encode(data.data(), data.size(), frames);
+  ASSERT_EQ(encoder.InBytes(), data.size());
+  ASSERT_EQ(encoder.OutBytes(), frames.size());
+  ASSERT_LT(frames.size(), data.size() / 3);
+  for (const size_t chunk_size : {1, 7, 4096, 100000}) {
+    ASSERT_EQ(Decode(frames, chunk_size), data) << chunk_size;
+  }
+}
+
+TEST(TunnelCodecTest, MatchesOfAllLengths) {
+  std::string data;
+  std::mt19937 gen{1};
+  for (size_t run = 1; data.size() < 30000; ++run) {
+    data += RandomData(run % 300, static_cast<uint32_t>(run));
+    data += std::string(run % 700, static_cast<char>(gen()));
+  }
+  TunnelEncoder encoder;
+  std::vector<char> frames;
+  encoder.Encode(data.data(), data.size(), frames);
+  ASSERT_LT(frames.size(), data.size());
+  ASSERT_EQ(Decode(frames, frames.size()), data);
+}
+
+// Incompressible blocks are sent raw, and after a failure the next blocks
+// aren't even tried.
+TEST(TunnelCodecTest, BypassIncompressibleData) {
+  TunnelEncoder encoder;
+  std::vector<char> frames;
+  std::string stream;
+  for (uint32_t i = 0; i < 8; ++i) {
+    const auto data = RandomData(1000, i);
+    encoder.Encode(data.data(), data.size(), frames);
+    stream += data;
+    ASSERT_EQ(frames[frames.size() - data.size() - kTunnelFrameHeaderSize],
+              static_cast<char>(TunnelFrameType::kRaw));
+  }
+  ASSERT_EQ(frames.size(), stream.size() + 8 * kTunnelFrameHeaderSize);
+
+  // Compression resumes after the backoff.
+  const auto json = JsonData(1000);
+  for (int i = 0; i < 8; ++i) {
+    encoder.Encode(json.data(), json.size(), frames);
+    stream += json;
+  }
+  ASSERT_LT(frames.size(), stream.size());
+  ASSERT_EQ(Decode(frames, 1000), stream);
+}
+
+TEST(TunnelCodecTest, SmallAndEmptyData) {
+  TunnelEncoder encoder;
+  std::vector<char> frames;
+  std::string stream;
+  for (size_t size = 0; size < 100; ++size) {
+    const auto data = JsonData(size);
+    encoder.Encode(data.data(), data.size(), frames);
+    stream += data;
+  }
+  ASSERT_EQ(Decode(frames, 3), stream);
+}
+
+TEST(TunnelCodecTest, EmptyFrames) {
+  // The encoder doesn't make them, but the peer may send them.
+  TunnelDecoder decoder;
+  std::vector<char> out;
+  const std::vector<char> frames{0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0};
+  ASSERT_TRUE(decoder.Decode(frames.data(), frames.size(), out));
+  ASSERT_TRUE(out.empty());
+}
+
+TEST(TunnelCodecTest, RejectMalformedFrames) {
+  const auto decode = [](std::vector<char> frames) {
+    TunnelDecoder decoder;
+    std::vector<char> out;
+    return decoder.Decode(frames.data(), frames.size(), out);
+  };
+  // Unknown type.
+  ASSERT_FALSE(decode({2, 0, 1, 0, 1, 'a'}));
+  // The sizes of a raw frame differ.
+  ASSERT_FALSE(decode({0, 0, 1, 0, 2, 'a', 'b'}));
+  // Too big.
+  ASSERT_FALSE(decode({0, char(0x80), 1, char(0x80), 1}));
+  // A match before the start of the block.
+  ASSERT_FALSE(decode({1, 0, 4, 0, 6, 0x10, 'a', 2, 0}));
+  // The block is shorter than its original size.
+  ASSERT_FALSE(decode({1, 0, 2, 0, 2, 0x10, 'a'}));
+  // A match repeating the last byte.
+  ASSERT_TRUE(decode({1, 0, 6, 0, 7, 0x11, 'a', 1, 0, 0x10, 'b'}));
+  // Incomplete frames wait for the rest.
+  ASSERT_TRUE(decode({0, 0, 10, 0, 10, 'a'}));
+}
+
+TEST(TunnelCodecTest, RandomDataRoundTrip) {
+  std::mt19937 gen{7};
+  TunnelEncoder encoder;
+  std::vector<char> frames;
+  std::string stream;
+  for (uint32_t i = 0; i < 50; ++i) {
+    const auto size = gen() % 70000;
+    const auto data = i % 2 ? JsonData(size) : RandomData(size, i);
+    encoder.Encode(data.data(), data.size(), frames);
+    stream += data;
+  }
+  ASSERT_EQ(Decode(frames, 1500), stream);
+}
+
+}  // namespace socks5::common
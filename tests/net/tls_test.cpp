@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <net/tls.hpp>
+#include <socks5/common/asio.hpp>
+#include <socks5/error/error.hpp>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace socks5::net {
+
+namespace {
+
+struct HandshakeResult {
+  boost::system::error_code server_err;
+  boost::system::error_code client_err;
+  // Received by the server over kTLS after the handshake.
+  std::string data;
+};
+
+// Writes a self-signed certificate for the name and its key to PEM files.
+void WriteSelfSignedCert(const std::string& name, const std::string& cert_file,
+                         const std::string& key_file) {
+  std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key{EVP_EC_gen("P-256"),
+                                                          &EVP_PKEY_free};
+  std::unique_ptr<X509, decltype(&X509_free)> cert{X509_new(), &X509_free};
+  if (!key || !cert) {
+    throw std::runtime_error{"Error creating test certificate"};
+  }
+  X509_set_version(cert.get(), 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert.get()), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert.get()), 3600);
+  X509_set_pubkey(cert.get(), key.get());
+  auto* subject = X509_get_subject_name(cert.get());
+  X509_NAME_add_entry_by_txt(
+      subject, "CN", MBSTRING_ASC,
+      reinterpret_cast<const unsigned char*>(name.c_str()), -1, -1, 0);
+  X509_set_issuer_name(cert.get(), subject);
+  X509_sign(cert.get(), key.get(), EVP_sha256());
+
+  std::unique_ptr<FILE, decltype(&fclose)> cert_out{
+      fopen(cert_file.c_str(), "w"), &fclose};
+  std::unique_ptr<FILE, decltype(&fclose)> key_out{fopen(key_file.c_str(), "w"),
+                                                   &fclose};
+  if (!cert_out || !key_out || !PEM_write_X509(cert_out.get(), cert.get()) ||
+      !PEM_write_PrivateKey(key_out.get(), key.get(), nullptr, nullptr, 0,
+                            nullptr, nullptr)) {
+    throw std::runtime_error{"Error writing test certificate"};
+  }
+}
+
+class TlsTest : public testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    WriteSelfSignedCert("proxy.test", CertFile(), KeyFile());
+    WriteSelfSignedCert("other.test", OtherCertFile(), OtherKeyFile());
+  }
+
+  static std::string CertFile() { return testing::TempDir() + "tls_cert.pem"; }
+  static std::string KeyFile() { return testing::TempDir() + "tls_key.pem"; }
+  static std::string OtherCertFile() {
+    return testing::TempDir() + "tls_other_cert.pem";
+  }
+  static std::string OtherKeyFile() {
+    return testing::TempDir() + "tls_other_key.pem";
+  }
+
+  // Runs the handshakes of a client and a server connected over loopback.
+  HandshakeResult RunHandshake(TlsContext& server, TlsContext& client) {
+    asio::io_context io_context;
+    tcp::acceptor acceptor{
+        io_context, tcp::endpoint{asio::ip::make_address("127.0.0.1"), 0}};
+    tcp::socket server_socket{io_context};
+    tcp::socket client_socket{io_context};
+    client_socket.connect(acceptor.local_endpoint());
+    acceptor.accept(server_socket);
+
+    HandshakeResult res;
+    asio::co_spawn(
+        io_context,
+        [&]() -> VoidAwait {
+          res.server_err = co_await server.Handshake(server_socket);
+        },
+        asio::detached);
+    asio::co_spawn(
+        io_context,
+        [&]() -> VoidAwait {
+          res.client_err = co_await client.Handshake(client_socket);
+        },
+        asio::detached);
+    io_context.run_for(std::chrono::seconds{5});
+
+    if (!res.server_err && !res.client_err) {
+      asio::write(client_socket, asio::buffer("ping", 4));
+      res.data.resize(4);
+      asio::read(server_socket, asio::buffer(res.data));
+    }
+    return res;
+  }
+};
+
+}  // namespace
+
+// kTLS isn't available everywhere, e.g. without the tls kernel module. Then
+// both ends fail after the handshake, the session is resumed anyway.
+TEST_F(TlsTest, HandshakeAndResumption) {
+  const auto server = TlsContext::MakeServer(CertFile(), KeyFile(), 3600);
+  const auto client = TlsContext::MakeClient(CertFile(), "proxy.test");
+  for (int i = 0; i < 2; ++i) {
+    const auto res = RunHandshake(*server, *client);
+    ASSERT_EQ(res.server_err, res.client_err) << res.client_err.message();
+    if (res.client_err) {
+      ASSERT_EQ(res.client_err, error::Error::kKernelTlsNotAvailable);
+      continue;
+    }
+    ASSERT_EQ(res.data, "ping");
+  }
+  ASSERT_EQ(server->ResumedHandshakes(), 1);
+  ASSERT_EQ(client->ResumedHandshakes(), 1);
+}
+
+TEST_F(TlsTest, RejectUntrustedServer) {
+  const auto server = TlsContext::MakeServer(CertFile(), KeyFile(), 3600);
+  const auto client = TlsContext::MakeClient(OtherCertFile(), "proxy.test");
+  const auto res = RunHandshake(*server, *client);
+  ASSERT_EQ(res.client_err, error::Error::kTlsHandshakeFailure);
+  ASSERT_EQ(res.server_err, error::Error::kTlsHandshakeFailure);
+}
+
+TEST_F(TlsTest, RejectWrongServerName) {
+  const auto server = TlsContext::MakeServer(CertFile(), KeyFile(), 3600);
+  const auto client = TlsContext::MakeClient(CertFile(), "other.test");
+  const auto res = RunHandshake(*server, *client);
+  ASSERT_EQ(res.client_err, error::Error::kTlsHandshakeFailure);
+  ASSERT_EQ(res.server_err, error::Error::kTlsHandshakeFailure);
+}
+
+// The self-signed certificate isn't trusted by the default CA certificates.
+TEST_F(TlsTest, VerifyByDefault) {
+  const auto server = TlsContext::MakeServer(CertFile(), KeyFile(), 3600);
+  const auto client = TlsContext::MakeClient({}, "proxy.test");
+  const auto res = RunHandshake(*server, *client);
+  ASSERT_EQ(res.client_err, error::Error::kTlsHandshakeFailure);
+}
+
+TEST_F(TlsTest, NoVerification) {
+  const auto server = TlsContext::MakeServer(CertFile(), KeyFile(), 3600);
+  const auto client = TlsContext::MakeUnverifiedClient("other.test");
+  const auto res = RunHandshake(*server, *client);
+  ASSERT_EQ(res.server_err, res.client_err) << res.client_err.message();
+  if (res.client_err) {
+    ASSERT_EQ(res.client_err, error::Error::kKernelTlsNotAvailable);
+  }
+}
+
+TEST_F(TlsTest, InvalidCertificateFiles) {
+  ASSERT_THROW(TlsContext::MakeServer(testing::TempDir() + "missing.pem",
+                                      KeyFile(), 3600),
+               std::runtime_error);
+  ASSERT_THROW(TlsContext::MakeServer(CertFile(), OtherKeyFile(), 3600),
+               std::runtime_error);
+  ASSERT_THROW(TlsContext::MakeClient(testing::TempDir() + "missing.pem", {}),
+               std::runtime_error);
+}
+
+}  // namespace socks5::net
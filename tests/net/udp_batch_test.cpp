@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+#include <net/udp_batch.hpp>
+#include <socks5/common/asio.hpp>
+#include <array>
+#include <string>
+#include <string_view>
+
+namespace socks5::net {
+
+namespace {
+
+class UdpBatchTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    const udp::endpoint ep{asio::ip::make_address_v4("127.0.0.1"), 0};
+    receiver_.open(udp::v4());
+    receiver_.bind(ep);
+    sender_.open(udp::v4());
+    sender_.bind(ep);
+  }
+
+  void SendDatagram(std::string_view data) {
+    sender_.send_to(asio::buffer(data.data(), data.size()),
+                    receiver_.local_endpoint());
+  }
+
+  std::string ReceiveDatagram() {
+    std::array<char, 64> buf;
+    udp::endpoint sender_ep;
+    const auto size = receiver_.receive_from(asio::buffer(buf), sender_ep);
+    EXPECT_EQ(sender_ep, sender_.local_endpoint());
+    return std::string{buf.data(), size};
+  }
+
+  // Loopback datagrams are queued synchronously, but the receiver may be
+  // polled a few times to be safe.
+  size_t Receive(UdpRecvBatch& batch, size_t expected) {
+    size_t received{0};
+    for (int i = 0; i < 100 && received < expected; ++i) {
+      boost::system::error_code err;
+      received = batch.TryReceive(receiver_, err);
+      EXPECT_FALSE(err);
+    }
+    return received;
+  }
+
+  asio::io_context io_context_;
+  udp::socket receiver_{io_context_};
+  udp::socket sender_{io_context_};
+};
+
+}  // namespace
+
+TEST_F(UdpBatchTest, ReceiveEmpty) {
+  UdpRecvBatch batch{4, 64};
+  boost::system::error_code err;
+  ASSERT_EQ(batch.TryReceive(receiver_, err), 0);
+  ASSERT_FALSE(err);
+  ASSERT_EQ(batch.Size(), 0);
+  ASSERT_EQ(batch.Bytes(), 0);
+}
+
+TEST_F(UdpBatchTest, ReceiveSeveralDatagrams) {
+  SendDatagram("first");
+  SendDatagram("second");
+  SendDatagram("third");
+  UdpRecvBatch batch{4, 64};
+#ifdef __linux__
+  ASSERT_EQ(Receive(batch, 3), 3);
+  ASSERT_EQ(batch.Bytes(), 16);
+  const std::array<std::string_view, 3> expected{"first", "second", "third"};
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(std::string_view(batch.Data(i), batch.Length(i)), expected[i]);
+    ASSERT_EQ(batch.Sender(i), sender_.local_endpoint());
+  }
+#else
+  ASSERT_EQ(Receive(batch, 1), 1);
+  ASSERT_EQ(std::string_view(batch.Data(0), batch.Length(0)), "first");
+#endif
+}
+
+TEST_F(UdpBatchTest, ReceiveMoreThanCapacity) {
+  SendDatagram("1");
+  SendDatagram("2");
+  SendDatagram("3");
+  UdpRecvBatch batch{2, 64};
+  ASSERT_GT(Receive(batch, 2), 0);
+  ASSERT_LE(batch.Size(), 2);
+  ASSERT_EQ(std::string_view(batch.Data(0), batch.Length(0)), "1");
+}
+
+#ifdef __linux__
+
+TEST_F(UdpBatchTest, DropTruncatedDatagrams) {
+  SendDatagram("short");
+  SendDatagram("too long datagram");
+  SendDatagram("end");
+  UdpRecvBatch batch{4, 8};
+  ASSERT_EQ(Receive(batch, 2), 2);
+  ASSERT_EQ(std::string_view(batch.Data(0), batch.Length(0)), "short");
+  ASSERT_EQ(std::string_view(batch.Data(1), batch.Length(1)), "end");
+  ASSERT_EQ(batch.Bytes(), 8);
+  ASSERT_EQ(batch.Truncated(), 1);
+}
+
+TEST_F(UdpBatchTest, ReceiveOnlyTruncatedDatagrams) {
+  SendDatagram("too long datagram");
+  UdpRecvBatch batch{4, 8};
+  boost::system::error_code err;
+  ASSERT_EQ(batch.TryReceive(receiver_, err), 0);
+  ASSERT_FALSE(err);
+  ASSERT_EQ(batch.Truncated(), 1);
+  ASSERT_EQ(batch.TryReceive(receiver_, err), 0);
+  ASSERT_EQ(batch.Truncated(), 0);
+}
+
+#endif
+
+TEST_F(UdpBatchTest, SendBatch) {
+  const auto ep = receiver_.local_endpoint();
+  const std::string header{"hdr:"};
+  const std::string payload1{"payload1"};
+  const std::string payload2{"payload2"};
+  UdpSendBatch batch{4};
+  ASSERT_TRUE(batch.Empty());
+  batch.Add(ep, payload1.data(), payload1.size());
+  batch.Add(ep, std::array{asio::const_buffer{header.data(), header.size()},
+                           asio::const_buffer{payload2.data(),
+                                              payload2.size()}});
+  ASSERT_EQ(batch.Size(), 2);
+  ASSERT_FALSE(batch.Full());
+  ASSERT_EQ(batch.Bytes(), 20);
+  ASSERT_EQ(batch.PayloadSize(0), payload1.size());
+  ASSERT_EQ(batch.PayloadSize(1), payload2.size());
+
+  size_t sent{0};
+  while (sent < batch.Size()) {
+    boost::system::error_code err;
+    sent += batch.TrySend(sender_, sent, err);
+    ASSERT_FALSE(err);
+  }
+  ASSERT_EQ(ReceiveDatagram(), "payload1");
+  ASSERT_EQ(ReceiveDatagram(), "hdr:payload2");
+
+  batch.Clear();
+  ASSERT_TRUE(batch.Empty());
+  ASSERT_EQ(batch.Bytes(), 0);
+}
+
+TEST_F(UdpBatchTest, SendFullBatch) {
+  const auto ep = receiver_.local_endpoint();
+  const std::array<std::string, 3> datagrams{"a", "bb", "ccc"};
+  UdpSendBatch batch{datagrams.size()};
+  for (const auto& datagram : datagrams) {
+    batch.Add(ep, datagram.data(), datagram.size());
+  }
+  ASSERT_TRUE(batch.Full());
+  size_t sent{0};
+  while (sent < batch.Size()) {
+    boost::system::error_code err;
+    sent += batch.TrySend(sender_, sent, err);
+    ASSERT_FALSE(err);
+  }
+  for (const auto& datagram : datagrams) {
+    ASSERT_EQ(ReceiveDatagram(), datagram);
+  }
+}
+
+TEST_F(UdpBatchTest, SendConnected) {
+  sender_.connect(receiver_.local_endpoint());
+  const std::string header{"hdr:"};
+  const std::array<std::string, 3> payloads{"aaaa", "bbbb", "cc"};
+  UdpSendBatch batch{4, true};
+  for (const auto& payload : payloads) {
+    batch.Add(std::array{asio::const_buffer{header.data(), header.size()},
+                         asio::const_buffer{payload.data(), payload.size()}});
+  }
+  const std::string last{"last"};
+  batch.Add(last.data(), last.size());
+  size_t sent{0};
+  while (sent < batch.Size()) {
+    boost::system::error_code err;
+    sent += batch.TrySend(sender_, sent, err);
+    ASSERT_FALSE(err);
+  }
+  for (const auto& payload : payloads) {
+    ASSERT_EQ(ReceiveDatagram(), header + payload);
+  }
+  ASSERT_EQ(ReceiveDatagram(), last);
+}
+
+TEST_F(UdpBatchTest, SendWithSegmentation) {
+  const auto ep = receiver_.local_endpoint();
+  const std::string header{"hdr:"};
+  const std::array<std::string, 4> payloads{"aaaa", "bbbb", "cccc", "dd"};
+  UdpSendBatch batch{8, true};
+  for (const auto& payload : payloads) {
+    batch.Add(ep, std::array{asio::const_buffer{header.data(), header.size()},
+                             asio::const_buffer{payload.data(),
+                                                payload.size()}});
+  }
+  // Starts a new run, it's bigger than the segment size.
+  const std::string last{"eeeeeeee"};
+  batch.Add(ep, last.data(), last.size());
+  size_t sent{0};
+  while (sent < batch.Size()) {
+    boost::system::error_code err;
+    sent += batch.TrySend(sender_, sent, err);
+    ASSERT_FALSE(err);
+  }
+  ASSERT_EQ(sent, 5);
+  for (const auto& payload : payloads) {
+    ASSERT_EQ(ReceiveDatagram(), header + payload);
+  }
+  ASSERT_EQ(ReceiveDatagram(), last);
+}
+
+TEST_F(UdpBatchTest, ReceiveWithGro) {
+  if (!EnableUdpGro(receiver_)) {
+    GTEST_SKIP() << "UDP GRO isn't supported";
+  }
+  const auto ep = receiver_.local_endpoint();
+  const std::array<std::string, 3> datagrams{"1111", "2222", "33"};
+  UdpSendBatch send_batch{datagrams.size(), true};
+  for (const auto& datagram : datagrams) {
+    send_batch.Add(ep, datagram.data(), datagram.size());
+  }
+  size_t sent{0};
+  while (sent < send_batch.Size()) {
+    boost::system::error_code err;
+    sent += send_batch.TrySend(sender_, sent, err);
+    ASSERT_FALSE(err);
+  }
+  UdpRecvBatch batch{1, 1024, true};
+  size_t received{0};
+  for (int i = 0; i < 100 && received < datagrams.size(); ++i) {
+    boost::system::error_code err;
+    if (batch.TryReceive(receiver_, err) == 0) {
+      ASSERT_FALSE(err);
+      continue;
+    }
+    for (size_t j = 0; j < batch.Size(); ++j) {
+      ASSERT_LT(received, datagrams.size());
+      ASSERT_EQ(std::string_view(batch.Data(j), batch.Length(j)),
+                datagrams[received]);
+      ASSERT_EQ(batch.Sender(j), sender_.local_endpoint());
+      ++received;
+    }
+  }
+  ASSERT_EQ(received, datagrams.size());
+}
+
+}  // namespace socks5::net
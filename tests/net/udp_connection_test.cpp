@@ -124,6 +124,41 @@ TEST_F(UdpConnectionTest, ReadSuccess) {
   });
 }
 
+TEST_F(UdpConnectionTest, ReadPooled) {
+  RunTest([&]() -> asio::awaitable<void> {
+    const std::string small_data(100, 's');
+    const std::string big_data(utils::kPooledBufferSize + 100, 'b');
+    co_await client_socket_->async_send_to(
+        asio::buffer(small_data), server_endpoint_, asio::use_awaitable);
+    co_await client_socket_->async_send_to(
+        asio::buffer(big_data), server_endpoint_, asio::use_awaitable);
+
+    utils::PooledBufferOpt buf;
+    const auto [err_opt, sender_ep_opt] =
+        co_await server_conn_->ReadPooled(buf);
+    EXPECT_FALSE(err_opt) << "Error: " << (err_opt ? err_opt->Msg() : "");
+    if (err_opt) {
+      co_return;
+    }
+    EXPECT_EQ(sender_ep_opt->port(), client_socket_->local_endpoint().port());
+    EXPECT_TRUE(buf->Pooled());
+    EXPECT_EQ(std::string_view(buf->BeginRead(), buf->ReadableBytes()),
+              small_data);
+
+    // The datagram doesn't fit into a pooled buffer, a bigger one is used.
+    const auto [err_opt2, sender_ep_opt2] =
+        co_await server_conn_->ReadPooled(buf);
+    EXPECT_FALSE(err_opt2) << "Error: " << (err_opt2 ? err_opt2->Msg() : "");
+    if (err_opt2) {
+      co_return;
+    }
+    EXPECT_EQ(std::string_view(buf->BeginRead(), buf->ReadableBytes()),
+              big_data);
+    EXPECT_EQ(metrics_->GetRecvBytesTotal(),
+              small_data.size() + big_data.size());
+  });
+}
+
 TEST_F(UdpConnectionTest, ReadTimeout) {
   RunTest([&]() -> asio::awaitable<void> {
     utils::StaticBuffer<128> buf;
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include <socks5/server/content_matcher.hpp>
+#include <socks5/common/asio.hpp>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace socks5::server {
+
+namespace {
+
+using Matches = std::vector<std::pair<uint32_t, uint64_t>>;
+
+class ContentMatcherTest : public testing::Test {
+ protected:
+  ContentMatchCb Collect() {
+    return [this](const ContentMatch& match) {
+      matches_.emplace_back(match.pattern_id, match.end);
+      return false;
+    };
+  }
+
+  std::optional<ContentMatch> Scan(const ContentMatcher& matcher,
+                                   ContentMatcher::Stream& stream,
+                                   std::string_view data) {
+    return matcher.Scan(stream, data.data(), data.size(), Collect());
+  }
+
+  Matches matches_;
+};
+
+ContentPattern Tag(std::string bytes, uint32_t id) {
+  return ContentPattern{std::move(bytes), ContentAction::kTag, id};
+}
+
+}  // namespace
+
+TEST_F(ContentMatcherTest, ThrowOnEmptyPattern) {
+  ASSERT_THROW((ContentMatcher{{Tag("", 1)}}), std::invalid_argument);
+}
+
+TEST_F(ContentMatcherTest, ReportOverlappingMatches) {
+  const ContentMatcher matcher{
+      {Tag("he", 1), Tag("she", 2), Tag("his", 3), Tag("hers", 4)}};
+  ASSERT_EQ(matcher.PatternsNum(), 4);
+  ContentMatcher::Stream stream;
+  ASSERT_FALSE(Scan(matcher, stream, "ushers"));
+  ASSERT_EQ(matches_, (Matches{{2, 4}, {1, 4}, {4, 6}}));
+  ASSERT_EQ(stream.offset, 6);
+}
+
+TEST_F(ContentMatcherTest, MatchAcrossChunks) {
+  const ContentMatcher matcher{{Tag("ClientHello", 1)}};
+  ContentMatcher::Stream stream;
+  ASSERT_FALSE(Scan(matcher, stream, "xxxxClie"));
+  ASSERT_FALSE(Scan(matcher, stream, "ntHe"));
+  ASSERT_FALSE(Scan(matcher, stream, "llo"));
+  ASSERT_EQ(matches_, (Matches{{1, 15}}));
+}
+
+TEST_F(ContentMatcherTest, CaseInsensitive) {
+  const ContentMatcher matcher{{Tag("GET /Admin", 1)}, true};
+  ContentMatcher::Stream stream;
+  ASSERT_FALSE(Scan(matcher, stream, "get /ADMIN HTTP/1.1"));
+  ASSERT_EQ(matches_, (Matches{{1, 10}}));
+}
+
+TEST_F(ContentMatcherTest, Actions) {
+  const ContentMatcher matcher{{Tag("tag", 1),
+                                {"block", ContentAction::kBlock, 2},
+                                {"cb", ContentAction::kCallback, 3}}};
+  ContentMatcher::Stream stream;
+  ASSERT_FALSE(Scan(matcher, stream, "tag cb"));
+  ASSERT_EQ(matches_, (Matches{{1, 3}, {3, 6}}));
+
+  const auto blocked = matcher.Scan(
+      stream, "cb", 2, [](const ContentMatch& match) { return true; });
+  ASSERT_TRUE(blocked);
+  ASSERT_EQ(blocked->pattern_id, 3);
+  ASSERT_EQ(blocked->end, 8);
+
+  ContentMatcher::Stream block_stream;
+  const auto block = Scan(matcher, block_stream, "a block tag");
+  ASSERT_TRUE(block);
+  ASSERT_EQ(block->pattern_id, 2);
+  ASSERT_EQ(block->action, ContentAction::kBlock);
+  // Scanning stops at the match that blocks the data.
+  ASSERT_EQ(block_stream.offset, 7);
+}
+
+// Compares the matches of many random patterns with a naive search. There
+// are more states than fit into the full transition table.
+TEST_F(ContentMatcherTest, ManyPatterns) {
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<int> byte{0, 255};
+  std::uniform_int_distribution<size_t> len{2, 24};
+  std::vector<ContentPattern> patterns;
+  std::string data(50000, '\0');
+  for (auto& c : data) {
+    c = static_cast<char>(byte(gen));
+  }
+  for (uint32_t id = 0; id < 20000; ++id) {
+    std::string bytes(len(gen), '\0');
+    // Half of the patterns are taken from the data, so they match.
+    if (id % 2) {
+      const auto pos = gen() % (data.size() - bytes.size());
+      bytes = data.substr(pos, bytes.size());
+    } else {
+      for (auto& c : bytes) {
+        c = static_cast<char>(byte(gen));
+      }
+    }
+    patterns.push_back(Tag(std::move(bytes), id));
+  }
+  const ContentMatcher matcher{patterns};
+
+  Matches expected;
+  for (const auto& pattern : patterns) {
+    for (auto pos = data.find(pattern.bytes); pos != std::string::npos;
+         pos = data.find(pattern.bytes, pos + 1)) {
+      expected.emplace_back(pattern.id, pos + pattern.bytes.size());
+    }
+  }
+  ContentMatcher::Stream stream;
+  for (size_t pos = 0; pos < data.size(); pos += 1000) {
+    ASSERT_FALSE(Scan(matcher, stream,
+                      std::string_view{data}.substr(pos, 1000)));
+  }
+  std::sort(expected.begin(), expected.end());
+  std::sort(matches_.begin(), matches_.end());
+  ASSERT_GE(expected.size(), 10000);
+  ASSERT_EQ(matches_, expected);
+}
+
+TEST_F(ContentMatcherTest, TcpRelayContentProcessor) {
+  const ContentMatcher matcher{{{"evil", ContentAction::kBlock, 7}}};
+  const auto processor = MakeTcpRelayContentProcessor(matcher);
+  const tcp::endpoint ep{asio::ip::make_address("127.0.0.1"), 1080};
+  auto client_to_server = processor.client_to_server_in_place(ep, ep);
+
+  std::string storage{"good ev"};
+  RelayBuffer buf{storage.data(), storage.data() + storage.size(),
+                  storage.data(), storage.size()};
+  client_to_server(buf);
+  ASSERT_EQ((std::string_view{buf.Data(), buf.Size()}), "good ev");
+  storage = "il";
+  buf = RelayBuffer{storage.data(), storage.data() + storage.size(),
+                    storage.data(), storage.size()};
+  try {
+    client_to_server(buf);
+    FAIL() << "The data isn't blocked";
+  } catch (const ContentBlockedError& ex) {
+    ASSERT_EQ(ex.PatternId(), 7);
+  }
+}
+
+TEST_F(ContentMatcherTest, UdpRelayContentProcessor) {
+  const ContentMatcher matcher{{{"evil", ContentAction::kBlock, 7}}};
+  const auto processor = MakeUdpRelayContentProcessor(matcher, Collect());
+  const udp::endpoint ep{asio::ip::make_address("127.0.0.1"), 1080};
+  std::vector<std::string> sent;
+  const RelayDataSender send = [&](const char* data, size_t size) {
+    sent.emplace_back(data, size);
+  };
+  auto client_to_server = processor.client_to_server(ep);
+  auto server_to_client = processor.server_to_client(ep, ep);
+  // Datagrams are matched on their own.
+  for (const std::string_view datagram : {"ev", "il", "an evil one"}) {
+    client_to_server(datagram.data(), datagram.size(), ep, send);
+  }
+  const std::string_view response{"evil"};
+  server_to_client(response.data(), response.size(), send);
+  ASSERT_EQ(sent, (std::vector<std::string>{"ev", "il"}));
+  ASSERT_EQ(matches_, (Matches{{7, 7}, {7, 4}}));
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,282 @@
+#include <gtest/gtest.h>
+#include <server/dns_cache.hpp>
+#include <socks5/common/asio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace socks5::server {
+
+namespace {
+
+using Message = std::vector<char>;
+
+constexpr uint16_t kTypeA{1};
+constexpr uint16_t kTypeOpt{41};
+constexpr uint16_t kRcodeNxDomain{3};
+constexpr uint16_t kRcodeServFail{2};
+
+void Put16(Message& msg, uint16_t value) {
+  msg.push_back(static_cast<char>(value >> 8));
+  msg.push_back(static_cast<char>(value));
+}
+
+void Put32(Message& msg, uint32_t value) {
+  Put16(msg, static_cast<uint16_t>(value >> 16));
+  Put16(msg, static_cast<uint16_t>(value));
+}
+
+uint16_t Get16(const Message& msg, size_t offset) {
+  return static_cast<uint16_t>(
+      (static_cast<uint8_t>(msg[offset]) << 8) |
+      static_cast<uint8_t>(msg[offset + 1]));
+}
+
+uint32_t Get32(const Message& msg, size_t offset) {
+  return (static_cast<uint32_t>(Get16(msg, offset)) << 16) |
+         Get16(msg, offset + 2);
+}
+
+void PutName(Message& msg, std::string_view name) {
+  while (!name.empty()) {
+    const auto dot = name.find('.');
+    const auto label = name.substr(0, dot);
+    msg.push_back(static_cast<char>(label.size()));
+    msg.insert(msg.end(), label.begin(), label.end());
+    name.remove_prefix(dot == std::string_view::npos ? name.size() : dot + 1);
+  }
+  msg.push_back(0);
+}
+
+void PutOpt(Message& msg) {
+  msg.push_back(0);
+  Put16(msg, kTypeOpt);
+  Put16(msg, 1232);
+  Put32(msg, 0);
+  Put16(msg, 0);
+}
+
+Message MakeMessage(uint16_t id, uint16_t flags, std::string_view name,
+                    uint16_t answers, uint16_t additional) {
+  Message msg;
+  Put16(msg, id);
+  Put16(msg, flags);
+  Put16(msg, 1);
+  Put16(msg, answers);
+  Put16(msg, 0);
+  Put16(msg, additional);
+  PutName(msg, name);
+  Put16(msg, kTypeA);
+  Put16(msg, 1);
+  return msg;
+}
+
+Message MakeQuery(uint16_t id, std::string_view name, bool edns = false) {
+  auto msg = MakeMessage(id, 0x0100, name, 0, edns ? 1 : 0);
+  if (edns) {
+    PutOpt(msg);
+  }
+  return msg;
+}
+
+// Offset of the TTL field of the answer record with the index.
+size_t TtlOffset(std::string_view name, size_t index) {
+  return 12 + name.size() + 2 + 4 + index * 16 + 6;
+}
+
+// A records point to the question name with a compression pointer.
+Message MakeAnswer(uint16_t id, std::string_view name,
+                   const std::vector<uint32_t>& ttls, uint16_t rcode = 0,
+                   bool edns = false, uint16_t extra_flags = 0) {
+  auto msg = MakeMessage(id, 0x8180 | rcode | extra_flags, name,
+                         static_cast<uint16_t>(ttls.size()), edns ? 1 : 0);
+  for (const auto ttl : ttls) {
+    Put16(msg, 0xc00c);
+    Put16(msg, kTypeA);
+    Put16(msg, 1);
+    Put32(msg, ttl);
+    Put16(msg, 4);
+    Put32(msg, 0x7f000001);
+  }
+  if (edns) {
+    PutOpt(msg);
+  }
+  return msg;
+}
+
+class DnsCacheTest : public testing::Test {
+ protected:
+  const udp::endpoint resolver_{asio::ip::make_address("127.0.0.1"), 53};
+  const udp::endpoint other_resolver_{asio::ip::make_address("127.0.0.2"),
+                                      53};
+  const DnsCache::Clock::time_point now_{DnsCache::Clock::now()};
+  DnsCache cache_{{{"127.0.0.1", 53}, {"127.0.0.2", 53}}, 64};
+  Message answer_;
+};
+
+}  // namespace
+
+TEST_F(DnsCacheTest, IsResolver) {
+  ASSERT_TRUE(cache_.IsResolver(resolver_));
+  ASSERT_TRUE(cache_.IsResolver(other_resolver_));
+  ASSERT_FALSE(cache_.IsResolver(
+      udp::endpoint{asio::ip::make_address("127.0.0.1"), 5353}));
+  ASSERT_FALSE(cache_.IsResolver(
+      udp::endpoint{asio::ip::make_address("127.0.0.3"), 53}));
+}
+
+TEST_F(DnsCacheTest, AnswerWithIdOfQuery) {
+  const auto query = MakeQuery(1, "example.com");
+  ASSERT_FALSE(
+      cache_.Lookup(resolver_, query.data(), query.size(), answer_, now_));
+  const auto answer = MakeAnswer(1, "example.com", {300});
+  cache_.Store(resolver_, answer.data(), answer.size(), now_);
+  ASSERT_EQ(cache_.Size(), 1);
+
+  const auto next_query = MakeQuery(0xabcd, "Example.COM");
+  ASSERT_TRUE(cache_.Lookup(resolver_, next_query.data(), next_query.size(),
+                            answer_, now_));
+  ASSERT_EQ(answer_.size(), answer.size());
+  ASSERT_EQ(Get16(answer_, 0), 0xabcd);
+  // The question keeps the letter case of the query.
+  const auto question_end = next_query.size();
+  ASSERT_TRUE(std::equal(answer.begin() + 2, answer.begin() + 12,
+                         answer_.begin() + 2));
+  ASSERT_TRUE(std::equal(next_query.begin() + 12, next_query.end(),
+                         answer_.begin() + 12));
+  ASSERT_TRUE(std::equal(answer.begin() + question_end, answer.end(),
+                         answer_.begin() + question_end));
+}
+
+TEST_F(DnsCacheTest, DecreaseTtlsByAge) {
+  const auto answer = MakeAnswer(1, "example.com", {300, 600});
+  cache_.Store(resolver_, answer.data(), answer.size(), now_);
+  const auto query = MakeQuery(2, "example.com");
+  ASSERT_TRUE(cache_.Lookup(resolver_, query.data(), query.size(), answer_,
+                            now_ + std::chrono::seconds{100}));
+  ASSERT_EQ(Get32(answer_, TtlOffset("example.com", 0)), 200);
+  ASSERT_EQ(Get32(answer_, TtlOffset("example.com", 1)), 500);
+}
+
+TEST_F(DnsCacheTest, ExpireAfterMinTtl) {
+  const auto answer = MakeAnswer(1, "example.com", {300, 30});
+  cache_.Store(resolver_, answer.data(), answer.size(), now_);
+  const auto query = MakeQuery(2, "example.com");
+  ASSERT_TRUE(cache_.Lookup(resolver_, query.data(), query.size(), answer_,
+                            now_ + std::chrono::seconds{29}));
+  ASSERT_FALSE(cache_.Lookup(resolver_, query.data(), query.size(), answer_,
+                             now_ + std::chrono::seconds{30}));
+  ASSERT_EQ(cache_.Size(), 0);
+}
+
+TEST_F(DnsCacheTest, CacheNxDomain) {
+  const auto answer = MakeAnswer(1, "missing.com", {60}, kRcodeNxDomain);
+  cache_.Store(resolver_, answer.data(), answer.size(), now_);
+  const auto query = MakeQuery(2, "missing.com");
+  ASSERT_TRUE(
+      cache_.Lookup(resolver_, query.data(), query.size(), answer_, now_));
+}
+
+TEST_F(DnsCacheTest, DontCacheUncacheableAnswers) {
+  const auto servfail = MakeAnswer(1, "example.com", {60}, kRcodeServFail);
+  cache_.Store(resolver_, servfail.data(), servfail.size(), now_);
+  const auto truncated = MakeAnswer(1, "example.com", {60}, 0, false, 0x0200);
+  cache_.Store(resolver_, truncated.data(), truncated.size(), now_);
+  const auto no_records = MakeAnswer(1, "example.com", {});
+  cache_.Store(resolver_, no_records.data(), no_records.size(), now_);
+  const auto zero_ttl = MakeAnswer(1, "example.com", {0});
+  cache_.Store(resolver_, zero_ttl.data(), zero_ttl.size(), now_);
+  const auto malformed = MakeAnswer(1, "example.com", {60});
+  cache_.Store(resolver_, malformed.data(), malformed.size() - 1, now_);
+  const auto query = MakeQuery(1, "example.com");
+  cache_.Store(resolver_, query.data(), query.size(), now_);
+  ASSERT_EQ(cache_.Size(), 0);
+}
+
+TEST_F(DnsCacheTest, KeyByResolverAndEdns) {
+  const auto answer = MakeAnswer(1, "example.com", {60});
+  cache_.Store(resolver_, answer.data(), answer.size(), now_);
+  const auto query = MakeQuery(2, "example.com");
+  ASSERT_FALSE(cache_.Lookup(other_resolver_, query.data(), query.size(),
+                             answer_, now_));
+  const auto edns_query = MakeQuery(2, "example.com", true);
+  ASSERT_FALSE(cache_.Lookup(resolver_, edns_query.data(), edns_query.size(),
+                             answer_, now_));
+
+  const auto edns_answer = MakeAnswer(1, "example.com", {60}, 0, true);
+  cache_.Store(resolver_, edns_answer.data(), edns_answer.size(), now_);
+  ASSERT_TRUE(cache_.Lookup(resolver_, edns_query.data(), edns_query.size(),
+                            answer_, now_));
+  ASSERT_EQ(answer_.size(), edns_answer.size());
+}
+
+TEST_F(DnsCacheTest, DontCacheEdnsOptions) {
+  auto answer = MakeAnswer(1, "example.com", {60}, 0, true);
+  // Replaces the empty rdata of the OPT record with a client cookie.
+  answer.resize(answer.size() - 2);
+  Put16(answer, 12);
+  Put16(answer, 10);
+  Put16(answer, 8);
+  Put32(answer, 0x01020304);
+  Put32(answer, 0x05060708);
+  cache_.Store(resolver_, answer.data(), answer.size(), now_);
+  ASSERT_EQ(cache_.Size(), 0);
+}
+
+TEST_F(DnsCacheTest, BoundSize) {
+  for (int i = 0; i < 1000; ++i) {
+    const auto answer =
+        MakeAnswer(1, "host" + std::to_string(i) + ".example.com", {60});
+    cache_.Store(resolver_, answer.data(), answer.size(), now_);
+  }
+  ASSERT_LE(cache_.Size(), 64);
+  ASSERT_GT(cache_.Size(), 0);
+}
+
+TEST(DnsPendingQueriesTest, MatchOutstandingQueries) {
+  DnsPendingQueries queries;
+  const auto query = MakeQuery(1, "example.com");
+  queries.Add(query.data(), query.size());
+  const auto other_query = MakeQuery(2, "other.example.com");
+  queries.Add(other_query.data(), other_query.size());
+  ASSERT_EQ(queries.Size(), 2);
+
+  const auto wrong_id = MakeAnswer(3, "example.com", {60});
+  ASSERT_FALSE(queries.Match(wrong_id.data(), wrong_id.size()));
+  const auto wrong_question = MakeAnswer(1, "other.example.com", {60});
+  ASSERT_FALSE(queries.Match(wrong_question.data(), wrong_question.size()));
+
+  // Names are compared case-insensitively.
+  const auto answer = MakeAnswer(1, "Example.COM", {60});
+  ASSERT_TRUE(queries.Match(answer.data(), answer.size()));
+  ASSERT_EQ(queries.Size(), 1);
+  // A repeated answer doesn't match a query anymore.
+  ASSERT_FALSE(queries.Match(answer.data(), answer.size()));
+}
+
+TEST(DnsPendingQueriesTest, IgnoreAnswersAndMalformedQueries) {
+  DnsPendingQueries queries;
+  const auto answer = MakeAnswer(1, "example.com", {60});
+  queries.Add(answer.data(), answer.size());
+  const auto query = MakeQuery(1, "example.com");
+  queries.Add(query.data(), query.size() - 1);
+  ASSERT_EQ(queries.Size(), 0);
+}
+
+TEST(DnsPendingQueriesTest, BoundSize) {
+  DnsPendingQueries queries;
+  for (uint16_t id = 0; id < 1000; ++id) {
+    const auto query = MakeQuery(id, "example.com");
+    queries.Add(query.data(), query.size());
+  }
+  ASSERT_LT(queries.Size(), 1000);
+  const auto oldest = MakeAnswer(0, "example.com", {60});
+  ASSERT_FALSE(queries.Match(oldest.data(), oldest.size()));
+  const auto newest = MakeAnswer(999, "example.com", {60});
+  ASSERT_TRUE(queries.Match(newest.data(), newest.size()));
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <server/flight_recorder.hpp>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace socks5::server {
+
+namespace {
+
+struct DumpedThread final {
+  FlightDumpThread thread;
+  std::vector<FlightEvent> events;
+};
+
+std::vector<DumpedThread> ParseDump(const std::string& dump) {
+  std::istringstream in{dump};
+  FlightDumpHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  EXPECT_EQ(std::memcmp(header.magic, kFlightDumpMagic, sizeof(header.magic)),
+            0);
+  EXPECT_EQ(header.version, kFlightDumpVersion);
+  std::vector<DumpedThread> threads(header.threads_num);
+  for (auto& thread : threads) {
+    in.read(reinterpret_cast<char*>(&thread.thread), sizeof(thread.thread));
+    thread.events.resize(thread.thread.events_num);
+    in.read(reinterpret_cast<char*>(thread.events.data()),
+            thread.events.size() * sizeof(FlightEvent));
+  }
+  EXPECT_TRUE(in.good());
+  EXPECT_EQ(in.peek(), std::char_traits<char>::eof());
+  return threads;
+}
+
+std::string Dump(const FlightRecorder& recorder) {
+  std::ostringstream out;
+  recorder.Dump(out);
+  return out.str();
+}
+
+}  // namespace
+
+TEST(FlightRecorderTest, DisabledRecorderDumpsNothing) {
+  FlightRecorder recorder{0};
+  EXPECT_FALSE(recorder.Enabled());
+  recorder.Record(1, FlightEventType::kHandshakeStart);
+  EXPECT_TRUE(ParseDump(Dump(recorder)).empty());
+}
+
+TEST(FlightRecorderTest, KeepsLastEvents) {
+  FlightRecorder recorder{3};
+  for (uint64_t i = 0; i < 10; ++i) {
+    recorder.Record(i, FlightEventType::kTcpRelayRead, 1, i * 100);
+  }
+
+  const auto threads = ParseDump(Dump(recorder));
+  ASSERT_EQ(threads.size(), 1);
+  const auto& events = threads[0].events;
+  // Capacity is rounded up to 4, the oldest slot is never dumped.
+  ASSERT_EQ(events.size(), 3);
+  for (size_t i = 0; i < events.size(); ++i) {
+    EXPECT_EQ(events[i].session_id, 7 + i);
+    EXPECT_EQ(events[i].type, FlightEventType::kTcpRelayRead);
+    EXPECT_EQ(events[i].arg0, 1);
+    EXPECT_EQ(events[i].arg1, (7 + i) * 100);
+  }
+  EXPECT_LE(events.front().timestamp_ns, events.back().timestamp_ns);
+}
+
+TEST(FlightRecorderTest, RecordsPerThread) {
+  FlightRecorder recorder{16};
+  std::vector<std::thread> threads;
+  for (uint64_t i = 0; i < 3; ++i) {
+    threads.emplace_back([&recorder, i] {
+      recorder.Record(i, FlightEventType::kHandshakeStart);
+      recorder.Record(i, FlightEventType::kHandshakeEnd, 1);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const auto dumped = ParseDump(Dump(recorder));
+  ASSERT_EQ(dumped.size(), 3);
+  for (const auto& thread : dumped) {
+    ASSERT_EQ(thread.events.size(), 2);
+    EXPECT_EQ(thread.events[0].session_id, thread.events[1].session_id);
+    EXPECT_EQ(thread.events[0].type, FlightEventType::kHandshakeStart);
+    EXPECT_EQ(thread.events[1].type, FlightEventType::kHandshakeEnd);
+  }
+}
+
+TEST(FlightRecorderTest, ReusesRingOfThread) {
+  FlightRecorder first{16};
+  FlightRecorder second{16};
+  for (uint64_t i = 0; i < 3; ++i) {
+    first.Record(i, FlightEventType::kHandshakeStart);
+    second.Record(i, FlightEventType::kHandshakeStart);
+  }
+
+  for (const auto* recorder : {&first, &second}) {
+    const auto dumped = ParseDump(Dump(*recorder));
+    ASSERT_EQ(dumped.size(), 1);
+    EXPECT_EQ(dumped[0].events.size(), 3);
+  }
+}
+
+TEST(FlightRecorderTest, DumpsWhileRecording) {
+  FlightRecorder recorder{64};
+  std::atomic_bool stop{false};
+  std::thread writer{[&] {
+    for (uint64_t i = 0; !stop.load(); ++i) {
+      recorder.Record(i, FlightEventType::kTcpRelayWrite, 0, i);
+    }
+  }};
+  for (size_t i = 0; i < 100; ++i) {
+    for (const auto& thread : ParseDump(Dump(recorder))) {
+      EXPECT_LE(thread.events.size(), 64);
+      for (size_t j = 1; j < thread.events.size(); ++j) {
+        EXPECT_EQ(thread.events[j].session_id,
+                  thread.events[j - 1].session_id + 1);
+      }
+    }
+  }
+  stop = true;
+  writer.join();
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <server/flow_recorder.hpp>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace socks5::server {
+
+namespace {
+
+FlowRecord MakeRecord(uint64_t session_id) {
+  FlowRecord record;
+  record.session_id = session_id;
+  record.command = SessionCommand::kConnect;
+  record.close_reason = CloseReason::kClientClosed;
+  return record;
+}
+
+}  // namespace
+
+TEST(FlowRecorderTest, DisabledWithoutCallback) {
+  FlowRecorder recorder{FlowRecordCb{}};
+  EXPECT_FALSE(recorder.Enabled());
+  recorder.Push(MakeRecord(1));
+  recorder.Stop();
+  EXPECT_EQ(recorder.Dropped(), 0);
+}
+
+TEST(FlowRecorderTest, RecordsAreDeliveredFromAllThreads) {
+  std::mutex mtx;
+  std::vector<uint64_t> ids;
+  FlowRecorder recorder{[&](const FlowRecord& record) {
+    std::lock_guard lk{mtx};
+    ids.push_back(record.session_id);
+  }};
+  EXPECT_TRUE(recorder.Enabled());
+
+  std::vector<std::thread> threads;
+  for (uint64_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&recorder, t] {
+      for (uint64_t i = 0; i < 100; ++i) {
+        recorder.Push(MakeRecord(t * 100 + i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  recorder.Stop();
+
+  EXPECT_EQ(recorder.Dropped(), 0);
+  std::sort(ids.begin(), ids.end());
+  ASSERT_EQ(ids.size(), 400);
+  for (uint64_t i = 0; i < ids.size(); ++i) {
+    EXPECT_EQ(ids[i], i);
+  }
+}
+
+TEST(FlowRecorderTest, RecordsAreDroppedWhenQueueIsFull) {
+  std::mutex mtx;
+  std::unique_lock blocked{mtx};
+  size_t delivered{0};
+  FlowRecorder recorder{[&](const FlowRecord&) {
+                          std::lock_guard lk{mtx};
+                          ++delivered;
+                        },
+                        2};
+
+  // The collector thread is blocked on the first record, so the queue can hold
+  // at most 2 more records.
+  for (uint64_t i = 0; i < 10; ++i) {
+    recorder.Push(MakeRecord(i));
+  }
+  EXPECT_GE(recorder.Dropped(), 7);
+  blocked.unlock();
+  recorder.Stop();
+  EXPECT_EQ(delivered + recorder.Dropped(), 10);
+}
+
+}  // namespace socks5::server
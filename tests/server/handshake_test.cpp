@@ -179,6 +179,7 @@ class HandshakeTest : public ::testing::Test {
   tcp::acceptor connect_acceptor_;
   tcp::acceptor connect_acceptor_ipv6_;
   common::Metrics metrics_;
+  Session session_;
 };
 
 template <typename T>
@@ -215,7 +216,8 @@ TEST_F(HandshakeTest, FullSuccessfulIPv4Connect) {
     Config config{};
     Handshake handshake{
         conn, config,
-        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }}};
+        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }},
+        session_};
 
     RunAcceptor();
     auto handshake_future =
@@ -261,6 +263,98 @@ TEST_F(HandshakeTest, FullSuccessfulIPv4Connect) {
   EXPECT_TRUE(completed);
 }
 
+TEST_F(HandshakeTest, CompressedTunnelAccepted) {
+  ConnectClient();
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    auto conn = MakeConnection();
+    Config config{};
+    const auth::server::UserAuthCb user_auth_cb{
+        [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config, user_auth_cb, session_, nullptr, true};
+
+    RunAcceptor();
+    auto handshake_future =
+        asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
+
+    // METHODS=NO AUTH, NO AUTH + COMPRESSED TUNNEL
+    co_await WriteClientData({0x05, 0x02, 0x00, 0x80});
+    const auto server_choice = co_await ReadClientData(2);
+    EXPECT_EQ(server_choice, std::vector<uint8_t>({0x05, 0x80}));
+
+    std::vector<uint8_t> request{
+        0x05,             // VER
+        0x01,             // CMD=CONNECT
+        0x00,             // RSV
+        0x01,             // ATYP=IPv4
+        127,  0,   0, 1,  // ADDR=127.0.0.1
+        0x04, 0xD2        // PORT=1234
+    };
+    co_await WriteClientData(request);
+    const auto [err, reply] = co_await ReadReply();
+    CO_ASSERT_FALSE(err);
+    EXPECT_EQ(reply->rsv, 0);
+
+    co_await utils::Timeout(50);
+    auto result = handshake_future.get();
+    CO_ASSERT_TRUE(result.has_value());
+    CO_ASSERT_TRUE(std::holds_alternative<ConnectCmdResult>(result.value()));
+    EXPECT_TRUE(std::get<ConnectCmdResult>(*result).compressed_tunnel);
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
+TEST_F(HandshakeTest, CompressedTunnelRefused) {
+  ConnectClient();
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    auto conn = MakeConnection();
+    Config config{};
+    // The server doesn't support the compressed tunnel.
+    Handshake handshake{
+        conn, config,
+        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }},
+        session_};
+
+    RunAcceptor();
+    auto handshake_future =
+        asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
+
+    // METHODS=NO AUTH, NO AUTH + COMPRESSED TUNNEL
+    co_await WriteClientData({0x05, 0x02, 0x00, 0x80});
+    const auto server_choice = co_await ReadClientData(2);
+    EXPECT_EQ(server_choice, std::vector<uint8_t>({0x05, 0x00}));
+
+    std::vector<uint8_t> request{
+        0x05,             // VER
+        0x01,             // CMD=CONNECT
+        0x00,             // RSV
+        0x01,             // ATYP=IPv4
+        127,  0,   0, 1,  // ADDR=127.0.0.1
+        0x04, 0xD2        // PORT=1234
+    };
+    co_await WriteClientData(request);
+    const auto [err, reply] = co_await ReadReply();
+    CO_ASSERT_FALSE(err);
+    EXPECT_EQ(reply->rsv, 0);
+
+    co_await utils::Timeout(50);
+    auto result = handshake_future.get();
+    CO_ASSERT_TRUE(result.has_value());
+    CO_ASSERT_TRUE(std::holds_alternative<ConnectCmdResult>(result.value()));
+    EXPECT_FALSE(std::get<ConnectCmdResult>(*result).compressed_tunnel);
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
 TEST_F(HandshakeTest, FullSuccessfulIPv4UdpAssociate) {
   ConnectClient();
   bool completed{false};
@@ -269,7 +363,8 @@ TEST_F(HandshakeTest, FullSuccessfulIPv4UdpAssociate) {
     Config config{};
     Handshake handshake{
         conn, config,
-        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }}};
+        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }},
+        session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -323,7 +418,8 @@ TEST_F(HandshakeTest, FullSuccessfulIPv4Bind) {
     Config config{};
     Handshake handshake{
         conn, config,
-        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }}};
+        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }},
+        session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -388,7 +484,8 @@ TEST_F(HandshakeTest, AuthTimeout) {
     config.handshake_timeout = 1;
     Handshake handshake{
         conn, config,
-        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }}};
+        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }},
+        session_};
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
     co_await utils::Timeout(1100);
@@ -414,7 +511,7 @@ TEST_F(HandshakeTest, UserAuthSuccess) {
            const auth::server::Config&) {
           return username == "user" && pass == "pass";
         };
-    Handshake handshake{conn, config, user_auth_cb};
+    Handshake handshake{conn, config, user_auth_cb, session_};
 
     RunAcceptor();
     auto handshake_future =
@@ -482,7 +579,7 @@ TEST_F(HandshakeTest, UserAuthFailure) {
         [](std::string_view, std::string_view, const auth::server::Config&) {
           return false;
         };
-    Handshake handshake{conn, config, user_auth_cb};
+    Handshake handshake{conn, config, user_auth_cb, session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -521,7 +618,8 @@ TEST_F(HandshakeTest, UnsupportedCommand) {
   auto main = [&]() -> asio::awaitable<void> {
     auto conn = MakeConnection();
     Config config{};
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -566,7 +664,8 @@ TEST_F(HandshakeTest, InvalidVersion) {
   auto main = [&]() -> asio::awaitable<void> {
     auto conn = MakeConnection();
     Config config{};
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -592,7 +691,8 @@ TEST_F(HandshakeTest, IPv6AddressHandling) {
   auto main = [&]() -> asio::awaitable<void> {
     auto conn = MakeConnection();
     Config config{};
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     RunIPv6Acceptor();
     auto handshake_future =
@@ -646,7 +746,8 @@ TEST_F(HandshakeTest, DomainNameHandling) {
   auto main = [&]() -> asio::awaitable<void> {
     auto conn = MakeConnection();
     Config config{};
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     RunAcceptor();
     auto handshake_future =
@@ -699,7 +800,8 @@ TEST_F(HandshakeTest, BindIPv4ValidationSuccess) {
     auto conn = MakeConnection();
     Config config{};
     config.bind_validate_accepted_conn = true;
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -765,7 +867,8 @@ TEST_F(HandshakeTest, BindIPv4ValidationFaliure) {
     auto conn = MakeConnection();
     Config config{};
     config.bind_validate_accepted_conn = true;
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -820,7 +923,8 @@ TEST_F(HandshakeTest, BindDomainValidationSuccess) {
     auto conn = MakeConnection();
     Config config{};
     config.bind_validate_accepted_conn = true;
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -886,7 +990,8 @@ TEST_F(HandshakeTest, BindDomainValidationFailure) {
     auto conn = MakeConnection();
     Config config{};
     config.bind_validate_accepted_conn = true;
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -941,7 +1046,8 @@ TEST_F(HandshakeTest, BindIPv6ValidationSuccess) {
     auto conn = MakeConnection();
     Config config{};
     config.bind_validate_accepted_conn = true;
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -1009,7 +1115,8 @@ TEST_F(HandshakeTest, BindIPv6ValidationFailure) {
     auto conn = MakeConnection();
     Config config{};
     config.bind_validate_accepted_conn = true;
-    Handshake handshake{conn, config, [](auto, auto, auto) { return true; }};
+    Handshake handshake{conn, config,
+                        [](auto, auto, auto) { return true; }, session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -1068,7 +1175,8 @@ TEST_F(HandshakeTest, ProcessRequestTimeout) {
     config.handshake_timeout = 1;
     Handshake handshake{
         conn, config,
-        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }}};
+        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }},
+        session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
@@ -1099,7 +1207,8 @@ TEST_F(HandshakeTest, ConnectToUnreachableTarget) {
     config.handshake_timeout = 1;
     Handshake handshake{
         conn, config,
-        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }}};
+        auth::server::UserAuthCb{[](auto, auto, auto) { return true; }},
+        session_};
 
     auto handshake_future =
         asio::co_spawn(io_context_, handshake.Run(), asio::use_future);
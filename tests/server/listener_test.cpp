@@ -26,7 +26,8 @@ class MockProxy final {
             common::Metrics& metrics,
             const auth::server::UserAuthCb& user_auth_cb,
             const TcpRelayDataProcessor& tcp_data_processor,
-            const UdpRelayDataProcessor& udp_data_processor) noexcept {}
+            const UdpRelayDataProcessor& udp_data_processor,
+            ServerContext& context) noexcept {}
 
   VoidAwait Run() noexcept {
     proxy_started = true;
@@ -49,10 +50,12 @@ TEST_F(ListenerTest, AcceptConnect) {
     auth::server::UserAuthCb user_auth_cb;
     auto tcp_data_processor = MakeDefaultTcpRelayDataProcessor();
     auto udp_data_processor = MakeDefaultUdpRelayDataProcessor();
+    ServerContext context;
 
     auto listener = std::make_shared<Listener<MockProxy>>(
         io_context, endpoint, test_tcp_relay_handler, test_udp_relay_handler,
-        config, metrics, user_auth_cb, tcp_data_processor, udp_data_processor);
+        config, metrics, user_auth_cb, tcp_data_processor, udp_data_processor,
+        context);
     listener->Run();
 
     tcp::socket client_socket{io_context};
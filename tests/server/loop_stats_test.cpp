@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <server/loop_stats.hpp>
+#include <thread>
+#include <vector>
+
+namespace socks5::server {
+
+namespace {
+
+class LoopStatsTest : public ::testing::Test {
+ protected:
+  asio::io_context io_context_;
+};
+
+}  // namespace
+
+TEST_F(LoopStatsTest, CountsHandlersPerThread) {
+  LoopStats loop_stats{2, true};
+  constexpr size_t kHandlersNum{100};
+  for (size_t i = 0; i < kHandlersNum; ++i) {
+    asio::post(io_context_, [] {});
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 2; ++i) {
+    threads.emplace_back([&] { loop_stats.RunThread(io_context_); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const auto stats = loop_stats.Get();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_EQ(stats[0].handlers_total + stats[1].handlers_total, kHandlersNum);
+}
+
+TEST_F(LoopStatsTest, MeasuresSchedulingDelay) {
+  LoopStats loop_stats{1, true};
+  loop_stats.StartLagProbes(io_context_, std::chrono::milliseconds{10});
+  asio::steady_timer stop_timer{io_context_, std::chrono::milliseconds{200}};
+  stop_timer.async_wait([&](auto) { io_context_.stop(); });
+
+  loop_stats.RunThread(io_context_);
+
+  const auto stats = loop_stats.Get();
+  ASSERT_EQ(stats.size(), 1);
+  EXPECT_GT(stats[0].lag_samples_total, 0);
+  EXPECT_GE(stats[0].max_lag, stats[0].last_lag);
+  EXPECT_GE(stats[0].lag_total, stats[0].max_lag);
+  EXPECT_GT(stats[0].handlers_total, stats[0].lag_samples_total);
+}
+
+TEST_F(LoopStatsTest, CountsBlockingHandlerAsBusy) {
+  LoopStats loop_stats{1, true};
+  constexpr std::chrono::milliseconds kBlockTime{50};
+  asio::post(io_context_, [&] { std::this_thread::sleep_for(kBlockTime); });
+
+  loop_stats.RunThread(io_context_);
+
+  const auto stats = loop_stats.Get();
+  EXPECT_GE(stats[0].busy_time, kBlockTime);
+}
+
+TEST_F(LoopStatsTest, CountsLiveSessionsOfWorkerThreads) {
+  LoopStats loop_stats{1};
+  EXPECT_EQ(loop_stats.SessionStarted(), LoopStats::kNoThread);
+
+  size_t thread_index{LoopStats::kNoThread};
+  asio::post(io_context_,
+             [&] { thread_index = loop_stats.SessionStarted(); });
+  loop_stats.RunThread(io_context_);
+  EXPECT_EQ(thread_index, 0);
+  EXPECT_EQ(loop_stats.Get()[0].live_sessions, 1);
+
+  loop_stats.SessionFinished(thread_index);
+  EXPECT_EQ(loop_stats.Get()[0].live_sessions, 0);
+}
+
+TEST_F(LoopStatsTest, SkipsHandlersIfNotCounted) {
+  LoopStats loop_stats{1};
+  loop_stats.StartLagProbes(io_context_, std::chrono::milliseconds{10});
+  asio::steady_timer stop_timer{io_context_, std::chrono::milliseconds{100}};
+  stop_timer.async_wait([&](auto) { io_context_.stop(); });
+
+  loop_stats.RunThread(io_context_);
+
+  const auto stats = loop_stats.Get();
+  EXPECT_GT(stats[0].lag_samples_total, 0);
+  EXPECT_EQ(stats[0].handlers_total, 0);
+  EXPECT_EQ(stats[0].busy_time.count(), 0);
+  EXPECT_EQ(stats[0].idle_time.count(), 0);
+}
+
+TEST_F(LoopStatsTest, Reset) {
+  LoopStats loop_stats{1, true};
+  asio::post(io_context_, [] {});
+  loop_stats.RunThread(io_context_);
+  EXPECT_EQ(loop_stats.Get()[0].handlers_total, 1);
+
+  loop_stats.Reset();
+  EXPECT_EQ(loop_stats.Get()[0].handlers_total, 0);
+}
+
+}  // namespace socks5::server
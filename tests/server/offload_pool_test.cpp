@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <server/offload_pool.hpp>
+#include <socks5/common/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+namespace socks5::server {
+
+TEST(OffloadPoolTest, ThrowIfNoThreads) {
+  ASSERT_THROW((OffloadPool{0, 1024, {}}), std::runtime_error);
+}
+
+TEST(OffloadPoolTest, RunOnPoolThread) {
+  asio::io_context io_context;
+  OffloadPool pool{2, 1024, {}};
+  const auto io_thread_id = std::this_thread::get_id();
+  bool completed{false};
+  auto main = [&]() -> VoidAwait {
+    std::thread::id fn_thread_id;
+    const auto fn = [&] { fn_thread_id = std::this_thread::get_id(); };
+    co_await pool.Run(16, fn);
+    EXPECT_NE(fn_thread_id, io_thread_id);
+    EXPECT_EQ(std::this_thread::get_id(), io_thread_id);
+    EXPECT_EQ(pool.InflightBytes(), 0);
+    completed = true;
+  };
+  asio::co_spawn(io_context, main, asio::detached);
+  io_context.run_for(std::chrono::seconds{5});
+  ASSERT_TRUE(completed);
+}
+
+TEST(OffloadPoolTest, RethrowException) {
+  asio::io_context io_context;
+  OffloadPool pool{1, 1024, {}};
+  bool completed{false};
+  auto main = [&]() -> VoidAwait {
+    const auto fn = [] { throw std::runtime_error{"error"}; };
+    EXPECT_THROW(co_await pool.Run(16, fn), std::runtime_error);
+    EXPECT_EQ(pool.InflightBytes(), 0);
+    completed = true;
+  };
+  asio::co_spawn(io_context, main, asio::detached);
+  io_context.run_for(std::chrono::seconds{5});
+  ASSERT_TRUE(completed);
+}
+
+TEST(OffloadPoolTest, BoundInflightBytes) {
+  asio::io_context io_context;
+  OffloadPool pool{2, 100, {}};
+  std::promise<void> release;
+  const auto released = release.get_future().share();
+  std::atomic<bool> first_started{false};
+  std::atomic<bool> second_started{false};
+  int completed{0};
+
+  auto first = [&]() -> VoidAwait {
+    const auto fn = [&] {
+      first_started = true;
+      released.wait();
+    };
+    co_await pool.Run(80, fn);
+    ++completed;
+  };
+  auto second = [&]() -> VoidAwait {
+    const auto fn = [&] { second_started = true; };
+    co_await pool.Run(80, fn);
+    ++completed;
+  };
+  auto check = [&]() -> VoidAwait {
+    asio::steady_timer timer{io_context};
+    while (!first_started) {
+      timer.expires_after(std::chrono::milliseconds{1});
+      co_await timer.async_wait(asio::use_awaitable);
+    }
+    timer.expires_after(std::chrono::milliseconds{50});
+    co_await timer.async_wait(asio::use_awaitable);
+    // The second chunk waits for the first one, the pool thread is free.
+    EXPECT_FALSE(second_started);
+    EXPECT_EQ(pool.InflightBytes(), 80);
+    release.set_value();
+  };
+
+  asio::co_spawn(io_context, first, asio::detached);
+  asio::co_spawn(io_context, second, asio::detached);
+  asio::co_spawn(io_context, check, asio::detached);
+  while (completed < 2 && io_context.run_one_for(std::chrono::seconds{5})) {
+  }
+  ASSERT_EQ(completed, 2);
+  ASSERT_TRUE(second_started);
+  ASSERT_EQ(pool.InflightBytes(), 0);
+}
+
+TEST(OffloadPoolTest, RunChunkBiggerThanLimit) {
+  asio::io_context io_context;
+  OffloadPool pool{1, 10, {}};
+  bool completed{false};
+  auto main = [&]() -> VoidAwait {
+    bool called{false};
+    const auto fn = [&] { called = true; };
+    co_await pool.Run(1000, fn);
+    EXPECT_TRUE(called);
+    completed = true;
+  };
+  asio::co_spawn(io_context, main, asio::detached);
+  io_context.run_for(std::chrono::seconds{5});
+  ASSERT_TRUE(completed);
+}
+
+}  // namespace socks5::server
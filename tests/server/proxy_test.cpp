@@ -10,7 +10,9 @@ class MockHandshakeConnectCmd final {
  public:
   MockHandshakeConnectCmd(
       net::TcpConnection& connect, const Config& config,
-      const auth::server::UserAuthCb& user_auth_cb) noexcept {}
+      const auth::server::UserAuthCb& user_auth_cb, Session& session,
+      const SharedUdpRelay* shared_udp_relay = nullptr,
+      bool compressed_tunnel = false) noexcept {}
 
   HandshakeResultOptAwait Run() noexcept {
     co_return ConnectCmdResult{tcp::socket{io_context_}};
@@ -22,8 +24,11 @@ class MockHandshakeConnectCmd final {
 
 class MockHandshakeBindCmd final {
  public:
-  MockHandshakeBindCmd(net::TcpConnection& connect, const Config& config,
-                       const auth::server::UserAuthCb& user_auth_cb) noexcept {}
+  MockHandshakeBindCmd(
+      net::TcpConnection& connect, const Config& config,
+      const auth::server::UserAuthCb& user_auth_cb, Session& session,
+      const SharedUdpRelay* shared_udp_relay = nullptr,
+      bool compressed_tunnel = false) noexcept {}
 
   HandshakeResultOptAwait Run() noexcept {
     co_return BindCmdResult{tcp::socket{io_context_}};
@@ -37,7 +42,9 @@ class MockHandshakeUdpAssociateCmd final {
  public:
   MockHandshakeUdpAssociateCmd(
       net::TcpConnection& connect, const Config& config,
-      const auth::server::UserAuthCb& user_auth_cb) noexcept {}
+      const auth::server::UserAuthCb& user_auth_cb, Session& session,
+      const SharedUdpRelay* shared_udp_relay = nullptr,
+      bool compressed_tunnel = false) noexcept {}
 
   HandshakeResultOptAwait Run() noexcept {
     co_return UdpAssociateCmdResult{udp::socket{io_context_}, proto::Addr{}};
@@ -49,8 +56,11 @@ class MockHandshakeUdpAssociateCmd final {
 
 class MockHandshakeNullopt final {
  public:
-  MockHandshakeNullopt(net::TcpConnection& connect, const Config& config,
-                       const auth::server::UserAuthCb& user_auth_cb) noexcept {}
+  MockHandshakeNullopt(
+      net::TcpConnection& connect, const Config& config,
+      const auth::server::UserAuthCb& user_auth_cb, Session& session,
+      const SharedUdpRelay* shared_udp_relay = nullptr,
+      bool compressed_tunnel = false) noexcept {}
 
   HandshakeResultOptAwait Run() noexcept { co_return std::nullopt; }
 
@@ -70,7 +80,8 @@ class MockTcpRelay final {
   MockTcpRelay(asio::io_context& io_context, net::TcpConnection client,
                net::TcpConnection server, const RelayHandler& handler,
                const Config& config, common::Metrics& metrics,
-               const TcpRelayDataProcessor& tcp_data_processor) noexcept {}
+               const TcpRelayDataProcessor& tcp_data_processor,
+               Session& session) noexcept {}
 
   VoidAwait Run() noexcept {
     tcp_relay_called = true;
@@ -88,7 +99,8 @@ class MockUdpRelay final {
                net::UdpConnection proxy, proto::Addr client_addr,
                const RelayHandler& handler, const Config& config,
                common::Metrics& metrics,
-               const UdpRelayDataProcessor& udp_data_processor) noexcept {}
+               const UdpRelayDataProcessor& udp_data_processor,
+               Session& session) noexcept {}
 
   VoidAwait Run() noexcept {
     udp_relay_called = true;
@@ -115,6 +127,7 @@ class ProxyTest : public testing::Test {
   UdpRelayDataProcessor udp_data_processor_;
   MockTcpRelayHandler tcp_relay_handler_;
   MockUdpRelayHandler udp_relay_handler_;
+  ServerContext context_;
 };
 
 }  // namespace
@@ -131,7 +144,8 @@ TEST_F(ProxyTest, ProcessConnectCmd) {
         metrics_,
         user_auth_cb_,
         tcp_data_processor_,
-        udp_data_processor_};
+        udp_data_processor_,
+        context_};
 
     co_await proxy.Run();
     EXPECT_TRUE(tcp_relay_called);
@@ -158,7 +172,8 @@ TEST_F(ProxyTest, ProcessBindCmd) {
         metrics_,
         user_auth_cb_,
         tcp_data_processor_,
-        udp_data_processor_};
+        udp_data_processor_,
+        context_};
 
     co_await proxy.Run();
     EXPECT_TRUE(udp_relay_called);
@@ -185,7 +200,8 @@ TEST_F(ProxyTest, ProcessUdpAssociateCmd) {
         metrics_,
         user_auth_cb_,
         tcp_data_processor_,
-        udp_data_processor_};
+        udp_data_processor_,
+        context_};
 
     co_await proxy.Run();
     EXPECT_TRUE(tcp_relay_called);
@@ -212,7 +228,8 @@ TEST_F(ProxyTest, ProcessNullopt) {
         metrics_,
         user_auth_cb_,
         tcp_data_processor_,
-        udp_data_processor_};
+        udp_data_processor_,
+        context_};
 
     co_await proxy.Run();
     EXPECT_FALSE(tcp_relay_called);
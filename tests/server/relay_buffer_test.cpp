@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <socks5/server/relay_data_processor_defs.hpp>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+namespace socks5::server {
+
+namespace {
+
+class RelayBufferTest : public testing::Test {
+ protected:
+  RelayBufferTest() { std::memcpy(storage_.data() + 4, "data", 4); }
+
+  std::string_view View() const {
+    return std::string_view{buf_.Data(), buf_.Size()};
+  }
+
+  std::array<char, 12> storage_{};
+  RelayBuffer buf_{storage_.data(), storage_.data() + storage_.size(),
+                   storage_.data() + 4, 4};
+};
+
+}  // namespace
+
+TEST_F(RelayBufferTest, Rooms) {
+  ASSERT_EQ(View(), "data");
+  ASSERT_EQ(buf_.Headroom(), 4);
+  ASSERT_EQ(buf_.Tailroom(), 4);
+}
+
+TEST_F(RelayBufferTest, RewriteInPlace) {
+  for (size_t i = 0; i < buf_.Size(); ++i) {
+    buf_.Data()[i] ^= 0x20;
+  }
+  ASSERT_EQ(View(), "DATA");
+  ASSERT_EQ(buf_.Data(), storage_.data() + 4);
+}
+
+TEST_F(RelayBufferTest, PrependAndAppend) {
+  std::memcpy(buf_.Prepend(2), "<<", 2);
+  std::memcpy(buf_.Append(3), ">>>", 3);
+  ASSERT_EQ(View(), "<<data>>>");
+  ASSERT_EQ(buf_.Headroom(), 2);
+  ASSERT_EQ(buf_.Tailroom(), 1);
+  ASSERT_THROW(buf_.Prepend(3), std::length_error);
+  ASSERT_THROW(buf_.Append(2), std::length_error);
+  ASSERT_EQ(View(), "<<data>>>");
+}
+
+TEST_F(RelayBufferTest, Trim) {
+  buf_.TrimFront(1);
+  buf_.TrimBack(1);
+  ASSERT_EQ(View(), "at");
+  ASSERT_EQ(buf_.Headroom(), 5);
+  ASSERT_EQ(buf_.Tailroom(), 5);
+  ASSERT_THROW(buf_.TrimFront(3), std::out_of_range);
+  ASSERT_THROW(buf_.TrimBack(3), std::out_of_range);
+  buf_.TrimBack(2);
+  ASSERT_EQ(buf_.Size(), 0);
+  ASSERT_EQ(buf_.Tailroom(), 7);
+}
+
+TEST_F(RelayBufferTest, Detach) {
+  ASSERT_FALSE(buf_.Detached());
+  buf_.Detach();
+  ASSERT_TRUE(buf_.Detached());
+  ASSERT_EQ(View(), "data");
+}
+
+}  // namespace socks5::server
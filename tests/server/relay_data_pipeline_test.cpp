@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <socks5/server/relay_data_pipeline.hpp>
+#include <socks5/common/asio.hpp>
+#include <array>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace socks5::server {
+
+namespace {
+
+class RelayDataPipelineTest : public testing::Test {
+ protected:
+  RelayBuffer Load(std::string_view data) {
+    std::memcpy(storage_.data() + 8, data.data(), data.size());
+    return RelayBuffer{storage_.data(), storage_.data() + storage_.size(),
+                       storage_.data() + 8, data.size()};
+  }
+
+  static std::string_view View(const RelayBuffer& buf) {
+    return std::string_view{buf.Data(), buf.Size()};
+  }
+
+  std::array<char, 64> storage_{};
+};
+
+char ToUpper(char c) { return c >= 'a' && c <= 'z' ? c - 32 : c; }
+
+}  // namespace
+
+TEST_F(RelayDataPipelineTest, RunStagesInOrder) {
+  std::string stages;
+  auto pipeline = RelayPipeline<>{}
+                      .Then([&](RelayBuffer& buf) {
+                        stages += '1';
+                        std::memcpy(buf.Prepend(4), "hdr:", 4);
+                      })
+                      .Then([&](RelayBuffer& buf) {
+                        stages += '2';
+                        std::memcpy(buf.Append(4), ":end", 4);
+                      });
+  static_assert(decltype(pipeline)::kStagesNum == 2);
+  auto buf = Load("data");
+  pipeline(buf);
+  ASSERT_EQ(stages, "12");
+  ASSERT_EQ(View(buf), "hdr:data:end");
+}
+
+TEST_F(RelayDataPipelineTest, FuseByteMaps) {
+  size_t inspected{0};
+  const auto leet = [](char c) { return c == 'A' ? '4' : c == 'T' ? '7' : c; };
+  const auto lower_d = [](char c) { return c == 'D' ? 'd' : c; };
+  auto pipeline = RelayPipeline<>{}
+                      .Then(MapBytes(ToUpper))
+                      .Then(MapBytes(leet))
+                      .Then(Inspect([&](const char*, size_t size) {
+                        inspected += size;
+                      }))
+                      .Then(MapBytes(lower_d));
+  static_assert(decltype(pipeline)::kStagesNum == 3);
+  auto buf = Load("data");
+  pipeline(buf);
+  ASSERT_EQ(View(buf), "d474");
+  ASSERT_EQ(inspected, 4);
+}
+
+TEST_F(RelayDataPipelineTest, StopOnFilteredData) {
+  bool called{false};
+  auto pipeline = RelayPipeline<>{}
+                      .Then([](RelayBuffer& buf) {
+                        if (View(buf) == "drop") {
+                          buf.TrimBack(buf.Size());
+                        }
+                      })
+                      .Then([&](RelayBuffer&) { called = true; });
+  auto buf = Load("drop");
+  pipeline(buf);
+  ASSERT_EQ(buf.Size(), 0);
+  ASSERT_FALSE(called);
+
+  buf = Load("keep");
+  pipeline(buf);
+  ASSERT_EQ(View(buf), "keep");
+  ASSERT_TRUE(called);
+}
+
+TEST_F(RelayDataPipelineTest, MakeTcpRelayPipelineProcessor) {
+  const tcp::endpoint ep{asio::ip::make_address("127.0.0.1"), 1080};
+  const auto processor = MakeTcpRelayPipelineProcessor(
+      [](const tcp::endpoint&, const tcp::endpoint&) {
+        return RelayPipeline<>{}.Then(MapBytes(ToUpper));
+      },
+      [](const tcp::endpoint&, const tcp::endpoint&) {
+        return RelayPipeline<>{}.Then(
+            [](RelayBuffer& buf) { buf.TrimFront(1); });
+      });
+  ASSERT_FALSE(processor.client_to_server);
+  ASSERT_FALSE(processor.server_to_client);
+
+  auto client_to_server = processor.client_to_server_in_place(ep, ep);
+  auto buf = Load("data");
+  client_to_server(buf);
+  ASSERT_EQ(View(buf), "DATA");
+
+  auto server_to_client = processor.server_to_client_in_place(ep, ep);
+  buf = Load("data");
+  server_to_client(buf);
+  ASSERT_EQ(View(buf), "ata");
+}
+
+TEST_F(RelayDataPipelineTest, MakeUdpRelayPipelineProcessor) {
+  const udp::endpoint ep{asio::ip::make_address("127.0.0.1"), 1080};
+  const auto processor = MakeUdpRelayPipelineProcessor(
+      [](const udp::endpoint&) {
+        return RelayPipeline<>{}
+            .Then([](RelayBuffer& buf) {
+              if (View(buf) == "drop") {
+                buf.TrimBack(buf.Size());
+              }
+            })
+            .Then([](RelayBuffer& buf) {
+              std::memcpy(buf.Prepend(4), "hdr:", 4);
+            });
+      },
+      [](const udp::endpoint&, const udp::endpoint&) {
+        return RelayPipeline<>{}.Then(MapBytes(ToUpper));
+      });
+
+  std::vector<std::string> sent;
+  const RelayDataSender send = [&](const char* data, size_t size) {
+    sent.emplace_back(data, size);
+  };
+  auto client_to_server = processor.client_to_server(ep);
+  const std::string_view data{"data"};
+  client_to_server(data.data(), data.size(), ep, send);
+  const std::string_view drop{"drop"};
+  client_to_server(drop.data(), drop.size(), ep, send);
+  auto server_to_client = processor.server_to_client(ep, ep);
+  server_to_client(data.data(), data.size(), send);
+  ASSERT_EQ(sent, (std::vector<std::string>{"hdr:data", "DATA"}));
+  ASSERT_EQ(data, "data");
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include <socks5/server/relay_kernels.hpp>
+#include <algorithm>
+#include <array>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace socks5::server {
+
+namespace {
+
+std::string RandomData(size_t size, uint32_t seed) {
+  std::mt19937 gen{seed};
+  std::uniform_int_distribution<int> byte{0, 255};
+  std::string data(size, '\0');
+  for (auto& c : data) {
+    c = static_cast<char>(byte(gen));
+  }
+  return data;
+}
+
+// Sizes of the chunks a stream is split into, to cross the vector blocks at
+// different positions.
+constexpr std::array<size_t, 8> kChunkSizes{1, 7, 31, 32, 33, 64, 100, 1000};
+
+template <typename Kernel>
+void ProcessInChunks(Kernel& kernel, std::string& data) {
+  size_t pos = 0;
+  for (size_t i = 0; pos < data.size(); ++i) {
+    const auto size =
+        std::min(kChunkSizes[i % kChunkSizes.size()], data.size() - pos);
+    kernel.Process(data.data() + pos, size);
+    pos += size;
+  }
+}
+
+template <typename Kernel>
+void UpdateInChunks(Kernel& kernel, std::string_view data) {
+  size_t pos = 0;
+  for (size_t i = 0; pos < data.size(); ++i) {
+    const auto size =
+        std::min(kChunkSizes[i % kChunkSizes.size()], data.size() - pos);
+    kernel.Update(data.data() + pos, size);
+    pos += size;
+  }
+}
+
+RelayBuffer MakeRelayBuffer(std::string& storage) {
+  return RelayBuffer{storage.data(), storage.data() + storage.size(),
+                     storage.data(), storage.size()};
+}
+
+}  // namespace
+
+TEST(RelayKernelsTest, XorStream) {
+  ASSERT_THROW(XorStream{""}, std::invalid_argument);
+  const auto data = RandomData(10000, 1);
+  for (const size_t key_size : {1, 3, 32, 37, 100}) {
+    const auto key = RandomData(key_size, 2);
+    auto expected = data;
+    for (size_t i = 0; i < expected.size(); ++i) {
+      expected[i] ^= key[i % key.size()];
+    }
+    XorStream xor_stream{key};
+    auto processed = data;
+    ProcessInChunks(xor_stream, processed);
+    ASSERT_EQ(processed, expected) << "key size " << key_size;
+
+    XorStream restore{key};
+    restore.Process(processed.data(), processed.size());
+    ASSERT_EQ(processed, data) << "key size " << key_size;
+  }
+}
+
+TEST(RelayKernelsTest, ByteTranslator) {
+  ByteTranslator::Table table;
+  for (size_t byte = 0; byte < table.size(); ++byte) {
+    table[byte] = static_cast<uint8_t>(byte * 7 + 3);
+  }
+  const ByteTranslator translator{table};
+  auto data = RandomData(10000, 3);
+  for (size_t byte = 0; byte < table.size(); ++byte) {
+    data[byte] = static_cast<char>(byte);
+  }
+  auto expected = data;
+  for (auto& c : expected) {
+    c = static_cast<char>(table[static_cast<uint8_t>(c)]);
+  }
+  ProcessInChunks(translator, data);
+  ASSERT_EQ(data, expected);
+}
+
+TEST(RelayKernelsTest, DelimiterScanner) {
+  std::string data(5000, 'a');
+  std::vector<uint64_t> expected;
+  for (size_t pos = 3; pos < data.size(); pos += 97) {
+    data[pos] = pos % 2 ? '\n' : '\0';
+    expected.push_back(pos);
+  }
+  std::vector<uint64_t> offsets;
+  DelimiterScanner scanner{std::string_view{"\n\0", 2},
+                           [&](uint64_t offset) { offsets.push_back(offset); }};
+  ASSERT_EQ(scanner.Find(data.data(), data.data() + data.size()),
+            data.data() + 3);
+  UpdateInChunks(scanner, data);
+  ASSERT_EQ(offsets, expected);
+  ASSERT_EQ(scanner.Count(), expected.size());
+  ASSERT_EQ(scanner.Offset(), data.size());
+}
+
+TEST(RelayKernelsTest, Crc32c) {
+  Crc32c crc;
+  ASSERT_EQ(crc.Value(), 0);
+  crc.Update("123456789", 9);
+  ASSERT_EQ(crc.Value(), 0xe3069283);
+
+  const auto data = RandomData(10000, 4);
+  crc.Reset();
+  crc.Update(data.data(), data.size());
+  Crc32c chunked;
+  UpdateInChunks(chunked, data);
+  ASSERT_EQ(chunked.Value(), crc.Value());
+}
+
+TEST(RelayKernelsTest, XxHash64) {
+  const auto hash = [](std::string_view data, uint64_t seed) {
+    XxHash64 xxhash{seed};
+    xxhash.Update(data.data(), data.size());
+    return xxhash.Value();
+  };
+  std::string bytes;
+  for (int i = 0; i < 1024; ++i) {
+    bytes.push_back(static_cast<char>(i));
+  }
+  const std::string_view long_input{
+      "Nobody inspects the spammish repetition"};
+  ASSERT_EQ(hash("", 0), 0xef46db3751d8e999);
+  ASSERT_EQ(hash("", 7), 0x95f0626f6f0a4409);
+  ASSERT_EQ(hash("abc", 0), 0x44bc2cf5ad770999);
+  ASSERT_EQ(hash("abc", 7), 0x9e755206156676d7);
+  ASSERT_EQ(hash(long_input, 0), 0xfbcea83c8a378bf1);
+  ASSERT_EQ(hash(long_input, 7), 0x26f1aeb39b9b1f5f);
+  ASSERT_EQ(hash(bytes, 0), 0x6f3914f18fe4df57);
+  ASSERT_EQ(hash(bytes, 7), 0xb13d05f16dbde3ea);
+
+  XxHash64 chunked{7};
+  UpdateInChunks(chunked, bytes);
+  ASSERT_EQ(chunked.Value(), 0xb13d05f16dbde3ea);
+  chunked.Reset();
+  chunked.Update(long_input.data(), long_input.size());
+  ASSERT_EQ(chunked.Value(), 0x26f1aeb39b9b1f5f);
+}
+
+TEST(RelayKernelsTest, ProcessorCallShapes) {
+  const udp::endpoint ep{asio::ip::make_address("127.0.0.1"), 1080};
+  std::vector<std::string> sent;
+  const RelayDataSender send = [&](const char* data, size_t size) {
+    sent.emplace_back(data, size);
+  };
+
+  XorStream xor_stream{"k"};
+  std::string storage{"ab"};
+  auto buf = MakeRelayBuffer(storage);
+  xor_stream(buf);
+  ASSERT_EQ(storage, (std::string{'a' ^ 'k', 'b' ^ 'k'}));
+  xor_stream(storage.data(), storage.size(), send);
+  ASSERT_EQ(sent, std::vector<std::string>{"ab"});
+
+  // Every datagram is XORed from the start of the key.
+  sent.clear();
+  XorStream datagrams{"xy"};
+  datagrams("a", 1, ep, send);
+  datagrams("a", 1, ep, send);
+  ASSERT_EQ(sent, (std::vector<std::string>{{'a' ^ 'x'}, {'a' ^ 'x'}}));
+
+  sent.clear();
+  Crc32c crc;
+  crc("1234", 4, send);
+  crc("56789", 5, ep, send);
+  ASSERT_EQ(sent, (std::vector<std::string>{"1234", "56789"}));
+  ASSERT_EQ(crc.Value(), 0xe3069283);
+}
+
+}  // namespace socks5::server
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <server/server_context.hpp>
+#include <server/session.hpp>
+#include <optional>
+
+namespace socks5::server {
+
+namespace {
+
+class SessionRegistryTest : public ::testing::Test {
+ protected:
+  asio::io_context io_context_;
+  ServerContext context_;
+};
+
+}  // namespace
+
+TEST_F(SessionRegistryTest, ListsLiveSessions) {
+  tcp::socket first_socket{io_context_};
+  Session first{context_, first_socket};
+  first.SetUser("user");
+  first.SetState(SessionState::kTcpRelay);
+  first.AddRelayedBytes(Session::Direction::kClientToTarget, 10);
+  {
+    tcp::socket second_socket{io_context_};
+    Session second{context_, second_socket};
+    EXPECT_EQ(context_.GetSessionRegistry().Snapshot().size(), 2);
+  }
+
+  const auto sessions = context_.GetSessionRegistry().Snapshot();
+  ASSERT_EQ(sessions.size(), 1);
+  EXPECT_EQ(sessions[0].session_id, first.Id());
+  EXPECT_EQ(sessions[0].user, "user");
+  EXPECT_EQ(sessions[0].state, SessionState::kTcpRelay);
+  EXPECT_EQ(sessions[0].bytes_from_client, 10);
+  EXPECT_EQ(sessions[0].bytes_from_target, 0);
+  EXPECT_TRUE(sessions[0].killable);
+}
+
+TEST_F(SessionRegistryTest, KillsSelectedSessions) {
+  tcp::acceptor acceptor{io_context_,
+                         tcp::endpoint{asio::ip::make_address("127.0.0.1"), 0}};
+  tcp::socket client{io_context_};
+  client.connect(acceptor.local_endpoint());
+  auto accepted = acceptor.accept();
+  Session killed{context_, accepted};
+  tcp::socket other_socket{io_context_};
+  Session other{context_, other_socket};
+
+  const auto requested = context_.GetSessionRegistry().Kill(
+      [&](const SessionInfo& info) { return info.session_id == killed.Id(); });
+  EXPECT_EQ(requested, 1);
+  io_context_.run();
+
+  EXPECT_TRUE(killed.Killed());
+  EXPECT_FALSE(other.Killed());
+  char byte{};
+  boost::system::error_code err;
+  client.read_some(asio::buffer(&byte, 1), err);
+  EXPECT_EQ(err, asio::error::eof);
+}
+
+TEST_F(SessionRegistryTest, SkipsNotKillableSessions) {
+  tcp::socket socket{io_context_};
+  Session session{context_, socket};
+  session.SetKillable(false);
+
+  EXPECT_EQ(context_.GetSessionRegistry().Kill(
+                [](const SessionInfo&) { return true; }),
+            0);
+  io_context_.run();
+  EXPECT_FALSE(session.Killed());
+  EXPECT_FALSE(context_.GetSessionRegistry().Snapshot()[0].killable);
+}
+
+TEST_F(SessionRegistryTest, IgnoresKillOfFinishedSession) {
+  tcp::socket socket{io_context_};
+  std::optional<Session> session;
+  session.emplace(context_, socket);
+
+  EXPECT_EQ(context_.GetSessionRegistry().Kill(
+                [](const SessionInfo&) { return true; }),
+            1);
+  session.reset();
+  io_context_.run();
+  EXPECT_TRUE(context_.GetSessionRegistry().Snapshot().empty());
+}
+
+}  // namespace socks5::server
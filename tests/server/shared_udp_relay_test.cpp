@@ -0,0 +1,249 @@
+#include <gtest/gtest.h>
+#include <server/shared_udp_relay.hpp>
+#include <socks5/server/config.hpp>
+#include <net/tcp_connection.hpp>
+#include <net/utils.hpp>
+#include <socks5/common/asio.hpp>
+#include <socks5/common/metrics.hpp>
+#include <common/proto_builders.hpp>
+#include <serializers/serializers.hpp>
+#include <common/socks5_datagram_io.hpp>
+#include <socks5/utils/buffer.hpp>
+#include <parsers/parsers.hpp>
+#include <array>
+#include <chrono>
+#include <list>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace socks5::server {
+
+namespace {
+
+class SharedUdpRelayTest : public testing::Test {
+ protected:
+  SharedUdpRelayTest()
+      : tcp_acceptor_{io_context_},
+        server_udp_socket_{
+            io_context_,
+            udp::endpoint{asio::ip::address::from_string("127.0.0.1"), 0}} {
+    tcp_acceptor_.open(tcp::v4());
+    tcp_acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    tcp_acceptor_.bind(tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+    tcp_acceptor_.listen();
+    server_udp_socket_ep_ = server_udp_socket_.local_endpoint();
+    server_udp_socket_addr_buf_ = serializers::Serialize(common::MakeAddr(
+        server_udp_socket_ep_.address(), server_udp_socket_ep_.port()));
+    config_.listener_addr = {"127.0.0.1", 0};
+    config_.threads_num = 2;
+    config_.udp_shared_relay = true;
+    relay_ = std::make_shared<SharedUdpRelay>(io_context_, config_, metrics_);
+  }
+
+  // Returns the proxy side of a new client tcp connection. The client side is
+  // kept open until the test ends.
+  tcp::socket MakeControlConnection() {
+    auto& client = client_tcp_sockets_.emplace_back(io_context_);
+    client.connect(tcp_acceptor_.local_endpoint());
+    return tcp_acceptor_.accept();
+  }
+
+  // Starts an association of the client udp socket. If expected_port is
+  // false, the association accepts datagrams from any port of the client.
+  void Associate(const udp::socket& client_udp_socket, bool expected_port,
+                 Session& session) {
+    const auto ep = client_udp_socket.local_endpoint();
+    asio::co_spawn(
+        io_context_,
+        relay_->Relay(
+            net::TcpConnection{MakeControlConnection(), metrics_},
+            common::MakeAddr(ep.address(), expected_port ? ep.port() : 0),
+            session),
+        asio::detached);
+  }
+
+  VoidAwait SendToTarget(udp::socket& client_udp_socket,
+                         std::string_view data) {
+    const auto buffs = common::MakeDatagramBuffs(
+        server_udp_socket_addr_buf_, data.data(), data.size());
+    co_await client_udp_socket.async_send_to(buffs, relay_->Endpoint(),
+                                             asio::use_awaitable);
+  }
+
+  asio::awaitable<std::pair<std::string, udp::endpoint>> ReceiveOnTarget() {
+    std::array<char, 1024> buf;
+    udp::endpoint sender_ep;
+    const auto size = co_await server_udp_socket_.async_receive_from(
+        asio::buffer(buf), sender_ep, asio::use_awaitable);
+    co_return std::make_pair(std::string{buf.data(), size}, sender_ep);
+  }
+
+  asio::awaitable<std::string> ReceiveOnClient(udp::socket& client_udp_socket) {
+    utils::StaticBuffer<kDatagramMaxLen> buf;
+    udp::endpoint sender_ep;
+    const auto size = co_await client_udp_socket.async_receive_from(
+        asio::buffer(buf.BeginWrite(), buf.WritableBytes()), sender_ep,
+        asio::use_awaitable);
+    buf.HasWritten(size);
+    EXPECT_EQ(sender_ep, relay_->Endpoint());
+    const auto datagram = parsers::ParseDatagram(buf);
+    EXPECT_EQ(datagram.header.addr.atyp, proto::AddrType::kAddrTypeIPv4);
+    EXPECT_EQ(net::MakeEndpointFromIP<udp>(datagram.header.addr),
+              server_udp_socket_ep_);
+    co_return std::string{reinterpret_cast<const char*>(datagram.data.data),
+                          datagram.data.data_size};
+  }
+
+  udp::socket MakeClientUdpSocket() {
+    return udp::socket{
+        io_context_,
+        udp::endpoint{asio::ip::address::from_string("127.0.0.1"), 0}};
+  }
+
+  template <typename Coro>
+  void Run(Coro coro) {
+    bool completed{false};
+    asio::co_spawn(
+        io_context_,
+        [&]() -> VoidAwait {
+          co_await coro();
+          completed = true;
+          io_context_.stop();
+        },
+        asio::detached);
+    io_context_.run_for(std::chrono::seconds{5});
+    EXPECT_TRUE(completed);
+  }
+
+  asio::io_context io_context_;
+  tcp::acceptor tcp_acceptor_;
+  std::list<tcp::socket> client_tcp_sockets_;
+  udp::socket server_udp_socket_;
+  udp::endpoint server_udp_socket_ep_;
+  AddrBuf server_udp_socket_addr_buf_;
+  common::Metrics metrics_;
+  Config config_;
+  SharedUdpRelayPtr relay_;
+};
+
+}  // namespace
+
+TEST_F(SharedUdpRelayTest, RelayThroughOnePort) {
+  relay_->Run();
+  ASSERT_NE(relay_->Endpoint().port(), 0);
+  auto client_udp_socket = MakeClientUdpSocket();
+  Session session;
+  Associate(client_udp_socket, true, session);
+  Run([&]() -> VoidAwait {
+    co_await SendToTarget(client_udp_socket, "hello");
+    const auto [data, relay_ep] = co_await ReceiveOnTarget();
+    EXPECT_EQ(data, "hello");
+    co_await server_udp_socket_.async_send_to(asio::buffer("reply", 5),
+                                              relay_ep, asio::use_awaitable);
+    EXPECT_EQ(co_await ReceiveOnClient(client_udp_socket), "reply");
+  });
+  EXPECT_EQ(session.RelayedBytes(Session::Direction::kClientToTarget), 5u);
+  EXPECT_EQ(session.RelayedBytes(Session::Direction::kTargetToClient), 5u);
+}
+
+TEST_F(SharedUdpRelayTest, DemultiplexAssociationsToSameTarget) {
+  relay_->Run();
+  auto client_udp_socket1 = MakeClientUdpSocket();
+  auto client_udp_socket2 = MakeClientUdpSocket();
+  Session session1;
+  Session session2;
+  Associate(client_udp_socket1, true, session1);
+  // The second association is bound by its first datagram.
+  Associate(client_udp_socket2, false, session2);
+  Run([&]() -> VoidAwait {
+    co_await SendToTarget(client_udp_socket1, "first");
+    const auto [data1, relay_ep1] = co_await ReceiveOnTarget();
+    EXPECT_EQ(data1, "first");
+    co_await SendToTarget(client_udp_socket2, "second");
+    const auto [data2, relay_ep2] = co_await ReceiveOnTarget();
+    EXPECT_EQ(data2, "second");
+    // The target server sees the associations as different peers.
+    EXPECT_NE(relay_ep1, relay_ep2);
+
+    co_await server_udp_socket_.async_send_to(asio::buffer("to2", 3),
+                                              relay_ep2, asio::use_awaitable);
+    EXPECT_EQ(co_await ReceiveOnClient(client_udp_socket2), "to2");
+    co_await server_udp_socket_.async_send_to(asio::buffer("to1", 3),
+                                              relay_ep1, asio::use_awaitable);
+    EXPECT_EQ(co_await ReceiveOnClient(client_udp_socket1), "to1");
+  });
+}
+
+TEST_F(SharedUdpRelayTest, ReuseEgressSocketOfFinishedAssociation) {
+  // One shard, so all the associations share its egress sockets.
+  config_.threads_num = 1;
+  relay_ = std::make_shared<SharedUdpRelay>(io_context_, config_, metrics_);
+  relay_->Run();
+  auto client_udp_socket1 = MakeClientUdpSocket();
+  auto client_udp_socket2 = MakeClientUdpSocket();
+  auto client_udp_socket3 = MakeClientUdpSocket();
+  Session session1;
+  Session session2;
+  Session session3;
+  Associate(client_udp_socket1, true, session1);
+  Associate(client_udp_socket2, true, session2);
+  Run([&]() -> VoidAwait {
+    co_await SendToTarget(client_udp_socket1, "first");
+    const auto [data1, relay_ep1] = co_await ReceiveOnTarget();
+    co_await SendToTarget(client_udp_socket2, "second");
+    const auto [data2, relay_ep2] = co_await ReceiveOnTarget();
+    EXPECT_NE(relay_ep1, relay_ep2);
+
+    client_tcp_sockets_.front().close();
+    asio::steady_timer timer{io_context_, std::chrono::milliseconds{100}};
+    co_await timer.async_wait(asio::use_awaitable);
+    Associate(client_udp_socket3, true, session3);
+    timer.expires_after(std::chrono::milliseconds{100});
+    co_await timer.async_wait(asio::use_awaitable);
+
+    // The socket of the finished association is free for the target again.
+    co_await SendToTarget(client_udp_socket3, "third");
+    const auto [data3, relay_ep3] = co_await ReceiveOnTarget();
+    EXPECT_EQ(data3, "third");
+    EXPECT_EQ(relay_ep3, relay_ep1);
+    co_await server_udp_socket_.async_send_to(asio::buffer("to3", 3),
+                                              relay_ep3, asio::use_awaitable);
+    EXPECT_EQ(co_await ReceiveOnClient(client_udp_socket3), "to3");
+  });
+}
+
+TEST_F(SharedUdpRelayTest, DropDatagramsOfUnknownClients) {
+  relay_->Run();
+  auto client_udp_socket = MakeClientUdpSocket();
+  auto stranger_udp_socket = MakeClientUdpSocket();
+  Session session;
+  Associate(client_udp_socket, true, session);
+  Run([&]() -> VoidAwait {
+    co_await SendToTarget(stranger_udp_socket, "stranger");
+    co_await SendToTarget(client_udp_socket, "client");
+    const auto [data, relay_ep] = co_await ReceiveOnTarget();
+    EXPECT_EQ(data, "client");
+  });
+}
+
+TEST_F(SharedUdpRelayTest, FinishWhenClientClosesConnection) {
+  relay_->Run();
+  auto client_udp_socket = MakeClientUdpSocket();
+  Session session;
+  Associate(client_udp_socket, true, session);
+  Run([&]() -> VoidAwait {
+    co_await SendToTarget(client_udp_socket, "hello");
+    co_await ReceiveOnTarget();
+    client_tcp_sockets_.front().close();
+    asio::steady_timer timer{io_context_, std::chrono::milliseconds{100}};
+    co_await timer.async_wait(asio::use_awaitable);
+    // The association is finished, the datagram is dropped.
+    co_await SendToTarget(client_udp_socket, "late");
+    timer.expires_after(std::chrono::milliseconds{100});
+    co_await timer.async_wait(asio::use_awaitable);
+  });
+  EXPECT_EQ(session.RelayedBytes(Session::Direction::kClientToTarget), 5u);
+}
+
+}  // namespace socks5::server
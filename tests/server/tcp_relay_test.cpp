@@ -1,13 +1,19 @@
 #include <gtest/gtest.h>
 #include <server/tcp_relay.hpp>
+#include <socks5/client/compressed_tunnel.hpp>
 #include <socks5/server/config.hpp>
 #include <net/tcp_connection.hpp>
 #include <socks5/common/asio.hpp>
 #include <socks5/common/metrics.hpp>
 #include <test_utils/assert_macro.hpp>
 #include <server/relay_data_processors.hpp>
+#include <server/offload_pool.hpp>
+#include <server/server_context.hpp>
 #include <socks5/utils/watchdog.hpp>
 #include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
 
 namespace socks5::server {
 
@@ -43,6 +49,7 @@ class TcpRelayTest : public testing::Test {
   tcp::socket server_socket_;
   tcp::socket server_proxy_socket_;
   common::Metrics metrics_;
+  Session session_;
 };
 
 void Read(std::shared_ptr<tcp::socket> from, std::shared_ptr<tcp::socket> to);
@@ -122,7 +129,8 @@ TEST_F(TcpRelayTest, DefaultTcpRelayHandlerBasicRelay) {
                        DefaultTcpRelayHandler,
                        config,
                        metrics_,
-                       MakeDefaultTcpRelayDataProcessor()};
+                       MakeDefaultTcpRelayDataProcessor(),
+                       session_};
 
     asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
 
@@ -179,6 +187,68 @@ TEST_F(TcpRelayTest, DefaultTcpRelayHandlerBasicRelay) {
   EXPECT_TRUE(completed);
 }
 
+TEST_F(TcpRelayTest, CompressedTunnelRoundTrip) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_proxy_connect{std::move(client_proxy_socket_),
+                                            metrics_};
+    net::TcpConnection server_proxy_connect{std::move(server_proxy_socket_),
+                                            metrics_};
+
+    Config config{};
+    TcpRelay tcp_relay{io_context_,
+                       std::move(client_proxy_connect),
+                       std::move(server_proxy_connect),
+                       DefaultTcpRelayHandler,
+                       config,
+                       metrics_,
+                       MakeDefaultTcpRelayDataProcessor(),
+                       session_};
+
+    asio::co_spawn(io_context_, tcp_relay.RunCompressedTunnel(),
+                   asio::detached);
+
+    client::CompressedTunnel tunnel{client_socket_};
+    tunnel.Reset(true);
+
+    std::string data;
+    for (size_t i = 0; data.size() < 100000; ++i) {
+      data += R"({"id":)" + std::to_string(i) + R"(,"status":"active"})";
+    }
+    const auto [send_err, sent] =
+        co_await tunnel.Send(data.data(), data.size());
+    CO_ASSERT_FALSE(send_err);
+    EXPECT_EQ(sent, data.size());
+    std::string buf(data.size(), '\0');
+    co_await asio::async_read(server_socket_, asio::buffer(buf),
+                              asio::use_awaitable);
+    EXPECT_EQ(buf, data);
+    EXPECT_LT(tunnel.SentWireBytes(), tunnel.SentBytes());
+
+    // The proxy compresses the data of the target server.
+    co_await asio::async_write(server_socket_, asio::buffer(data),
+                               asio::use_awaitable);
+    std::string received;
+    std::array<char, 4096> chunk;
+    while (received.size() < data.size()) {
+      const auto [read_err, size] =
+          co_await tunnel.ReadSome(chunk.data(), chunk.size());
+      CO_ASSERT_FALSE(read_err);
+      received.append(chunk.data(), size);
+    }
+    EXPECT_EQ(received, data);
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
 TEST_F(TcpRelayTest, DefaultTcpRelayHandlerTimeout) {
   bool completed{false};
   auto main = [&]() -> asio::awaitable<void> {
@@ -197,7 +267,8 @@ TEST_F(TcpRelayTest, DefaultTcpRelayHandlerTimeout) {
                        DefaultTcpRelayHandler,
                        config,
                        metrics_,
-                       MakeDefaultTcpRelayDataProcessor()};
+                       MakeDefaultTcpRelayDataProcessor(),
+                       session_};
 
     auto tcp_relay_future =
         asio::co_spawn(io_context_, tcp_relay.Run(), asio::use_future);
@@ -270,7 +341,8 @@ TEST_F(TcpRelayTest, TcpRelayHandlerWithDataProcessorBasicRelay1) {
                        TcpRelayHandlerWithDataProcessor,
                        config,
                        metrics_,
-                       tcp_relay_data_processor};
+                       tcp_relay_data_processor,
+                       session_};
 
     asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
 
@@ -303,6 +375,393 @@ TEST_F(TcpRelayTest, TcpRelayHandlerWithDataProcessorBasicRelay1) {
   EXPECT_TRUE(completed);
 }
 
+TEST_F(TcpRelayTest, TcpRelayHandlerWithInlineDataProcessor) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_proxy_connect{std::move(client_proxy_socket_),
+                                            metrics_};
+    net::TcpConnection server_proxy_connect{std::move(server_proxy_socket_),
+                                            metrics_};
+
+    std::string_view prefix{"processed_"};
+    const auto client_to_server = [&](const tcp::endpoint& client,
+                                      const tcp::endpoint& server) {
+      return [&](const char* data, size_t size, RelayDataSink& sink) {
+        EXPECT_EQ((std::string_view{data, size}),
+                  (std::string_view{"testmsg1"}));
+        sink.Send(prefix.data(), prefix.size());
+        sink.Send(data, size);
+      };
+    };
+    const auto server_to_client = [](const tcp::endpoint& server,
+                                     const tcp::endpoint& client) {
+      return [](const char* data, size_t size, RelayDataSink& sink) {
+        sink.Send(data, size);
+      };
+    };
+
+    const auto tcp_relay_data_processor =
+        MakeTcpRelayDataProcessor(client_to_server, server_to_client);
+    EXPECT_FALSE(tcp_relay_data_processor.client_to_server);
+    EXPECT_TRUE(tcp_relay_data_processor.client_to_server_inline);
+
+    Config config{};
+    TcpRelay tcp_relay{io_context_,
+                       std::move(client_proxy_connect),
+                       std::move(server_proxy_connect),
+                       TcpRelayHandlerWithDataProcessor,
+                       config,
+                       metrics_,
+                       tcp_relay_data_processor,
+                       session_};
+
+    asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
+
+    const std::string_view testmsg1{"testmsg1"};
+    co_await asio::async_write(client_socket_,
+                               asio::buffer(testmsg1.data(), testmsg1.size()),
+                               asio::use_awaitable);
+    std::vector<char> buf(prefix.size() + testmsg1.size());
+    co_await asio::async_read(server_socket_,
+                              asio::buffer(buf.data(), buf.size()),
+                              asio::use_awaitable);
+    EXPECT_EQ((std::string_view{buf.data(), buf.size()}), "processed_testmsg1");
+
+    const std::string_view testmsg2{"testmsg2"};
+    co_await asio::async_write(server_socket_,
+                               asio::buffer(testmsg2.data(), testmsg2.size()),
+                               asio::use_awaitable);
+    std::vector<char> buf2(testmsg2.size());
+    co_await asio::async_read(client_socket_,
+                              asio::buffer(buf2.data(), buf2.size()),
+                              asio::use_awaitable);
+    EXPECT_EQ(testmsg2, (std::string_view{buf2.data(), buf2.size()}));
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
+TEST_F(TcpRelayTest, TcpRelayHandlerWithDetachedDataProcessor) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_proxy_connect{std::move(client_proxy_socket_),
+                                            metrics_};
+    net::TcpConnection server_proxy_connect{std::move(server_proxy_socket_),
+                                            metrics_};
+
+    size_t client_to_server_calls{0};
+    size_t server_to_client_calls{0};
+    std::string_view prefix{"processed_"};
+    const auto client_to_server = [&](const tcp::endpoint& client,
+                                      const tcp::endpoint& server) {
+      return [&](const char* data, size_t size, RelayDataSink& sink) {
+        ++client_to_server_calls;
+        sink.Send(prefix.data(), prefix.size());
+        sink.Send(data, size);
+        sink.Detach();
+      };
+    };
+    const auto server_to_client = [](const tcp::endpoint& server,
+                                     const tcp::endpoint& client) {
+      return [](const char* data, size_t size, RelayDataSink& sink) {
+        sink.Send(data, size);
+      };
+    };
+
+    auto tcp_relay_data_processor =
+        MakeTcpRelayDataProcessor(client_to_server, server_to_client);
+    tcp_relay_data_processor.server_to_client_in_place =
+        [&](const tcp::endpoint& server, const tcp::endpoint& client) {
+          return [&](RelayBuffer& buf) {
+            ++server_to_client_calls;
+            buf.TrimFront(1);
+            buf.Detach();
+          };
+        };
+
+    Config config{};
+    TcpRelay tcp_relay{io_context_,
+                       std::move(client_proxy_connect),
+                       std::move(server_proxy_connect),
+                       TcpRelayHandlerWithDataProcessor,
+                       config,
+                       metrics_,
+                       tcp_relay_data_processor,
+                       session_};
+
+    asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
+
+    for (const std::string_view expected : {"processed_testmsg1", "testmsg1"}) {
+      const std::string_view testmsg1{"testmsg1"};
+      co_await asio::async_write(
+          client_socket_, asio::buffer(testmsg1.data(), testmsg1.size()),
+          asio::use_awaitable);
+      std::vector<char> buf(expected.size());
+      co_await asio::async_read(server_socket_,
+                                asio::buffer(buf.data(), buf.size()),
+                                asio::use_awaitable);
+      EXPECT_EQ((std::string_view{buf.data(), buf.size()}), expected);
+    }
+    EXPECT_EQ(client_to_server_calls, 1);
+
+    for (const std::string_view expected : {"estmsg2", "testmsg2"}) {
+      const std::string_view testmsg2{"testmsg2"};
+      co_await asio::async_write(
+          server_socket_, asio::buffer(testmsg2.data(), testmsg2.size()),
+          asio::use_awaitable);
+      std::vector<char> buf(expected.size());
+      co_await asio::async_read(client_socket_,
+                                asio::buffer(buf.data(), buf.size()),
+                                asio::use_awaitable);
+      EXPECT_EQ((std::string_view{buf.data(), buf.size()}), expected);
+    }
+    EXPECT_EQ(server_to_client_calls, 1);
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
+TEST_F(TcpRelayTest, TcpRelayHandlerWithInPlaceDataProcessor) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_proxy_connect{std::move(client_proxy_socket_),
+                                            metrics_};
+    net::TcpConnection server_proxy_connect{std::move(server_proxy_socket_),
+                                            metrics_};
+
+    // Uppercases the data and wraps it in a header and a trailer.
+    const auto client_to_server = [](const tcp::endpoint& client,
+                                     const tcp::endpoint& server) {
+      return [](RelayBuffer& buf) {
+        for (size_t i = 0; i < buf.Size(); ++i) {
+          buf.Data()[i] ^= 0x20;
+        }
+        std::memcpy(buf.Prepend(4), "hdr:", 4);
+        std::memcpy(buf.Append(4), ":end", 4);
+      };
+    };
+    // Drops the first byte.
+    const auto server_to_client = [](const tcp::endpoint& server,
+                                     const tcp::endpoint& client) {
+      return [](RelayBuffer& buf) { buf.TrimFront(1); };
+    };
+
+    TcpRelayDataProcessor tcp_relay_data_processor;
+    tcp_relay_data_processor.client_to_server_in_place = client_to_server;
+    tcp_relay_data_processor.server_to_client_in_place = server_to_client;
+
+    Config config{};
+    TcpRelay tcp_relay{io_context_,
+                       std::move(client_proxy_connect),
+                       std::move(server_proxy_connect),
+                       TcpRelayHandlerWithDataProcessor,
+                       config,
+                       metrics_,
+                       tcp_relay_data_processor,
+                       session_};
+
+    asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
+
+    const std::string_view testmsg1{"testmsg1"};
+    co_await asio::async_write(client_socket_,
+                               asio::buffer(testmsg1.data(), testmsg1.size()),
+                               asio::use_awaitable);
+    std::string_view processed_testmsg1{"hdr:TESTMSG\x11:end"};
+    std::vector<char> buf(processed_testmsg1.size());
+    co_await asio::async_read(server_socket_,
+                              asio::buffer(buf.data(), buf.size()),
+                              asio::use_awaitable);
+    EXPECT_EQ(processed_testmsg1, (std::string_view{buf.data(), buf.size()}));
+
+    const std::string_view testmsg2{"_testmsg2"};
+    co_await asio::async_write(server_socket_,
+                               asio::buffer(testmsg2.data(), testmsg2.size()),
+                               asio::use_awaitable);
+    std::vector<char> buf2(testmsg2.size() - 1);
+    co_await asio::async_read(client_socket_,
+                              asio::buffer(buf2.data(), buf2.size()),
+                              asio::use_awaitable);
+    EXPECT_EQ((std::string_view{buf2.data(), buf2.size()}), "testmsg2");
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
+TEST_F(TcpRelayTest, TcpRelayHandlerWithAsyncDataProcessor) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_proxy_connect{std::move(client_proxy_socket_),
+                                            metrics_};
+    net::TcpConnection server_proxy_connect{std::move(server_proxy_socket_),
+                                            metrics_};
+
+    // Suspends on a timer before emitting the data. Nothing is read from the
+    // client meanwhile.
+    size_t in_progress{0};
+    const auto client_to_server = [&](const tcp::endpoint& client,
+                                      const tcp::endpoint& server) {
+      return [&](const char* data, size_t size,
+                 RelayDataSink& sink) -> VoidAwait {
+        EXPECT_EQ(in_progress++, 0);
+        asio::steady_timer timer{co_await asio::this_coro::executor,
+                                 std::chrono::milliseconds{50}};
+        co_await timer.async_wait(asio::use_awaitable);
+        sink.Send(data, size);
+        --in_progress;
+      };
+    };
+    const auto server_to_client = [](const tcp::endpoint& server,
+                                     const tcp::endpoint& client) {
+      return [](const char* data, size_t size,
+                RelayDataSink& sink) -> VoidAwait {
+        sink.Send(data, size);
+        co_return;
+      };
+    };
+
+    TcpRelayDataProcessor tcp_relay_data_processor;
+    tcp_relay_data_processor.client_to_server_async = client_to_server;
+    tcp_relay_data_processor.server_to_client_async = server_to_client;
+
+    Config config{};
+    TcpRelay tcp_relay{io_context_,
+                       std::move(client_proxy_connect),
+                       std::move(server_proxy_connect),
+                       TcpRelayHandlerWithDataProcessor,
+                       config,
+                       metrics_,
+                       tcp_relay_data_processor,
+                       session_};
+
+    asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
+
+    std::string sent;
+    for (int i = 0; i < 3; ++i) {
+      const auto msg = "testmsg" + std::to_string(i);
+      co_await asio::async_write(client_socket_,
+                                 asio::buffer(msg.data(), msg.size()),
+                                 asio::use_awaitable);
+      sent += msg;
+    }
+    std::vector<char> buf(sent.size());
+    co_await asio::async_read(server_socket_,
+                              asio::buffer(buf.data(), buf.size()),
+                              asio::use_awaitable);
+    EXPECT_EQ(sent, (std::string_view{buf.data(), buf.size()}));
+
+    const std::string_view testmsg{"testmsg"};
+    co_await asio::async_write(server_socket_,
+                               asio::buffer(testmsg.data(), testmsg.size()),
+                               asio::use_awaitable);
+    std::vector<char> buf2(testmsg.size());
+    co_await asio::async_read(client_socket_,
+                              asio::buffer(buf2.data(), buf2.size()),
+                              asio::use_awaitable);
+    EXPECT_EQ(testmsg, (std::string_view{buf2.data(), buf2.size()}));
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
+TEST_F(TcpRelayTest, TcpRelayHandlerWithDataProcessorOnOffloadPool) {
+  bool completed{false};
+  ServerContext context;
+  OffloadPool offload_pool{2, 16, {}};
+  context.SetOffloadPool(&offload_pool);
+  Session session{context, client_socket_};
+  const auto io_thread_id = std::this_thread::get_id();
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_proxy_connect{std::move(client_proxy_socket_),
+                                            metrics_};
+    net::TcpConnection server_proxy_connect{std::move(server_proxy_socket_),
+                                            metrics_};
+
+    const auto make_processor = [&](const tcp::endpoint&,
+                                    const tcp::endpoint&) {
+      return [&, output = std::string{}](const char* data, size_t size,
+                                         const RelayDataSender& send) mutable {
+        EXPECT_NE(std::this_thread::get_id(), io_thread_id);
+        output = "processed_" + std::string{data, size};
+        send(output.data(), output.size());
+      };
+    };
+    TcpRelayDataProcessor tcp_relay_data_processor{make_processor,
+                                                   make_processor};
+
+    Config config{};
+    TcpRelay tcp_relay{io_context_,
+                       std::move(client_proxy_connect),
+                       std::move(server_proxy_connect),
+                       TcpRelayHandlerWithDataProcessor,
+                       config,
+                       metrics_,
+                       tcp_relay_data_processor,
+                       session};
+
+    asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
+
+    const std::string_view testmsg1{"testmsg1"};
+    co_await asio::async_write(client_socket_,
+                               asio::buffer(testmsg1.data(), testmsg1.size()),
+                               asio::use_awaitable);
+    std::vector<char> buf(std::string_view{"processed_testmsg1"}.size());
+    co_await asio::async_read(server_socket_,
+                              asio::buffer(buf.data(), buf.size()),
+                              asio::use_awaitable);
+    EXPECT_EQ((std::string_view{buf.data(), buf.size()}), "processed_testmsg1");
+    EXPECT_EQ(std::this_thread::get_id(), io_thread_id);
+
+    const std::string_view testmsg2{"testmsg2"};
+    co_await asio::async_write(server_socket_,
+                               asio::buffer(testmsg2.data(), testmsg2.size()),
+                               asio::use_awaitable);
+    std::vector<char> buf2(std::string_view{"processed_testmsg2"}.size());
+    co_await asio::async_read(client_socket_,
+                              asio::buffer(buf2.data(), buf2.size()),
+                              asio::use_awaitable);
+    EXPECT_EQ((std::string_view{buf2.data(), buf2.size()}),
+              "processed_testmsg2");
+    EXPECT_EQ(offload_pool.InflightBytes(), 0);
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
 TEST_F(TcpRelayTest, TcpRelayHandlerWithDataProcessorBasicRelay2) {
   bool completed{false};
   auto main = [&]() -> asio::awaitable<void> {
@@ -341,7 +800,8 @@ TEST_F(TcpRelayTest, TcpRelayHandlerWithDataProcessorBasicRelay2) {
                        TcpRelayHandlerWithDataProcessor,
                        config,
                        metrics_,
-                       tcp_relay_data_processor};
+                       tcp_relay_data_processor,
+                       session_};
 
     asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
 
@@ -418,7 +878,8 @@ TEST_F(TcpRelayTest,
                        TcpRelayHandlerWithDataProcessor,
                        config,
                        metrics_,
-                       tcp_relay_data_processor};
+                       tcp_relay_data_processor,
+                       session_};
 
     asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
 
@@ -505,7 +966,8 @@ TEST_F(TcpRelayTest, TcpRelayHandlerWithDataProcessorTimeout) {
                        TcpRelayHandlerWithDataProcessor,
                        config,
                        metrics_,
-                       tcp_relay_data_processor};
+                       tcp_relay_data_processor,
+                       session_};
 
     auto tcp_relay_future =
         asio::co_spawn(io_context_, tcp_relay.Run(), asio::use_future);
@@ -563,7 +1025,8 @@ TEST_F(TcpRelayTest, TcpRelayHandlerCbBasicRelay) {
                        TestTcpRelayHandlerCb,
                        config,
                        metrics_,
-                       MakeDefaultTcpRelayDataProcessor()};
+                       MakeDefaultTcpRelayDataProcessor(),
+                       session_};
 
     asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
 
@@ -614,7 +1077,8 @@ TEST_F(TcpRelayTest, CoroTcpRelayHandlerCbBasicRelay) {
                        TestCoroTcpRelayHandlerCb,
                        config,
                        metrics_,
-                       MakeDefaultTcpRelayDataProcessor()};
+                       MakeDefaultTcpRelayDataProcessor(),
+                       session_};
 
     asio::co_spawn(io_context_, tcp_relay.Run(), asio::detached);
 
@@ -2,10 +2,13 @@
 #include <server/udp_relay.hpp>
 #include <socks5/server/config.hpp>
 #include <net/tcp_connection.hpp>
+#include <net/utils.hpp>
 #include <socks5/common/asio.hpp>
 #include <socks5/common/metrics.hpp>
 #include <test_utils/assert_macro.hpp>
 #include <server/relay_data_processors.hpp>
+#include <server/server_context.hpp>
+#include <server/dns_cache.hpp>
 #include <net/udp_connection.hpp>
 #include <socks5/utils/watchdog.hpp>
 #include <common/proto_builders.hpp>
@@ -13,7 +16,11 @@
 #include <common/socks5_datagram_io.hpp>
 #include <socks5/utils/buffer.hpp>
 #include <parsers/parsers.hpp>
+#include <array>
 #include <chrono>
+#include <span>
+#include <string>
+#include <vector>
 
 namespace socks5::server {
 
@@ -66,6 +73,7 @@ class UdpRelayTest : public testing::Test {
   proto::Addr server_udp_socket_addr_;
   AddrBuf server_udp_socket_addr_buf_;
   common::Metrics metrics_;
+  Session session_;
 };
 
 void TestUdpRelayHandlerCb(asio::io_context& io_context, tcp::socket client,
@@ -117,7 +125,8 @@ TEST_F(UdpRelayTest, DefaultUdpRelayHandlerBasicRelay) {
                        DefaultUdpRelayHandler,
                        config,
                        metrics_,
-                       MakeDefaultUdpRelayDataProcessor()};
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session_};
 
     asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
 
@@ -203,6 +212,303 @@ TEST_F(UdpRelayTest, DefaultUdpRelayHandlerBasicRelay) {
   EXPECT_TRUE(completed);
 }
 
+TEST_F(UdpRelayTest, DefaultUdpRelayHandlerConnectedTargets) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_connect{std::move(proxy_tcp_socket_), metrics_};
+    net::UdpConnection proxy_connect{std::move(proxy_udp_socket_), metrics_};
+
+    Config config{};
+    config.udp_connect_targets = true;
+    UdpRelay udp_relay{io_context_,
+                       std::move(client_connect),
+                       std::move(proxy_connect),
+                       client_udp_socket_addr_,
+                       DefaultUdpRelayHandler,
+                       config,
+                       metrics_,
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session_};
+
+    asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
+
+    const std::vector<char> data{'h', 'e', 'l', 'l', 'o'};
+    const auto dgrm_buffs = common::MakeDatagramBuffs(
+        server_udp_socket_addr_buf_, data.data(), data.size());
+    co_await client_udp_socket_.async_send_to(dgrm_buffs, proxy_udp_socket_ep_,
+                                              asio::use_awaitable);
+    std::vector<char> buf(data.size());
+    udp::endpoint sender_ep;
+    co_await server_udp_socket_.async_receive_from(
+        asio::buffer(buf.data(), buf.size()), sender_ep, asio::use_awaitable);
+    EXPECT_EQ(data, buf);
+
+    // The socket is connected to the target server, so the datagram of
+    // another sender is dropped by the kernel.
+    udp::socket other_udp_socket{
+        io_context_,
+        udp::endpoint{asio::ip::address::from_string("127.0.0.1"), 0}};
+    co_await other_udp_socket.async_send_to(asio::buffer("other", 5),
+                                            sender_ep, asio::use_awaitable);
+
+    const std::vector<char> data2{'t', 'e', 's', 't', 'm', 's', 'g', '1'};
+    co_await server_udp_socket_.async_send_to(
+        asio::buffer(data2.data(), data2.size()), sender_ep,
+        asio::use_awaitable);
+    utils::StaticBuffer<kDatagramMaxLen> buf2;
+    udp::endpoint sender_ep2;
+    const auto recv_bytes = co_await client_udp_socket_.async_receive_from(
+        asio::buffer(buf2.BeginWrite(), buf2.WritableBytes()), sender_ep2,
+        asio::use_awaitable);
+    buf2.HasWritten(recv_bytes);
+    const auto dgrm2 = parsers::ParseDatagram(buf2);
+    EXPECT_EQ(dgrm2.data.data_size, data2.size());
+    EXPECT_TRUE(std::memcmp(dgrm2.data.data, data2.data(), data2.size()) == 0);
+    EXPECT_EQ(sender_ep2, proxy_udp_socket_ep_);
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
+TEST_F(UdpRelayTest, DefaultUdpRelayHandlerEvictTargetServers) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_connect{std::move(proxy_tcp_socket_), metrics_};
+    net::UdpConnection proxy_connect{std::move(proxy_udp_socket_), metrics_};
+
+    Config config{};
+    config.udp_max_target_servers = 1;
+    UdpRelay udp_relay{io_context_,
+                       std::move(client_connect),
+                       std::move(proxy_connect),
+                       client_udp_socket_addr_,
+                       DefaultUdpRelayHandler,
+                       config,
+                       metrics_,
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session_};
+
+    asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
+
+    udp::socket other_server_socket{
+        io_context_,
+        udp::endpoint{asio::ip::address::from_string("127.0.0.1"), 0}};
+    const auto other_server_ep = other_server_socket.local_endpoint();
+    const auto other_server_addr_buf = serializers::Serialize(
+        common::MakeAddr(other_server_ep.address(), other_server_ep.port()));
+
+    const std::vector<char> data{'h', 'e', 'l', 'l', 'o'};
+    co_await client_udp_socket_.async_send_to(
+        common::MakeDatagramBuffs(server_udp_socket_addr_buf_, data.data(),
+                                  data.size()),
+        proxy_udp_socket_ep_, asio::use_awaitable);
+    std::vector<char> buf(data.size());
+    udp::endpoint sender_ep;
+    co_await server_udp_socket_.async_receive_from(
+        asio::buffer(buf.data(), buf.size()), sender_ep, asio::use_awaitable);
+    EXPECT_EQ(data, buf);
+    EXPECT_EQ(metrics_.GetUdpTargetServers(), 1);
+
+    // The second target server evicts the first one.
+    co_await client_udp_socket_.async_send_to(
+        common::MakeDatagramBuffs(other_server_addr_buf, data.data(),
+                                  data.size()),
+        proxy_udp_socket_ep_, asio::use_awaitable);
+    udp::endpoint other_sender_ep;
+    co_await other_server_socket.async_receive_from(
+        asio::buffer(buf.data(), buf.size()), other_sender_ep,
+        asio::use_awaitable);
+    EXPECT_EQ(data, buf);
+    EXPECT_EQ(metrics_.GetEvictedUdpTargetServersTotal(), 1);
+
+    // The reader of the evicted target server is finished, the relay keeps
+    // working.
+    asio::steady_timer timer{io_context_, std::chrono::milliseconds{50}};
+    co_await timer.async_wait(asio::use_awaitable);
+    EXPECT_EQ(metrics_.GetUdpTargetServers(), 1);
+    co_await other_server_socket.async_send_to(
+        asio::buffer(data.data(), data.size()), other_sender_ep,
+        asio::use_awaitable);
+    utils::StaticBuffer<kDatagramMaxLen> buf2;
+    udp::endpoint sender_ep2;
+    const auto recv_bytes = co_await client_udp_socket_.async_receive_from(
+        asio::buffer(buf2.BeginWrite(), buf2.WritableBytes()), sender_ep2,
+        asio::use_awaitable);
+    buf2.HasWritten(recv_bytes);
+    const auto dgrm = parsers::ParseDatagram(buf2);
+    EXPECT_EQ(net::MakeEndpointFromIP<udp>(dgrm.header.addr), other_server_ep);
+    EXPECT_EQ(dgrm.data.data_size, data.size());
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
+TEST_F(UdpRelayTest, DefaultUdpRelayHandlerResolveDomainInBackground) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_connect{std::move(proxy_tcp_socket_), metrics_};
+    net::UdpConnection proxy_connect{std::move(proxy_udp_socket_), metrics_};
+
+    Config config{};
+    UdpRelay udp_relay{io_context_,
+                       std::move(client_connect),
+                       std::move(proxy_connect),
+                       client_udp_socket_addr_,
+                       DefaultUdpRelayHandler,
+                       config,
+                       metrics_,
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session_};
+
+    asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
+
+    udp::socket other_server_socket{
+        io_context_,
+        udp::endpoint{asio::ip::address::from_string("127.0.0.1"), 0}};
+    const auto other_server_ep = other_server_socket.local_endpoint();
+    const auto other_server_addr_buf = serializers::Serialize(
+        common::MakeAddr(other_server_ep.address(), other_server_ep.port()));
+    const auto domain_addr_buf = serializers::Serialize(
+        common::MakeAddr("127.0.0.1", server_udp_socket_ep_.port()));
+
+    // The datagrams to the domain name are queued while it's being resolved,
+    // the datagram to the other target server isn't delayed by them.
+    const std::array<std::string, 2> domain_data{"first", "second"};
+    for (const auto& data : domain_data) {
+      co_await client_udp_socket_.async_send_to(
+          common::MakeDatagramBuffs(domain_addr_buf, data.data(), data.size()),
+          proxy_udp_socket_ep_, asio::use_awaitable);
+    }
+    const std::string other_data{"other"};
+    co_await client_udp_socket_.async_send_to(
+        common::MakeDatagramBuffs(other_server_addr_buf, other_data.data(),
+                                  other_data.size()),
+        proxy_udp_socket_ep_, asio::use_awaitable);
+
+    std::array<char, 64> buf;
+    udp::endpoint sender_ep;
+    auto size = co_await other_server_socket.async_receive_from(
+        asio::buffer(buf), sender_ep, asio::use_awaitable);
+    EXPECT_EQ(std::string(buf.data(), size), other_data);
+    for (const auto& data : domain_data) {
+      size = co_await server_udp_socket_.async_receive_from(
+          asio::buffer(buf), sender_ep, asio::use_awaitable);
+      EXPECT_EQ(std::string(buf.data(), size), data);
+    }
+    EXPECT_EQ(metrics_.GetDroppedUdpDatagramsTotal(), 0);
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
+TEST_F(UdpRelayTest, DefaultUdpRelayHandlerDnsCache) {
+  bool completed{false};
+  ServerContext context;
+  context.SetDnsCache(std::make_unique<DnsCache>(
+      std::vector<ResolverAddr>{{"127.0.0.1", server_udp_socket_ep_.port()}},
+      16));
+  Session session{context, client_tcp_socket_};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_connect{std::move(proxy_tcp_socket_), metrics_};
+    net::UdpConnection proxy_connect{std::move(proxy_udp_socket_), metrics_};
+
+    Config config{};
+    config.udp_dns_cache = true;
+    UdpRelay udp_relay{io_context_,
+                       std::move(client_connect),
+                       std::move(proxy_connect),
+                       client_udp_socket_addr_,
+                       DefaultUdpRelayHandler,
+                       config,
+                       metrics_,
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session};
+
+    asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
+
+    // Query and answer of the A record of "a" with TTL 60.
+    std::vector<char> query{0, 1, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0,
+                            1, 'a', 0, 0, 1, 0, 1};
+    std::vector<char> answer{0, 1, '\x81', '\x80', 0, 1, 0, 1, 0, 0, 0, 0,
+                             1, 'a', 0, 0, 1, 0, 1, '\xc0', 12, 0, 1, 0, 1,
+                             0, 0, 0, 60, 0, 4, 127, 0, 0, 1};
+    auto receive_answer = [&]() -> asio::awaitable<std::vector<char>> {
+      utils::StaticBuffer<kDatagramMaxLen> buf;
+      udp::endpoint sender_ep;
+      const auto size = co_await client_udp_socket_.async_receive_from(
+          asio::buffer(buf.BeginWrite(), buf.WritableBytes()), sender_ep,
+          asio::use_awaitable);
+      buf.HasWritten(size);
+      const auto datagram = parsers::ParseDatagram(buf);
+      EXPECT_EQ(net::MakeEndpointFromIP<udp>(datagram.header.addr),
+                server_udp_socket_ep_);
+      const auto* data = reinterpret_cast<const char*>(datagram.data.data);
+      co_return std::vector<char>(data, data + datagram.data.data_size);
+    };
+
+    co_await client_udp_socket_.async_send_to(
+        common::MakeDatagramBuffs(server_udp_socket_addr_buf_, query.data(),
+                                  query.size()),
+        proxy_udp_socket_ep_, asio::use_awaitable);
+    std::array<char, 64> buf;
+    udp::endpoint sender_ep;
+    auto size = co_await server_udp_socket_.async_receive_from(
+        asio::buffer(buf), sender_ep, asio::use_awaitable);
+    EXPECT_EQ(std::vector<char>(buf.data(), buf.data() + size), query);
+    co_await server_udp_socket_.async_send_to(asio::buffer(answer), sender_ep,
+                                              asio::use_awaitable);
+    EXPECT_EQ(co_await receive_answer(), answer);
+
+    // The repeated query is answered from the cache with its own id.
+    query[1] = answer[1] = 2;
+    co_await client_udp_socket_.async_send_to(
+        common::MakeDatagramBuffs(server_udp_socket_addr_buf_, query.data(),
+                                  query.size()),
+        proxy_udp_socket_ep_, asio::use_awaitable);
+    EXPECT_EQ(co_await receive_answer(), answer);
+
+    // The resolver sees the next datagram only.
+    const std::string other_data{"other"};
+    co_await client_udp_socket_.async_send_to(
+        common::MakeDatagramBuffs(server_udp_socket_addr_buf_,
+                                  other_data.data(), other_data.size()),
+        proxy_udp_socket_ep_, asio::use_awaitable);
+    size = co_await server_udp_socket_.async_receive_from(
+        asio::buffer(buf), sender_ep, asio::use_awaitable);
+    EXPECT_EQ(std::string(buf.data(), size), other_data);
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
 TEST_F(UdpRelayTest, DefaultUdpRelayHandlerMultipleTargetServersRelay) {
   bool completed{false};
   auto main = [&]() -> asio::awaitable<void> {
@@ -219,7 +525,8 @@ TEST_F(UdpRelayTest, DefaultUdpRelayHandlerMultipleTargetServersRelay) {
                        DefaultUdpRelayHandler,
                        config,
                        metrics_,
-                       MakeDefaultUdpRelayDataProcessor()};
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session_};
 
     asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
 
@@ -349,7 +656,8 @@ TEST_F(UdpRelayTest, DefaultUdpRelayHandlerCloseTcpConnect) {
                        DefaultUdpRelayHandler,
                        config,
                        metrics_,
-                       MakeDefaultUdpRelayDataProcessor()};
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session_};
 
     auto fut = asio::co_spawn(io_context_, udp_relay.Run(), asio::use_future);
 
@@ -397,7 +705,8 @@ TEST_F(UdpRelayTest, DefaultUdpRelayHandlerTimeout) {
                        DefaultUdpRelayHandler,
                        config,
                        metrics_,
-                       MakeDefaultUdpRelayDataProcessor()};
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session_};
 
     auto fut = asio::co_spawn(io_context_, udp_relay.Run(), asio::use_future);
 
@@ -464,7 +773,8 @@ TEST_F(UdpRelayTest, UppRelayHandlerWithDataProcessorBasicRelay) {
                        UdpRelayHandlerWithDataProcessor,
                        config,
                        metrics_,
-                       udp_relay_data_processor};
+                       udp_relay_data_processor,
+                       session_};
 
     auto fut = asio::co_spawn(io_context_, udp_relay.Run(), asio::use_future);
 
@@ -515,6 +825,189 @@ TEST_F(UdpRelayTest, UppRelayHandlerWithDataProcessorBasicRelay) {
   EXPECT_TRUE(completed);
 }
 
+TEST_F(UdpRelayTest, UdpRelayHandlerWithBatchDataProcessor) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_connect{std::move(proxy_tcp_socket_), metrics_};
+    net::UdpConnection proxy_connect{std::move(proxy_udp_socket_), metrics_};
+
+    // Every datagram is prefixed, the output of the previous batch is
+    // discarded when the next one comes.
+    const auto make_processor = [](std::string prefix) {
+      return [prefix, output = std::vector<std::string>{}](
+                 std::span<const UdpRelayDatagram> datagrams,
+                 UdpRelayBatchSender& send) mutable {
+        output.clear();
+        output.reserve(datagrams.size());
+        for (size_t i = 0; i < datagrams.size(); ++i) {
+          const auto& datagram = datagrams[i];
+          const auto& data = output.emplace_back(
+              prefix + std::string{datagram.data, datagram.size});
+          send.Send(i, data.data(), data.size());
+        }
+      };
+    };
+    UdpRelayDataProcessor udp_relay_data_processor;
+    udp_relay_data_processor.client_to_server_batch =
+        [&](const udp::endpoint&) { return make_processor("c:"); };
+    udp_relay_data_processor.server_to_client_batch =
+        [&](const udp::endpoint&, const udp::endpoint& server) {
+          EXPECT_EQ(server, server_udp_socket_ep_);
+          return make_processor("s:");
+        };
+
+    Config config{};
+    config.udp_batch_size = 4;
+    UdpRelay udp_relay{io_context_,
+                       std::move(client_connect),
+                       std::move(proxy_connect),
+                       client_udp_socket_addr_,
+                       UdpRelayHandlerWithDataProcessor,
+                       config,
+                       metrics_,
+                       udp_relay_data_processor,
+                       session_};
+
+    asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
+
+    const std::array<std::string, 3> data{"msg1", "msg2", "msg3"};
+    for (const auto& msg : data) {
+      co_await client_udp_socket_.async_send_to(
+          common::MakeDatagramBuffs(server_udp_socket_addr_buf_, msg.data(),
+                                    msg.size()),
+          proxy_udp_socket_ep_, asio::use_awaitable);
+    }
+    std::array<char, 64> buf;
+    udp::endpoint sender_ep;
+    for (const auto& msg : data) {
+      const auto size = co_await server_udp_socket_.async_receive_from(
+          asio::buffer(buf), sender_ep, asio::use_awaitable);
+      EXPECT_EQ(std::string(buf.data(), size), "c:" + msg);
+    }
+
+    for (const auto& msg : data) {
+      co_await server_udp_socket_.async_send_to(
+          asio::buffer(msg.data(), msg.size()), sender_ep,
+          asio::use_awaitable);
+    }
+    for (const auto& msg : data) {
+      utils::StaticBuffer<kDatagramMaxLen> client_buf;
+      const auto size = co_await client_udp_socket_.async_receive_from(
+          asio::buffer(client_buf.BeginWrite(), client_buf.WritableBytes()),
+          sender_ep, asio::use_awaitable);
+      client_buf.HasWritten(size);
+      const auto datagram = parsers::ParseDatagram(client_buf);
+      EXPECT_EQ(net::MakeEndpointFromIP<udp>(datagram.header.addr),
+                server_udp_socket_ep_);
+      EXPECT_EQ(
+          std::string(reinterpret_cast<const char*>(datagram.data.data),
+                      datagram.data.data_size),
+          "s:" + msg);
+    }
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
+TEST_F(UdpRelayTest, UdpRelayHandlerWithAsyncDataProcessor) {
+  bool completed{false};
+  auto main = [&]() -> asio::awaitable<void> {
+    MakeSockets();
+
+    net::TcpConnection client_connect{std::move(proxy_tcp_socket_), metrics_};
+    net::UdpConnection proxy_connect{std::move(proxy_udp_socket_), metrics_};
+
+    // Every datagram is prefixed after a delay. The first one is delayed the
+    // most, but the datagrams must stay in order.
+    const auto make_processor = [](std::string prefix) {
+      return [prefix, output = std::string{},
+              delay = std::chrono::milliseconds{100}](
+                 const char* data, size_t size,
+                 RelayDataSink& sink) mutable -> VoidAwait {
+        asio::steady_timer timer{co_await asio::this_coro::executor, delay};
+        co_await timer.async_wait(asio::use_awaitable);
+        delay /= 2;
+        output = prefix + std::string{data, size};
+        sink.Send(output.data(), output.size());
+      };
+    };
+    UdpRelayDataProcessor udp_relay_data_processor;
+    udp_relay_data_processor.client_to_server_async =
+        [&](const udp::endpoint&) {
+          return [processor = make_processor("c:")](
+                     const char* data, size_t size, const udp::endpoint&,
+                     RelayDataSink& sink) mutable {
+            return processor(data, size, sink);
+          };
+        };
+    udp_relay_data_processor.server_to_client_async =
+        [&](const udp::endpoint&, const udp::endpoint& server) {
+          EXPECT_EQ(server, server_udp_socket_ep_);
+          return make_processor("s:");
+        };
+
+    Config config{};
+    UdpRelay udp_relay{io_context_,
+                       std::move(client_connect),
+                       std::move(proxy_connect),
+                       client_udp_socket_addr_,
+                       UdpRelayHandlerWithDataProcessor,
+                       config,
+                       metrics_,
+                       udp_relay_data_processor,
+                       session_};
+
+    asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
+
+    const std::array<std::string, 3> data{"msg1", "msg2", "msg3"};
+    for (const auto& msg : data) {
+      co_await client_udp_socket_.async_send_to(
+          common::MakeDatagramBuffs(server_udp_socket_addr_buf_, msg.data(),
+                                    msg.size()),
+          proxy_udp_socket_ep_, asio::use_awaitable);
+    }
+    std::array<char, 64> buf;
+    udp::endpoint sender_ep;
+    for (const auto& msg : data) {
+      const auto size = co_await server_udp_socket_.async_receive_from(
+          asio::buffer(buf), sender_ep, asio::use_awaitable);
+      EXPECT_EQ(std::string(buf.data(), size), "c:" + msg);
+    }
+
+    for (const auto& msg : data) {
+      co_await server_udp_socket_.async_send_to(
+          asio::buffer(msg.data(), msg.size()), sender_ep,
+          asio::use_awaitable);
+    }
+    for (const auto& msg : data) {
+      utils::StaticBuffer<kDatagramMaxLen> client_buf;
+      const auto size = co_await client_udp_socket_.async_receive_from(
+          asio::buffer(client_buf.BeginWrite(), client_buf.WritableBytes()),
+          sender_ep, asio::use_awaitable);
+      client_buf.HasWritten(size);
+      const auto datagram = parsers::ParseDatagram(client_buf);
+      EXPECT_EQ(
+          std::string(reinterpret_cast<const char*>(datagram.data.data),
+                      datagram.data.data_size),
+          "s:" + msg);
+    }
+
+    io_context_.stop();
+    completed = true;
+  };
+
+  asio::co_spawn(io_context_, main, asio::detached);
+  io_context_.run_for(std::chrono::seconds{5});
+  EXPECT_TRUE(completed);
+}
+
 TEST_F(UdpRelayTest,
        UdpRelayHandlerWithDataProcessorMultipleDataTransmissions) {
   bool completed{false};
@@ -555,7 +1048,8 @@ TEST_F(UdpRelayTest,
                        UdpRelayHandlerWithDataProcessor,
                        config,
                        metrics_,
-                       udp_relay_data_processor};
+                       udp_relay_data_processor,
+                       session_};
 
     asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
 
@@ -672,7 +1166,8 @@ TEST_F(UdpRelayTest,
                        UdpRelayHandlerWithDataProcessor,
                        config,
                        metrics_,
-                       udp_relay_data_processor};
+                       udp_relay_data_processor,
+                       session_};
 
     asio::co_spawn(io_context_, udp_relay.Run(), asio::detached);
 
@@ -828,7 +1323,8 @@ TEST_F(UdpRelayTest, UppRelayHandlerWithDataProcessorTimeout) {
                        UdpRelayHandlerWithDataProcessor,
                        config,
                        metrics_,
-                       udp_relay_data_processor};
+                       udp_relay_data_processor,
+                       session_};
 
     auto fut = asio::co_spawn(io_context_, udp_relay.Run(), asio::use_future);
 
@@ -922,7 +1418,8 @@ TEST_F(UdpRelayTest, UppRelayHandlerWithDataProcessorCloseTcpConnect) {
                        UdpRelayHandlerWithDataProcessor,
                        config,
                        metrics_,
-                       udp_relay_data_processor};
+                       udp_relay_data_processor,
+                       session_};
 
     auto fut = asio::co_spawn(io_context_, udp_relay.Run(), asio::use_future);
 
@@ -996,7 +1493,8 @@ TEST_F(UdpRelayTest, UdpRelayHandlerCbBasicRelay) {
                        TestUdpRelayHandlerCb,
                        config,
                        metrics_,
-                       MakeDefaultUdpRelayDataProcessor()};
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session_};
 
     auto fut = asio::co_spawn(io_context_, udp_relay.Run(), asio::use_future);
 
@@ -1037,7 +1535,8 @@ TEST_F(UdpRelayTest, CoroUdpRelayHandlerCbBasicRelay) {
                        CoroTestUdpRelayHandlerCb,
                        config,
                        metrics_,
-                       MakeDefaultUdpRelayDataProcessor()};
+                       MakeDefaultUdpRelayDataProcessor(),
+                       session_};
 
     auto fut = asio::co_spawn(io_context_, udp_relay.Run(), asio::use_future);
 
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <utils/logger.hpp>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace socks5::logger {
+
+namespace {
+
+class AsyncLoggerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    prev_logger_ = GetLogger();
+    prev_level_ = GetLevel().load();
+    SetLogger(
+        [this](const char*, int, const char*, Level, const std::string& msg) {
+          std::lock_guard lk{mtx_};
+          messages_.push_back(msg);
+        },
+        Level::trace);
+  }
+
+  void TearDown() override {
+    EnableAsyncLogging(false);
+    SetLogger(*prev_logger_, prev_level_);
+  }
+
+  std::vector<std::string> GetMessages() {
+    std::lock_guard lk{mtx_};
+    return messages_;
+  }
+
+  LoggerCbPtr prev_logger_;
+  Level prev_level_{};
+  std::mutex mtx_;
+  std::vector<std::string> messages_;
+};
+
+}  // namespace
+
+TEST(LogRecordTest, FormattingIsDeferred) {
+  std::string str{"first"};
+  const auto record = detail::MakeLogRecord("file", 1, "func", Level::info,
+                                            "{} {} {}", str, 42, "literal");
+  str = "second";
+  EXPECT_EQ(record.Format(), "first 42 literal");
+  EXPECT_STREQ(record.Filename(), "file");
+  EXPECT_EQ(record.Line(), 1);
+  EXPECT_STREQ(record.Funcname(), "func");
+  EXPECT_EQ(record.GetLevel(), Level::info);
+}
+
+TEST(LogRecordTest, MessageWithoutFormatString) {
+  const std::string msg{"{} is not a placeholder"};
+  const auto record =
+      detail::MakeLogRecord("file", 1, "func", Level::debug, msg);
+  EXPECT_EQ(record.Format(), msg);
+}
+
+TEST(LogRecordTest, LargeArgumentsAreFormattedEagerly) {
+  std::array<std::string, 16> args;
+  for (size_t i = 0; i < args.size(); ++i) {
+    args[i] = std::to_string(i);
+  }
+  const auto record = detail::MakeLogRecord(
+      "file", 1, "func", Level::info,
+      "{}{}{}{}{}{}{}{}{}{}{}{}{}{}{}{}", args[0], args[1], args[2], args[3],
+      args[4], args[5], args[6], args[7], args[8], args[9], args[10], args[11],
+      args[12], args[13], args[14], args[15]);
+  EXPECT_EQ(record.Format(), "0123456789101112131415");
+}
+
+TEST(LogRecordTest, MoveRecord) {
+  auto record = detail::MakeLogRecord("file", 1, "func", Level::info, "{}",
+                                      std::string(100, 'a'));
+  detail::LogRecord moved{std::move(record)};
+  EXPECT_EQ(moved.Format(), std::string(100, 'a'));
+
+  detail::LogRecord assigned;
+  EXPECT_EQ(assigned.Format(), "");
+  assigned = std::move(moved);
+  EXPECT_EQ(assigned.Format(), std::string(100, 'a'));
+}
+
+TEST_F(AsyncLoggerTest, MessagesAreWrittenFromAllThreads) {
+  EnableAsyncLogging(true, OverflowPolicy::kBlock, 16);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < 100; ++i) {
+        SOCKS5_LOG(debug, "{}", t * 100 + i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EnableAsyncLogging(false);
+
+  auto messages = GetMessages();
+  ASSERT_EQ(messages.size(), 400);
+  std::vector<int> values;
+  for (const auto& msg : messages) {
+    values.push_back(std::stoi(msg));
+  }
+  std::sort(values.begin(), values.end());
+  for (int i = 0; i < 400; ++i) {
+    EXPECT_EQ(values[i], i);
+  }
+}
+
+TEST_F(AsyncLoggerTest, SyncLoggingWhenDisabled) {
+  SOCKS5_LOG(info, "sync {}", 1);
+  EXPECT_EQ(GetMessages(), std::vector<std::string>{"sync 1"});
+}
+
+}  // namespace socks5::logger
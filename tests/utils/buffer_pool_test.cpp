@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <utils/buffer_pool.hpp>
+#include <thread>
+#include <utility>
+
+namespace socks5::utils {
+
+TEST(BufferPoolTest, ReuseBuffers) {
+  const char* data{};
+  {
+    PooledBuffer buf;
+    EXPECT_TRUE(buf.Pooled());
+    EXPECT_EQ(buf.Size(), kPooledBufferSize);
+    EXPECT_EQ(buf.ReadableBytes(), 0);
+    data = buf.Begin();
+  }
+  const auto cached = PooledBuffersCached();
+  EXPECT_GT(cached, 0);
+  PooledBuffer buf{100};
+  EXPECT_EQ(buf.Size(), kPooledBufferSize);
+  EXPECT_EQ(buf.Begin(), data);
+  EXPECT_EQ(PooledBuffersCached(), cached - 1);
+}
+
+TEST(BufferPoolTest, BigBuffersArentPooled) {
+  const auto cached = PooledBuffersCached();
+  {
+    PooledBuffer buf{kPooledBufferSize + 1};
+    EXPECT_FALSE(buf.Pooled());
+    EXPECT_EQ(buf.Size(), kPooledBufferSize + 1);
+    buf.HasWritten(kPooledBufferSize + 1);
+  }
+  EXPECT_EQ(PooledBuffersCached(), cached);
+}
+
+TEST(BufferPoolTest, MoveBuffer) {
+  PooledBuffer buf;
+  const char data[]{"data"};
+  buf.Append(data, sizeof(data));
+  const auto* begin = buf.Begin();
+  PooledBufferOpt moved;
+  moved.emplace(std::move(buf));
+  EXPECT_EQ(moved->Begin(), begin);
+  EXPECT_EQ(moved->ReadableBytes(), sizeof(data));
+  EXPECT_STREQ(moved->BeginRead(), data);
+  const auto cached = PooledBuffersCached();
+  moved.reset();
+  EXPECT_EQ(PooledBuffersCached(), cached + 1);
+}
+
+TEST(BufferPoolTest, ReleaseInOtherThread) {
+  PooledBufferOpt buf;
+  buf.emplace();
+  const auto cached = PooledBuffersCached();
+  std::thread thread{[&] {
+    const auto thread_cached = PooledBuffersCached();
+    buf.reset();
+    EXPECT_EQ(PooledBuffersCached(), thread_cached + 1);
+  }};
+  thread.join();
+  EXPECT_EQ(PooledBuffersCached(), cached);
+}
+
+}  // namespace socks5::utils
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <utils/byte_set.hpp>
+#include <string_view>
+#include <vector>
+
+namespace socks5::utils {
+
+namespace {
+
+const uint8_t* Find(const ByteSetFinder& finder, std::string_view data) {
+  const auto* begin = reinterpret_cast<const uint8_t*>(data.data());
+  return finder.Find(begin, begin + data.size());
+}
+
+size_t FindIndex(const ByteSetFinder& finder, std::string_view data) {
+  return static_cast<size_t>(
+      Find(finder, data) - reinterpret_cast<const uint8_t*>(data.data()));
+}
+
+}  // namespace
+
+TEST(ByteSetTest, EmptySet) {
+  const ByteSetFinder finder{ByteSet{}};
+  const std::string_view data{"some data longer than a vector register....."};
+  ASSERT_EQ(FindIndex(finder, data), data.size());
+  ASSERT_EQ(FindIndex(finder, ""), 0);
+}
+
+TEST(ByteSetTest, FindFirstByteOfSet) {
+  ByteSet set{};
+  set['x'] = true;
+  set[0xff] = true;
+  const ByteSetFinder finder{set};
+  ASSERT_TRUE(finder.Contains('x'));
+  ASSERT_FALSE(finder.Contains('y'));
+  // Every position of a buffer longer than the vector registers.
+  std::string data(100, 'a');
+  ASSERT_EQ(FindIndex(finder, data), data.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = i % 2 ? 'x' : '\xff';
+    ASSERT_EQ(FindIndex(finder, data), i);
+    data[i] = 'a';
+  }
+}
+
+// Every byte of the set and out of it, with more groups of low nibbles than
+// the SIMD filter has buckets, so it gives false candidates.
+TEST(ByteSetTest, MatchScalarSearch) {
+  ByteSet set{};
+  for (size_t byte = 0; byte < set.size(); byte += 7) {
+    set[byte] = true;
+  }
+  const ByteSetFinder finder{set};
+  for (size_t byte = 0; byte < set.size(); ++byte) {
+    std::string data(70, '\x01');
+    data[65] = static_cast<char>(byte);
+    ASSERT_EQ(FindIndex(finder, data), set[byte] ? 65 : data.size()) << byte;
+  }
+}
+
+}  // namespace socks5::utils
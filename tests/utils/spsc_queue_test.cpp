@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <utils/spsc_queue.hpp>
+#include <thread>
+#include <vector>
+
+namespace socks5::utils {
+
+TEST(SpscQueueTest, CapacityIsRoundedUpToPowerOfTwo) {
+  EXPECT_EQ(SpscQueue<int>{0}.Capacity(), 2);
+  EXPECT_EQ(SpscQueue<int>{3}.Capacity(), 4);
+  EXPECT_EQ(SpscQueue<int>{8}.Capacity(), 8);
+}
+
+TEST(SpscQueueTest, PushAndPop) {
+  SpscQueue<int> queue{4};
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_TRUE(queue.TryPush(1));
+  EXPECT_TRUE(queue.TryPush(2));
+  EXPECT_FALSE(queue.Empty());
+
+  int value{};
+  EXPECT_TRUE(queue.TryPop(value));
+  EXPECT_EQ(value, 1);
+  EXPECT_TRUE(queue.TryPop(value));
+  EXPECT_EQ(value, 2);
+  EXPECT_FALSE(queue.TryPop(value));
+  EXPECT_TRUE(queue.Empty());
+}
+
+TEST(SpscQueueTest, PushFailsWhenFull) {
+  SpscQueue<int> queue{2};
+  EXPECT_TRUE(queue.TryPush(1));
+  EXPECT_TRUE(queue.TryPush(2));
+  EXPECT_FALSE(queue.TryPush(3));
+
+  int value{};
+  EXPECT_TRUE(queue.TryPop(value));
+  EXPECT_TRUE(queue.TryPush(3));
+}
+
+TEST(SpscQueueTest, ConsumeAll) {
+  SpscQueue<int> queue{8};
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(queue.TryPush(int{i}));
+  }
+  std::vector<int> values;
+  EXPECT_EQ(queue.ConsumeAll([&](int value) { values.push_back(value); }), 5);
+  EXPECT_EQ(values, (std::vector<int>{0, 1, 2, 3, 4}));
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_EQ(queue.ConsumeAll([](int) {}), 0);
+}
+
+TEST(SpscQueueTest, ProducerAndConsumerThreads) {
+  constexpr int kCount{10000};
+  SpscQueue<int> queue{64};
+  std::thread producer{[&] {
+    for (int i = 0; i < kCount; ++i) {
+      while (!queue.TryPush(int{i})) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+
+  int expected{0};
+  while (expected < kCount) {
+    queue.ConsumeAll([&](int value) { EXPECT_EQ(value, expected++); });
+  }
+  producer.join();
+  EXPECT_TRUE(queue.Empty());
+}
+
+}  // namespace socks5::utils
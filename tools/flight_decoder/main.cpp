@@ -0,0 +1,191 @@
+// Converts a binary dump of the socks5 server flight recorder to text. Events
+// of all the threads are merged and printed in the order of their timestamps.
+//
+// Usage: socks5_flight_decoder <dump file> [session id]
+
+#include <socks5/server/flight_event.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+using socks5::server::FlightDumpHeader;
+using socks5::server::FlightDumpThread;
+using socks5::server::FlightEvent;
+using socks5::server::FlightEventType;
+
+struct ThreadEvent final {
+  uint32_t thread_index{};
+  FlightEvent event;
+};
+
+template <typename T>
+bool Read(std::istream& in, T& value) {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+const char* ToString(FlightEventType type) {
+  switch (type) {
+    case FlightEventType::kNone:
+      return "none";
+    case FlightEventType::kHandshakeStart:
+      return "handshake_start";
+    case FlightEventType::kHandshakeEnd:
+      return "handshake_end";
+    case FlightEventType::kAuthResult:
+      return "auth_result";
+    case FlightEventType::kConnectStart:
+      return "connect_start";
+    case FlightEventType::kConnectEnd:
+      return "connect_end";
+    case FlightEventType::kTcpRelayRead:
+      return "tcp_relay_read";
+    case FlightEventType::kTcpRelayWrite:
+      return "tcp_relay_write";
+    case FlightEventType::kUdpDatagramIn:
+      return "udp_datagram_in";
+    case FlightEventType::kUdpDatagramOut:
+      return "udp_datagram_out";
+    case FlightEventType::kWatchdogExpired:
+      return "watchdog_expired";
+    case FlightEventType::kSessionKilled:
+      return "session_killed";
+    case FlightEventType::kSessionClose:
+      return "session_close";
+    case FlightEventType::kUdpTargetEvicted:
+      return "udp_target_evicted";
+    case FlightEventType::kTcpRelayDetached:
+      return "tcp_relay_detached";
+  }
+  return "unknown";
+}
+
+const char* DirectionToString(uint32_t direction) {
+  return direction == 0 ? "client->target" : "target->client";
+}
+
+const char* CloseReasonToString(uint32_t reason) {
+  static constexpr const char* kReasons[]{"client_closed", "target_closed",
+                                          "timeout", "error", "killed"};
+  return reason < std::size(kReasons) ? kReasons[reason] : "unknown";
+}
+
+void PrintArgs(std::ostream& out, const FlightEvent& event) {
+  switch (event.type) {
+    case FlightEventType::kHandshakeEnd:
+      out << " success=" << event.arg0;
+      break;
+    case FlightEventType::kAuthResult:
+      out << " method=" << event.arg0 << " success=" << event.arg1;
+      break;
+    case FlightEventType::kConnectEnd:
+      out << " error=" << static_cast<int32_t>(event.arg0);
+      break;
+    case FlightEventType::kTcpRelayRead:
+    case FlightEventType::kTcpRelayWrite:
+    case FlightEventType::kUdpDatagramIn:
+    case FlightEventType::kUdpDatagramOut:
+      out << " dir=" << DirectionToString(event.arg0)
+          << " bytes=" << event.arg1;
+      break;
+    case FlightEventType::kWatchdogExpired:
+      out << " timeout=" << event.arg1 << "s";
+      break;
+    case FlightEventType::kSessionClose:
+      out << " reason=" << CloseReasonToString(event.arg0)
+          << " bytes=" << event.arg1;
+      break;
+    case FlightEventType::kUdpTargetEvicted:
+      out << " idle=" << event.arg0 << " targets=" << event.arg1;
+      break;
+    case FlightEventType::kTcpRelayDetached:
+      out << " dir=" << DirectionToString(event.arg0)
+          << " bytes=" << event.arg1;
+      break;
+    default:
+      break;
+  }
+}
+
+void PrintTime(std::ostream& out, int64_t system_ns) {
+  const auto seconds = static_cast<std::time_t>(system_ns / 1'000'000'000);
+  std::tm tm{};
+#ifdef _WIN32
+  gmtime_s(&tm, &seconds);
+#else
+  gmtime_r(&seconds, &tm);
+#endif
+  out << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << '.' << std::setw(9)
+      << std::setfill('0') << system_ns % 1'000'000'000 << std::setfill(' ');
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <dump file> [session id]\n";
+    return 1;
+  }
+  std::optional<uint64_t> session_filter;
+  if (argc > 2) {
+    session_filter = std::stoull(argv[2]);
+  }
+  std::ifstream in{argv[1], std::ios::binary};
+  if (!in) {
+    std::cerr << "Can't open " << argv[1] << '\n';
+    return 1;
+  }
+  FlightDumpHeader header;
+  if (!Read(in, header) ||
+      std::memcmp(header.magic, socks5::server::kFlightDumpMagic,
+                  sizeof(header.magic)) != 0) {
+    std::cerr << "Not a flight recorder dump\n";
+    return 1;
+  }
+  if (header.version != socks5::server::kFlightDumpVersion) {
+    std::cerr << "Unsupported dump version " << header.version << '\n';
+    return 1;
+  }
+  std::vector<ThreadEvent> events;
+  for (uint32_t i = 0; i < header.threads_num; ++i) {
+    FlightDumpThread thread;
+    if (!Read(in, thread)) {
+      std::cerr << "Truncated dump\n";
+      return 1;
+    }
+    for (uint32_t j = 0; j < thread.events_num; ++j) {
+      FlightEvent event;
+      if (!Read(in, event)) {
+        std::cerr << "Truncated dump\n";
+        return 1;
+      }
+      if (!session_filter || *session_filter == event.session_id) {
+        events.push_back({thread.thread_index, event});
+      }
+    }
+  }
+  std::stable_sort(events.begin(), events.end(),
+                   [](const ThreadEvent& lhs, const ThreadEvent& rhs) {
+                     return lhs.event.timestamp_ns < rhs.event.timestamp_ns;
+                   });
+  for (const auto& [thread_index, event] : events) {
+    const auto ago_ns = header.steady_now_ns - event.timestamp_ns;
+    PrintTime(std::cout, header.system_now_ns - ago_ns);
+    std::cout << " -" << std::fixed << std::setprecision(6)
+              << static_cast<double>(ago_ns) / 1e9
+              << "s thread=" << thread_index << " session=" << event.session_id
+              << ' ' << ToString(event.type);
+    PrintArgs(std::cout, event);
+    std::cout << '\n';
+  }
+  return 0;
+}
@@ -0,0 +1,159 @@
+// Measures the throughput of the socks5 server tcp relay on loopback with no
+// data processor, a pass-through TcpRelayDataProcessorCb and a pass-through
+// processor made by MakeTcpRelayDataProcessor(). Every run relays the data
+// from a client to a target server that discards it.
+//
+// Usage: socks5_relay_bench [megabytes] [proxy port]
+
+#include <boost/asio.hpp>
+#include <socks5/client/client.hpp>
+#include <socks5/auth/client/auth_options.hpp>
+#include <socks5/server/server_builder.hpp>
+#include <socks5/server/server.hpp>
+#include <socks5/server/relay_data_processor_defs.hpp>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+const std::string kProxyAddr{"127.0.0.1"};
+constexpr size_t kChunkSize{64 * 1024};
+constexpr int kConnectAttempts{100};
+constexpr std::chrono::milliseconds kConnectRetryDelay{10};
+
+struct RunResult final {
+  size_t received{0};
+  Clock::duration elapsed{};
+};
+
+asio::awaitable<void> Discard(tcp::acceptor& acceptor, RunResult& result) {
+  auto socket = co_await acceptor.async_accept(asio::use_awaitable);
+  std::vector<char> buf(kChunkSize);
+  boost::system::error_code err;
+  while (!err) {
+    result.received += co_await socket.async_read_some(
+        asio::buffer(buf), asio::redirect_error(asio::use_awaitable, err));
+  }
+}
+
+// The proxy listener is started asynchronously, so the connection is retried.
+asio::awaitable<boost::system::error_code> Connect(
+    tcp::socket& socket, const tcp::endpoint& proxy_ep,
+    const tcp::endpoint& target_ep) {
+  auto auth_options = socks5::auth::client::MakeAuthOptions();
+  auth_options.AddAuthMethod<socks5::auth::client::AuthMethod::kNone>();
+  asio::steady_timer timer{co_await asio::this_coro::executor};
+  boost::system::error_code err;
+  for (int i = 0; i < kConnectAttempts; ++i) {
+    err = co_await socks5::client::AsyncConnect(
+        socket, proxy_ep, socks5::common::Address{target_ep}, auth_options);
+    if (!err) {
+      break;
+    }
+    socket = tcp::socket{co_await asio::this_coro::executor};
+    timer.expires_after(kConnectRetryDelay);
+    co_await timer.async_wait(asio::use_awaitable);
+  }
+  co_return err;
+}
+
+asio::awaitable<void> Send(const tcp::endpoint& proxy_ep,
+                           const tcp::endpoint& target_ep, size_t total,
+                           RunResult& result) {
+  tcp::socket socket{co_await asio::this_coro::executor};
+  if (const auto err = co_await Connect(socket, proxy_ep, target_ep)) {
+    std::cerr << "Connect error: " << err.message() << std::endl;
+    co_return;
+  }
+  const std::vector<char> chunk(kChunkSize, 'x');
+  const auto start = Clock::now();
+  for (size_t sent = 0; sent < total; sent += kChunkSize) {
+    co_await asio::async_write(socket, asio::buffer(chunk),
+                               asio::use_awaitable);
+  }
+  socket.shutdown(tcp::socket::shutdown_send);
+  // The proxy closes the target connection after the client one is closed.
+  std::array<char, 1> buf;
+  boost::system::error_code err;
+  co_await socket.async_read_some(
+      asio::buffer(buf), asio::redirect_error(asio::use_awaitable, err));
+  result.elapsed = Clock::now() - start;
+}
+
+template <typename T>
+RunResult Run(const char* name, T tcp_handler, unsigned short proxy_port,
+              size_t total) {
+  auto server = socks5::server::MakeServerBuilder(kProxyAddr, proxy_port)
+                    .SetThreadsNum(1)
+                    .Build(std::move(tcp_handler), nullptr);
+  server.Run();
+
+  asio::io_context io_context{1};
+  tcp::acceptor acceptor{io_context,
+                         tcp::endpoint{asio::ip::make_address(kProxyAddr), 0}};
+  const tcp::endpoint proxy_ep{asio::ip::make_address(kProxyAddr),
+                               proxy_port};
+  RunResult result;
+  asio::co_spawn(io_context, Discard(acceptor, result), asio::detached);
+  asio::co_spawn(io_context,
+                 Send(proxy_ep, acceptor.local_endpoint(), total, result),
+                 asio::detached);
+  io_context.run();
+  server.Stop();
+  server.Wait();
+
+  const auto seconds =
+      std::chrono::duration<double>(result.elapsed).count();
+  std::cout << std::left << std::setw(10) << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(1)
+            << (seconds > 0 ? result.received / seconds / (1 << 20) : 0.0)
+            << " MiB/s" << std::setw(14) << result.received << " bytes"
+            << std::endl;
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  try {
+    const size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 1024;
+    const auto proxy_port =
+        static_cast<unsigned short>(argc > 2 ? std::stoul(argv[2]) : 1080);
+    const auto total = megabytes << 20;
+
+    Run("none", nullptr, proxy_port, total);
+
+    const auto pass_through = [](const tcp::endpoint&, const tcp::endpoint&) {
+      return [](const char* data, size_t size,
+                const socks5::server::RelayDataSender& send) {
+        send(data, size);
+      };
+    };
+    Run("function",
+        socks5::server::TcpRelayDataProcessor{pass_through, pass_through},
+        proxy_port, total);
+
+    const auto inline_pass_through = [](const tcp::endpoint&,
+                                        const tcp::endpoint&) {
+      return [](const char* data, size_t size,
+                socks5::server::RelayDataSink& sink) { sink.Send(data, size); };
+    };
+    Run("inline",
+        socks5::server::MakeTcpRelayDataProcessor(inline_pass_through,
+                                                  inline_pass_through),
+        proxy_port, total);
+    return 0;
+  } catch (const std::exception& ex) {
+    std::cerr << "Exception: " << ex.what() << std::endl;
+    return 1;
+  }
+}